@@ -30,14 +30,28 @@
 #include <sys/signal.h>
 #include <sys/signalfd.h>
 #include <sys/socket.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <systemd/sd-login.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "config.h"
+
 #define DRM_MAJOR 226
 
+#define WAYLAND_SOCKET_MAX 32
+
+// a hung compositor gets SIGABRT first for a core dump, then SIGKILL after
+// this long (ms)
+#define HUNG_KILL_GRACE 3000
+
+// restarts of a hung compositor before giving up with it
+#define MAX_RESTARTS 3
+
 #ifndef KDSKBMUTE
 #define KDSKBMUTE 0x4B51
 #endif
@@ -46,6 +60,14 @@
 #define EVIOCREVOKE _IOW('E', 0x91, int)
 #endif
 
+#ifndef DRM_IOCTL_SET_MASTER
+#define DRM_IOCTL_SET_MASTER _IO('d', 0x1e)
+#endif
+
+#ifndef DRM_IOCTL_DROP_MASTER
+#define DRM_IOCTL_DROP_MASTER _IO('d', 0x1f)
+#endif
+
 struct zippo_launch {
   char* user;  // root only
   char* tty_path;
@@ -60,11 +82,32 @@ struct zippo_launch {
   int sock[2];
   int signal_fd;
 
+  int wayland_fd;
+  int wayland_lock_fd;
+  char wayland_name[16];
+  char wayland_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+  char wayland_lock_path[sizeof(((struct sockaddr_un*)0)->sun_path) + 5];
+
   pid_t child;
+  int argc;
+  char** argv;
+
+  bool heartbeat_seen;  // compositors without heartbeats are never restarted
+  uint64_t last_heartbeat;
+  uint64_t hung_since;  // 0 unless killed for missing heartbeats
+  int restarts;
 };
 
 #define DEBUG
 
+static uint64_t
+now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
 static int
 open_tty_by_number(int ttynr)
 {
@@ -166,8 +209,8 @@ zippo_launch_setup_launch_socket(struct zippo_launch* self)
 static void
 zippo_launch_teardown_launch_socket(struct zippo_launch* self)
 {
-  close(self->sock[0]);
-  close(self->sock[1]);
+  if (self->sock[0] >= 0) close(self->sock[0]);
+  if (self->sock[1] >= 0) close(self->sock[1]);
 }
 
 static int
@@ -388,6 +431,124 @@ zippo_launch_teardown_tty(struct zippo_launch* self)
   if (self->tty != STDIN_FILENO) close(self->tty);
 }
 
+static const char*
+zippo_launch_get_runtime_dir(struct zippo_launch* self)
+{
+  const char* dir = NULL;
+
+  // pam_systemd sets up the runtime dir of the new session
+  if (self->user) dir = pam_getenv(self->ph, "XDG_RUNTIME_DIR");
+  if (dir == NULL) dir = getenv("XDG_RUNTIME_DIR");
+
+  return dir;
+}
+
+// also used to listen again for a restarted compositor, the lock is still
+// held then
+static int
+zippo_launch_listen_wayland_socket(struct zippo_launch* self)
+{
+  struct sockaddr_un addr = {.sun_family = AF_LOCAL};
+  struct stat st;
+
+  // left over by a compositor that did not clean up
+  if (lstat(self->wayland_path, &st) == 0) unlink(self->wayland_path);
+
+  self->wayland_fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (self->wayland_fd < 0) return -1;
+
+  strcpy(addr.sun_path, self->wayland_path);
+  if (bind(self->wayland_fd, (struct sockaddr*)&addr, sizeof addr) < 0)
+    goto err_socket;
+
+  // clients that connect now wait in the backlog until zippo accepts
+  if (listen(self->wayland_fd, 128) < 0) goto err_bind;
+
+  if (self->user &&
+      chown(self->wayland_path, self->pw->pw_uid, self->pw->pw_gid) < 0)
+    goto err_bind;
+
+  return 0;
+
+err_bind:
+  unlink(self->wayland_path);
+
+err_socket:
+  close(self->wayland_fd);
+  self->wayland_fd = -1;
+  return -1;
+}
+
+static int
+zippo_launch_bind_wayland_socket(struct zippo_launch* self)
+{
+  self->wayland_lock_fd = open(self->wayland_lock_path,
+      O_CREAT | O_CLOEXEC | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if (self->wayland_lock_fd < 0) return -1;
+
+  // held by another compositor
+  if (flock(self->wayland_lock_fd, LOCK_EX | LOCK_NB) < 0) goto err_lock;
+
+  if (self->user &&
+      chown(self->wayland_lock_path, self->pw->pw_uid, self->pw->pw_gid) < 0)
+    goto err_lock;
+
+  if (zippo_launch_listen_wayland_socket(self) != 0) goto err_lock;
+
+  return 0;
+
+err_lock:
+  close(self->wayland_lock_fd);
+  self->wayland_lock_fd = -1;
+  return -1;
+}
+
+// same naming and locking as wl_display_add_socket_auto(), so zippo-launch
+// and other compositors agree on which wayland-N is taken
+static int
+zippo_launch_setup_wayland_socket(struct zippo_launch* self)
+{
+  const char* dir = zippo_launch_get_runtime_dir(self);
+
+  if (dir == NULL) {
+    fprintf(stderr, "XDG_RUNTIME_DIR is not set\n");
+    return -1;
+  }
+
+  for (int i = 0; i < WAYLAND_SOCKET_MAX; i++) {
+    snprintf(self->wayland_name, sizeof self->wayland_name, "wayland-%d", i);
+
+    if (snprintf(self->wayland_path, sizeof self->wayland_path, "%s/%s", dir,
+            self->wayland_name) >= (int)sizeof self->wayland_path) {
+      fprintf(stderr, "Socket path is too long: %s\n", dir);
+      return -1;
+    }
+    snprintf(self->wayland_lock_path, sizeof self->wayland_lock_path,
+        "%s.lock", self->wayland_path);
+
+    if (zippo_launch_bind_wayland_socket(self) == 0) {
+#ifdef DEBUG
+      fprintf(stderr, "[DEBUG] wayland socket: %s\n", self->wayland_path);
+#endif
+      return 0;
+    }
+  }
+
+  fprintf(stderr, "Failed to create wayland socket in %s\n", dir);
+
+  return -1;
+}
+
+static void
+zippo_launch_teardown_wayland_socket(struct zippo_launch* self)
+{
+  if (self->wayland_fd >= 0) close(self->wayland_fd);
+
+  unlink(self->wayland_path);
+  unlink(self->wayland_lock_path);
+  close(self->wayland_lock_fd);
+}
+
 // westonでは、以下の場合にtrueを返していた。
 // 1. rootユーザである。
 // 2. 実行ユーザがweston-launch グループに属している。
@@ -440,32 +601,153 @@ zippo_launch_set_pw(struct zippo_launch* self)
 }
 
 static int
-zippo_launch_send_reply(struct zippo_launch* self, int reply)
+zippo_launch_send_reply(
+    struct zippo_launch* self, uint32_t id, int ret, int fd)
+{
+  struct zippo_launch_reply reply = {.ret = ret};
+
+  if (zippo_launch_message_send(self->sock[0], ZIPPO_LAUNCH_REPLY, id, &reply,
+          sizeof reply, fd) != 0) {
+    fprintf(stderr, "Failed to send reply: %s\n", strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+static int
+zippo_launch_send_event(struct zippo_launch* self, uint16_t event)
 {
-  int len;
+  if (zippo_launch_message_send(self->sock[0], event, 0, NULL, 0, -1) != 0) {
+    fprintf(stderr, "Failed to send event: %s\n", strerror(errno));
+    return -1;
+  }
 
-  do {
-    len = send(self->sock[0], &reply, sizeof reply, 0);
-  } while (len < 0 && errno == EINTR);
+  return 0;
+}
 
-  return len;
+// 0 if fd is a character device of the given major, negative errno otherwise
+static int
+check_device_major(int fd, unsigned int device_major)
+{
+  struct stat s;
+
+  if (fstat(fd, &s) < 0) return -errno;
+  if (!S_ISCHR(s.st_mode) || major(s.st_rdev) != device_major) return -EPERM;
+
+  return 0;
+}
+
+// return the opened fd or negative errno
+static int
+zippo_launch_open_device(const struct zippo_launch_open* message)
+{
+  int fd, ret;
+
+  // only input and drm devices, like weston-launch
+  fd = open(message->path,
+      (message->flags & (O_ACCMODE | O_NONBLOCK)) | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0) return -errno;
+
+  ret = check_device_major(fd, INPUT_MAJOR);
+  if (ret == -EPERM) ret = check_device_major(fd, DRM_MAJOR);
+  if (ret < 0) {
+    fprintf(stderr, "Refused to open %s\n", message->path);
+    close(fd);
+    return ret;
+  }
+
+  return fd;
+}
+
+static void
+zippo_launch_handle_request(struct zippo_launch* self,
+    const struct zippo_launch_message* message, int fd)
+{
+  const void* payload = message + 1;
+  int ret, reply_fd = -1;
+
+  switch (message->opcode) {
+    case ZIPPO_LAUNCH_OPEN:
+      ret = zippo_launch_open_device(payload);
+      if (ret >= 0) {
+        reply_fd = ret;
+        ret = 0;
+      }
+      break;
+
+    case ZIPPO_LAUNCH_REVOKE:
+      ret = check_device_major(fd, INPUT_MAJOR);
+      if (ret == 0 && ioctl(fd, EVIOCREVOKE, 0) < 0) ret = -errno;
+      break;
+
+    case ZIPPO_LAUNCH_SWITCH_VT: {
+      const struct zippo_launch_switch_vt* switch_vt = payload;
+      ret = ioctl(self->tty, VT_ACTIVATE, switch_vt->vt) < 0 ? -errno : 0;
+      break;
+    }
+
+    case ZIPPO_LAUNCH_SET_MASTER:
+      ret = check_device_major(fd, DRM_MAJOR);
+      if (ret == 0 && ioctl(fd, DRM_IOCTL_SET_MASTER, 0) < 0) ret = -errno;
+      break;
+
+    case ZIPPO_LAUNCH_DROP_MASTER:
+      ret = check_device_major(fd, DRM_MAJOR);
+      if (ret == 0 && ioctl(fd, DRM_IOCTL_DROP_MASTER, 0) < 0) ret = -errno;
+      break;
+
+    case ZIPPO_LAUNCH_DEACTIVATE_DONE:
+      ret = ioctl(self->tty, VT_RELDISP, 1) < 0 ? -errno : 0;
+      break;
+
+    case ZIPPO_LAUNCH_HEARTBEAT:
+      self->heartbeat_seen = true;
+      self->last_heartbeat = now_ms();
+      ret = 0;
+      break;
+
+    default:  // an event sent the wrong way
+      ret = -EOPNOTSUPP;
+      break;
+  }
+
+  zippo_launch_send_reply(self, message->id, ret, reply_fd);
+
+  if (reply_fd >= 0) close(reply_fd);
 }
 
 static void
 zippo_launch_handle_socket_msg(struct zippo_launch* self)
 {
-  (void)self;
-  // char control[CMSG_SPACE(sizeof(int))];
-  // char buf[BUFSIZ];
-  // struct msghdr msg;
-  // struct iovec iov;
-  // int ret = -1;
-  // ssize_t len;
-  // struct zippo_launch_message* message;
+  union {
+    struct zippo_launch_message message;
+    char buf[ZIPPO_LAUNCH_MAX_MESSAGE_SIZE];
+  } data;
+  ssize_t len;
+  int fd, ret;
+
+  // the compositor pipelines requests, handle all of them in order before
+  // going back to poll.
+  while ((len = zippo_launch_message_recv(
+              self->sock[0], data.buf, sizeof data.buf, &fd)) > 0) {
+    ret = zippo_launch_message_validate(data.buf, len, fd);
+    if (ret == 0) {
+      zippo_launch_handle_request(self, &data.message, fd);
+    } else if ((size_t)len >= sizeof data.message && data.message.id != 0) {
+      // still answer it, or the compositor would wait for it forever
+      zippo_launch_send_reply(self, data.message.id, ret, -1);
+    }
+
+    if (fd >= 0) close(fd);
+  }
 
-  // memset(&msg, 0, sizeof(msg));
+  if (len < 0 && errno != EAGAIN)
+    fprintf(stderr, "Failed to receive message: %s\n", strerror(errno));
 }
 
+static int zippo_launch_restart(struct zippo_launch* self);
+
 // return >= 0 to exit
 static int
 zippo_launch_handle_signal(struct zippo_launch* self)
@@ -483,6 +765,10 @@ zippo_launch_handle_signal(struct zippo_launch* self)
       pid = waitpid(-1, &status, 0);  // wait a child precess to die.
       if (pid == self->child) {
         self->child = 0;
+        if (self->hung_since && self->restarts < MAX_RESTARTS &&
+            zippo_launch_restart(self) == 0)
+          break;
+
         if (WIFEXITED(status)) {
           ret = WEXITSTATUS(status);
         } else if (WIFSIGNALED(status)) {
@@ -508,11 +794,11 @@ zippo_launch_handle_signal(struct zippo_launch* self)
       kill(self->child, sig.ssi_signo);
       break;
     case SIGUSR1:
-      zippo_launch_send_reply(self, ZIPPO_LAUNCH_DEACTIVATE);
+      zippo_launch_send_event(self, ZIPPO_LAUNCH_DEACTIVATE);
       break;
     case SIGUSR2:
       ioctl(self->tty, VT_RELDISP, VT_ACKACQ);
-      // TODO:
+      zippo_launch_send_event(self, ZIPPO_LAUNCH_ACTIVATE);
       break;
     default:
       assert(0 && "cannot be reached");
@@ -521,21 +807,143 @@ zippo_launch_handle_signal(struct zippo_launch* self)
   return -1;
 }
 
+static int
+zippo_launch_drop_privileges(struct zippo_launch* self)
+{
+  char** env;
+
+  if (!self->user) return 0;
+
+  if (setgid(self->pw->pw_gid) < 0 ||
+      initgroups(self->pw->pw_name, self->pw->pw_gid) < 0 ||
+      setuid(self->pw->pw_uid) < 0) {
+    fprintf(stderr, "Failed to drop privileges: %s\n", strerror(errno));
+    return -1;
+  }
+
+  setenv("USER", self->pw->pw_name, 1);
+  setenv("LOGNAME", self->pw->pw_name, 1);
+  setenv("HOME", self->pw->pw_dir, 1);
+  setenv("SHELL", self->pw->pw_shell, 1);
+
+  env = pam_getenvlist(self->ph);
+  if (env) {
+    for (int i = 0; env[i]; i++) {
+      if (putenv(env[i]) != 0) fprintf(stderr, "putenv %s failed\n", env[i]);
+    }
+    free(env);  // the strings now belong to the environment
+  }
+
+  return 0;
+}
+
 static void
 zippo_launch_compositor_launch(
     struct zippo_launch* self, int argc, char* argv[])
 {
-  (void)self;
-  (void)argc;
-  (void)argv;
+  char sock[16], wayland_fd[16];
+  char** child_argv;
+  sigset_t mask;
+  int flags;
+
+  if (zippo_launch_drop_privileges(self) != 0) exit(EXIT_FAILURE);
+
+  // the launcher blocked these for its signalfd, the mask survives exec
+  sigemptyset(&mask);
+  sigprocmask(SIG_SETMASK, &mask, NULL);
+
+  flags = fcntl(self->wayland_fd, F_GETFD);
+  if (flags < 0 || fcntl(self->wayland_fd, F_SETFD, flags & ~FD_CLOEXEC) < 0) {
+    fprintf(stderr, "fcntl failed: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  snprintf(sock, sizeof sock, "%d", self->sock[1]);
+  setenv(ZIPPO_LAUNCH_SOCKET_ENV, sock, 1);
+
+  snprintf(wayland_fd, sizeof wayland_fd, "%d", self->wayland_fd);
+  setenv(ZIPPO_LAUNCH_WAYLAND_SOCKET_ENV, wayland_fd, 1);
+  setenv("WAYLAND_DISPLAY", self->wayland_name, 1);
+
+  child_argv = calloc(argc + 2, sizeof *child_argv);
+  if (child_argv == NULL) exit(EXIT_FAILURE);
+
+  // an absolute path, the launcher may run as root and PATH is the user's
+  child_argv[0] = ZIPPO_COMPOSITOR_PATH;
+  for (int i = 0; i < argc; i++) child_argv[i + 1] = argv[i];
 
-  // FIXME:
-  char* child_argv[3] = {"/bin/uname", "-a", NULL};
   execv(child_argv[0], child_argv);
-  fprintf(stderr, "exec failed: %s", strerror(errno));
+  fprintf(stderr, "Failed to exec %s: %s\n", child_argv[0], strerror(errno));
   exit(EXIT_FAILURE);
 }
 
+static int
+zippo_launch_spawn(struct zippo_launch* self)
+{
+  self->child = fork();
+  if (self->child == -1) {
+    fprintf(stderr, "Failed to create fork: %s\n", strerror(errno));
+    return -1;
+  }
+
+  if (self->child == 0)
+    zippo_launch_compositor_launch(self, self->argc, self->argv);  // -> exit
+
+  close(self->sock[1]);
+  self->sock[1] = -1;
+
+  // only zippo listens from now on, clients see the socket close with it
+  close(self->wayland_fd);
+  self->wayland_fd = -1;
+
+  self->heartbeat_seen = false;
+  self->hung_since = 0;
+
+  return 0;
+}
+
+// the hung compositor may have left requests in the socketpair and clients
+// in the backlog, start over with new ones
+static int
+zippo_launch_restart(struct zippo_launch* self)
+{
+  fprintf(stderr, "Restarting %s\n", ZIPPO_COMPOSITOR_PATH);
+  self->restarts++;
+
+  close(self->sock[0]);
+  if (zippo_launch_setup_launch_socket(self) != 0) {
+    self->sock[0] = self->sock[1] = -1;
+    return -1;
+  }
+
+  if (zippo_launch_listen_wayland_socket(self) != 0) {
+    fprintf(stderr, "Failed to listen on %s\n", self->wayland_path);
+    return -1;
+  }
+
+  return zippo_launch_spawn(self);
+}
+
+// SIGABRT leaves a core dump of the hung compositor, SIGCHLD restarts it
+static void
+zippo_launch_check_heartbeat(struct zippo_launch* self)
+{
+  uint64_t now = now_ms();
+
+  if (!self->child || !self->heartbeat_seen) return;
+
+  if (self->hung_since == 0) {
+    if (now - self->last_heartbeat < ZIPPO_LAUNCH_HEARTBEAT_TIMEOUT) return;
+
+    fprintf(stderr, "No heartbeat from %s for %d ms, killing it\n",
+        ZIPPO_COMPOSITOR_PATH, (int)(now - self->last_heartbeat));
+    self->hung_since = now;
+    kill(self->child, SIGABRT);
+  } else if (now - self->hung_since >= HUNG_KILL_GRACE) {
+    kill(self->child, SIGKILL);
+  }
+}
+
 int
 zippo_launch_launch(struct zippo_launch* self, int argc, char* argv[])
 {
@@ -547,18 +955,16 @@ zippo_launch_launch(struct zippo_launch* self, int argc, char* argv[])
 
   if (zippo_launch_setup_launch_socket(self) != 0) goto err_setup_launch_sock;
 
-  if (zippo_launch_setup_signal(self) != 0) goto err_setup_signal;
+  // bound before zippo starts, so clients can connect while it initializes
+  if (zippo_launch_setup_wayland_socket(self) != 0)
+    goto err_setup_wayland_sock;
 
-  self->child = fork();
-  if (self->child == -1) {
-    fprintf(stderr, "Failed to create fork: %s\n", strerror(errno));
-    goto err_fork;
-  }
+  if (zippo_launch_setup_signal(self) != 0) goto err_setup_signal;
 
-  if (self->child == 0)
-    zippo_launch_compositor_launch(self, argc, argv);  // -> exit
+  self->argc = argc;
+  self->argv = argv;
 
-  close(self->sock[1]);
+  if (zippo_launch_spawn(self) != 0) goto err_fork;
 
   while (1) {
     struct pollfd fds[2];
@@ -569,7 +975,8 @@ zippo_launch_launch(struct zippo_launch* self, int argc, char* argv[])
     fds[1].fd = self->signal_fd;
     fds[1].events = POLLIN;
 
-    n = poll(fds, 2, -1);
+    // wake up to check on the compositor once it sends heartbeats
+    n = poll(fds, 2, self->heartbeat_seen ? 1000 : -1);
     if (n < 0) {
       fprintf(stderr, "poll failed: %s\n", strerror(errno));
       goto err_loop;
@@ -583,6 +990,8 @@ zippo_launch_launch(struct zippo_launch* self, int argc, char* argv[])
         break;
       }
     }
+
+    zippo_launch_check_heartbeat(self);
   }
 
 err_loop:
@@ -590,6 +999,9 @@ err_fork:
   zippo_launch_teardown_signal(self);
 
 err_setup_signal:
+  zippo_launch_teardown_wayland_socket(self);
+
+err_setup_wayland_sock:
   zippo_launch_teardown_launch_socket(self);
 
 err_setup_launch_sock:
@@ -610,6 +1022,8 @@ zippo_launch_create(const char* user, const char* tty)
   self = calloc(1, sizeof *self);
   self->user = user ? strdup(user) : NULL;
   self->tty_path = tty ? strdup(tty) : NULL;
+  self->wayland_fd = -1;
+  self->wayland_lock_fd = -1;
 
   if (zippo_launch_set_pw(self) != 0) goto err;
 
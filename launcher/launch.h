@@ -1,21 +1,7 @@
 #ifndef ZIPPO_LAUNCHER_LAUNCH_H
 #define ZIPPO_LAUNCHER_LAUNCH_H
 
-enum zippo_launch_opcode {
-  ZIPPO_LAUNCH_OPEN,
-};
-
-enum zippo_launch_event {
-  ZIPPO_LAUNCH_ACTIVATE,
-  ZIPPO_LAUNCH_DEACTIVATE,
-  ZIPPO_LAUNCH_DEACTIVATE_DONE,
-  // this event is followed by an fd handle
-  ZIPPO_LAUNCH_OPEN_REPLY,
-};
-
-struct zippo_launch_message {
-  int opcode;
-};
+#include "protocol.h"
 
 struct zippo_launch;
 
@@ -0,0 +1,145 @@
+#define _GNU_SOURCE
+
+#include "protocol.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+int
+zippo_launch_message_validate(const void* data, size_t len, int fd)
+{
+  const struct zippo_launch_message* message = data;
+  const char* payload = (const char*)data + sizeof *message;
+
+  if (len < sizeof *message) return -EINVAL;
+  if (message->version != ZIPPO_LAUNCH_PROTOCOL_VERSION)
+    return -EPROTONOSUPPORT;
+  if (message->size != len - sizeof *message) return -EINVAL;
+
+  switch (message->opcode) {
+    case ZIPPO_LAUNCH_OPEN:
+      if (message->size <= sizeof(struct zippo_launch_open)) return -EINVAL;
+      if (payload[message->size - 1] != '\0') return -EINVAL;
+      return fd < 0 ? 0 : -EINVAL;
+
+    case ZIPPO_LAUNCH_REVOKE:       // fall through
+    case ZIPPO_LAUNCH_SET_MASTER:   // fall through
+    case ZIPPO_LAUNCH_DROP_MASTER:
+      return message->size == 0 && fd >= 0 ? 0 : -EINVAL;
+
+    case ZIPPO_LAUNCH_SWITCH_VT:
+      if (message->size != sizeof(struct zippo_launch_switch_vt))
+        return -EINVAL;
+      return fd < 0 ? 0 : -EINVAL;
+
+    case ZIPPO_LAUNCH_DEACTIVATE_DONE:  // fall through
+    case ZIPPO_LAUNCH_HEARTBEAT:
+      return message->size == 0 && fd < 0 ? 0 : -EINVAL;
+
+    case ZIPPO_LAUNCH_REPLY:
+      if (message->size != sizeof(struct zippo_launch_reply)) return -EINVAL;
+      return message->id != 0 ? 0 : -EINVAL;
+
+    case ZIPPO_LAUNCH_ACTIVATE:  // fall through
+    case ZIPPO_LAUNCH_DEACTIVATE:
+      return message->size == 0 && message->id == 0 && fd < 0 ? 0 : -EINVAL;
+
+    default:
+      return -EOPNOTSUPP;
+  }
+}
+
+int
+zippo_launch_message_send(int sock, uint16_t opcode, uint32_t id,
+    const void* payload, uint32_t size, int fd)
+{
+  struct zippo_launch_message message;
+  struct iovec iov[2];
+  struct msghdr msg;
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  ssize_t len;
+
+  message.version = ZIPPO_LAUNCH_PROTOCOL_VERSION;
+  message.opcode = opcode;
+  message.id = id;
+  message.size = size;
+
+  iov[0].iov_base = &message;
+  iov[0].iov_len = sizeof message;
+  iov[1].iov_base = (void*)payload;
+  iov[1].iov_len = size;
+
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = size > 0 ? 2 : 1;
+
+  if (fd >= 0) {
+    struct cmsghdr* cmsg;
+
+    memset(&control, 0, sizeof control);
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof fd);
+  }
+
+  do {
+    len = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  } while (len < 0 && errno == EINTR);
+
+  return len < 0 ? -1 : 0;
+}
+
+ssize_t
+zippo_launch_message_recv(int sock, void* buf, size_t size, int* fd)
+{
+  struct iovec iov;
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  ssize_t len;
+
+  *fd = -1;
+
+  iov.iov_base = buf;
+  iov.iov_len = size;
+
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof control.buf;
+
+  do {
+    len = recvmsg(sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+  } while (len < 0 && errno == EINTR);
+
+  if (len < 0) return -1;
+
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+      memcpy(fd, CMSG_DATA(cmsg), sizeof *fd);
+  }
+
+  if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+    if (*fd >= 0) close(*fd);
+    *fd = -1;
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  return len;
+}
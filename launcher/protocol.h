@@ -0,0 +1,103 @@
+#ifndef ZIPPO_LAUNCHER_PROTOCOL_H
+#define ZIPPO_LAUNCHER_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// wire protocol between zippo-launch and the compositor over the
+// SOCK_SEQPACKET socketpair, one message per packet.
+//
+// every request carries an id chosen by the compositor and is answered by
+// exactly one ZIPPO_LAUNCH_REPLY with the same id, so the compositor may
+// send many requests before reading any reply. events are sent with id 0.
+
+#define ZIPPO_LAUNCH_PROTOCOL_VERSION 1
+
+#define ZIPPO_LAUNCH_MAX_MESSAGE_SIZE 4096
+
+// environment variable holding the compositor's end of the socketpair
+#define ZIPPO_LAUNCH_SOCKET_ENV "ZIPPO_LAUNCHER_SOCK"
+
+// environment variable holding the wayland listening socket zippo-launch
+// has already bound, the compositor accepts on it instead of creating one
+#define ZIPPO_LAUNCH_WAYLAND_SOCKET_ENV "ZIPPO_WAYLAND_SOCKET"
+
+// the compositor sends ZIPPO_LAUNCH_HEARTBEAT from its main loop this often
+// (ms). once it has sent one, the launcher restarts it when none has come
+// for ZIPPO_LAUNCH_HEARTBEAT_TIMEOUT.
+#define ZIPPO_LAUNCH_HEARTBEAT_INTERVAL 2000
+#define ZIPPO_LAUNCH_HEARTBEAT_TIMEOUT 10000
+
+// compositor -> launcher
+enum zippo_launch_opcode {
+  // payload: struct zippo_launch_open, the reply carries the opened fd
+  ZIPPO_LAUNCH_OPEN = 1,
+  // carries an input device fd, revoked with EVIOCREVOKE
+  ZIPPO_LAUNCH_REVOKE,
+  // payload: struct zippo_launch_switch_vt
+  ZIPPO_LAUNCH_SWITCH_VT,
+  // carries a drm fd
+  ZIPPO_LAUNCH_SET_MASTER,
+  // carries a drm fd
+  ZIPPO_LAUNCH_DROP_MASTER,
+  // acknowledges ZIPPO_LAUNCH_DEACTIVATE, the vt is released
+  ZIPPO_LAUNCH_DEACTIVATE_DONE,
+  // the main loop is making progress
+  ZIPPO_LAUNCH_HEARTBEAT,
+};
+
+// launcher -> compositor
+enum zippo_launch_event {
+  // payload: struct zippo_launch_reply, may be followed by an fd handle
+  ZIPPO_LAUNCH_REPLY = 0x100,
+  ZIPPO_LAUNCH_ACTIVATE,
+  ZIPPO_LAUNCH_DEACTIVATE,
+};
+
+struct zippo_launch_message {
+  uint16_t version;
+  uint16_t opcode;
+  uint32_t id;
+  uint32_t size;  // of the payload following the header
+};
+
+struct zippo_launch_open {
+  int32_t flags;
+  char path[];  // null terminated
+};
+
+struct zippo_launch_switch_vt {
+  int32_t vt;
+};
+
+struct zippo_launch_reply {
+  int32_t ret;  // 0 or negative errno
+};
+
+/**
+ * Check that a received packet is a well formed message of a known opcode,
+ * with the payload size and fd expected for it.
+ *
+ * @return 0 if valid, negative errno otherwise
+ */
+int zippo_launch_message_validate(const void* data, size_t len, int fd);
+
+/**
+ * Send one message, with an optional fd (-1 for none).
+ *
+ * @return 0 on success, -1 on failure with errno set
+ */
+int zippo_launch_message_send(int sock, uint16_t opcode, uint32_t id,
+    const void* payload, uint32_t size, int fd);
+
+/**
+ * Receive one packet without blocking. The received fd, if any, is stored
+ * in fd, -1 otherwise.
+ *
+ * @return the length of the packet, 0 if the peer has gone, -1 on failure
+ * with errno set (EAGAIN if there is nothing to read)
+ */
+ssize_t zippo_launch_message_recv(int sock, void* buf, size_t size, int* fd);
+
+#endif  //  ZIPPO_LAUNCHER_PROTOCOL_H
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "client_quota.h"
+
+#define CLIENTS 16
+#define OPERATIONS 10000000
+#define BUFFER_SIZE (1920 * 1080 * 4)
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+handle_pressure(void* data, struct wl_client* client)
+{
+  int* count = data;
+  (void)client;
+
+  (*count)++;
+}
+
+// usage: ./build/playground/client_quota_bench
+//
+// cost of charging and releasing buffers with many clients connected, then
+// one client that keeps attaching new 1080p buffers until it is cut off.
+int
+main()
+{
+  struct zippo_client_limits limits = {
+      .soft = ZIPPO_CLIENT_DEFAULT_SOFT_LIMIT,
+      .hard = ZIPPO_CLIENT_DEFAULT_HARD_LIMIT,
+  };
+  struct zippo_client_account* accounts[CLIENTS];
+  struct wl_client* clients[CLIENTS];
+  struct zippo_client_quota* quota;
+  struct wl_display* display;
+  struct wl_event_loop* loop;
+  int pressure_count = 0, buffers = 0;
+  double start, elapsed;
+
+  display = wl_display_create();
+  if (display == NULL) return EXIT_FAILURE;
+  loop = wl_display_get_event_loop(display);
+
+  quota = zippo_client_quota_create(
+      display, &limits, handle_pressure, &pressure_count);
+  if (quota == NULL) return EXIT_FAILURE;
+
+  for (int i = 0; i < CLIENTS; i++) {
+    int fds[2];
+
+    if (socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+      return EXIT_FAILURE;
+    clients[i] = wl_client_create(display, fds[0]);
+    if (clients[i] == NULL) return EXIT_FAILURE;
+    accounts[i] = zippo_client_quota_get_account(quota, clients[i]);
+    if (accounts[i] == NULL) return EXIT_FAILURE;
+  }
+
+  start = now();
+  for (int i = 0; i < OPERATIONS; i++) {
+    struct zippo_client_account* account = accounts[i % CLIENTS];
+    zippo_client_account_charge(account, ZIPPO_CLIENT_SHM, BUFFER_SIZE);
+    zippo_client_account_release(account, ZIPPO_CLIENT_SHM, BUFFER_SIZE);
+  }
+  elapsed = now() - start;
+  fprintf(stdout, "charge + release: %.1f ns with %d clients\n",
+      elapsed * 1e9 / OPERATIONS, CLIENTS);
+
+  start = now();
+  for (int i = 0; i < OPERATIONS; i++)
+    zippo_client_quota_get_account(quota, clients[i % CLIENTS]);
+  elapsed = now() - start;
+  fprintf(stdout, "account lookup: %.1f ns\n", elapsed * 1e9 / OPERATIONS);
+
+  // never releases anything
+  while (zippo_client_account_charge(
+             accounts[0], ZIPPO_CLIENT_SHM, BUFFER_SIZE) == 0)
+    buffers++;
+  fprintf(stdout, "leaking client: %d buffers, %d pressure callbacks\n",
+      buffers, pressure_count);
+
+  // the disconnect is deferred to an idle callback, its buffers stay
+  // accounted until their resources are destroyed
+  wl_event_loop_dispatch(loop, 0);
+  zippo_client_account_release(
+      accounts[0], ZIPPO_CLIENT_SHM, (uint64_t)buffers * BUFFER_SIZE);
+
+  fprintf(stdout, "\nmetrics:\n");
+  zippo_client_quota_write_metrics(quota, stdout);
+
+  wl_display_destroy_clients(display);
+  zippo_client_quota_destroy(quota);
+  wl_display_destroy(display);
+
+  return EXIT_SUCCESS;
+}
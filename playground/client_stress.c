@@ -0,0 +1,559 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "client_quota.h"
+#include "input_coalesce.h"
+#include "renderer.h"
+#include "repaint.h"
+#include "scene.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define REFRESH_NS 16666667ull
+#define MAX_DAMAGE 32
+#define KEY_INTERVAL 100  // pointer motions between key presses
+
+struct stress;
+
+struct stress_client {
+  struct stress* stress;
+  struct wl_client* client;
+  int fd;  // the client's end of the socket
+  struct zippo_client_account* account;
+  struct zippo_scene_view* view;
+
+  // double buffered, like a client attaching wl_shm buffers in turn
+  struct zippo_scale_image buffers[2];
+  size_t buffer_size;
+  bool charged;
+  int current;
+
+  uint64_t period_ns;
+  uint64_t next_commit_ns;
+};
+
+struct stress {
+  struct wl_display* display;
+  struct wl_event_loop* loop;
+  struct zippo_client_quota* quota;
+  struct zippo_repaint_scheduler* scheduler;
+  struct zippo_input_coalescer* input;
+  struct zippo_renderer* renderer;
+  struct zippo_scene* scene;
+  struct zippo_scale_image target;
+  struct wl_event_source* commit_timer;
+  struct wl_event_source* input_timer;
+
+  struct stress_client* clients;
+  int client_count;
+
+  // in output coordinates, more than MAX_DAMAGE means the whole output
+  struct zippo_renderer_rect damage[MAX_DAMAGE];
+  int damage_count;
+
+  double pointer_x;
+  double pointer_y;
+  struct zippo_scene_view* focus;
+  uint64_t input_ticks;
+
+  // counted from the start of the measurement
+  uint64_t commits;
+  uint64_t input_events;  // delivered to a focused client
+  double* frame_ms;
+  int frame_count;
+  int frame_capacity;
+  bool measuring;
+};
+
+// commit rates of the clients in turn, a video, an animation, a terminal
+// and an idle clock
+static const int rates[] = {60, 30, 10, 1};
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double
+cpu_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t
+rss_bytes()
+{
+  FILE* file = fopen("/proc/self/statm", "r");
+  unsigned long size, resident = 0;
+
+  if (file == NULL) return 0;
+  if (fscanf(file, "%lu %lu", &size, &resident) != 2) resident = 0;
+  fclose(file);
+
+  return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+static void
+add_damage(struct stress* stress, struct zippo_scene_view* view)
+{
+  if (stress->damage_count >= MAX_DAMAGE) {
+    stress->damage_count = MAX_DAMAGE + 1;
+    return;
+  }
+
+  stress->damage[stress->damage_count++] = (struct zippo_renderer_rect){
+      view->x, view->y, view->buffer.width, view->buffer.height};
+}
+
+static void
+record_frame(struct stress* stress, double ms)
+{
+  if (stress->frame_count == stress->frame_capacity) {
+    int capacity = stress->frame_capacity ? stress->frame_capacity * 2 : 1024;
+    double* frame_ms =
+        realloc(stress->frame_ms, capacity * sizeof *stress->frame_ms);
+    if (frame_ms == NULL) return;
+    stress->frame_ms = frame_ms;
+    stress->frame_capacity = capacity;
+  }
+
+  stress->frame_ms[stress->frame_count++] = ms;
+}
+
+// a headless output, the frame is on screen as soon as it is drawn
+static void
+repaint(void* data, uint32_t reasons, uint64_t target_ns)
+{
+  struct stress* stress = data;
+  struct zippo_renderer_rect full = {0, 0, WIDTH, HEIGHT};
+  uint64_t start = now_ns();
+  (void)reasons;
+
+  if (stress->damage_count > MAX_DAMAGE) {
+    zippo_renderer_render(
+        stress->renderer, stress->scene, 0, 0, &stress->target, &full, 1);
+  } else if (stress->damage_count > 0) {
+    zippo_renderer_render(stress->renderer, stress->scene, 0, 0,
+        &stress->target, stress->damage, stress->damage_count);
+  }
+  stress->damage_count = 0;
+
+  zippo_input_coalescer_flush(stress->input);
+
+  if (stress->measuring) record_frame(stress, (now_ns() - start) / 1e6);
+
+  zippo_repaint_scheduler_present_done(stress->scheduler, target_ns);
+}
+
+static void
+commit(struct stress_client* client)
+{
+  struct stress* stress = client->stress;
+  struct zippo_scale_image* buffer;
+  int row;
+
+  // the client draws into its other buffer, one row is enough to make it
+  // differ
+  client->current ^= 1;
+  buffer = &client->buffers[client->current];
+  row = (client->next_commit_ns / client->period_ns) % buffer->height;
+  memset((uint8_t*)buffer->data + row * buffer->stride, 0xff, buffer->stride);
+
+  zippo_scene_view_set_buffer(client->view, buffer, true);
+  add_damage(stress, client->view);
+  zippo_repaint_scheduler_schedule(stress->scheduler,
+      ZIPPO_REPAINT_DAMAGE | ZIPPO_REPAINT_FRAME_CALLBACK);
+
+  if (stress->measuring) stress->commits++;
+}
+
+static int
+handle_commit_timer(void* data)
+{
+  struct stress* stress = data;
+  uint64_t now = now_ns();
+
+  for (int i = 0; i < stress->client_count; i++) {
+    struct stress_client* client = &stress->clients[i];
+
+    if (client->next_commit_ns > now) continue;
+    commit(client);
+    client->next_commit_ns += client->period_ns;
+    if (client->next_commit_ns <= now)  // fell behind, do not catch up
+      client->next_commit_ns = now + client->period_ns;
+  }
+
+  wl_event_source_timer_update(stress->commit_timer, 1);
+
+  return 0;
+}
+
+// a 1000 Hz mouse circling over the desktop, with a key typed now and then
+static int
+handle_input_timer(void* data)
+{
+  struct stress* stress = data;
+  uint64_t tick = stress->input_ticks++;
+  uint64_t time_usec = now_ns() / 1000;
+  double angle = tick * 0.01;
+
+  zippo_input_coalescer_motion(stress->input, time_usec, cos(angle) * 4,
+      sin(angle) * 4, cos(angle) * 4, sin(angle) * 4);
+
+  if (tick % KEY_INTERVAL == 0) {
+    zippo_input_coalescer_key(stress->input, time_usec, KEY_A, true);
+    zippo_input_coalescer_key(stress->input, time_usec, KEY_A, false);
+  }
+
+  wl_event_source_timer_update(stress->input_timer, 1);
+
+  return 0;
+}
+
+static void
+update_focus(struct stress* stress)
+{
+  struct zippo_scene_view* view;
+
+  stress->focus = NULL;
+  wl_list_for_each_reverse(view, &stress->scene->views, link)
+  {
+    if (stress->pointer_x >= view->x &&
+        stress->pointer_x < view->x + view->buffer.width &&
+        stress->pointer_y >= view->y &&
+        stress->pointer_y < view->y + view->buffer.height) {
+      stress->focus = view;
+      return;
+    }
+  }
+}
+
+static void
+handle_motion(void* data, uint64_t time_usec, double dx, double dy,
+    double dx_unaccel, double dy_unaccel)
+{
+  struct stress* stress = data;
+  (void)time_usec;
+  (void)dx_unaccel;
+  (void)dy_unaccel;
+
+  stress->pointer_x = fmin(fmax(stress->pointer_x + dx, 0), WIDTH - 1);
+  stress->pointer_y = fmin(fmax(stress->pointer_y + dy, 0), HEIGHT - 1);
+  update_focus(stress);
+
+  if (stress->focus && stress->measuring) stress->input_events++;
+}
+
+static void
+handle_key(void* data, uint64_t time_usec, uint32_t key, bool pressed)
+{
+  struct stress* stress = data;
+  (void)time_usec;
+  (void)key;
+  (void)pressed;
+
+  if (stress->focus && stress->measuring) stress->input_events++;
+}
+
+static const struct zippo_input_coalescer_listener input_listener = {
+    .motion = handle_motion,
+    .key = handle_key,
+};
+
+static int
+create_buffer(struct zippo_scale_image* buffer, int width, int height)
+{
+  size_t size = (size_t)width * height * 4;
+  void* data;
+  int fd;
+
+  // what a client hands over through wl_shm
+  fd = memfd_create("zippo-stress", MFD_CLOEXEC);
+  if (fd < 0 || ftruncate(fd, size) < 0) {
+    fprintf(stderr, "Failed to create buffer: %s\n", strerror(errno));
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+
+  data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "Failed to map buffer: %s\n", strerror(errno));
+    return -1;
+  }
+
+  memset(data, 0x80, size);
+  buffer->data = data;
+  buffer->width = width;
+  buffer->height = height;
+  buffer->stride = width * 4;
+
+  return 0;
+}
+
+static int
+stress_client_init(struct stress_client* self, struct stress* stress,
+    int index, int width, int height)
+{
+  int columns = WIDTH / width;
+  int fds[2];
+
+  self->stress = stress;
+  self->fd = -1;
+
+  if (socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+    fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+    return -1;
+  }
+  self->fd = fds[1];
+
+  self->client = wl_client_create(stress->display, fds[0]);
+  if (self->client == NULL) {
+    close(fds[0]);
+    return -1;
+  }
+
+  self->account = zippo_client_quota_get_account(stress->quota, self->client);
+  if (self->account == NULL) return -1;
+
+  self->buffer_size = (size_t)width * height * 4;
+  for (int i = 0; i < 2; i++) {
+    if (create_buffer(&self->buffers[i], width, height) != 0) return -1;
+  }
+
+  if (zippo_client_account_charge(
+          self->account, ZIPPO_CLIENT_SHM, 2 * self->buffer_size) != 0)
+    return -1;
+  self->charged = true;
+
+  self->view = zippo_scene_view_create(stress->scene);
+  if (self->view == NULL) return -1;
+  zippo_scene_view_set_buffer(self->view, &self->buffers[0], true);
+  zippo_scene_view_set_position(
+      self->view, index % columns * width, index / columns * height);
+
+  // spread out, so that clients at the same rate do not commit in lockstep
+  self->period_ns = 1000000000ull / rates[index % 4];
+  self->next_commit_ns =
+      now_ns() + self->period_ns * index / stress->client_count;
+
+  return 0;
+}
+
+static void
+stress_client_fini(struct stress_client* self)
+{
+  if (self->view) zippo_scene_view_destroy(self->view);
+
+  for (int i = 0; i < 2; i++) {
+    if (self->buffers[i].data) munmap(self->buffers[i].data, self->buffer_size);
+  }
+
+  if (self->charged) {
+    zippo_client_account_release(
+        self->account, ZIPPO_CLIENT_SHM, 2 * self->buffer_size);
+  }
+
+  if (self->client) wl_client_destroy(self->client);
+  if (self->fd >= 0) close(self->fd);
+}
+
+static int
+compare_double(const void* a, const void* b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+
+  return (x > y) - (x < y);
+}
+
+static double
+percentile(const double* sorted, int count, double p)
+{
+  int i = (int)ceil(p / 100 * count) - 1;
+
+  if (count == 0) return 0;
+
+  return sorted[i < 0 ? 0 : i];
+}
+
+// a few thousand clients need more fds than the usual soft limit of 1024
+static void
+raise_fd_limit()
+{
+  struct rlimit limit;
+
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+static void
+write_results(FILE* out, struct stress* stress, double seconds,
+    double cpu, uint64_t rss, uint64_t buffer_bytes)
+{
+  const double* f = stress->frame_ms;
+  int n = stress->frame_count;
+  int clients = stress->client_count;
+  uint64_t overhead = rss > buffer_bytes ? rss - buffer_bytes : 0;
+
+  fprintf(out,
+      "{\"clients\": %d, \"seconds\": %.1f, \"renderer\": \"%s\", "
+      "\"cpu_percent\": %.1f, \"frames\": %d, "
+      "\"frame_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+      "\"max\": %.3f}, "
+      "\"commits\": %" PRIu64 ", \"input_events\": %" PRIu64 ", "
+      "\"client_buffer_bytes\": %" PRIu64 ", "
+      "\"client_overhead_bytes\": %" PRIu64 "}\n",
+      clients, seconds, stress->renderer->name, cpu / seconds * 100, n,
+      percentile(f, n, 50), percentile(f, n, 90), percentile(f, n, 99),
+      n ? f[n - 1] : 0, stress->commits, stress->input_events,
+      buffer_bytes / clients, overhead / clients);
+}
+
+// usage: ./build/playground/client_stress [clients] [seconds] [results]
+//
+// a 1080p headless output with the given number of clients, 100 by default,
+// tiled over it. they commit shm sized buffers at 60, 30, 10 or 1 Hz while
+// a 1000 Hz mouse moves over them. the clients do next to no work, so the
+// process cpu time is the compositor's: quota accounting, scene updates,
+// repaint scheduling, input coalescing and rendering with ZIPPO_RENDERER,
+// the software renderer by default.
+//
+// prints one line of json, also written to results if given, to compare
+// runs. client_overhead_bytes is what each client costs besides its buffers.
+int
+main(int argc, char* argv[])
+{
+  struct zippo_client_limits limits = {
+      .soft = ZIPPO_CLIENT_DEFAULT_SOFT_LIMIT,
+      .hard = ZIPPO_CLIENT_DEFAULT_HARD_LIMIT,
+  };
+  struct stress stress = {0};
+  const char* renderer_name = getenv("ZIPPO_RENDERER");
+  int client_count = argc > 1 ? atoi(argv[1]) : 100;
+  double seconds = argc > 2 ? atof(argv[2]) : 5;
+  int columns, rows, ret = EXIT_FAILURE;
+  uint64_t rss_before, rss, buffer_bytes = 0, end, now;
+  double cpu;
+
+  if (client_count < 1 || seconds <= 0) {
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  raise_fd_limit();
+  stress.pointer_x = WIDTH / 2;
+  stress.pointer_y = HEIGHT / 2;
+
+  stress.display = wl_display_create();
+  if (stress.display == NULL) return EXIT_FAILURE;
+  stress.loop = wl_display_get_event_loop(stress.display);
+
+  stress.quota =
+      zippo_client_quota_create(stress.display, &limits, NULL, NULL);
+  stress.scene = zippo_scene_create();
+  stress.renderer = zippo_renderer_create(
+      renderer_name && *renderer_name ? renderer_name : "software");
+  stress.input = zippo_input_coalescer_create(&input_listener, &stress);
+  stress.scheduler = zippo_repaint_scheduler_create(
+      stress.loop, REFRESH_NS, repaint, &stress);
+  if (stress.quota == NULL || stress.scene == NULL ||
+      stress.renderer == NULL || stress.input == NULL ||
+      stress.scheduler == NULL)
+    goto out;
+
+  if (create_buffer(&stress.target, WIDTH, HEIGHT) != 0) goto out;
+
+  // as close to square tiles as the output allows
+  columns = ceil(sqrt(client_count * (double)WIDTH / HEIGHT));
+  rows = (client_count + columns - 1) / columns;
+
+  stress.clients = calloc(client_count, sizeof *stress.clients);
+  if (stress.clients == NULL) goto out;
+
+  rss_before = rss_bytes();
+  for (int i = 0; i < client_count; i++) {
+    stress.client_count++;
+    if (stress_client_init(&stress.clients[i], &stress, i, WIDTH / columns,
+            HEIGHT / rows) != 0) {
+      fprintf(stderr, "Failed to create client %d\n", i);
+      goto out;
+    }
+    buffer_bytes += 2 * stress.clients[i].buffer_size;
+  }
+  rss = rss_bytes() - rss_before;
+
+  // the first frame draws the whole desktop, not part of the measurement
+  stress.damage_count = MAX_DAMAGE + 1;
+  zippo_repaint_scheduler_schedule(stress.scheduler, ZIPPO_REPAINT_DAMAGE);
+  wl_event_loop_dispatch(stress.loop, 100);
+
+  stress.commit_timer =
+      wl_event_loop_add_timer(stress.loop, handle_commit_timer, &stress);
+  stress.input_timer =
+      wl_event_loop_add_timer(stress.loop, handle_input_timer, &stress);
+  if (stress.commit_timer == NULL || stress.input_timer == NULL) goto out;
+  wl_event_source_timer_update(stress.commit_timer, 1);
+  wl_event_source_timer_update(stress.input_timer, 1);
+
+  stress.measuring = true;
+  cpu = cpu_seconds();
+  end = now_ns() + seconds * 1e9;
+  while ((now = now_ns()) < end) {
+    wl_event_loop_dispatch(stress.loop, (int)((end - now) / 1000000) + 1);
+    wl_display_flush_clients(stress.display);
+  }
+  cpu = cpu_seconds() - cpu;
+  stress.measuring = false;
+
+  qsort(stress.frame_ms, stress.frame_count, sizeof *stress.frame_ms,
+      compare_double);
+
+  write_results(stdout, &stress, seconds, cpu, rss, buffer_bytes);
+  if (argc > 3) {
+    FILE* file = fopen(argv[3], "w");
+    if (file == NULL) {
+      fprintf(stderr, "Failed to open %s: %s\n", argv[3], strerror(errno));
+      goto out;
+    }
+    write_results(file, &stress, seconds, cpu, rss, buffer_bytes);
+    fclose(file);
+  }
+
+  ret = EXIT_SUCCESS;
+
+out:
+  if (stress.input_timer) wl_event_source_remove(stress.input_timer);
+  if (stress.commit_timer) wl_event_source_remove(stress.commit_timer);
+  for (int i = 0; i < stress.client_count; i++)
+    stress_client_fini(&stress.clients[i]);
+  free(stress.clients);
+  free(stress.frame_ms);
+  if (stress.target.data)
+    munmap(stress.target.data, (size_t)WIDTH * HEIGHT * 4);
+  if (stress.scheduler) zippo_repaint_scheduler_destroy(stress.scheduler);
+  if (stress.input) zippo_input_coalescer_destroy(stress.input);
+  if (stress.renderer) zippo_renderer_destroy(stress.renderer);
+  if (stress.scene) zippo_scene_destroy(stress.scene);
+  if (stress.quota) zippo_client_quota_destroy(stress.quota);
+  wl_display_destroy(stress.display);
+
+  return ret;
+}
@@ -0,0 +1,146 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "color_lut.h"
+
+#define WIDTH 3840
+#define HEIGHT 2160
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct zippo_color_lut*
+create_test_lut(int size)
+{
+  struct zippo_color_lut* lut;
+  float *table, shaper[256 * 3];
+
+  table = malloc(sizeof *table * size * size * size * 3);
+  if (table == NULL) return NULL;
+
+  // gamma-ish shaper and a mildly cross-talking 3D part, like a calibration
+  for (int i = 0; i < 256; i++)
+    for (int c = 0; c < 3; c++) shaper[i * 3 + c] = powf(i / 255.0f, 1 / 1.1f);
+
+  for (int b = 0; b < size; b++) {
+    for (int g = 0; g < size; g++) {
+      for (int r = 0; r < size; r++) {
+        float* node = &table[((b * size + g) * size + r) * 3];
+        float fr = (float)r / (size - 1), fg = (float)g / (size - 1),
+              fb = (float)b / (size - 1);
+        node[0] = 0.9f * fr + 0.1f * fg;
+        node[1] = 0.05f * fr + 0.9f * fg + 0.05f * fb;
+        node[2] = 0.1f * fg + 0.9f * fb;
+      }
+    }
+  }
+
+  lut = zippo_color_lut_create(shaper, 256, table, size);
+  free(table);
+
+  return lut;
+}
+
+// windows of flat color over a gradient wallpaper, with noisy text lines
+static void
+fill_desktop(uint32_t* frame)
+{
+  for (int y = 0; y < HEIGHT; y++)
+    for (int x = 0; x < WIDTH; x++)
+      frame[y * WIDTH + x] = 0xff000000 | (x * 255 / WIDTH) << 16 | y % 256;
+
+  for (int i = 0; i < 8; i++) {
+    int x0 = i * 397 % (WIDTH - 1200), y0 = i * 211 % (HEIGHT - 800);
+    uint32_t color = 0xff000000 | (uint32_t)(i * 0x1f3d5b + 0x404040);
+
+    for (int y = y0; y < y0 + 800; y++) {
+      for (int x = x0; x < x0 + 1200; x++) {
+        bool text = y % 20 < 12 && x % 7 < 5 && (x * 31 + y * 17) % 11 < 4;
+        frame[y * WIDTH + x] = text ? 0xff202020 | rand() % 0x10 : color;
+      }
+    }
+  }
+}
+
+// every frame transforms the original content, not its own output
+static void
+bench(struct zippo_color_lut* lut, const uint32_t* content, uint32_t* frame,
+    const char* name, int rect_width, int rect_height, int rect_count)
+{
+  int frames = 0;
+  double start, elapsed = 0;
+
+  do {
+    for (int i = 0; i < rect_count; i++) {
+      int x = (i * 997) % (WIDTH - rect_width + 1);
+      int y = (i * 577) % (HEIGHT - rect_height + 1);
+      for (int j = y; j < y + rect_height; j++)
+        memcpy(&frame[j * WIDTH + x], &content[j * WIDTH + x],
+            sizeof *frame * rect_width);
+    }
+
+    start = now();
+    for (int i = 0; i < rect_count; i++) {
+      int x = (i * 997) % (WIDTH - rect_width + 1);
+      int y = (i * 577) % (HEIGHT - rect_height + 1);
+      zippo_color_lut_apply(
+          lut, frame, WIDTH * 4, x, y, rect_width, rect_height);
+    }
+    frames++;
+    elapsed += now() - start;
+  } while (elapsed < 1.0);
+
+  fprintf(stdout, "%-28s %8.2f ms/frame %8.1f Mpix/s\n", name,
+      elapsed * 1e3 / frames,
+      (double)rect_width * rect_height * rect_count * frames / elapsed / 1e6);
+}
+
+// usage: ./build/playground/color_lut_bench
+//
+// noise is the worst case, every pixel is a lookup of its own. the desktop
+// has the long runs of one color real content has.
+int
+main()
+{
+  const char* names[] = {"noise", "desktop"};
+  uint32_t *contents[2], *frame;
+
+  contents[0] = malloc(sizeof *frame * WIDTH * HEIGHT);
+  contents[1] = malloc(sizeof *frame * WIDTH * HEIGHT);
+  frame = malloc(sizeof *frame * WIDTH * HEIGHT);
+  if (contents[0] == NULL || contents[1] == NULL || frame == NULL)
+    return EXIT_FAILURE;
+
+  for (int i = 0; i < WIDTH * HEIGHT; i++) contents[0][i] = rand();
+  fill_desktop(contents[1]);
+
+  for (int size = 17; size <= 65; size = size * 2 - 1) {
+    struct zippo_color_lut* lut = create_test_lut(size);
+    if (lut == NULL) return EXIT_FAILURE;
+
+    for (int c = 0; c < 2; c++) {
+      fprintf(stdout, "LUT %dx%dx%d, %s\n", size, size, size, names[c]);
+      bench(lut, contents[c], frame, "  full 4K frame", WIDTH, HEIGHT, 1);
+      bench(lut, contents[c], frame, "  ~25% damage (32x 256^2)", 256, 256,
+          32);
+      bench(lut, contents[c], frame, "  cursor-sized damage", 64, 64, 2);
+    }
+
+    zippo_color_lut_unref(lut);
+  }
+
+  free(contents[0]);
+  free(contents[1]);
+  free(frame);
+
+  return EXIT_SUCCESS;
+}
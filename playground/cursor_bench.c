@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cursor.h"
+#include "renderer.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define MOTIONS 5000  // 5 s of a 1000 Hz mouse
+#define COMMIT_EVERY 16  // the window under the cursor redraws at 60 Hz
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+fill(struct zippo_scale_image* image, uint32_t color, bool gradient)
+{
+  for (int y = 0; y < image->height; y++) {
+    for (int x = 0; x < image->width; x++) {
+      uint32_t a = gradient ? x * 255 / image->width : 255;
+      uint32_t r = ((color >> 16) & 0xff) * a / 255;
+      uint32_t g = ((color >> 8) & 0xff) * a / 255;
+      uint32_t b = (color & 0xff) * a / 255;
+      image->data[y * image->width + x] = a << 24 | r << 16 | g << 8 | b;
+    }
+  }
+}
+
+static struct zippo_scale_image
+create_image(int width, int height, uint32_t color, bool gradient)
+{
+  struct zippo_scale_image image = {
+      .width = width,
+      .height = height,
+      .stride = width * 4,
+  };
+
+  image.data = malloc((size_t)width * height * 4);
+  if (image.data == NULL) exit(EXIT_FAILURE);
+  fill(&image, color, gradient);
+
+  return image;
+}
+
+// small steps of a high rate mouse, back and forth across the windows
+static void
+position(int i, int* x, int* y)
+{
+  *x = 40 + (i * 3) % 1400;
+  *y = 60 + (i * 2) % 700;
+}
+
+// usage: ./build/playground/cursor_bench
+//
+// 1000 Hz cursor motion over a 1080p desktop with the software renderer.
+// "scene" moves a cursor view and composites the old and new rectangle,
+// "layer" moves the save-under cursor layer, "layer+commit" also has the
+// translucent window under the cursor commit new content at 60 Hz. every
+// run ends with a comparison against a full composite with the cursor in
+// the scene, which has to be identical.
+int
+main()
+{
+  const char* modes[] = {"scene", "layer", "layer+commit"};
+  struct zippo_renderer_rect full = {0, 0, WIDTH, HEIGHT};
+  struct zippo_scene_view *view, *animated = NULL, *cursor_view;
+  struct zippo_scale_image images[7], target, reference;
+  struct zippo_cursor_layer* cursor;
+  struct zippo_renderer* renderer;
+  struct zippo_scene* scene;
+  int failures = 0;
+
+  scene = zippo_scene_create();
+  renderer = zippo_renderer_create("software");
+  if (scene == NULL || renderer == NULL) return EXIT_FAILURE;
+
+  images[0] = create_image(WIDTH, HEIGHT, 0x203040, false);
+  images[1] = create_image(1000, 700, 0xe0e0e0, false);
+  images[2] = create_image(900, 600, 0x304050, false);
+  images[3] = create_image(800, 500, 0xf0f0f0, false);
+  images[4] = create_image(600, 400, 0x4080c0, true);
+  images[5] = create_image(400, 120, 0x202020, true);
+  images[6] = create_image(32, 32, 0xffffff, true);
+  target = create_image(WIDTH, HEIGHT, 0, false);
+  reference = create_image(WIDTH, HEIGHT, 0, false);
+
+  for (int i = 0; i < 6; i++) {
+    view = zippo_scene_view_create(scene);
+    if (view == NULL) return EXIT_FAILURE;
+    zippo_scene_view_set_buffer(view, &images[i], i < 4);
+    zippo_scene_view_set_position(view, i * 150 % 900, i * 90 % 500);
+    if (i == 4) animated = view;
+  }
+
+  cursor = zippo_cursor_layer_create(&images[6], 0, 0);
+  if (cursor == NULL) return EXIT_FAILURE;
+
+  for (int m = 0; m < 3; m++) {
+    struct zippo_renderer_rect damage[2];
+    long pixels = 0;
+    int x, y, count;
+    double start, elapsed;
+    bool layer = m > 0;
+
+    cursor_view = NULL;
+    position(0, &x, &y);
+    zippo_renderer_render(renderer, scene, 0, 0, &target, &full, 1);
+    if (layer) {
+      zippo_cursor_layer_move(cursor, &target, x, y, damage);
+    } else {
+      cursor_view = zippo_scene_view_create(scene);
+      if (cursor_view == NULL) return EXIT_FAILURE;
+      zippo_scene_view_set_buffer(cursor_view, &images[6], false);
+      zippo_scene_view_set_position(cursor_view, x, y);
+      zippo_renderer_render(renderer, scene, 0, 0, &target, &full, 1);
+    }
+
+    start = now();
+    for (int i = 1; i < MOTIONS; i++) {
+      position(i, &x, &y);
+
+      if (layer) {
+        count = zippo_cursor_layer_move(cursor, &target, x, y, damage);
+      } else {
+        damage[0] = (struct zippo_renderer_rect){
+            cursor_view->x, cursor_view->y, 32, 32};
+        damage[1] = (struct zippo_renderer_rect){x, y, 32, 32};
+        zippo_scene_view_set_position(cursor_view, x, y);
+        zippo_renderer_render(renderer, scene, 0, 0, &target, damage, 2);
+        count = 2;
+      }
+      for (int j = 0; j < count; j++)
+        pixels += (long)damage[j].width * damage[j].height;
+
+      if (m == 2 && i % COMMIT_EVERY == 0) {
+        struct zippo_renderer_rect window = {animated->x, animated->y,
+            animated->buffer.width, animated->buffer.height};
+
+        fill(&images[4], i / COMMIT_EVERY % 2 ? 0xc08040 : 0x4080c0, true);
+        zippo_scene_view_set_buffer(animated, &images[4], false);
+        zippo_renderer_render(renderer, scene, 0, 0, &target, &window, 1);
+        zippo_cursor_layer_repair(cursor, &target, &window);
+        pixels += (long)window.width * window.height;
+      }
+    }
+    elapsed = now() - start;
+
+    // the cursor as the top view of a full composite is the truth
+    if (layer) {
+      cursor_view = zippo_scene_view_create(scene);
+      if (cursor_view == NULL) return EXIT_FAILURE;
+      zippo_scene_view_set_buffer(cursor_view, &images[6], false);
+      zippo_scene_view_set_position(cursor_view, x, y);
+    }
+    zippo_renderer_render(renderer, scene, 0, 0, &reference, &full, 1);
+    zippo_scene_view_destroy(cursor_view);
+
+    fprintf(stdout, "%-12s %7.2f us/motion %8.0f px/motion ", modes[m],
+        elapsed * 1e6 / (MOTIONS - 1), (double)pixels / (MOTIONS - 1));
+    if (memcmp(target.data, reference.data, (size_t)WIDTH * HEIGHT * 4)) {
+      fprintf(stdout, "FAIL: differs from a full composite\n");
+      failures++;
+    } else {
+      fprintf(stdout, "PASS\n");
+    }
+    if (layer) zippo_cursor_layer_hide(cursor, &target, damage);
+  }
+
+  zippo_cursor_layer_destroy(cursor);
+  zippo_renderer_destroy(renderer);
+  zippo_scene_destroy(scene);
+  for (int i = 0; i < 7; i++) free(images[i].data);
+  free(target.data);
+  free(reference.data);
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
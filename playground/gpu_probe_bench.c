@@ -0,0 +1,179 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gpu_probe.h"
+
+#define ITERATIONS 1000
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+write_file(const char* path, const char* content)
+{
+  FILE* file = fopen(path, "w");
+
+  if (file == NULL) {
+    fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  fputs(content, file);
+  fclose(file);
+
+  return 0;
+}
+
+static int
+make_dir(const char* path)
+{
+  if (mkdir(path, 0755) == 0 || errno == EEXIST) return 0;
+
+  fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+  return -1;
+}
+
+// <root>/sys/class/drm/card<N>{,-DP-1} with a pci parent, the last card on
+// seat1 and the second to last being the boot_vga one, plus the matching
+// udev database entries.
+static int
+create_fixture(const char* root, int cards)
+{
+  char path[PATH_MAX], target[PATH_MAX], content[128];
+  const char* dirs[] = {"sys", "sys/class", "sys/class/drm", "sys/devices",
+      "run", "run/udev", "run/udev/data"};
+
+  for (size_t i = 0; i < sizeof dirs / sizeof dirs[0]; i++) {
+    snprintf(path, sizeof path, "%s/%s", root, dirs[i]);
+    if (make_dir(path) != 0) return -1;
+  }
+
+  for (int i = 0; i < cards; i++) {
+    snprintf(path, sizeof path, "%s/sys/devices/0000:%02x:00.0", root, i);
+    if (make_dir(path) != 0) return -1;
+
+    snprintf(path, sizeof path, "%s/sys/devices/0000:%02x:00.0/boot_vga",
+        root, i);
+    if (write_file(path, i == cards - 2 ? "1\n" : "0\n") != 0) return -1;
+
+    snprintf(path, sizeof path, "%s/sys/devices/0000:%02x:00.0/card%d", root,
+        i, i);
+    if (make_dir(path) != 0) return -1;
+
+    snprintf(target, sizeof target,
+        "%s/sys/devices/0000:%02x:00.0/card%d/dev", root, i, i);
+    snprintf(content, sizeof content, "226:%d\n", i);
+    if (write_file(target, content) != 0) return -1;
+
+    snprintf(target, sizeof target,
+        "%s/sys/devices/0000:%02x:00.0/card%d/device", root, i, i);
+    snprintf(path, sizeof path, "../../0000:%02x:00.0", i);
+    if (symlink(path, target) != 0) return -1;
+
+    snprintf(target, sizeof target, "%s/sys/devices/0000:%02x:00.0/card%d",
+        root, i, i);
+    snprintf(path, sizeof path, "%s/sys/class/drm/card%d", root, i);
+    if (symlink(target, path) != 0) return -1;
+
+    // connector, must be skipped
+    snprintf(path, sizeof path, "%s/sys/class/drm/card%d-DP-1", root, i);
+    if (symlink(target, path) != 0) return -1;
+
+    snprintf(path, sizeof path, "%s/run/udev/data/c226:%d", root, i);
+    snprintf(content, sizeof content,
+        "I:1234\nE:ID_PATH=pci-0000:%02x:00.0\n%sG:seat\nQ:seat\n", i,
+        i == cards - 1 ? "E:ID_SEAT=seat1\n" : "");
+    if (write_file(path, content) != 0) return -1;
+  }
+
+  return 0;
+}
+
+static void
+bench_sysfs(const char* root, const char* seat)
+{
+  char syspath[PATH_MAX] = "";
+  double start, elapsed;
+  int ret = -1;
+
+  start = now();
+  for (int i = 0; i < ITERATIONS; i++)
+    ret = zippo_gpu_probe_sysfs(root, seat, syspath, sizeof syspath);
+  elapsed = now() - start;
+
+  fprintf(stdout, "sysfs  %-6s %8.1f us/probe  %s\n", seat,
+      elapsed * 1e6 / ITERATIONS, ret == 0 ? syspath : "(not found)");
+}
+
+static void
+bench_udev(const char* seat)
+{
+  struct udev* udev;
+  struct udev_device* device = NULL;
+  double start, elapsed;
+
+  udev = udev_new();
+  if (udev == NULL) return;
+
+  start = now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    if (device) udev_device_unref(device);
+    device = zippo_gpu_probe_udev(udev, seat);
+  }
+  elapsed = now() - start;
+
+  fprintf(stdout, "udev   %-6s %8.1f us/probe  %s\n", seat,
+      elapsed * 1e6 / ITERATIONS,
+      device ? udev_device_get_syspath(device) : "(not found)");
+
+  if (device) udev_device_unref(device);
+  udev_unref(udev);
+}
+
+// usage: ./build/playground/gpu_probe_bench [card count]
+//
+// libudev cannot be pointed at a fixture, so the udev path is only measured
+// against the host's sysfs. the "host:" section runs both paths there to
+// compare like with like.
+int
+main(int argc, char const* argv[])
+{
+  char root[] = "/tmp/zippo-sysfs-XXXXXX";
+  char command[PATH_MAX + 16];
+  int cards = argc > 1 ? atoi(argv[1]) : 4;
+
+  if (cards < 2) cards = 2;
+
+  if (mkdtemp(root) == NULL) {
+    fprintf(stderr, "Failed to create fixture: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  if (create_fixture(root, cards) == 0) {
+    fprintf(stdout, "fixture: %s, %d cards\n", root, cards);
+    bench_sysfs(root, "seat0");
+    bench_sysfs(root, "seat1");
+  }
+
+  fprintf(stdout, "host:\n");
+  bench_sysfs("", "seat0");
+  bench_udev("seat0");
+
+  snprintf(command, sizeof command, "rm -rf %s", root);
+  if (system(command) != 0) fprintf(stderr, "Failed to remove %s\n", root);
+
+  return EXIT_SUCCESS;
+}
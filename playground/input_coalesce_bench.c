@@ -0,0 +1,157 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "input_coalesce.h"
+
+#define POLL_HZ 8000
+#define FRAME_HZ 60
+#define SECONDS 10
+#define CLICK_INTERVAL_USEC 250000
+
+struct pointer {
+  double x;  // from the delivered motion
+  double y;
+  double raw_x;  // from the delivered unaccelerated motion
+  double raw_y;
+  double expected_x;  // at the time of each event
+  double expected_y;
+  int misplaced_clicks;
+  uint64_t last_time;
+  int out_of_order;
+  uint64_t deliveries;
+};
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+check_time(struct pointer* pointer, uint64_t time_usec)
+{
+  if (time_usec < pointer->last_time) pointer->out_of_order++;
+  pointer->last_time = time_usec;
+  pointer->deliveries++;
+}
+
+static void
+motion(void* data, uint64_t time_usec, double dx, double dy,
+    double dx_unaccel, double dy_unaccel)
+{
+  struct pointer* pointer = data;
+
+  check_time(pointer, time_usec);
+  pointer->x += dx;
+  pointer->y += dy;
+  pointer->raw_x += dx_unaccel;
+  pointer->raw_y += dy_unaccel;
+}
+
+static void
+button(void* data, uint64_t time_usec, uint32_t button, bool pressed)
+{
+  struct pointer* pointer = data;
+  (void)button;
+  (void)pressed;
+
+  check_time(pointer, time_usec);
+  if (pointer->x != pointer->expected_x || pointer->y != pointer->expected_y)
+    pointer->misplaced_clicks++;
+}
+
+static const struct zippo_input_coalescer_listener listener = {
+    .motion = motion,
+    .button = button,
+};
+
+static void
+emit(struct zippo_input_coalescer* coalescer,
+    struct zippo_input_evdev_state* device, uint64_t time_usec,
+    uint16_t type, uint16_t code, int32_t value)
+{
+  struct input_event event = {
+      .input_event_sec = time_usec / 1000000,
+      .input_event_usec = time_usec % 1000000,
+      .type = type,
+      .code = code,
+      .value = value,
+  };
+
+  zippo_input_coalescer_handle_evdev(coalescer, device, &event);
+}
+
+// usage: ./build/playground/input_coalesce_bench
+//
+// replays a synthetic 8000 Hz mouse with a click every 250 ms and flushes at
+// 60 Hz, then checks that no motion was lost and every click was delivered
+// at the position the pointer had when it happened.
+int
+main()
+{
+  struct zippo_input_coalescer* coalescer;
+  struct zippo_input_evdev_state device = {.fd = -1};
+  struct zippo_input_coalescer_stats stats;
+  struct pointer pointer = {0};
+  uint64_t events = 0, next_frame = 0, next_click = CLICK_INTERVAL_USEC;
+  double start, elapsed;
+  bool exact, raw_exact;
+
+  coalescer = zippo_input_coalescer_create(&listener, &pointer);
+  if (coalescer == NULL) return EXIT_FAILURE;
+
+  srand(1);
+
+  start = now();
+  for (uint64_t i = 0; i < (uint64_t)POLL_HZ * SECONDS; i++) {
+    uint64_t time_usec = i * 1000000 / POLL_HZ;
+    int dx = rand() % 7 - 3, dy = rand() % 7 - 3;
+
+    if (time_usec >= next_frame) {
+      zippo_input_coalescer_flush(coalescer);
+      next_frame += 1000000 / FRAME_HZ;
+    }
+
+    if (dx) emit(coalescer, &device, time_usec, EV_REL, REL_X, dx);
+    if (dy) emit(coalescer, &device, time_usec, EV_REL, REL_Y, dy);
+    pointer.expected_x += dx;
+    pointer.expected_y += dy;
+
+    if (time_usec >= next_click) {
+      emit(coalescer, &device, time_usec, EV_KEY, BTN_LEFT, 1);
+      emit(coalescer, &device, time_usec, EV_SYN, SYN_REPORT, 0);
+      emit(coalescer, &device, time_usec, EV_KEY, BTN_LEFT, 0);
+      next_click += CLICK_INTERVAL_USEC;
+      events += 2;
+    }
+
+    emit(coalescer, &device, time_usec, EV_SYN, SYN_REPORT, 0);
+    events++;
+  }
+  zippo_input_coalescer_flush(coalescer);
+  elapsed = now() - start;
+
+  zippo_input_coalescer_get_stats(coalescer, &stats);
+
+  exact = pointer.x == pointer.expected_x && pointer.y == pointer.expected_y;
+  raw_exact = pointer.raw_x == pointer.expected_x &&
+              pointer.raw_y == pointer.expected_y;
+
+  fprintf(stdout,
+      "%" PRIu64 " evdev frames -> %" PRIu64 " deliveries (%" PRIu64
+      " of %" PRIu64 " motions)\n",
+      events, pointer.deliveries, stats.motion_out, stats.motion_in);
+  fprintf(stdout, "%.1f ns per frame\n", elapsed * 1e9 / events);
+  fprintf(stdout, "motion %s, raw motion %s\n", exact ? "exact" : "LOST",
+      raw_exact ? "exact" : "LOST");
+  fprintf(stdout, "clicks misplaced %d, out of order %d\n",
+      pointer.misplaced_clicks, pointer.out_of_order);
+
+  zippo_input_coalescer_destroy(coalescer);
+
+  return EXIT_SUCCESS;
+}
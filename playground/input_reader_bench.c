@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "input_coalesce.h"
+#include "input_reader.h"
+
+#define FRAME_HZ 60
+#define MAX_FRAME_EVENTS 8
+
+enum device_kind {
+  DEVICE_MOUSE,
+  DEVICE_KEYBOARD,
+  DEVICE_TOUCHPAD,
+};
+
+struct device {
+  struct bench* bench;
+  const char* name;
+  enum device_kind kind;
+  int hz;
+  int fds[2];  // a pipe stands in for the evdev node
+
+  struct zippo_input_source* source;
+  struct zippo_input_evdev_state state;
+  uint64_t sent;  // events, by the writer
+  uint64_t received;
+  uint64_t next_ns;
+};
+
+struct bench {
+  struct device devices[4];
+  int device_count;
+  uint64_t end_ns;
+  _Atomic bool writer_done;
+
+  struct zippo_input_coalescer* coalescer;
+  struct wl_event_source* frame;  // the output asks for the motion
+  double x;  // delivered motion of both mice
+  double y;
+  double expected_x;  // written by the writer, read after it is joined
+  double expected_y;
+};
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t
+thread_cpu_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+motion(void* data, uint64_t time_usec, double dx, double dy,
+    double dx_unaccel, double dy_unaccel)
+{
+  struct bench* bench = data;
+  (void)time_usec;
+  (void)dx_unaccel;
+  (void)dy_unaccel;
+
+  bench->x += dx;
+  bench->y += dy;
+}
+
+static const struct zippo_input_coalescer_listener listener = {
+    .motion = motion,
+};
+
+static void
+set_event(struct input_event* event, uint64_t time_ns, uint16_t type,
+    uint16_t code, int32_t value)
+{
+  event->input_event_sec = time_ns / 1000000000;
+  event->input_event_usec = time_ns % 1000000000 / 1000;
+  event->type = type;
+  event->code = code;
+  event->value = value;
+}
+
+// one frame, written at once the way evdev hands out whole frames
+static void
+write_frame(struct bench* bench, struct device* device, uint64_t time_ns)
+{
+  struct input_event events[MAX_FRAME_EVENTS];
+  int count = 0, dx = rand() % 7 - 3, dy = rand() % 7 - 3;
+  static bool pressed;
+
+  switch (device->kind) {
+    case DEVICE_MOUSE:
+      set_event(&events[count++], time_ns, EV_REL, REL_X, dx);
+      set_event(&events[count++], time_ns, EV_REL, REL_Y, dy);
+      bench->expected_x += dx;
+      bench->expected_y += dy;
+      break;
+    case DEVICE_KEYBOARD:
+      pressed = !pressed;
+      set_event(&events[count++], time_ns, EV_MSC, MSC_SCAN, 0x70004);
+      set_event(&events[count++], time_ns, EV_KEY, KEY_A, pressed);
+      break;
+    case DEVICE_TOUCHPAD:
+      set_event(&events[count++], time_ns, EV_ABS, ABS_MT_SLOT, 0);
+      set_event(&events[count++], time_ns, EV_ABS, ABS_MT_POSITION_X, dx);
+      set_event(&events[count++], time_ns, EV_ABS, ABS_MT_POSITION_Y, dy);
+      set_event(&events[count++], time_ns, EV_ABS, ABS_X, dx);
+      set_event(&events[count++], time_ns, EV_ABS, ABS_Y, dy);
+      break;
+  }
+  set_event(&events[count++], time_ns, EV_SYN, SYN_REPORT, 0);
+
+  if (write(device->fds[1], events, count * sizeof events[0]) ==
+      (ssize_t)(count * sizeof events[0]))
+    device->sent += count;
+}
+
+// every device at its own rate, in real time
+static void*
+run_writer(void* data)
+{
+  struct bench* bench = data;
+
+  for (int i = 0; i < bench->device_count; i++)
+    bench->devices[i].next_ns = now_ns();
+
+  for (;;) {
+    struct device* next = &bench->devices[0];
+    struct timespec ts;
+
+    for (int i = 1; i < bench->device_count; i++) {
+      if (bench->devices[i].next_ns < next->next_ns)
+        next = &bench->devices[i];
+    }
+    if (next->next_ns >= bench->end_ns) break;
+
+    ts.tv_sec = next->next_ns / 1000000000;
+    ts.tv_nsec = next->next_ns % 1000000000;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+    write_frame(bench, next, next->next_ns);
+    next->next_ns += 1000000000ull / next->hz;
+  }
+
+  atomic_store(&bench->writer_done, true);
+
+  return NULL;
+}
+
+static void
+handle_events(void* data, const struct input_event* events, int count)
+{
+  struct device* device = data;
+
+  if (count == 0) {
+    fprintf(stderr, "%s is gone\n", device->name);
+    zippo_input_source_remove(device->source);
+    device->source = NULL;
+    return;
+  }
+
+  device->received += count;
+  for (int i = 0; i < count; i++) {
+    zippo_input_coalescer_handle_evdev(
+        device->bench->coalescer, &device->state, &events[i]);
+  }
+}
+
+static int
+handle_frame(void* data)
+{
+  struct bench* bench = data;
+
+  zippo_input_coalescer_flush(bench->coalescer);
+  wl_event_source_timer_update(bench->frame, 1000 / FRAME_HZ);
+
+  return 0;
+}
+
+static bool
+drained(struct bench* bench)
+{
+  if (!atomic_load(&bench->writer_done)) return false;
+
+  for (int i = 0; i < bench->device_count; i++) {
+    if (bench->devices[i].received < bench->devices[i].sent) return false;
+  }
+
+  return true;
+}
+
+static int
+run(bool use_io_uring, int seconds)
+{
+  struct bench bench = {
+      .devices = {
+          {.name = "mouse", .kind = DEVICE_MOUSE, .hz = 1000},
+          {.name = "gaming mouse", .kind = DEVICE_MOUSE, .hz = 8000},
+          {.name = "keyboard", .kind = DEVICE_KEYBOARD, .hz = 20},
+          {.name = "touchpad", .kind = DEVICE_TOUCHPAD, .hz = 125},
+      },
+      .device_count = 4,
+  };
+  struct zippo_input_reader_stats stats;
+  struct zippo_input_reader* reader;
+  struct wl_event_loop* loop;
+  uint64_t dispatches = 0, start, cpu, events = 0;
+  pthread_t writer;
+  double elapsed;
+  bool exact;
+
+  loop = wl_event_loop_create();
+  bench.coalescer = zippo_input_coalescer_create(&listener, &bench);
+  if (loop == NULL || bench.coalescer == NULL) return -1;
+
+  reader = zippo_input_reader_create(loop, use_io_uring);
+  if (reader == NULL) return -1;
+
+  for (int i = 0; i < bench.device_count; i++) {
+    struct device* device = &bench.devices[i];
+
+    device->bench = &bench;
+    device->state.fd = -1;  // no keys to read back from a pipe
+    if (pipe2(device->fds, O_CLOEXEC) < 0 ||
+        fcntl(device->fds[0], F_SETFL, O_NONBLOCK) < 0)
+      return -1;
+    device->source = zippo_input_reader_add(
+        reader, device->fds[0], handle_events, device, device->name);
+    if (device->source == NULL) return -1;
+  }
+
+  bench.frame = wl_event_loop_add_timer(loop, handle_frame, &bench);
+  if (bench.frame == NULL) return -1;
+  wl_event_source_timer_update(bench.frame, 1000 / FRAME_HZ);
+
+  srand(1);
+  start = now_ns();
+  bench.end_ns = start + seconds * 1000000000ull;
+  cpu = thread_cpu_ns();
+  if (pthread_create(&writer, NULL, run_writer, &bench) != 0) return -1;
+
+  while (!drained(&bench)) {
+    wl_event_loop_dispatch(loop, -1);
+    dispatches++;
+  }
+  zippo_input_coalescer_flush(bench.coalescer);
+
+  cpu = thread_cpu_ns() - cpu;
+  elapsed = (now_ns() - start) / 1e9;
+  pthread_join(writer, NULL);
+
+  zippo_input_reader_get_stats(reader, &stats);
+  exact = bench.x == bench.expected_x && bench.y == bench.expected_y;
+
+  for (int i = 0; i < bench.device_count; i++)
+    events += bench.devices[i].sent;
+
+  fprintf(stdout,
+      "%-18s %6.0f wakeups/s %6.0f syscalls/s (%.0f epoll_wait + %.0f "
+      "read or submit) %5.2f%% cpu, %s of %" PRIu64 " events, motion %s\n",
+      zippo_input_reader_get_backend(reader), stats.wakeups / elapsed,
+      (dispatches + stats.syscalls) / elapsed, dispatches / elapsed,
+      stats.syscalls / elapsed, cpu / 1e7 / elapsed,
+      stats.events == events ? "all" : "LOST some", events,
+      exact ? "exact" : "LOST");
+
+  for (int i = 0; i < bench.device_count; i++) {
+    if (bench.devices[i].source)
+      zippo_input_source_remove(bench.devices[i].source);
+    close(bench.devices[i].fds[0]);
+    close(bench.devices[i].fds[1]);
+  }
+  wl_event_source_remove(bench.frame);
+  zippo_input_reader_destroy(reader);
+  zippo_input_coalescer_destroy(bench.coalescer);
+  wl_event_loop_destroy(loop);
+
+  return 0;
+}
+
+// usage: ./build/playground/input_reader_bench [seconds]
+//
+// replays a 1000 Hz and an 8000 Hz mouse, a keyboard and a touchpad in real
+// time into pipes standing in for evdev nodes, read by the event loop with
+// epoll, then with io_uring. every event goes through the input coalescer,
+// which flushes at 60 Hz. syscalls are what the main thread makes to wait
+// for and read input, cpu is that of the main thread.
+int
+main(int argc, char const* argv[])
+{
+  int seconds = argc > 1 ? atoi(argv[1]) : 3;
+
+  if (seconds < 1) seconds = 3;
+
+  if (run(false, seconds) != 0 || run(true, seconds) != 0) {
+    fprintf(stderr, "Failed to run the replay\n");
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
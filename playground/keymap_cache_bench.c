@@ -0,0 +1,87 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "keymap_cache.h"
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+get(struct xkb_context* context, const char* dir,
+    const struct xkb_rule_names* names, const char* label)
+{
+  struct zippo_keymap_cache* cache;
+  struct zippo_keymap *keymap, *again;
+  double start, first, second;
+
+  cache = zippo_keymap_cache_create(context, dir);
+  if (cache == NULL) return -1;
+
+  start = now();
+  keymap = zippo_keymap_cache_get(cache, names);
+  first = now() - start;
+
+  start = now();
+  again = keymap ? zippo_keymap_cache_get(cache, names) : NULL;
+  second = now() - start;
+
+  if (keymap)
+    fprintf(stdout, "%-10s %8.2f ms, in memory %6.3f ms, %zu bytes, %s fd\n",
+        label, first * 1e3, second * 1e3, keymap->size,
+        again && again->fd == keymap->fd ? "shared" : "separate");
+
+  if (again) zippo_keymap_unref(again);
+  if (keymap) zippo_keymap_unref(keymap);
+  zippo_keymap_cache_destroy(cache);
+
+  return keymap ? 0 : -1;
+}
+
+// usage: ./build/playground/keymap_cache_bench [layout [variant [options]]]
+//
+// compiles the keymap from the rules into an empty cache directory, then
+// loads it again through a fresh cache as the next startup would.
+int
+main(int argc, char const* argv[])
+{
+  struct xkb_rule_names names = {
+      .layout = argc > 1 ? argv[1] : NULL,
+      .variant = argc > 2 ? argv[2] : NULL,
+      .options = argc > 3 ? argv[3] : NULL,
+  };
+  char dir[] = "/tmp/zippo-keymaps-XXXXXX";
+  char command[PATH_MAX + 16];
+  struct xkb_context* context;
+  int ret = EXIT_FAILURE;
+
+  if (mkdtemp(dir) == NULL) {
+    fprintf(stderr, "Failed to create cache dir: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+  if (context == NULL) goto out;
+
+  if (get(context, dir, &names, "compile") == 0 &&
+      get(context, dir, &names, "from disk") == 0)
+    ret = EXIT_SUCCESS;
+
+  xkb_context_unref(context);
+
+out:
+  snprintf(command, sizeof command, "rm -rf %s", dir);
+  if (system(command) != 0) fprintf(stderr, "Failed to remove %s\n", dir);
+
+  return ret;
+}
@@ -0,0 +1,147 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "launcher_client.h"
+#include "protocol.h"
+
+#define REQUESTS 100000
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// stands in for zippo-launch: same receive loop and reply path, but opens
+// /dev/null and does no ioctls, so only the protocol cost is measured.
+static void
+run_responder(int sock)
+{
+  union {
+    struct zippo_launch_message message;
+    char buf[ZIPPO_LAUNCH_MAX_MESSAGE_SIZE];
+  } data;
+  struct pollfd pfd = {.fd = sock, .events = POLLIN};
+
+  while (poll(&pfd, 1, -1) >= 0) {
+    ssize_t len;
+    int fd;
+
+    while ((len = zippo_launch_message_recv(
+                sock, data.buf, sizeof data.buf, &fd)) > 0) {
+      struct zippo_launch_reply reply;
+      int reply_fd = -1;
+
+      reply.ret = zippo_launch_message_validate(data.buf, len, fd);
+      if (reply.ret == 0 && data.message.opcode == ZIPPO_LAUNCH_OPEN)
+        reply_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+      zippo_launch_message_send(sock, ZIPPO_LAUNCH_REPLY, data.message.id,
+          &reply, sizeof reply, reply_fd);
+
+      if (reply_fd >= 0) close(reply_fd);
+      if (fd >= 0) close(fd);
+    }
+
+    if (len == 0 || (len < 0 && errno != EAGAIN)) break;
+  }
+
+  exit(EXIT_SUCCESS);
+}
+
+static void
+reply_callback(void* data, int ret, int fd)
+{
+  int* failures = data;
+
+  if (ret != 0) (*failures)++;
+  if (fd >= 0) close(fd);
+}
+
+static int
+send_request(struct zippo_launcher_client* client, int open, int* failures)
+{
+  if (open)
+    return zippo_launcher_client_open(
+        client, "/dev/null", O_RDONLY, reply_callback, failures);
+  else
+    return zippo_launcher_client_switch_vt(
+        client, 1, reply_callback, failures);
+}
+
+static void
+wait_replies(struct zippo_launcher_client* client, int pending)
+{
+  struct pollfd pfd = {
+      .fd = zippo_launcher_client_get_fd(client), .events = POLLIN};
+
+  while (zippo_launcher_client_get_pending(client) > pending) {
+    poll(&pfd, 1, -1);
+    zippo_launcher_client_dispatch(client);
+  }
+}
+
+static void
+bench(struct zippo_launcher_client* client, const char* name, int open,
+    int pipelined)
+{
+  int failures = 0;
+  double start, elapsed;
+
+  start = now();
+  for (int i = 0; i < REQUESTS; i++) {
+    send_request(client, open, &failures);
+    if (!pipelined) wait_replies(client, 0);
+  }
+  wait_replies(client, 0);
+  elapsed = now() - start;
+
+  fprintf(stdout, "%-26s %10.0f requests/s%s\n", name, REQUESTS / elapsed,
+      failures ? " (with failures)" : "");
+}
+
+// usage: ./build/playground/launch_bench
+int
+main()
+{
+  struct zippo_launcher_client* client;
+  int sock[2], status;
+  pid_t child;
+
+  if (socketpair(AF_LOCAL, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sock) < 0) {
+    fprintf(stderr, "Failed to create socketpair: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  child = fork();
+  if (child < 0) return EXIT_FAILURE;
+  if (child == 0) {
+    close(sock[0]);
+    run_responder(sock[1]);
+  }
+  close(sock[1]);
+
+  client = zippo_launcher_client_create(sock[0], NULL, NULL);
+  if (client == NULL) return EXIT_FAILURE;
+
+  bench(client, "switch vt, one at a time", 0, 0);
+  bench(client, "switch vt, pipelined", 0, 1);
+  bench(client, "open, one at a time", 1, 0);
+  bench(client, "open, pipelined", 1, 1);
+
+  zippo_launcher_client_destroy(client);
+  waitpid(child, &status, 0);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "launcher_client.h"
+#include "protocol.h"
+
+static void
+reply_callback(void* data, int ret, int fd)
+{
+  (void)data;
+  (void)ret;
+  if (fd >= 0) close(fd);
+}
+
+// both ends parse untrusted packets: zippo-launch runs as root and checks
+// every request with zippo_launch_message_validate(), the compositor reads
+// replies through zippo_launcher_client_dispatch().
+int
+LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  struct zippo_launcher_client* client;
+  int sock[2], fd;
+
+  fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  zippo_launch_message_validate(data, size, -1);
+  zippo_launch_message_validate(data, size, fd);
+
+  if (socketpair(AF_LOCAL, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sock) < 0)
+    abort();
+
+  client = zippo_launcher_client_create(sock[0], NULL, NULL);
+  if (client == NULL) abort();
+
+  // something for replies to match
+  zippo_launcher_client_switch_vt(client, 1, reply_callback, NULL);
+  zippo_launcher_client_switch_vt(client, 2, reply_callback, NULL);
+
+  if (send(sock[1], data, size, 0) == (ssize_t)size) {
+    if (size > 0 && data[0] & 1)  // and with an fd attached
+      zippo_launch_message_send(sock[1], ZIPPO_LAUNCH_REPLY, 1,
+          &(struct zippo_launch_reply){0}, sizeof(struct zippo_launch_reply),
+          fd);
+    zippo_launcher_client_dispatch(client);
+  }
+
+  zippo_launcher_client_destroy(client);
+  close(sock[1]);
+  close(fd);
+
+  return 0;
+}
+
+#ifndef ZIPPO_LIBFUZZER
+
+// seeds are valid messages, mutations flip bytes, truncate and extend them
+static size_t
+generate(uint8_t* buf, size_t size, unsigned int* seed)
+{
+  struct zippo_launch_message* message = (void*)buf;
+  size_t len = sizeof *message;
+  uint16_t opcodes[] = {ZIPPO_LAUNCH_OPEN, ZIPPO_LAUNCH_REVOKE,
+      ZIPPO_LAUNCH_SWITCH_VT, ZIPPO_LAUNCH_SET_MASTER,
+      ZIPPO_LAUNCH_DROP_MASTER, ZIPPO_LAUNCH_DEACTIVATE_DONE,
+      ZIPPO_LAUNCH_HEARTBEAT, ZIPPO_LAUNCH_REPLY, ZIPPO_LAUNCH_ACTIVATE,
+      ZIPPO_LAUNCH_DEACTIVATE};
+
+  memset(buf, 0, size);
+  message->version = ZIPPO_LAUNCH_PROTOCOL_VERSION;
+  message->opcode = opcodes[rand_r(seed) % (sizeof opcodes / sizeof *opcodes)];
+  message->id = rand_r(seed) % 4;
+  if (message->opcode == ZIPPO_LAUNCH_OPEN) {
+    const char path[] = "/dev/input/event0";
+    memcpy(buf + len + sizeof(int32_t), path, sizeof path);
+    len += sizeof(int32_t) + sizeof path;
+  } else if (message->opcode == ZIPPO_LAUNCH_SWITCH_VT ||
+             message->opcode == ZIPPO_LAUNCH_REPLY) {
+    len += sizeof(int32_t);
+  }
+  message->size = len - sizeof *message;
+
+  for (int n = rand_r(seed) % 4; n > 0; n--) {
+    switch (rand_r(seed) % 3) {
+      case 0:
+        if (len > 0) buf[rand_r(seed) % len] ^= 1 << (rand_r(seed) % 8);
+        break;
+      case 1:
+        len = rand_r(seed) % (len + 1);
+        break;
+      case 2:
+        len += rand_r(seed) % 16;
+        if (len > size) len = size;
+        break;
+    }
+  }
+
+  return len;
+}
+
+// usage: ./build/playground/launch_fuzz [iterations [seed]]
+//
+// standalone random driver. for coverage guided fuzzing build this file
+// with clang -fsanitize=fuzzer -DZIPPO_LIBFUZZER instead.
+int
+main(int argc, char const* argv[])
+{
+  long iterations = argc > 1 ? atol(argv[1]) : 100000;
+  unsigned int seed = argc > 2 ? (unsigned int)atol(argv[2]) : 1;
+  uint8_t buf[256];
+
+  for (long i = 0; i < iterations; i++) {
+    size_t len = generate(buf, sizeof buf, &seed);
+    LLVMFuzzerTestOneInput(buf, len);
+  }
+
+  fprintf(stdout, "%ld inputs\n", iterations);
+
+  return EXIT_SUCCESS;
+}
+
+#endif
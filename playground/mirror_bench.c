@@ -0,0 +1,254 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mirror.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define FRAMES 120
+#define TARGET_COUNT 4
+#define LUT_SIZE 17
+
+static const struct {
+  int width;
+  int height;
+} sizes[TARGET_COUNT] = {
+    {1920, 1080},  // the same, copied
+    {1280, 720},
+    {3840, 2160},
+    {1024, 768},  // a projector, stretched
+};
+
+// calibrated with a color LUT, the copied one and the projector
+static bool
+calibrated(int index)
+{
+  return index == 0 || index == 3;
+}
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+fill(struct zippo_scale_image* image, uint32_t color, bool gradient)
+{
+  for (int y = 0; y < image->height; y++) {
+    for (int x = 0; x < image->width; x++) {
+      uint32_t a = gradient ? x * 255 / image->width : 255;
+      uint32_t r = ((color >> 16) & 0xff) * a / 255;
+      uint32_t g = ((color >> 8) & 0xff) * a / 255;
+      uint32_t b = (color & 0xff) * a / 255;
+      image->data[y * image->width + x] = a << 24 | r << 16 | g << 8 | b;
+    }
+  }
+}
+
+static struct zippo_scale_image
+create_image(int width, int height, uint32_t color, bool gradient)
+{
+  struct zippo_scale_image image = {
+      .width = width,
+      .height = height,
+      .stride = width * 4,
+  };
+
+  image.data = malloc((size_t)width * height * 4);
+  if (image.data == NULL) exit(EXIT_FAILURE);
+  fill(&image, color, gradient);
+
+  return image;
+}
+
+// warmer, with some cross talk between the channels
+static struct zippo_color_lut*
+create_calibration()
+{
+  static float table[LUT_SIZE * LUT_SIZE * LUT_SIZE * 3];
+
+  for (int b = 0; b < LUT_SIZE; b++) {
+    for (int g = 0; g < LUT_SIZE; g++) {
+      for (int r = 0; r < LUT_SIZE; r++) {
+        float* node = &table[((b * LUT_SIZE + g) * LUT_SIZE + r) * 3];
+        float fr = (float)r / (LUT_SIZE - 1), fg = (float)g / (LUT_SIZE - 1),
+              fb = (float)b / (LUT_SIZE - 1);
+        node[0] = 0.95f * fr + 0.05f * fg;
+        node[1] = 0.05f * fr + 0.9f * fg + 0.05f * fb;
+        node[2] = 0.1f * fg + 0.8f * fb;
+      }
+    }
+  }
+
+  return zippo_color_lut_create(NULL, 0, table, LUT_SIZE);
+}
+
+// a client redraws its window and the cursor moves, every frame
+static void
+run(struct zippo_mirror** mirrors, int mirror_count,
+    struct zippo_scene_view* animated, struct zippo_scene_view* cursor,
+    struct zippo_scale_image* window)
+{
+  for (int i = 0; i < FRAMES; i++) {
+    struct zippo_renderer_rect damage[3] = {
+        {animated->x, animated->y, window->width, window->height},
+        {cursor->x, cursor->y, 32, 32},
+        {cursor->x + 7, cursor->y + 3, 32, 32},
+    };
+
+    fill(window, i % 2 ? 0xc08040 : 0x4080c0, false);
+    zippo_scene_view_set_buffer(animated, window, true);
+    zippo_scene_view_set_position(cursor, cursor->x + 7, cursor->y + 3);
+
+    for (int m = 0; m < mirror_count; m++) {
+      for (int d = 0; d < 3; d++) zippo_mirror_damage(mirrors[m], &damage[d]);
+      if (zippo_mirror_render(mirrors[m]) != 0) exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void
+print_stats(struct zippo_mirror_target* target, int index)
+{
+  struct zippo_mirror_stats stats;
+
+  zippo_mirror_target_get_stats(target, &stats);
+  fprintf(stdout,
+      "  %4dx%-4d %3d frames, %3d copied, %8.0f px/frame, %6.3f ms/frame",
+      sizes[index].width, sizes[index].height, (int)stats.frames,
+      (int)stats.copied_frames, (double)stats.pixels / stats.frames,
+      stats.blit_ns / 1e6 / stats.frames);
+  if (calibrated(index))
+    fprintf(stdout, ", %6.3f of it color", stats.color_ns / 1e6 / stats.frames);
+  fprintf(stdout, "\n");
+}
+
+// usage: ./build/playground/mirror_bench
+//
+// one 1080p desktop shown on four outputs of different sizes with the
+// software renderer, while a window redraws and the cursor moves. "per
+// output" composites the scene for every output and scales it, "mirror"
+// composites once and blits the damage to every output. the outputs of
+// both have to match each other and a full scale of a full composite, with
+// the color LUT applied to all of it on two of them.
+int
+main()
+{
+  struct zippo_mirror *mirror, *outputs[TARGET_COUNT];
+  struct zippo_mirror_target *targets[TARGET_COUNT],
+      *output_targets[TARGET_COUNT];
+  struct zippo_scale_image images[6], mirrored[TARGET_COUNT],
+      separate[TARGET_COUNT], expected[TARGET_COUNT];
+  struct zippo_scene_view *view, *animated = NULL, *cursor = NULL;
+  struct zippo_color_lut* lut;
+  struct zippo_renderer* renderer;
+  struct zippo_scaler* scaler;
+  struct zippo_scene* scene;
+  double start, separate_time, mirror_time;
+  int failures = 0;
+
+  scene = zippo_scene_create();
+  renderer = zippo_renderer_create("software");
+  scaler = zippo_scaler_create();
+  lut = create_calibration();
+  if (scene == NULL || renderer == NULL || scaler == NULL || lut == NULL)
+    return EXIT_FAILURE;
+
+  images[0] = create_image(WIDTH, HEIGHT, 0x203040, false);
+  images[1] = create_image(1000, 700, 0xe0e0e0, false);
+  images[2] = create_image(900, 600, 0x304050, false);
+  images[3] = create_image(600, 400, 0x4080c0, true);
+  images[4] = create_image(400, 120, 0x202020, true);
+  images[5] = create_image(32, 32, 0xffffff, true);
+
+  for (int i = 0; i < 6; i++) {
+    view = zippo_scene_view_create(scene);
+    if (view == NULL) return EXIT_FAILURE;
+    zippo_scene_view_set_buffer(view, &images[i], i < 3);
+    zippo_scene_view_set_position(view, i * 150 % 900, i * 90 % 500);
+    if (i == 2) animated = view;
+    cursor = view;
+  }
+  zippo_scene_view_set_position(cursor, 100, 100);
+
+  mirror = zippo_mirror_create(renderer, scene, 0, 0, WIDTH, HEIGHT);
+  if (mirror == NULL) return EXIT_FAILURE;
+
+  for (int i = 0; i < TARGET_COUNT; i++) {
+    mirrored[i] = create_image(sizes[i].width, sizes[i].height, 0, false);
+    separate[i] = create_image(sizes[i].width, sizes[i].height, 0, false);
+    expected[i] = create_image(sizes[i].width, sizes[i].height, 0, false);
+
+    targets[i] = zippo_mirror_add_target(
+        mirror, &mirrored[i], ZIPPO_SCALE_FILTER_BILINEAR);
+    outputs[i] = zippo_mirror_create(renderer, scene, 0, 0, WIDTH, HEIGHT);
+    if (targets[i] == NULL || outputs[i] == NULL) return EXIT_FAILURE;
+    output_targets[i] = zippo_mirror_add_target(
+        outputs[i], &separate[i], ZIPPO_SCALE_FILTER_BILINEAR);
+    if (output_targets[i] == NULL) return EXIT_FAILURE;
+
+    if (calibrated(i)) {
+      zippo_mirror_target_set_color_lut(targets[i], lut);
+      zippo_mirror_target_set_color_lut(output_targets[i], lut);
+    }
+  }
+
+  // everything drawn once, not measured
+  zippo_mirror_render(mirror);
+  for (int i = 0; i < TARGET_COUNT; i++) zippo_mirror_render(outputs[i]);
+
+  start = now();
+  run(outputs, TARGET_COUNT, animated, cursor, &images[2]);
+  separate_time = now() - start;
+  zippo_scene_view_set_position(cursor, 100, 100);
+
+  start = now();
+  run(&mirror, 1, animated, cursor, &images[2]);
+  mirror_time = now() - start;
+
+  fprintf(stdout, "per output %7.3f ms/frame\n", separate_time * 1e3 / FRAMES);
+  fprintf(stdout, "mirror     %7.3f ms/frame\n", mirror_time * 1e3 / FRAMES);
+  for (int i = 0; i < TARGET_COUNT; i++) print_stats(targets[i], i);
+
+  // the window ends with the same content both times, the cursor at the
+  // same place
+  for (int i = 0; i < TARGET_COUNT; i++) {
+    size_t size = (size_t)sizes[i].width * sizes[i].height * 4;
+
+    zippo_scaler_scale(scaler, ZIPPO_SCALE_FILTER_BILINEAR,
+        zippo_mirror_get_source(mirror), &expected[i]);
+    if (calibrated(i))
+      zippo_color_lut_apply(lut, expected[i].data, expected[i].stride, 0, 0,
+          sizes[i].width, sizes[i].height);
+    if (memcmp(mirrored[i].data, expected[i].data, size) != 0 ||
+        memcmp(separate[i].data, expected[i].data, size) != 0) {
+      fprintf(stdout, "FAIL: %dx%d differs from a full scale\n",
+          sizes[i].width, sizes[i].height);
+      failures++;
+    }
+  }
+  if (failures == 0) fprintf(stdout, "PASS: every output matches\n");
+
+  for (int i = 0; i < TARGET_COUNT; i++) {
+    zippo_mirror_target_remove(targets[i]);
+    zippo_mirror_target_remove(output_targets[i]);
+    zippo_mirror_destroy(outputs[i]);
+    free(mirrored[i].data);
+    free(separate[i].data);
+    free(expected[i].data);
+  }
+  zippo_mirror_destroy(mirror);
+  zippo_color_lut_unref(lut);
+  zippo_scaler_destroy(scaler);
+  zippo_renderer_destroy(renderer);
+  zippo_scene_destroy(scene);
+  for (int i = 0; i < 6; i++) free(images[i].data);
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
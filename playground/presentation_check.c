@@ -0,0 +1,238 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-server-core.h>
+
+#include "presentation.h"
+#include "repaint.h"
+#include "scene.h"
+
+#define REFRESH_NS 16666667ull
+#define SIZE 64
+#define VIDEO_FRAMES 30
+
+struct output {
+  struct wl_event_loop* loop;
+  struct zippo_repaint_scheduler* scheduler;
+  struct zippo_presentation* presentation;
+  struct zippo_scene* scene;
+  struct zippo_scale_image target;
+  bool fail_next;
+  uint64_t failed_ns;  // the vblank of the last frame that failed
+};
+
+// a video player at 30 fps that paces itself from the feedback alone
+struct video {
+  struct output* output;
+  struct zippo_scene_view* view;
+  struct zippo_scale_image buffer;
+  struct wl_event_source* timer;
+  bool paced;  // commit its next frame from the feedback
+
+  struct zippo_presentation_info infos[VIDEO_FRAMES];
+  int presented;
+  int discarded;
+};
+
+static uint32_t pixels[2][SIZE * SIZE];
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+run_for(struct wl_event_loop* loop, int ms)
+{
+  uint64_t end = now_ns() + ms * 1000000ull, now;
+
+  while ((now = now_ns()) < end)
+    wl_event_loop_dispatch(loop, (int)((end - now) / 1000000) + 1);
+}
+
+// a headless output with simulated vblanks, a frame is on screen at the
+// vblank it was drawn for
+static void
+repaint(void* data, uint32_t reasons, uint64_t target_ns)
+{
+  struct output* output = data;
+  const struct zippo_scale_image* image;
+  uint32_t flags = ZIPPO_PRESENTATION_VSYNC;
+  (void)reasons;
+
+  zippo_presentation_latch(output->presentation);
+  image = zippo_scene_render_output(output->scene, 0, 0, &output->target);
+  if (image != &output->target) flags |= ZIPPO_PRESENTATION_ZERO_COPY;
+
+  zippo_repaint_scheduler_present_done(output->scheduler, target_ns);
+
+  if (output->fail_next) {
+    output->fail_next = false;
+    output->failed_ns = target_ns;
+    zippo_presentation_failed(output->presentation);
+    zippo_repaint_scheduler_schedule(output->scheduler, ZIPPO_REPAINT_DAMAGE);
+    return;
+  }
+
+  zippo_presentation_presented(output->presentation, target_ns, flags);
+}
+
+static void handle_presented(
+    void* data, const struct zippo_presentation_info* info);
+
+static void
+video_commit(struct video* video)
+{
+  struct output* output = video->output;
+
+  video->buffer.data = pixels[video->buffer.data == pixels[0]];
+  zippo_scene_view_set_buffer(video->view, &video->buffer, true);
+  zippo_presentation_feedback_create(
+      output->presentation, video, handle_presented, video);
+  zippo_repaint_scheduler_schedule(output->scheduler,
+      ZIPPO_REPAINT_DAMAGE | ZIPPO_REPAINT_FRAME_CALLBACK);
+}
+
+static int
+handle_video_timer(void* data)
+{
+  video_commit(data);
+  return 0;
+}
+
+static void
+handle_presented(void* data, const struct zippo_presentation_info* info)
+{
+  struct video* video = data;
+  uint64_t commit_ns, now = now_ns();
+
+  if (info == NULL) {
+    video->discarded++;
+    return;
+  }
+
+  if (video->presented < VIDEO_FRAMES) video->infos[video->presented] = *info;
+  video->presented++;
+
+  if (!video->paced || video->presented >= VIDEO_FRAMES) return;
+
+  // the next frame is for two vblanks later, commit it once the vblank in
+  // between has passed
+  commit_ns = info->present_ns + info->refresh_ns;
+  wl_event_source_timer_update(video->timer,
+      commit_ns > now ? (int)((commit_ns - now + 999999) / 1000000) : 1);
+}
+
+static bool
+check(bool ok, const char* what)
+{
+  fprintf(stdout, "%s: %s\n", ok ? "PASS" : "FAIL", what);
+  return ok;
+}
+
+// usage: ./build/playground/presentation_check
+//
+// drives presentation feedback on a 60 Hz headless output with simulated
+// vblanks, with a fullscreen 30 fps video that schedules its frames from the
+// reported present time, refresh and sequence only.
+int
+main()
+{
+  struct output output = {0};
+  struct video video = {0};
+  struct zippo_presentation_info clock, first;
+  uint64_t seq, present_ns;
+  bool ok = true, paced = true;
+
+  output.loop = wl_event_loop_create();
+  output.presentation = zippo_presentation_create(REFRESH_NS);
+  output.scene = zippo_scene_create();
+  output.scheduler = zippo_repaint_scheduler_create(
+      output.loop, REFRESH_NS, repaint, &output);
+  if (output.loop == NULL || output.presentation == NULL ||
+      output.scene == NULL || output.scheduler == NULL)
+    return EXIT_FAILURE;
+  output.target = (struct zippo_scale_image){
+      .data = calloc(SIZE * SIZE, 4),
+      .width = SIZE,
+      .height = SIZE,
+      .stride = SIZE * 4,
+  };
+
+  video.output = &output;
+  video.buffer = (struct zippo_scale_image){
+      .data = pixels[1],
+      .width = SIZE,
+      .height = SIZE,
+      .stride = SIZE * 4,
+  };
+  video.view = zippo_scene_view_create(output.scene);
+  video.timer =
+      wl_event_loop_add_timer(output.loop, handle_video_timer, &video);
+  if (output.target.data == NULL || video.view == NULL || video.timer == NULL)
+    return EXIT_FAILURE;
+
+  // paced playback, every frame shown exactly two vblanks after the last
+  video.paced = true;
+  video_commit(&video);
+  run_for(output.loop, VIDEO_FRAMES * 2 * 17 + 100);
+  video.paced = false;
+
+  for (int i = 1; i < VIDEO_FRAMES && i < video.presented; i++) {
+    struct zippo_presentation_info* a = &video.infos[i - 1];
+    struct zippo_presentation_info* b = &video.infos[i];
+    if (b->seq - a->seq != 2 ||
+        b->present_ns - a->present_ns != 2 * REFRESH_NS)
+      paced = false;
+  }
+  ok &= check(video.presented == VIDEO_FRAMES, "every video frame presented");
+  ok &= check(paced, "frames two vblanks apart, in seq and present time");
+  ok &= check(video.infos[0].refresh_ns == REFRESH_NS, "refresh reported");
+  ok &= check(video.infos[0].flags ==
+                  (ZIPPO_PRESENTATION_VSYNC | ZIPPO_PRESENTATION_ZERO_COPY),
+      "vsync and zero copy for the fullscreen opaque buffer");
+
+  // a commit replaced before the output got to it
+  video.presented = 0;
+  video_commit(&video);
+  video_commit(&video);
+  run_for(output.loop, 50);
+  ok &= check(video.discarded == 1 && video.presented == 1,
+      "replaced commit discarded, the newer one presented");
+
+  // the vblank counter keeps going while nothing is drawn
+  zippo_presentation_get_clock(output.presentation, &clock);
+  run_for(output.loop, 200);
+  video.presented = 0;
+  video_commit(&video);
+  run_for(output.loop, 50);
+  first = video.infos[0];
+  seq = first.seq - clock.seq;
+  present_ns = first.present_ns - clock.present_ns;
+  ok &= check(
+      video.presented == 1 && seq > 10 && seq * REFRESH_NS == present_ns,
+      "seq counts the idle vblanks");
+
+  // a frame that never reached the screen, its content goes into the next
+  video.presented = 0;
+  output.fail_next = true;
+  video_commit(&video);
+  run_for(output.loop, 50);
+  ok &= check(video.presented == 1 &&
+                  video.infos[0].present_ns == output.failed_ns + REFRESH_NS,
+      "content of a failed frame presented with the next one");
+
+  wl_event_source_remove(video.timer);
+  zippo_scene_view_destroy(video.view);
+  zippo_repaint_scheduler_destroy(output.scheduler);
+  zippo_presentation_destroy(output.presentation);
+  zippo_scene_destroy(output.scene);
+  free(output.target.data);
+  wl_event_loop_destroy(output.loop);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "renderer.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define FRAMES 120
+#define LINE_HEIGHT 16
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct zippo_scale_image
+create_image(int width, int height, uint32_t color, bool gradient)
+{
+  struct zippo_scale_image image = {
+      .width = width,
+      .height = height,
+      .stride = width * 4,
+  };
+
+  image.data = malloc((size_t)width * height * 4);
+  if (image.data == NULL) exit(EXIT_FAILURE);
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint32_t a = gradient ? x * 255 / width : 255;
+      // premultiplied, every channel scaled down with alpha
+      uint32_t r = ((color >> 16) & 0xff) * a / 255;
+      uint32_t g = ((color >> 8) & 0xff) * a / 255;
+      uint32_t b = (color & 0xff) * a / 255;
+      image.data[y * width + x] = a << 24 | r << 16 | g << 8 | b;
+    }
+  }
+
+  return image;
+}
+
+// largest difference of any channel, rounding in the GPU blender may be
+// off by one
+static int
+compare(struct zippo_scale_image* a, struct zippo_scale_image* b)
+{
+  int max = 0;
+
+  for (int i = 0; i < a->width * a->height; i++) {
+    for (int shift = 0; shift < 32; shift += 8) {
+      int d = (int)((a->data[i] >> shift) & 0xff) -
+              (int)((b->data[i] >> shift) & 0xff);
+      if (d < 0) d = -d;
+      if (d > max) max = d;
+    }
+  }
+
+  return max;
+}
+
+static void
+run(struct zippo_renderer* renderer, struct zippo_scene* scene,
+    struct zippo_scene_view* animated, struct zippo_scene_view* cursor,
+    struct zippo_scale_image* target, const char* mode)
+{
+  struct zippo_renderer_rect full = {0, 0, WIDTH, HEIGHT};
+  double start, elapsed;
+
+  start = now();
+  for (int i = 0; i < FRAMES; i++) {
+    struct zippo_renderer_rect damage[2] = {
+        {cursor->x, cursor->y, 32, 32},
+        {cursor->x + 8, cursor->y + 4, 32, 32},
+    };
+
+    if (strcmp(mode, "full") == 0) {
+      zippo_renderer_render(renderer, scene, 0, 0, target, &full, 1);
+    } else if (strcmp(mode, "cursor") == 0) {
+      zippo_scene_view_set_position(cursor, cursor->x + 8, cursor->y + 4);
+      zippo_renderer_render(renderer, scene, 0, 0, target, damage, 2);
+    } else if (strcmp(mode, "damage") == 0) {
+      // a terminal redraws one line of its window and damages only that
+      struct zippo_scale_image* buffer = &animated->buffer;
+      int line = i * LINE_HEIGHT % (buffer->height - LINE_HEIGHT);
+      struct zippo_renderer_rect rect = {
+          animated->x, animated->y + line, buffer->width, LINE_HEIGHT};
+
+      for (int j = line; j < line + LINE_HEIGHT; j++) {
+        for (int x = 0; x < buffer->width; x++)
+          buffer->data[j * buffer->width + x] = 0xff000000 | i * 0x020406;
+      }
+      zippo_scene_view_set_buffer_damage(
+          animated, buffer, true, 0, line, buffer->width, LINE_HEIGHT);
+      zippo_renderer_render(renderer, scene, 0, 0, target, &rect, 1);
+    } else {
+      // a client commits a new frame of the whole window every time
+      struct zippo_renderer_rect window = {
+          animated->x, animated->y, animated->buffer.width,
+          animated->buffer.height};
+      zippo_scene_view_set_buffer(animated, &animated->buffer, true);
+      zippo_renderer_render(renderer, scene, 0, 0, target, &window, 1);
+    }
+  }
+  elapsed = now() - start;
+
+  zippo_scene_view_set_position(cursor, 100, 100);
+
+  fprintf(stdout, "%-9s %-7s %8.3f ms/frame\n", renderer->name, mode,
+      elapsed * 1e3 / FRAMES);
+}
+
+// usage: ./build/playground/renderer_bench
+//
+// draws a 1080p desktop of a wallpaper, opaque and translucent windows and a
+// cursor with both renderers. on a machine without a GPU, mesa runs the
+// gles2 renderer on llvmpipe.
+int
+main()
+{
+  const char* names[] = {"software", "gles2"};
+  const char* modes[] = {"full", "cursor", "commit", "damage"};
+  struct zippo_scene* scene;
+  struct zippo_scene_view *view, *animated = NULL, *cursor;
+  struct zippo_scale_image images[7], targets[2];
+  struct zippo_renderer_rect full = {0, 0, WIDTH, HEIGHT};
+
+  scene = zippo_scene_create();
+  if (scene == NULL) return EXIT_FAILURE;
+
+  images[0] = create_image(WIDTH, HEIGHT, 0x203040, false);
+  images[1] = create_image(1000, 700, 0xe0e0e0, false);
+  images[2] = create_image(900, 600, 0x304050, false);
+  images[3] = create_image(800, 500, 0xf0f0f0, false);
+  images[4] = create_image(600, 400, 0x4080c0, true);
+  images[5] = create_image(400, 120, 0x202020, true);
+  images[6] = create_image(32, 32, 0xffffff, true);
+
+  for (int i = 0; i < 7; i++) {
+    view = zippo_scene_view_create(scene);
+    if (view == NULL) return EXIT_FAILURE;
+    zippo_scene_view_set_buffer(view, &images[i], i < 4);
+    zippo_scene_view_set_position(view, i * 150 % 900, i * 90 % 500);
+    if (i == 2) animated = view;
+  }
+  cursor = view;
+  zippo_scene_view_set_position(cursor, 100, 100);
+
+  for (int i = 0; i < 2; i++) {
+    struct zippo_renderer* renderer = zippo_renderer_create(names[i]);
+
+    targets[i] = create_image(WIDTH, HEIGHT, 0, false);
+    if (renderer == NULL) {
+      fprintf(stdout, "%-9s unavailable\n", names[i]);
+      continue;
+    }
+
+    for (int m = 0; m < 4; m++)
+      run(renderer, scene, animated, cursor, &targets[i], modes[m]);
+
+    zippo_renderer_render(renderer, scene, 0, 0, &targets[i], &full, 1);
+    zippo_renderer_destroy(renderer);
+
+    if (i > 0)
+      fprintf(stdout, "max channel difference to software: %d\n",
+          compare(&targets[0], &targets[i]));
+  }
+
+  zippo_scene_destroy(scene);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-server-core.h>
+
+#include "repaint.h"
+
+#define REFRESH_NS 16666667ull
+
+struct scene {
+  struct wl_event_loop* loop;
+  struct zippo_repaint_scheduler* scheduler;
+  struct wl_event_source* client_timer;
+  int client_interval_ms;  // 0 for no client
+  bool polls_frame_callbacks;
+};
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// a headless output, the frame is on screen as soon as it is drawn
+static void
+repaint(void* data, uint32_t reasons, uint64_t target_ns)
+{
+  struct scene* scene = data;
+
+  zippo_repaint_scheduler_present_done(scene->scheduler, target_ns);
+
+  // frame done, a polling client asks for the next one right away
+  if ((reasons & ZIPPO_REPAINT_FRAME_CALLBACK) &&
+      scene->polls_frame_callbacks)
+    zippo_repaint_scheduler_schedule(
+        scene->scheduler, ZIPPO_REPAINT_FRAME_CALLBACK);
+}
+
+static int
+client_commit(void* data)
+{
+  struct scene* scene = data;
+
+  zippo_repaint_scheduler_schedule(scene->scheduler,
+      ZIPPO_REPAINT_DAMAGE | ZIPPO_REPAINT_FRAME_CALLBACK);
+  wl_event_source_timer_update(scene->client_timer, scene->client_interval_ms);
+
+  return 0;
+}
+
+static void
+run(const char* name, int client_interval_ms, bool polls,
+    struct zippo_repaint_stats* stats)
+{
+  struct scene scene = {0};
+  struct zippo_repaint_stats before;
+  uint64_t end, now;
+  double seconds = 2;
+
+  scene.loop = wl_event_loop_create();
+  scene.scheduler = zippo_repaint_scheduler_create(
+      scene.loop, REFRESH_NS, repaint, &scene);
+  scene.client_interval_ms = client_interval_ms;
+  scene.polls_frame_callbacks = polls;
+
+  // the desktop is drawn once at startup
+  zippo_repaint_scheduler_schedule(scene.scheduler, ZIPPO_REPAINT_DAMAGE);
+  wl_event_loop_dispatch(scene.loop, 100);
+
+  if (client_interval_ms > 0) {
+    scene.client_timer =
+        wl_event_loop_add_timer(scene.loop, client_commit, &scene);
+    wl_event_source_timer_update(scene.client_timer, client_interval_ms);
+  }
+
+  // count from here, after the startup frame
+  zippo_repaint_scheduler_get_stats(scene.scheduler, &before);
+
+  end = now_ns() + seconds * 1e9;
+  while ((now = now_ns()) < end)
+    wl_event_loop_dispatch(scene.loop, (int)((end - now) / 1000000) + 1);
+
+  zippo_repaint_scheduler_get_stats(scene.scheduler, stats);
+  stats->wakeups -= before.wakeups;
+  stats->idle_wakeups -= before.idle_wakeups;
+  stats->frames -= before.frames;
+  stats->deferred -= before.deferred;
+
+  fprintf(stdout,
+      "%-34s %6.1f wakeups/s %6.1f idle wakeups/s %6.1f frames/s, "
+      "interval %.1f ms\n",
+      name, stats->wakeups / seconds, stats->idle_wakeups / seconds,
+      stats->frames / seconds,
+      zippo_repaint_scheduler_get_effective_interval(scene.scheduler) / 1e6);
+
+  if (scene.client_timer) wl_event_source_remove(scene.client_timer);
+  zippo_repaint_scheduler_destroy(scene.scheduler);
+  wl_event_loop_destroy(scene.loop);
+}
+
+// usage: ./build/playground/repaint_idle
+//
+// drives the repaint scheduler of a 60 Hz headless output. fails unless an
+// idle desktop causes no wakeups at all.
+int
+main()
+{
+  struct zippo_repaint_stats idle, stats;
+
+  run("idle desktop", 0, false, &idle);
+  run("client at 60 Hz", 16, false, &stats);
+  run("client at 20 Hz", 50, false, &stats);
+  run("client at 20 Hz, polling frames", 50, true, &stats);
+
+  if (idle.wakeups != 0) {
+    fprintf(stderr, "FAIL: %" PRIu64 " wakeups while idle\n", idle.wakeups);
+    return EXIT_FAILURE;
+  }
+
+  fprintf(stdout, "PASS: no wakeups while idle\n");
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "scale.h"
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+bench(struct zippo_scaler* scaler, enum zippo_scale_filter filter,
+    const char* name, int src_width, int src_height, int dst_width,
+    int dst_height)
+{
+  struct zippo_scale_image src, dst;
+  int frames = 0, ret = -1;
+  double start, elapsed;
+
+  src.width = src_width;
+  src.height = src_height;
+  src.stride = src_width * 4;
+  src.data = malloc((size_t)src.stride * src_height);
+  dst.width = dst_width;
+  dst.height = dst_height;
+  dst.stride = dst_width * 4;
+  dst.data = malloc((size_t)dst.stride * dst_height);
+  if (!src.data || !dst.data) goto out;
+
+  for (int i = 0; i < src_width * src_height; i++) src.data[i] = rand();
+
+  // the first call builds the coefficient tables
+  if (zippo_scaler_scale(scaler, filter, &src, &dst) != 0) goto out;
+
+  start = now();
+  do {
+    zippo_scaler_scale(scaler, filter, &src, &dst);
+    frames++;
+    elapsed = now() - start;
+  } while (elapsed < 1.0);
+
+  fprintf(stdout, "%-24s %-8s %4dx%-4d -> %4dx%-4d %8.1f Mpix/s %7.2f ms\n",
+      name, filter == ZIPPO_SCALE_FILTER_BOX ? "box" : "bilinear", src_width,
+      src_height, dst_width, dst_height,
+      (double)dst_width * dst_height * frames / elapsed / 1e6,
+      elapsed * 1e3 / frames);
+  ret = 0;
+
+out:
+  free(src.data);
+  free(dst.data);
+  return ret;
+}
+
+// usage: ./build/playground/scale_bench
+int
+main()
+{
+  struct zippo_scaler* scaler;
+  int ret = 0;
+
+  scaler = zippo_scaler_create();
+  if (scaler == NULL) return EXIT_FAILURE;
+
+  for (int filter = 0; filter < 2; filter++) {
+    ret |= bench(scaler, filter, "output scale 1.25", 1536, 864, 1920, 1080);
+    ret |= bench(scaler, filter, "output scale 1.5", 2560, 1440, 3840, 2160);
+    ret |= bench(scaler, filter, "thumbnail 1/10", 3840, 2160, 384, 216);
+    ret |= bench(scaler, filter, "thumbnail 1/5", 1920, 1080, 384, 216);
+  }
+
+  zippo_scaler_destroy(scaler);
+
+  return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,237 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scale.h"
+
+#define SENTINEL 0xdeadbeefu
+
+// the scalar build of scale.c, from scale_scalar.c
+int zippo_scalar_scaler_scale(struct zippo_scaler* self,
+    enum zippo_scale_filter filter, const struct zippo_scale_image* src,
+    struct zippo_scale_image* dst);
+struct zippo_scaler* zippo_scalar_scaler_create();
+void zippo_scalar_scaler_destroy(struct zippo_scaler* self);
+
+struct size {
+  int src_width;
+  int src_height;
+  int dst_width;
+  int dst_height;
+};
+
+// output scales, thumbnails, odd widths for the tails of the SSE2 loops and
+// single rows and columns
+static const struct size sizes[] = {
+    {1536, 864, 1920, 1080},
+    {1920, 1080, 384, 216},
+    {640, 480, 333, 251},
+    {97, 61, 203, 149},
+    {255, 3, 17, 1},
+    {1, 40, 7, 13},
+};
+
+static const char* filter_names[] = {"bilinear", "box"};
+
+static bool
+image_init(struct zippo_scale_image* image, int width, int height)
+{
+  image->width = width;
+  image->height = height;
+  image->stride = width * 4;
+  image->data = malloc((size_t)image->stride * height);
+
+  return image->data != NULL;
+}
+
+static void
+image_fill(struct zippo_scale_image* image, uint32_t color)
+{
+  for (int i = 0; i < image->width * image->height; i++)
+    image->data[i] = color;
+}
+
+// first differing pixel, -1 if there is none
+static long
+image_compare(
+    const struct zippo_scale_image* a, const struct zippo_scale_image* b)
+{
+  for (long i = 0; i < (long)a->width * a->height; i++)
+    if (a->data[i] != b->data[i]) return i;
+
+  return -1;
+}
+
+static bool
+check(bool ok, const char* what, enum zippo_scale_filter filter,
+    const struct size* size)
+{
+  fprintf(stdout, "%s: %-40s %-8s %4dx%-4d -> %4dx%-4d\n",
+      ok ? "PASS" : "FAIL", what, filter_names[filter], size->src_width,
+      size->src_height, size->dst_width, size->dst_height);
+  return ok;
+}
+
+// byte for byte the same result from both paths
+static bool
+check_sse2(struct zippo_scaler* scaler, struct zippo_scaler* scalar,
+    enum zippo_scale_filter filter, const struct size* size)
+{
+  struct zippo_scale_image src = {0}, dst = {0}, ref = {0};
+  bool ok = false;
+
+  if (!image_init(&src, size->src_width, size->src_height) ||
+      !image_init(&dst, size->dst_width, size->dst_height) ||
+      !image_init(&ref, size->dst_width, size->dst_height))
+    goto out;
+
+  for (int i = 0; i < src.width * src.height; i++)
+    src.data[i] = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+
+  if (zippo_scaler_scale(scaler, filter, &src, &dst) != 0) goto out;
+  if (zippo_scalar_scaler_scale(scalar, filter, &src, &ref) != 0) goto out;
+
+  ok = image_compare(&dst, &ref) < 0;
+
+out:
+  free(src.data);
+  free(dst.data);
+  free(ref.data);
+  return check(ok, "sse2 matches scalar", filter, size);
+}
+
+// weights sum up to exactly one, a flat image keeps its exact color
+static bool
+check_flat(struct zippo_scaler* scaler, enum zippo_scale_filter filter,
+    const struct size* size)
+{
+  static const uint32_t colors[] = {
+      0x00000000, 0xffffffff, 0x80ff0000, 0x7f123456};
+  struct zippo_scale_image src = {0}, dst = {0}, ref = {0};
+  bool ok = false;
+
+  if (!image_init(&src, size->src_width, size->src_height) ||
+      !image_init(&dst, size->dst_width, size->dst_height) ||
+      !image_init(&ref, size->dst_width, size->dst_height))
+    goto out;
+
+  ok = true;
+  for (size_t i = 0; ok && i < sizeof colors / sizeof colors[0]; i++) {
+    image_fill(&src, colors[i]);
+    image_fill(&ref, colors[i]);
+    ok = zippo_scaler_scale(scaler, filter, &src, &dst) == 0 &&
+         image_compare(&dst, &ref) < 0;
+  }
+
+out:
+  free(src.data);
+  free(dst.data);
+  free(ref.data);
+  return check(ok, "flat color stays exact", filter, size);
+}
+
+// scaling to the same size copies the image
+static bool
+check_identity(struct zippo_scaler* scaler, enum zippo_scale_filter filter,
+    const struct size* size)
+{
+  struct size identity = {size->src_width, size->src_height,
+      size->src_width, size->src_height};
+  struct zippo_scale_image src = {0}, dst = {0};
+  bool ok = false;
+
+  if (!image_init(&src, size->src_width, size->src_height) ||
+      !image_init(&dst, size->src_width, size->src_height))
+    goto out;
+
+  for (int i = 0; i < src.width * src.height; i++)
+    src.data[i] = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+
+  ok = zippo_scaler_scale(scaler, filter, &src, &dst) == 0 &&
+       image_compare(&dst, &src) < 0;
+
+out:
+  free(src.data);
+  free(dst.data);
+  return check(ok, "identity copies", filter, &identity);
+}
+
+// a region is the same as that part of the full scale, the rest of dst is
+// left alone
+static bool
+check_region(struct zippo_scaler* scaler, enum zippo_scale_filter filter,
+    const struct size* size)
+{
+  struct zippo_scale_image src = {0}, dst = {0}, ref = {0};
+  int x, y, width, height;
+  bool ok = false;
+
+  if (!image_init(&src, size->src_width, size->src_height) ||
+      !image_init(&dst, size->dst_width, size->dst_height) ||
+      !image_init(&ref, size->dst_width, size->dst_height))
+    goto out;
+
+  for (int i = 0; i < src.width * src.height; i++)
+    src.data[i] = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+
+  if (zippo_scaler_scale(scaler, filter, &src, &ref) != 0) goto out;
+
+  // not aligned to the tiles, and reaching past the bottom right edge
+  x = dst.width / 3;
+  y = dst.height / 5;
+  width = dst.width;
+  height = dst.height;
+
+  image_fill(&dst, SENTINEL);
+  if (zippo_scaler_scale_region(
+          scaler, filter, &src, &dst, x, y, width, height) != 0)
+    goto out;
+
+  ok = true;
+  for (int j = 0; ok && j < dst.height; j++) {
+    for (int i = 0; ok && i < dst.width; i++) {
+      uint32_t pixel = dst.data[j * dst.width + i];
+      if (i >= x && j >= y)
+        ok = pixel == ref.data[j * ref.width + i];
+      else
+        ok = pixel == SENTINEL;
+    }
+  }
+
+out:
+  free(src.data);
+  free(dst.data);
+  free(ref.data);
+  return check(ok, "region matches full scale", filter, size);
+}
+
+// usage: ./build/playground/scale_check
+//
+// golden checks for the scaler, exits nonzero if any of them fails
+int
+main()
+{
+  struct zippo_scaler *scaler, *scalar;
+  bool ok = true;
+
+  scaler = zippo_scaler_create();
+  scalar = zippo_scalar_scaler_create();
+  if (scaler == NULL || scalar == NULL) return EXIT_FAILURE;
+
+  srand(1);
+
+  for (int filter = 0; filter < 2; filter++) {
+    for (size_t i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+      ok &= check_sse2(scaler, scalar, filter, &sizes[i]);
+      ok &= check_flat(scaler, filter, &sizes[i]);
+      ok &= check_identity(scaler, filter, &sizes[i]);
+      ok &= check_region(scaler, filter, &sizes[i]);
+    }
+  }
+
+  zippo_scaler_destroy(scaler);
+  zippo_scalar_scaler_destroy(scalar);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,11 @@
+// scale.c built once more without SSE2 and under other names, so that
+// scale_check can compare the SSE2 paths against the scalar ones in one
+// process
+#undef __SSE2__
+
+#define zippo_scaler_scale zippo_scalar_scaler_scale
+#define zippo_scaler_scale_region zippo_scalar_scaler_scale_region
+#define zippo_scaler_create zippo_scalar_scaler_create
+#define zippo_scaler_destroy zippo_scalar_scaler_destroy
+
+#include "../src/scale.c"
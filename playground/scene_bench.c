@@ -0,0 +1,124 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "scene.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define FRAMES 120
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct zippo_scale_image
+create_image(int width, int height, uint32_t color)
+{
+  struct zippo_scale_image image = {
+      .width = width,
+      .height = height,
+      .stride = width * 4,
+  };
+
+  image.data = malloc((size_t)width * height * 4);
+  if (image.data == NULL) exit(EXIT_FAILURE);
+  for (int i = 0; i < width * height; i++) image.data[i] = color;
+
+  return image;
+}
+
+static void
+run(struct zippo_scene* scene, const char* name,
+    struct zippo_scale_image* target)
+{
+  struct zippo_scene_stats before = scene->stats;
+  uint64_t passthrough, saved;
+  double start, elapsed;
+  uint64_t checksum = 0;
+
+  start = now();
+  for (int i = 0; i < FRAMES; i++) {
+    const struct zippo_scale_image* image =
+        zippo_scene_render_output(scene, 0, 0, target);
+    // the consumer, e.g. a capture client, reads the frame
+    checksum += image->data[i * 997 % (WIDTH * HEIGHT)];
+  }
+  elapsed = now() - start;
+
+  passthrough =
+      scene->stats.passthrough_frames - before.passthrough_frames;
+  saved = scene->stats.bytes_saved - before.bytes_saved;
+
+  fprintf(stdout,
+      "%-24s %7.3f ms/frame, bypass %5.1f%%, saved %6.1f MB/s at 60 Hz "
+      "(%" PRIx64 ")\n",
+      name, elapsed * 1e3 / FRAMES, passthrough * 100.0 / FRAMES,
+      saved * 60.0 / FRAMES / 1e6, checksum & 0xffff);
+}
+
+// usage: ./build/playground/scene_bench
+//
+// a fullscreen video on a 1080p output, then the same with the cursor and
+// a translucent notification above it, which must fall back to composition.
+int
+main()
+{
+  struct zippo_scene* scene;
+  struct zippo_scene_view *background, *video, *cursor, *popup;
+  struct zippo_scale_image target, wallpaper, frame, arrow, notification;
+
+  scene = zippo_scene_create();
+  if (scene == NULL) return EXIT_FAILURE;
+
+  target = create_image(WIDTH, HEIGHT, 0);
+  wallpaper = create_image(WIDTH, HEIGHT, 0xff203040);
+  frame = create_image(WIDTH, HEIGHT, 0xff808080);
+  arrow = create_image(64, 64, 0x80808080);  // premultiplied white
+  notification = create_image(400, 120, 0xc0101010);
+
+  background = zippo_scene_view_create(scene);
+  zippo_scene_view_set_buffer(background, &wallpaper, true);
+  video = zippo_scene_view_create(scene);
+  zippo_scene_view_set_buffer(video, &frame, true);
+
+  run(scene, "fullscreen video", &target);
+
+  cursor = zippo_scene_view_create(scene);
+  zippo_scene_view_set_buffer(cursor, &arrow, false);
+  zippo_scene_view_set_position(cursor, 900, 500);
+  run(scene, "video + cursor", &target);
+
+  popup = zippo_scene_view_create(scene);
+  zippo_scene_view_set_buffer(popup, &notification, false);
+  zippo_scene_view_set_position(popup, WIDTH - 420, 20);
+  zippo_scene_view_raise(cursor);
+  run(scene, "video + cursor + popup", &target);
+
+  // the cursor moves to another output
+  zippo_scene_view_set_position(cursor, WIDTH + 100, 100);
+  zippo_scene_view_set_buffer(popup, NULL, false);
+  run(scene, "video, overlays gone", &target);
+
+  fprintf(stdout, "total: %" PRIu64 " of %" PRIu64 " frames bypassed\n",
+      scene->stats.passthrough_frames, scene->stats.frames);
+
+  zippo_scene_view_destroy(popup);
+  zippo_scene_view_destroy(cursor);
+  zippo_scene_view_destroy(video);
+  zippo_scene_view_destroy(background);
+  zippo_scene_destroy(scene);
+
+  free(notification.data);
+  free(arrow.data);
+  free(frame.data);
+  free(wallpaper.data);
+  free(target.data);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,311 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "renderer.h"
+#include "screenshot.h"
+
+#define WIDTH 3840
+#define HEIGHT 2160
+
+struct result {
+  bool done;
+  int ret;
+};
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t
+get_be32(const uint8_t* p)
+{
+  return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static struct zippo_scale_image
+create_image(int width, int height, uint32_t color, bool text)
+{
+  struct zippo_scale_image image = {
+      .width = width,
+      .height = height,
+      .stride = width * 4,
+  };
+
+  image.data = malloc((size_t)width * height * 4);
+  if (image.data == NULL) exit(EXIT_FAILURE);
+
+  // lines of dark specks stand in for text, which is what makes a
+  // screenshot expensive to compress
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      bool ink = text && y % 24 < 14 && x % 600 < 560 && rand() % 3 == 0;
+      image.data[y * width + x] = ink ? 0xff202020 : 0xff000000 | color;
+    }
+  }
+
+  return image;
+}
+
+static void
+handle_done(void* data, int ret)
+{
+  struct result* result = data;
+
+  result->done = true;
+  result->ret = ret;
+}
+
+// pixels of a png we wrote, only the up filter has to be undone
+static int
+check_png(const uint8_t* file, size_t len, const struct zippo_scale_image* in)
+{
+  size_t row_len = 1 + (size_t)in->width * 3, raw_len = row_len * in->height;
+  uint8_t* raw = malloc(raw_len);
+  z_stream z = {0};
+  size_t pos = 8;
+  int ret = -1;
+
+  if (raw == NULL || inflateInit(&z) != Z_OK) goto out;
+  z.next_out = raw;
+  z.avail_out = raw_len;
+
+  while (pos + 12 <= len) {
+    uint32_t chunk_len = get_be32(file + pos);
+    const uint8_t* type = file + pos + 4;
+
+    if (crc32(0, type, chunk_len + 4) != get_be32(file + pos + 8 + chunk_len))
+      goto out_inflate;
+    if (memcmp(type, "IDAT", 4) == 0) {
+      z.next_in = (uint8_t*)type + 4;
+      z.avail_in = chunk_len;
+      if (inflate(&z, Z_NO_FLUSH) < 0) goto out_inflate;
+    }
+    pos += 12 + chunk_len;
+  }
+  if (z.avail_out != 0) goto out_inflate;
+
+  for (int y = 0; y < in->height; y++) {
+    uint8_t* row = raw + y * row_len;
+
+    for (int x = 0; x < in->width; x++) {
+      uint32_t p = in->data[y * in->width + x];
+
+      for (int c = 0; c < 3; c++) {
+        uint8_t above = y > 0 ? row[1 + x * 3 + c - row_len] : 0;
+
+        row[1 + x * 3 + c] += above;
+        if (row[1 + x * 3 + c] != ((p >> (16 - 8 * c)) & 0xff))
+          goto out_inflate;
+      }
+    }
+  }
+  ret = 0;
+
+out_inflate:
+  inflateEnd(&z);
+
+out:
+  free(raw);
+  return ret;
+}
+
+static int
+check_qoi(const uint8_t* file, size_t len, const struct zippo_scale_image* in)
+{
+  uint32_t index[64] = {0}, px = 0xff000000;
+  size_t pos = 14, count = (size_t)in->width * in->height;
+  int run = 0;
+
+  if (len < 22 || memcmp(file, "qoif", 4) != 0 ||
+      get_be32(file + 4) != (uint32_t)in->width ||
+      get_be32(file + 8) != (uint32_t)in->height)
+    return -1;
+
+  for (size_t i = 0; i < count; i++) {
+    int r = (px >> 16) & 0xff, g = (px >> 8) & 0xff, b = px & 0xff;
+
+    if (run > 0) {
+      run--;
+    } else {
+      uint8_t op;
+
+      if (pos >= len - 8) return -1;
+      op = file[pos++];
+      if (op == 0xfe) {
+        r = file[pos];
+        g = file[pos + 1];
+        b = file[pos + 2];
+        pos += 3;
+      } else if ((op & 0xc0) == 0x00) {
+        px = index[op];
+        r = (px >> 16) & 0xff;
+        g = (px >> 8) & 0xff;
+        b = px & 0xff;
+      } else if ((op & 0xc0) == 0x40) {
+        r += ((op >> 4) & 3) - 2;
+        g += ((op >> 2) & 3) - 2;
+        b += (op & 3) - 2;
+      } else if ((op & 0xc0) == 0x80) {
+        int dg = (op & 0x3f) - 32, second = file[pos++];
+
+        r += dg + (second >> 4) - 8;
+        g += dg;
+        b += dg + (second & 0xf) - 8;
+      } else {
+        run = op & 0x3f;
+      }
+      px = 0xff000000 | (r & 0xff) << 16 | (g & 0xff) << 8 | (b & 0xff);
+      index[(((px >> 16) & 0xff) * 3 + ((px >> 8) & 0xff) * 5 +
+                (px & 0xff) * 7 + 255 * 11) %
+            64] = px;
+    }
+
+    if (px != (in->data[i] | 0xff000000)) return -1;
+  }
+
+  return 0;
+}
+
+static int
+check_file(const char* path, enum zippo_screenshot_format format,
+    const struct zippo_scale_image* in, size_t* size)
+{
+  FILE* file = fopen(path, "r");
+  struct stat st;
+  uint8_t* data;
+  int ret = -1;
+
+  if (file == NULL || fstat(fileno(file), &st) != 0) return -1;
+  *size = st.st_size;
+  data = malloc(st.st_size);
+  if (data && fread(data, 1, st.st_size, file) == (size_t)st.st_size)
+    ret = format == ZIPPO_SCREENSHOT_FORMAT_PNG
+              ? check_png(data, st.st_size, in)
+              : check_qoi(data, st.st_size, in);
+
+  free(data);
+  fclose(file);
+
+  return ret;
+}
+
+static int
+run(const struct zippo_scale_image* output,
+    enum zippo_screenshot_format format, int threads)
+{
+  const char* name = format == ZIPPO_SCREENSHOT_FORMAT_PNG ? "png" : "qoi";
+  char path[] = "/tmp/zippo-screenshot-XXXXXX";
+  struct zippo_screenshot_stats warmup, stats;
+  struct zippo_screenshooter* shooter;
+  struct result result = {0};
+  struct wl_event_loop* loop;
+  double start, stall, total;
+  size_t size = 0;
+  int fd, ret;
+
+  loop = wl_event_loop_create();
+  if (loop == NULL) return -1;
+  shooter = zippo_screenshooter_create(loop, threads);
+  fd = mkstemp(path);
+  if (shooter == NULL || fd < 0) return -1;
+
+  // a first one to /dev/null leaves a snapshot in the pool, the way a
+  // compositor that took screenshots before has one
+  if (zippo_screenshooter_capture(shooter, output, format,
+          open("/dev/null", O_WRONLY | O_CLOEXEC), handle_done, &result) != 0)
+    return -1;
+  while (!result.done) wl_event_loop_dispatch(loop, -1);
+  result.done = false;
+  zippo_screenshooter_get_stats(shooter, &warmup);
+
+  start = now();
+  if (zippo_screenshooter_capture(
+          shooter, output, format, fd, handle_done, &result) != 0)
+    return -1;
+  stall = now() - start;
+
+  while (!result.done) wl_event_loop_dispatch(loop, -1);
+  total = now() - start;
+
+  zippo_screenshooter_get_stats(shooter, &stats);
+  ret = result.ret == 0 ? check_file(path, format, output, &size) : -1;
+
+  fprintf(stdout,
+      "%s %2d threads: main loop %7.2f ms (copy %5.2f ms), done in %7.1f "
+      "ms, %6.0f MiB/s, %5.2f MiB %s\n",
+      name, threads, stall * 1e3, (stats.copy_ns - warmup.copy_ns) / 1e6,
+      total * 1e3,
+      (double)output->width * output->height * 4 / (1 << 20) / total,
+      size / (double)(1 << 20),
+      ret == 0 ? "PASS" : "FAIL: does not decode to the output");
+
+  unlink(path);
+  zippo_screenshooter_destroy(shooter);
+  wl_event_loop_destroy(loop);
+
+  return ret;
+}
+
+// usage: ./build/playground/screenshot_bench
+//
+// takes screenshots of a 4k desktop of windows full of text, as png and
+// qoi, encoded on the main loop and then on growing numbers of workers.
+// main loop is how long the capture call held the main loop, done in is
+// until the file was written. every file is decoded and compared with the
+// output.
+int
+main()
+{
+  struct zippo_renderer_rect full = {0, 0, WIDTH, HEIGHT};
+  struct zippo_scale_image images[4], output;
+  int threads[] = {0, 1, 4, (int)sysconf(_SC_NPROCESSORS_ONLN)};
+  struct zippo_renderer* renderer;
+  struct zippo_scene* scene;
+  int failures = 0;
+
+  scene = zippo_scene_create();
+  renderer = zippo_renderer_create("software");
+  if (scene == NULL || renderer == NULL) return EXIT_FAILURE;
+
+  srand(1);
+  images[0] = create_image(WIDTH, HEIGHT, 0x203040, false);
+  images[1] = create_image(1800, 1600, 0xf0f0f0, true);
+  images[2] = create_image(1600, 1200, 0xffffff, true);
+  images[3] = create_image(1400, 900, 0x304050, false);
+  output = create_image(WIDTH, HEIGHT, 0, false);
+
+  for (int i = 0; i < 4; i++) {
+    struct zippo_scene_view* view = zippo_scene_view_create(scene);
+
+    if (view == NULL) return EXIT_FAILURE;
+    zippo_scene_view_set_buffer(view, &images[i], true);
+    zippo_scene_view_set_position(view, i * 700, i * 300);
+  }
+  zippo_renderer_render(renderer, scene, 0, 0, &output, &full, 1);
+
+  for (int f = 0; f < 2; f++) {
+    for (size_t t = 0; t < sizeof threads / sizeof threads[0]; t++) {
+      if (run(&output, f ? ZIPPO_SCREENSHOT_FORMAT_QOI
+                         : ZIPPO_SCREENSHOT_FORMAT_PNG,
+              threads[t]) != 0)
+        failures++;
+    }
+  }
+
+  zippo_renderer_destroy(renderer);
+  zippo_scene_destroy(scene);
+  for (int i = 0; i < 4; i++) free(images[i].data);
+  free(output.data);
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,319 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "renderer.h"
+#include "seat.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define MAX_SEATS 16
+#define INPUTS_PER_SEAT 3  // keyboard, mouse, touchpad
+
+struct output {
+  struct zippo_seat* seat;
+  struct zippo_scene* scene;
+  struct zippo_scale_image wallpaper;
+  struct zippo_scale_image target;
+};
+
+static int
+write_file(const char* path, const char* content)
+{
+  FILE* file = fopen(path, "w");
+
+  if (file == NULL) {
+    fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  fputs(content, file);
+  fclose(file);
+
+  return 0;
+}
+
+static int
+make_dir(const char* path)
+{
+  if (mkdir(path, 0755) == 0 || errno == EEXIST) return 0;
+
+  fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+  return -1;
+}
+
+// a card and a few evdev devices per seat, tagged with ID_SEAT in the udev
+// database the way logind's seat assignment leaves them. seat0 has no tag.
+static int
+create_fixture(const char* root, int seats)
+{
+  char path[PATH_MAX], content[128], tag[64];
+  const char* dirs[] = {"sys", "sys/class", "sys/class/drm", "sys/class/input",
+      "run", "run/udev", "run/udev/data", "keymaps"};
+
+  for (size_t i = 0; i < sizeof dirs / sizeof dirs[0]; i++) {
+    snprintf(path, sizeof path, "%s/%s", root, dirs[i]);
+    if (make_dir(path) != 0) return -1;
+  }
+
+  for (int i = 0; i < seats; i++) {
+    snprintf(tag, sizeof tag, i > 0 ? "E:ID_SEAT=seat%d\n" : "", i);
+
+    snprintf(path, sizeof path, "%s/sys/class/drm/card%d", root, i);
+    if (make_dir(path) != 0) return -1;
+    snprintf(path, sizeof path, "%s/sys/class/drm/card%d/dev", root, i);
+    snprintf(content, sizeof content, "226:%d\n", i);
+    if (write_file(path, content) != 0) return -1;
+    snprintf(path, sizeof path, "%s/run/udev/data/c226:%d", root, i);
+    snprintf(content, sizeof content, "%sG:seat\n", tag);
+    if (write_file(path, content) != 0) return -1;
+
+    for (int j = 0; j < INPUTS_PER_SEAT; j++) {
+      int n = i * INPUTS_PER_SEAT + j;
+
+      snprintf(path, sizeof path, "%s/sys/class/input/event%d", root, n);
+      if (make_dir(path) != 0) return -1;
+      snprintf(path, sizeof path, "%s/sys/class/input/event%d/dev", root, n);
+      snprintf(content, sizeof content, "13:%d\n", 64 + n);
+      if (write_file(path, content) != 0) return -1;
+      snprintf(path, sizeof path, "%s/run/udev/data/c13:%d", root, 64 + n);
+      snprintf(content, sizeof content, "%sG:seat\n", tag);
+      if (write_file(path, content) != 0) return -1;
+    }
+  }
+
+  return 0;
+}
+
+static long
+pss_kib()
+{
+  FILE* file = fopen("/proc/self/smaps_rollup", "r");
+  char line[256];
+  long pss = -1;
+
+  if (file == NULL) return -1;
+  while (fgets(line, sizeof line, file)) {
+    if (sscanf(line, "Pss: %ld kB", &pss) == 1) break;
+  }
+  fclose(file);
+
+  return pss;
+}
+
+static int
+output_init(struct output* self, struct zippo_seat* seat,
+    struct zippo_renderer* renderer)
+{
+  struct zippo_renderer_rect full = {0, 0, WIDTH, HEIGHT};
+  struct zippo_scene_view* view;
+  size_t size = (size_t)WIDTH * HEIGHT * 4;
+
+  self->seat = seat;
+  self->scene = zippo_scene_create();
+  self->wallpaper = (struct zippo_scale_image){
+      malloc(size), WIDTH, HEIGHT, WIDTH * 4};
+  self->target = (struct zippo_scale_image){
+      malloc(size), WIDTH, HEIGHT, WIDTH * 4};
+  if (self->scene == NULL || self->wallpaper.data == NULL ||
+      self->target.data == NULL)
+    return -1;
+
+  memset(self->wallpaper.data, 0x40, size);
+  view = zippo_scene_view_create(self->scene);
+  if (view == NULL) return -1;
+  zippo_scene_view_set_buffer(view, &self->wallpaper, true);
+
+  return zippo_renderer_render(
+      renderer, self->scene, 0, 0, &self->target, &full, 1);
+}
+
+static void
+output_fini(struct output* self)
+{
+  if (self->scene) zippo_scene_destroy(self->scene);
+  free(self->wallpaper.data);
+  free(self->target.data);
+}
+
+// one compositor process: a renderer and keymap cache for the process, then
+// the seats it drives, every one with its devices, keymap and a drawn
+// output. reports its pss, then waits for stdin to close.
+static int
+run_compositor(const char* root, int only)
+{
+  char seats[MAX_SEATS][ZIPPO_GPU_PROBE_SEAT_MAX], path[PATH_MAX];
+  struct output outputs[MAX_SEATS] = {0};
+  const char* name = getenv("ZIPPO_RENDERER");
+  struct zippo_renderer* renderer;
+  struct zippo_keymap_cache* keymaps;
+  struct xkb_context* context;
+  int count, output_count = 0, inputs = 0;
+  char c;
+
+  renderer = zippo_renderer_create(name && *name ? name : "software");
+  context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+  if (renderer == NULL || context == NULL) return EXIT_FAILURE;
+
+  snprintf(path, sizeof path, "%s/keymaps", root);
+  keymaps = zippo_keymap_cache_create(context, path);
+  if (keymaps == NULL) return EXIT_FAILURE;
+
+  count = zippo_gpu_probe_seats(root, seats, MAX_SEATS);
+  for (int i = 0; i < count; i++) {
+    char syspath[PATH_MAX];
+    struct zippo_seat* seat;
+
+    if (only >= 0 && i != only) continue;
+
+    if (zippo_gpu_probe_sysfs(root, seats[i], syspath, sizeof syspath) != 0)
+      return EXIT_FAILURE;
+    seat = zippo_seat_create(root, seats[i], syspath, keymaps);
+    if (seat == NULL) return EXIT_FAILURE;
+    inputs += seat->input_count;
+
+    if (output_init(&outputs[output_count++], seat, renderer) != 0)
+      return EXIT_FAILURE;
+  }
+
+  fprintf(stdout, "%d %d %ld\n", output_count, inputs, pss_kib());
+  fflush(stdout);
+
+  // stay around while the others measure
+  while (read(STDIN_FILENO, &c, 1) > 0) continue;
+
+  for (int i = 0; i < output_count; i++) {
+    zippo_seat_destroy(outputs[i].seat);
+    output_fini(&outputs[i]);
+  }
+  zippo_keymap_cache_destroy(keymaps);
+  xkb_context_unref(context);
+  zippo_renderer_destroy(renderer);
+
+  return EXIT_SUCCESS;
+}
+
+struct child {
+  pid_t pid;
+  int in;
+  FILE* out;
+};
+
+static int
+spawn(struct child* child, const char* root, int only)
+{
+  char only_arg[16];
+  int in[2], out[2];
+
+  snprintf(only_arg, sizeof only_arg, "%d", only);
+  if (pipe2(in, O_CLOEXEC) < 0 || pipe2(out, O_CLOEXEC) < 0) return -1;
+
+  child->pid = fork();
+  if (child->pid < 0) return -1;
+
+  if (child->pid == 0) {
+    dup2(in[0], STDIN_FILENO);
+    dup2(out[1], STDOUT_FILENO);
+    execl("/proc/self/exe", "seat_bench", "--compositor", root, only_arg,
+        (char*)NULL);
+    _exit(EXIT_FAILURE);
+  }
+
+  close(in[0]);
+  close(out[1]);
+  child->in = in[1];
+  child->out = fdopen(out[0], "r");
+
+  return child->out ? 0 : -1;
+}
+
+// one process for all seats, or one per seat. seats, input devices and pss
+// of every process, summed.
+static int
+measure(const char* root, int children, int* seats, int* inputs, long* pss)
+{
+  struct child list[MAX_SEATS];
+  int ret = 0;
+
+  *seats = *inputs = 0;
+  *pss = 0;
+
+  for (int i = 0; i < children; i++) {
+    if (spawn(&list[i], root, children > 1 ? i : -1) != 0) return -1;
+  }
+
+  // all alive at once, so that what they share is split between them
+  for (int i = 0; i < children; i++) {
+    int s = 0, n = 0;
+    long kib = 0;
+
+    if (fscanf(list[i].out, "%d %d %ld", &s, &n, &kib) != 3) ret = -1;
+    *seats += s;
+    *inputs += n;
+    *pss += kib;
+  }
+
+  for (int i = 0; i < children; i++) {
+    close(list[i].in);
+    fclose(list[i].out);
+    waitpid(list[i].pid, NULL, 0);
+  }
+
+  return ret;
+}
+
+// usage: ./build/playground/seat_bench [seat count]
+//
+// memory of one process driving every seat against one process per seat,
+// on fake seats from a sysfs and udev database fixture. every seat draws a
+// 1080p output with the renderer from ZIPPO_RENDERER, software by default.
+int
+main(int argc, char const* argv[])
+{
+  char root[] = "/tmp/zippo-seats-XXXXXX";
+  char command[PATH_MAX + 16];
+  int count = argc > 1 ? atoi(argv[1]) : 4;
+  int seats, inputs;
+  long shared, separate;
+
+  if (argc > 3 && strcmp(argv[1], "--compositor") == 0)
+    return run_compositor(argv[2], atoi(argv[3]));
+
+  if (count < 1 || count > MAX_SEATS) count = 4;
+
+  if (mkdtemp(root) == NULL) {
+    fprintf(stderr, "Failed to create fixture: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  if (create_fixture(root, count) != 0) goto out;
+
+  // everything is compiled once up front, neither side pays for the rules
+  if (measure(root, 1, &seats, &inputs, &shared) != 0) goto out;
+
+  if (measure(root, 1, &seats, &inputs, &shared) != 0) goto out;
+  fprintf(stdout, "1 process:   %2d seats, %2d inputs, %8.1f MiB pss\n",
+      seats, inputs, shared / 1024.0);
+
+  if (measure(root, count, &seats, &inputs, &separate) != 0) goto out;
+  fprintf(stdout, "%d processes: %2d seats, %2d inputs, %8.1f MiB pss\n",
+      count, seats, inputs, separate / 1024.0);
+
+  fprintf(stdout, "saved %.1f MiB, %.1f MiB per extra seat\n",
+      (separate - shared) / 1024.0,
+      count > 1 ? (separate - shared) / 1024.0 / (count - 1) : 0);
+
+out:
+  snprintf(command, sizeof command, "rm -rf %s", root);
+  if (system(command) != 0) fprintf(stderr, "Failed to remove %s\n", root);
+
+  return EXIT_SUCCESS;
+}
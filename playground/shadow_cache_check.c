@@ -0,0 +1,216 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shadow_cache.h"
+
+#define WIDTH 64
+#define HEIGHT 48
+#define PADDED_STRIDE (WIDTH * 4 + 32)
+#define SIZE ((size_t)WIDTH * HEIGHT * 4)
+
+// the client buffers, the second one with a stride larger than its width
+static uint32_t pixels[HEIGHT * WIDTH];
+static uint32_t padded[HEIGHT * PADDED_STRIDE / 4];
+static uint32_t large[HEIGHT * 2 * WIDTH];
+
+// surface keys, only their addresses are used
+static int surfaces[4];
+
+static bool
+check(bool ok, const char* what)
+{
+  fprintf(stdout, "%s: %s\n", ok ? "PASS" : "FAIL", what);
+  return ok;
+}
+
+static void
+fill(uint32_t* data, int stride, uint32_t seed)
+{
+  for (int y = 0; y < HEIGHT; y++)
+    for (int x = 0; x < WIDTH; x++)
+      data[y * (stride / 4) + x] = seed ^ (uint32_t)(y << 16 | x);
+}
+
+// the copy has each pixel from new inside the rects and from old outside
+static bool
+matches(const uint32_t* copy, const uint32_t* old, const uint32_t* new,
+    int stride, const struct zippo_shadow_rect* rects, int count)
+{
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      const uint32_t* src = old;
+
+      for (int i = 0; i < count; i++) {
+        if (x >= rects[i].x && x < rects[i].x + rects[i].width &&
+            y >= rects[i].y && y < rects[i].y + rects[i].height)
+          src = new;
+      }
+
+      if (copy[y * WIDTH + x] != src[y * (stride / 4) + x]) return false;
+    }
+  }
+
+  return true;
+}
+
+static const uint32_t*
+get(struct zippo_shadow_cache* cache, const void* key)
+{
+  int width, height;
+
+  return zippo_shadow_cache_get(cache, key, &width, &height);
+}
+
+// a new surface gets a full copy, a cached one only its damage
+static bool
+check_damage(struct zippo_shadow_cache* cache)
+{
+  static uint32_t old[HEIGHT * PADDED_STRIDE / 4];
+  struct zippo_shadow_rect full = {0, 0, WIDTH, HEIGHT};
+  struct zippo_shadow_rect damage[] = {
+      {3, 5, 10, 7},
+      {WIDTH - 4, HEIGHT - 2, 20, 20},  // reaches past the bottom right
+  };
+  struct zippo_shadow_cache_stats stats;
+  const uint32_t* copy;
+  bool ok = true;
+  int width = 0, height = 0;
+
+  fill(pixels, WIDTH * 4, 0x11000000);
+  zippo_shadow_cache_upload(
+      cache, &surfaces[0], pixels, WIDTH, HEIGHT, WIDTH * 4, damage, 1);
+  zippo_shadow_cache_get_stats(cache, &stats);
+  copy = zippo_shadow_cache_get(cache, &surfaces[0], &width, &height);
+  ok &= check(stats.misses == 1 && stats.hits == 0 &&
+                  stats.bytes_copied == SIZE && stats.bytes_cached == SIZE,
+      "first upload is a miss and copies the whole buffer");
+  ok &= check(copy && width == WIDTH && height == HEIGHT &&
+                  matches(copy, pixels, pixels, WIDTH * 4, &full, 1),
+      "first upload ignores the damage");
+
+  memcpy(old, pixels, sizeof pixels);
+  fill(pixels, WIDTH * 4, 0x22000000);
+  zippo_shadow_cache_upload(
+      cache, &surfaces[0], pixels, WIDTH, HEIGHT, WIDTH * 4, damage, 2);
+  zippo_shadow_cache_get_stats(cache, &stats);
+  copy = get(cache, &surfaces[0]);
+  ok &= check(stats.misses == 1 && stats.hits == 1 &&
+                  stats.bytes_copied == SIZE + (10 * 7 + 4 * 2) * 4,
+      "same size upload is a hit and copies only the clipped damage");
+  ok &= check(copy && matches(copy, old, pixels, WIDTH * 4, damage, 2),
+      "pixels outside the damage keep the previous commit");
+
+  // the client attaches another buffer, with padding at the end of its rows
+  for (int y = 0; y < HEIGHT; y++)
+    memcpy(&padded[y * PADDED_STRIDE / 4], copy + y * WIDTH, WIDTH * 4);
+  memcpy(old, padded, sizeof padded);
+  fill(padded, PADDED_STRIDE, 0x33000000);
+  zippo_shadow_cache_upload(cache, &surfaces[0], padded, WIDTH, HEIGHT,
+      PADDED_STRIDE, damage, 1);
+  copy = get(cache, &surfaces[0]);
+  ok &= check(copy && matches(copy, old, padded, PADDED_STRIDE, damage, 1),
+      "damage is copied from a padded stride");
+
+  zippo_shadow_cache_upload(
+      cache, &surfaces[0], pixels, WIDTH / 2, HEIGHT, WIDTH * 4, damage, 1);
+  zippo_shadow_cache_get_stats(cache, &stats);
+  copy = zippo_shadow_cache_get(cache, &surfaces[0], &width, &height);
+  ok &= check(stats.misses == 2 && width == WIDTH / 2 &&
+                  stats.bytes_cached == SIZE / 2 && copy &&
+                  memcmp(copy, pixels, WIDTH * 2) == 0,
+      "resized upload is a miss and copies the whole buffer");
+
+  zippo_shadow_cache_remove(cache, &surfaces[0]);
+  zippo_shadow_cache_get_stats(cache, &stats);
+  ok &= check(get(cache, &surfaces[0]) == NULL && stats.bytes_cached == 0,
+      "remove drops the copy");
+
+  return ok;
+}
+
+// room for two surfaces, the least recently uploaded one goes first
+static bool
+check_eviction(struct zippo_shadow_cache* cache)
+{
+  struct zippo_shadow_cache_stats stats;
+  bool ok = true;
+
+  fill(pixels, WIDTH * 4, 0x44000000);
+  zippo_shadow_cache_set_budget(cache, SIZE * 2);
+
+  for (int i = 0; i < 3; i++)
+    zippo_shadow_cache_upload(
+        cache, &surfaces[i], pixels, WIDTH, HEIGHT, WIDTH * 4, NULL, 0);
+  zippo_shadow_cache_get_stats(cache, &stats);
+  ok &= check(stats.evictions == 1 && stats.bytes_cached == SIZE * 2 &&
+                  get(cache, &surfaces[0]) == NULL &&
+                  get(cache, &surfaces[1]) && get(cache, &surfaces[2]),
+      "a new surface over the budget evicts the oldest");
+
+  // a hit makes 1 the most recently used, 2 is the one to go now
+  zippo_shadow_cache_upload(
+      cache, &surfaces[1], pixels, WIDTH, HEIGHT, WIDTH * 4, NULL, 0);
+  zippo_shadow_cache_upload(
+      cache, &surfaces[3], pixels, WIDTH, HEIGHT, WIDTH * 4, NULL, 0);
+  zippo_shadow_cache_get_stats(cache, &stats);
+  ok &= check(stats.evictions == 2 && get(cache, &surfaces[1]) &&
+                  get(cache, &surfaces[2]) == NULL && get(cache, &surfaces[3]),
+      "a hit keeps a surface from being evicted next");
+
+  zippo_shadow_cache_set_budget(cache, SIZE);
+  zippo_shadow_cache_get_stats(cache, &stats);
+  ok &= check(stats.evictions == 3 && stats.bytes_cached == SIZE &&
+                  get(cache, &surfaces[1]) == NULL && get(cache, &surfaces[3]),
+      "a smaller budget evicts at once");
+
+  return ok;
+}
+
+// a buffer larger than the budget is left to the caller, and does not push
+// out the others on its way
+static bool
+check_oversize(struct zippo_shadow_cache* cache)
+{
+  struct zippo_shadow_cache_stats before, after;
+  bool ok = true;
+
+  zippo_shadow_cache_set_budget(cache, SIZE + SIZE / 2);
+  zippo_shadow_cache_get_stats(cache, &before);
+
+  ok &= check(zippo_shadow_cache_upload(cache, &surfaces[0], large, WIDTH,
+                  HEIGHT * 2, WIDTH * 4, NULL, 0) == 0,
+      "oversize upload succeeds");
+  zippo_shadow_cache_get_stats(cache, &after);
+  ok &= check(get(cache, &surfaces[0]) == NULL &&
+                  after.misses == before.misses + 1 &&
+                  after.bytes_copied == before.bytes_copied &&
+                  after.evictions == before.evictions &&
+                  get(cache, &surfaces[3]),
+      "oversize buffer is not cached and evicts nothing");
+
+  return ok;
+}
+
+// usage: ./build/playground/shadow_cache_check
+//
+// checks hits, misses, eviction and oversize buffers of the shadow cache,
+// exits nonzero if any of them fails
+int
+main()
+{
+  struct zippo_shadow_cache* cache;
+  bool ok = true;
+
+  cache = zippo_shadow_cache_create(ZIPPO_SHADOW_CACHE_DEFAULT_BUDGET);
+  if (cache == NULL) return EXIT_FAILURE;
+
+  ok &= check_damage(cache);
+  ok &= check_eviction(cache);
+  ok &= check_oversize(cache);
+
+  zippo_shadow_cache_destroy(cache);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
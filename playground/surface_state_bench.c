@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wayland-server-core.h>
+
+#include "surface_state.h"
+
+#define TREES 100
+#define TREE_SIZE 100  // a toplevel, 10 subsurfaces, 89 below those
+#define SURFACE_COUNT (TREES * TREE_SIZE)
+#define FRAMES 100
+
+// a surface the way one is usually kept, a struct of its states, linked to
+// its parent and children, its damage in rectangles of their own
+struct state {
+  void* buffer;
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  int32_t height;
+  struct wl_list damage;  // rect::link
+  uint32_t flags;
+};
+
+struct rect {
+  struct wl_list link;
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  int32_t height;
+};
+
+struct surface {
+  struct state pending;
+  struct state cached;
+  struct state current;
+
+  struct surface* parent;
+  struct wl_list children;  // surface::link, the top one first
+  struct wl_list link;
+  bool sync;
+};
+
+struct damage_sum {
+  uint64_t rects;
+  uint64_t area;
+};
+
+static char buffers[4];
+static uint64_t store_releases, list_releases;
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+handle_release(void* data, void* buffer)
+{
+  (void)buffer;
+  (*(uint64_t*)data)++;
+}
+
+static void
+init_state(struct state* state)
+{
+  *state = (struct state){0};
+  wl_list_init(&state->damage);
+}
+
+static void
+list_cache(struct surface* surface)
+{
+  struct state *pending = &surface->pending, *cached = &surface->cached;
+
+  if (pending->flags & ZIPPO_SURFACE_STATE_BUFFER) {
+    if (cached->flags & ZIPPO_SURFACE_STATE_BUFFER &&
+        cached->buffer != pending->buffer)
+      handle_release(&list_releases, cached->buffer);
+    cached->buffer = pending->buffer;
+    cached->width = pending->width;
+    cached->height = pending->height;
+    pending->buffer = NULL;
+  }
+  if (pending->flags & ZIPPO_SURFACE_STATE_POSITION) {
+    cached->x = pending->x;
+    cached->y = pending->y;
+  }
+  wl_list_insert_list(cached->damage.prev, &pending->damage);
+  wl_list_init(&pending->damage);
+
+  cached->flags |= pending->flags;
+  pending->flags = 0;
+}
+
+static bool
+list_is_synchronized(struct surface* surface)
+{
+  for (struct surface* s = surface; s->parent; s = s->parent) {
+    if (s->sync) return true;
+  }
+
+  return false;
+}
+
+static void
+list_apply(struct surface* surface)
+{
+  struct state *cached = &surface->cached, *current = &surface->current;
+  struct surface* child;
+
+  if (cached->flags & ZIPPO_SURFACE_STATE_BUFFER) {
+    if (current->buffer != NULL && current->buffer != cached->buffer)
+      handle_release(&list_releases, current->buffer);
+    current->buffer = cached->buffer;
+    current->width = cached->width;
+    current->height = cached->height;
+    cached->buffer = NULL;
+  }
+  if (cached->flags & ZIPPO_SURFACE_STATE_POSITION) {
+    current->x = cached->x;
+    current->y = cached->y;
+  }
+  wl_list_insert_list(current->damage.prev, &cached->damage);
+  wl_list_init(&cached->damage);
+
+  current->flags |= cached->flags;
+  cached->flags = 0;
+
+  wl_list_for_each(child, &surface->children, link)
+  {
+    if (list_is_synchronized(child)) list_apply(child);
+  }
+}
+
+static void
+list_commit(struct surface* surface)
+{
+  list_cache(surface);
+  if (!list_is_synchronized(surface)) list_apply(surface);
+}
+
+static void
+list_damage(struct surface* surface, int32_t x, int32_t y, int32_t width,
+    int32_t height)
+{
+  struct rect* rect = malloc(sizeof *rect);
+
+  if (rect == NULL) exit(EXIT_FAILURE);
+  *rect = (struct rect){.x = x, .y = y, .width = width, .height = height};
+  wl_list_insert(surface->pending.damage.prev, &rect->link);
+  surface->pending.flags |= ZIPPO_SURFACE_STATE_DAMAGE;
+}
+
+static void
+list_take_damage(struct surface* surface, struct damage_sum* sum)
+{
+  struct rect *rect, *tmp;
+
+  wl_list_for_each_safe(rect, tmp, &surface->current.damage, link)
+  {
+    sum->rects++;
+    sum->area += (uint64_t)rect->width * rect->height;
+    free(rect);
+  }
+  wl_list_init(&surface->current.damage);
+  surface->current.flags = 0;
+}
+
+static void
+add_damage(void* data, int32_t x, int32_t y, int32_t width, int32_t height)
+{
+  struct damage_sum* sum = data;
+
+  (void)x;
+  (void)y;
+  sum->rects++;
+  sum->area += (uint64_t)width * height;
+}
+
+// parent of the k-th surface of a tree, the toplevel is the first
+static int
+parent_of(int k)
+{
+  return (k - 1) / 10;
+}
+
+// what a client does in a frame, the same for both
+static void
+list_requests(struct surface* surface, int frame, int k)
+{
+  struct state* pending = &surface->pending;
+  int32_t size = 64 + k % 32;
+
+  pending->buffer = &buffers[(frame + k) % 4];
+  pending->width = size;
+  pending->height = size;
+  pending->flags |= ZIPPO_SURFACE_STATE_BUFFER;
+  if (k > 0) {
+    pending->x = frame % 50 + k;
+    pending->y = k * 3;
+    pending->flags |= ZIPPO_SURFACE_STATE_POSITION;
+  }
+  list_damage(surface, 0, 0, size, size / 2);
+  list_damage(surface, frame % size, size / 2, 8, 8);
+  list_commit(surface);
+}
+
+static int
+store_requests(struct zippo_surface_store* store, uint32_t id, int frame, int k)
+{
+  int32_t size = 64 + k % 32;
+
+  zippo_surface_store_attach(store, id, &buffers[(frame + k) % 4], size, size);
+  if (k > 0) zippo_surface_store_set_position(store, id, frame % 50 + k, k * 3);
+  if (zippo_surface_store_damage(store, id, 0, 0, size, size / 2) != 0 ||
+      zippo_surface_store_damage(store, id, frame % size, size / 2, 8, 8) != 0)
+    return -1;
+  zippo_surface_store_commit(store, id);
+
+  return 0;
+}
+
+// usage: ./build/playground/surface_state_bench
+//
+// 100 windows of 100 surfaces each. the subsurfaces are synchronized but for
+// every tenth, so there are desynchronized ones right below a toplevel,
+// below a synchronized parent and below a desynchronized one. every
+// frame each surface attaches a buffer, moves, damages twice and commits,
+// and every toplevel commit applies its tree. "structs" keeps a struct per
+// surface and applies a tree surface by surface, recursively, "store"
+// keeps them in zippo_surface_store. the surfaces are created in a random
+// order, as windows open and close. both have to end with the same current
+// state, damage and buffer releases.
+int
+main()
+{
+  static struct surface* surfaces[SURFACE_COUNT];
+  static uint32_t ids[SURFACE_COUNT];
+  static int order[SURFACE_COUNT];
+  struct damage_sum list_sum = {0}, store_sum = {0};
+  const struct zippo_surface_arrays* current;
+  struct zippo_surface_store_stats stats;
+  struct zippo_surface_store* store;
+  double start, list_commit_time = 0, store_commit_time = 0;
+  double list_take_time = 0, store_take_time = 0;
+  int failures = 0;
+
+  store = zippo_surface_store_create(handle_release, &store_releases);
+  if (store == NULL) return EXIT_FAILURE;
+
+  srand(1);
+  for (int i = 0; i < SURFACE_COUNT; i++) order[i] = i;
+  for (int i = SURFACE_COUNT - 1; i > 0; i--) {
+    int j = rand() % (i + 1), tmp = order[i];
+
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  for (int i = 0; i < SURFACE_COUNT; i++) {
+    struct surface* surface = calloc(1, sizeof *surface);
+
+    if (surface == NULL) return EXIT_FAILURE;
+    init_state(&surface->pending);
+    init_state(&surface->cached);
+    init_state(&surface->current);
+    wl_list_init(&surface->children);
+    wl_list_init(&surface->link);
+    surfaces[order[i]] = surface;
+
+    ids[order[i]] = zippo_surface_store_add(store);
+    if (ids[order[i]] == ZIPPO_SURFACE_NONE) return EXIT_FAILURE;
+  }
+
+  for (int t = 0; t < TREES; t++) {
+    for (int k = 1; k < TREE_SIZE; k++) {
+      int i = t * TREE_SIZE + k, p = t * TREE_SIZE + parent_of(k);
+
+      surfaces[i]->parent = surfaces[p];
+      surfaces[i]->sync = k % 10 != 5;
+      wl_list_insert(&surfaces[p]->children, &surfaces[i]->link);
+      zippo_surface_store_set_parent(store, ids[i], ids[p]);
+      zippo_surface_store_set_sync(store, ids[i], surfaces[i]->sync);
+    }
+  }
+
+  for (int frame = 0; frame < FRAMES; frame++) {
+    // subsurfaces before their toplevel
+    start = now();
+    for (int t = 0; t < TREES; t++) {
+      for (int k = TREE_SIZE - 1; k >= 0; k--)
+        list_requests(surfaces[t * TREE_SIZE + k], frame, k);
+    }
+    list_commit_time += now() - start;
+
+    start = now();
+    for (int t = 0; t < TREES; t++) {
+      for (int k = TREE_SIZE - 1; k >= 0; k--) {
+        if (store_requests(store, ids[t * TREE_SIZE + k], frame, k) != 0)
+          return EXIT_FAILURE;
+      }
+    }
+    store_commit_time += now() - start;
+
+    // the compare reads the current state after the last frame, the
+    // damage is taken as an output would after every other one
+    if (frame == FRAMES - 1) break;
+
+    start = now();
+    for (int i = 0; i < SURFACE_COUNT; i++)
+      list_take_damage(surfaces[i], &list_sum);
+    list_take_time += now() - start;
+
+    start = now();
+    for (int i = 0; i < SURFACE_COUNT; i++)
+      zippo_surface_store_take_damage(store, ids[i], add_damage, &store_sum);
+    store_take_time += now() - start;
+  }
+
+  current = zippo_surface_store_get_current(store);
+  for (int i = 0; i < SURFACE_COUNT; i++) {
+    struct state* state = &surfaces[i]->current;
+    uint32_t id = ids[i];
+
+    const struct zippo_surface_geometry* geometry = &current->geometry[id];
+
+    if (state->buffer != current->buffer[id] || state->x != geometry->x ||
+        state->y != geometry->y || state->width != geometry->width ||
+        state->height != geometry->height ||
+        state->flags != current->flags[id] ||
+        (uint32_t)wl_list_length(&state->damage) !=
+            current->damage[id].count) {
+      fprintf(stdout, "FAIL: surface %d differs\n", i);
+      failures++;
+      break;
+    }
+    list_take_damage(surfaces[i], &list_sum);
+    zippo_surface_store_take_damage(store, id, add_damage, &store_sum);
+  }
+  if (list_sum.rects != store_sum.rects || list_sum.area != store_sum.area) {
+    fprintf(stdout, "FAIL: damage differs\n");
+    failures++;
+  }
+  if (list_releases != store_releases) {
+    fprintf(stdout, "FAIL: %llu releases, %llu expected\n",
+        (unsigned long long)store_releases,
+        (unsigned long long)list_releases);
+    failures++;
+  }
+
+  zippo_surface_store_get_stats(store, &stats);
+  fprintf(stdout,
+      "structs %7.3f ms/frame, %6.2f M commits/s, damage taken in %6.3f "
+      "ms/frame\n",
+      list_commit_time * 1e3 / FRAMES,
+      SURFACE_COUNT * FRAMES / list_commit_time / 1e6,
+      list_take_time * 1e3 / (FRAMES - 1));
+  fprintf(stdout,
+      "store   %7.3f ms/frame, %6.2f M commits/s, damage taken in %6.3f "
+      "ms/frame\n",
+      store_commit_time * 1e3 / FRAMES,
+      SURFACE_COUNT * FRAMES / store_commit_time / 1e6,
+      store_take_time * 1e3 / (FRAMES - 1));
+  fprintf(stdout,
+      "%llu commits, %llu applied in %llu batches, %llu releases\n",
+      (unsigned long long)stats.commits, (unsigned long long)stats.applied,
+      (unsigned long long)stats.batches, (unsigned long long)store_releases);
+  if (failures == 0) fprintf(stdout, "PASS: same state, damage and releases\n");
+
+  for (int i = 0; i < SURFACE_COUNT; i++) free(surfaces[i]);
+  zippo_surface_store_destroy(store);
+
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wayland-server-protocol.h>
+
+#define CLIENTS 500
+#define FRAMES 300
+#define EVENTS_PER_FRAME 3  // frame done, pointer motion, buffer release
+#define EVENT_SIZE 12       // wl_callback.done, header and one argument
+
+struct bench_client {
+  struct wl_client* client;
+  struct wl_resource* callback;
+  int fd;  // the client's end of the socket
+};
+
+static uint64_t sendmsg_calls;
+
+// libwayland-server's calls end up here rather than in libc, so they can be
+// counted
+ssize_t
+sendmsg(int fd, const struct msghdr* msg, int flags)
+{
+  sendmsg_calls++;
+  return syscall(SYS_sendmsg, fd, msg, flags);
+}
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t
+drain(int fd)
+{
+  char buf[4096];
+  uint64_t total = 0;
+  ssize_t len;
+
+  while ((len = read(fd, buf, sizeof buf)) > 0) total += len;
+
+  return total;
+}
+
+static void
+run(const char* name, bool flush_per_event)
+{
+  struct bench_client clients[CLIENTS];
+  struct wl_display* display;
+  uint64_t calls, received = 0, expected, elapsed = 0, start;
+
+  display = wl_display_create();
+  if (display == NULL) exit(EXIT_FAILURE);
+
+  for (int i = 0; i < CLIENTS; i++) {
+    int fds[2];
+
+    if (socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0,
+            fds) < 0)
+      exit(EXIT_FAILURE);
+    if (i == CLIENTS - 1) {
+      // small socket buffers, so that it fills up within the run
+      int size = 4096;
+      setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof size);
+      setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+    }
+    clients[i].fd = fds[1];
+    clients[i].client = wl_client_create(display, fds[0]);
+    if (clients[i].client == NULL) exit(EXIT_FAILURE);
+    clients[i].callback =
+        wl_resource_create(clients[i].client, &wl_callback_interface, 1, 0);
+    if (clients[i].callback == NULL) exit(EXIT_FAILURE);
+  }
+
+  calls = sendmsg_calls;
+  for (int frame = 0; frame < FRAMES; frame++) {
+    start = now_ns();
+    // each kind of event goes out to every client in turn, the way the
+    // output and the seat would send them
+    for (int e = 0; e < EVENTS_PER_FRAME; e++) {
+      for (int i = 0; i < CLIENTS; i++) {
+        wl_callback_send_done(clients[i].callback, frame);
+        if (flush_per_event) wl_client_flush(clients[i].client);
+      }
+    }
+    if (!flush_per_event) wl_display_flush_clients(display);
+    elapsed += now_ns() - start;
+
+    // the last client never reads, its socket fills up and the rest must
+    // not notice
+    for (int i = 0; i < CLIENTS - 1; i++) received += drain(clients[i].fd);
+  }
+  calls = sendmsg_calls - calls;
+  expected = (uint64_t)(CLIENTS - 1) * FRAMES * EVENTS_PER_FRAME * EVENT_SIZE;
+
+  fprintf(stdout,
+      "%-14s %8.1f sendmsg/frame %8.1f us/frame, %" PRIu64 " of %" PRIu64
+      " bytes delivered\n",
+      name, (double)calls / FRAMES, elapsed / 1e3 / FRAMES, received,
+      expected);
+
+  wl_display_destroy_clients(display);
+  wl_display_destroy(display);
+  for (int i = 0; i < CLIENTS; i++) close(clients[i].fd);
+}
+
+// usage: ./build/playground/wire_flush_bench
+//
+// cost of getting a frame's worth of small events out to 500 clients,
+// flushing after every event or once per loop iteration as the compositor
+// does.
+int
+main()
+{
+  struct rlimit limit;
+
+  // two fds per client
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  run("per event", true);
+  run("per iteration", false);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,278 @@
+#include "client_quota.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "loop_monitor.h"
+
+struct zippo_client_account {
+  struct zippo_client_quota* quota;
+  struct wl_client* client;  // NULL once gone, until everything is released
+  struct wl_listener client_destroy;
+  struct wl_list link;
+
+  uint64_t usage[ZIPPO_CLIENT_RESOURCE_COUNT];
+  uint64_t total;
+  uint64_t peak;
+  bool pressured;
+  struct wl_event_source* disconnect_source;
+};
+
+struct zippo_client_quota {
+  struct wl_display* display;
+  struct zippo_client_limits limits;
+  zippo_client_pressure_func_t pressure;
+  void* data;
+
+  struct wl_listener client_created;
+  struct wl_list accounts;
+
+  // sums over all clients
+  uint64_t usage[ZIPPO_CLIENT_RESOURCE_COUNT];
+  uint64_t pressure_count;
+  uint64_t disconnect_count;
+};
+
+static const char* resource_names[ZIPPO_CLIENT_RESOURCE_COUNT] = {
+    [ZIPPO_CLIENT_SHM] = "shm",
+    [ZIPPO_CLIENT_TEXTURE] = "texture",
+    [ZIPPO_CLIENT_EVENTS] = "events",
+};
+
+static void
+zippo_client_account_free(struct zippo_client_account* self)
+{
+  if (self->disconnect_source) {
+    zippo_loop_source_remove(wl_display_get_event_loop(self->quota->display),
+        self->disconnect_source);
+  }
+  wl_list_remove(&self->client_destroy.link);
+  wl_list_remove(&self->link);
+  free(self);
+}
+
+static void
+handle_client_destroy(struct wl_listener* listener, void* data)
+{
+  struct zippo_client_account* self =
+      wl_container_of(listener, self, client_destroy);
+  (void)data;
+
+  // resources are destroyed after the destroy listeners have run, keep the
+  // account until they have released what they charged
+  wl_list_remove(&self->client_destroy.link);
+  wl_list_init(&self->client_destroy.link);
+  if (self->disconnect_source) {
+    zippo_loop_source_remove(wl_display_get_event_loop(self->quota->display),
+        self->disconnect_source);
+  }
+  self->disconnect_source = NULL;
+  self->client = NULL;
+
+  if (self->total == 0) zippo_client_account_free(self);
+}
+
+static struct zippo_client_account*
+zippo_client_account_create(
+    struct zippo_client_quota* quota, struct wl_client* client)
+{
+  struct zippo_client_account* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->quota = quota;
+  self->client = client;
+  self->client_destroy.notify = handle_client_destroy;
+  wl_client_add_destroy_listener(client, &self->client_destroy);
+  wl_list_insert(&quota->accounts, &self->link);
+
+  return self;
+}
+
+static void
+handle_disconnect(void* data)
+{
+  struct zippo_client_account* self = data;
+
+  self->disconnect_source = NULL;  // idle sources go away once dispatched
+  wl_client_destroy(self->client);
+}
+
+static void
+zippo_client_account_disconnect(struct zippo_client_account* self)
+{
+  struct zippo_client_quota* quota = self->quota;
+  pid_t pid;
+
+  if (self->disconnect_source) return;
+
+  wl_client_get_credentials(self->client, &pid, NULL, NULL);
+  fprintf(stderr, "Client %d is over its memory limit, disconnecting\n",
+      (int)pid);
+
+  // the client may be in the middle of a request, destroy it from a clean
+  // stack
+  wl_client_post_no_memory(self->client);
+  self->disconnect_source =
+      zippo_loop_add_idle(wl_display_get_event_loop(quota->display),
+          handle_disconnect, self, "client disconnect");
+  quota->disconnect_count++;
+}
+
+struct zippo_client_account*
+zippo_client_quota_get_account(
+    struct zippo_client_quota* self, struct wl_client* client)
+{
+  struct wl_listener* listener;
+  struct zippo_client_account* account;
+
+  listener = wl_client_get_destroy_listener(client, handle_client_destroy);
+  if (listener) return wl_container_of(listener, account, client_destroy);
+
+  return zippo_client_account_create(self, client);
+}
+
+int
+zippo_client_account_charge(struct zippo_client_account* self,
+    enum zippo_client_resource resource, uint64_t bytes)
+{
+  struct zippo_client_quota* quota = self->quota;
+  uint64_t total = self->total + bytes;
+
+  if (self->client == NULL || self->disconnect_source) return -1;
+
+  if (quota->limits.hard && total > quota->limits.hard) {
+    zippo_client_account_disconnect(self);
+    return -1;
+  }
+
+  self->usage[resource] += bytes;
+  self->total = total;
+  if (total > self->peak) self->peak = total;
+  quota->usage[resource] += bytes;
+
+  if (quota->limits.soft && total > quota->limits.soft && !self->pressured) {
+    self->pressured = true;
+    quota->pressure_count++;
+    if (quota->pressure) quota->pressure(quota->data, self->client);
+  }
+
+  return 0;
+}
+
+void
+zippo_client_account_release(struct zippo_client_account* self,
+    enum zippo_client_resource resource, uint64_t bytes)
+{
+  struct zippo_client_quota* quota = self->quota;
+  uint64_t soft = quota->limits.soft;
+
+  self->usage[resource] -= bytes;
+  self->total -= bytes;
+  quota->usage[resource] -= bytes;
+
+  // hysteresis, so that a client hovering at the limit is not asked to
+  // release on every buffer
+  if (self->pressured && self->total < soft - soft / 4)
+    self->pressured = false;
+
+  if (self->client == NULL && self->total == 0)
+    zippo_client_account_free(self);
+}
+
+uint64_t
+zippo_client_account_get_usage(struct zippo_client_account* self)
+{
+  return self->total;
+}
+
+void
+zippo_client_quota_write_metrics(void* data, FILE* out)
+{
+  struct zippo_client_quota* self = data;
+  struct zippo_client_account* account;
+  int clients = 0;
+
+  wl_list_for_each(account, &self->accounts, link)
+  {
+    pid_t pid;
+
+    if (account->client == NULL) continue;
+    clients++;
+
+    wl_client_get_credentials(account->client, &pid, NULL, NULL);
+    for (int i = 0; i < ZIPPO_CLIENT_RESOURCE_COUNT; i++) {
+      fprintf(out, "client_bytes{pid=\"%d\",resource=\"%s\"} %" PRIu64 "\n",
+          (int)pid, resource_names[i], account->usage[i]);
+    }
+    fprintf(out, "client_peak_bytes{pid=\"%d\"} %" PRIu64 "\n", (int)pid,
+        account->peak);
+  }
+
+  fprintf(out, "clients %d\n", clients);
+  for (int i = 0; i < ZIPPO_CLIENT_RESOURCE_COUNT; i++) {
+    fprintf(out, "clients_bytes{resource=\"%s\"} %" PRIu64 "\n",
+        resource_names[i], self->usage[i]);
+  }
+  fprintf(out, "client_soft_limit_bytes %" PRIu64 "\n", self->limits.soft);
+  fprintf(out, "client_hard_limit_bytes %" PRIu64 "\n", self->limits.hard);
+  fprintf(out, "client_pressure_total %" PRIu64 "\n", self->pressure_count);
+  fprintf(
+      out, "client_disconnect_total %" PRIu64 "\n", self->disconnect_count);
+}
+
+static void
+handle_client_created(struct wl_listener* listener, void* data)
+{
+  struct zippo_client_quota* self =
+      wl_container_of(listener, self, client_created);
+  struct wl_client* client = data;
+
+  // on failure, zippo_client_quota_get_account() tries again
+  zippo_client_account_create(self, client);
+}
+
+struct zippo_client_quota*
+zippo_client_quota_create(struct wl_display* display,
+    const struct zippo_client_limits* limits,
+    zippo_client_pressure_func_t pressure, void* data)
+{
+  struct zippo_client_quota* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->display = display;
+  self->limits = *limits;
+  self->pressure = pressure;
+  self->data = data;
+  wl_list_init(&self->accounts);
+
+  self->client_created.notify = handle_client_created;
+  wl_display_add_client_created_listener(display, &self->client_created);
+
+  return self;
+}
+
+void
+zippo_client_quota_destroy(struct zippo_client_quota* self)
+{
+  struct zippo_client_account *account, *tmp;
+
+  wl_list_for_each_safe(account, tmp, &self->accounts, link)
+  {
+    zippo_client_account_free(account);
+  }
+
+  wl_list_remove(&self->client_created.link);
+  free(self);
+}
@@ -0,0 +1,69 @@
+#ifndef ZIPPO_CLIENT_QUOTA_H
+#define ZIPPO_CLIENT_QUOTA_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+
+// memory a client makes the compositor hold on its behalf
+enum zippo_client_resource {
+  ZIPPO_CLIENT_SHM,      // mapped wl_shm pools
+  ZIPPO_CLIENT_TEXTURE,  // renderer textures of its buffers
+  ZIPPO_CLIENT_EVENTS,   // events queued for it
+  ZIPPO_CLIENT_RESOURCE_COUNT,
+};
+
+// limits on the sum of all resources of one client, 0 for none
+struct zippo_client_limits {
+  uint64_t soft;
+  uint64_t hard;
+};
+
+#define ZIPPO_CLIENT_DEFAULT_SOFT_LIMIT (512ull << 20)
+#define ZIPPO_CLIENT_DEFAULT_HARD_LIMIT (1024ull << 20)
+
+/**
+ * Called once when a client goes over the soft limit, again only after it
+ * has dropped well below it. Release what is held for the client, e.g.
+ * send wl_buffer.release for buffers already copied, so that it can free
+ * them.
+ */
+typedef void (*zippo_client_pressure_func_t)(
+    void* data, struct wl_client* client);
+
+// usage of one client, kept up to date by whoever maps or allocates memory
+// for it
+struct zippo_client_account;
+
+struct zippo_client_quota;
+
+/**
+ * Only walks the client's destroy listeners, look the account up once
+ * when a resource is created and keep it.
+ */
+struct zippo_client_account* zippo_client_quota_get_account(
+    struct zippo_client_quota* self, struct wl_client* client);
+
+/**
+ * @return 0 on success, -1 when this would take the client past the hard
+ * limit. Nothing is charged then, the caller fails the operation and the
+ * client is disconnected with a no_memory error.
+ */
+int zippo_client_account_charge(struct zippo_client_account* self,
+    enum zippo_client_resource resource, uint64_t bytes);
+
+void zippo_client_account_release(struct zippo_client_account* self,
+    enum zippo_client_resource resource, uint64_t bytes);
+
+uint64_t zippo_client_account_get_usage(struct zippo_client_account* self);
+
+// zippo_metrics_func_t
+void zippo_client_quota_write_metrics(void* data, FILE* out);
+
+struct zippo_client_quota* zippo_client_quota_create(
+    struct wl_display* display, const struct zippo_client_limits* limits,
+    zippo_client_pressure_func_t pressure, void* data);
+
+void zippo_client_quota_destroy(struct zippo_client_quota* self);
+
+#endif  //  ZIPPO_CLIENT_QUOTA_H
@@ -0,0 +1,421 @@
+#define _GNU_SOURCE
+
+#include "color_lut.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// LUT nodes hold 8bit values with VALUE_BITS fractional bits, tetrahedral
+// weights are Q14 and sum up to exactly 1 << WEIGHT_BITS. both fit in int16
+// so a pair of vertices can be blended with one _mm_madd_epi16.
+#define VALUE_BITS 6
+#define WEIGHT_BITS 14
+
+#define ZIPPO_COLOR_LUT_MAX_SIZE 129
+
+// position of an 8bit input on one axis of the 3D grid
+struct zippo_color_lut_coord {
+  uint16_t index;  // <= size - 2
+  uint16_t frac;   // Q14, 0 to 1 << WEIGHT_BITS inclusive
+};
+
+struct zippo_color_lut {
+  int ref;
+  int size;
+  // shaper folded into per channel tables indexed by the input byte
+  struct zippo_color_lut_coord red[256], green[256], blue[256];
+  // size^3 nodes of {B, G, R, 0}, the byte order of ARGB8888 in memory
+  int16_t (*nodes)[4];
+};
+
+struct zippo_color_lut_cache_entry {
+  char* path;
+  struct zippo_color_lut* lut;
+};
+
+struct zippo_color_lut_cache {
+  struct zippo_color_lut_cache_entry* entries;
+  int count;
+};
+
+static float
+shaper_eval(const float* shaper, int size, int channel, float x)
+{
+  float pos = x * (size - 1), frac;
+  int i = (int)pos;
+
+  if (i >= size - 1) return shaper[(size - 1) * 3 + channel];
+
+  frac = pos - i;
+  return shaper[i * 3 + channel] * (1 - frac) +
+         shaper[(i + 1) * 3 + channel] * frac;
+}
+
+static void
+build_coords(struct zippo_color_lut_coord* coords, const float* shaper,
+    int shaper_size, int channel, int size)
+{
+  for (int v = 0; v < 256; v++) {
+    float x = v / 255.0f, pos;
+    int index;
+
+    if (shaper) x = shaper_eval(shaper, shaper_size, channel, x);
+    if (x < 0) x = 0;
+    if (x > 1) x = 1;
+
+    pos = x * (size - 1);
+    index = (int)pos;
+    if (index > size - 2) index = size - 2;
+
+    coords[v].index = index;
+    coords[v].frac = (uint16_t)lroundf((pos - index) * (1 << WEIGHT_BITS));
+  }
+}
+
+struct zippo_color_lut*
+zippo_color_lut_create(
+    const float* shaper, int shaper_size, const float* lut, int lut_size)
+{
+  struct zippo_color_lut* self;
+  int count;
+
+  if (lut_size < 2 || lut_size > ZIPPO_COLOR_LUT_MAX_SIZE ||
+      (shaper && shaper_size < 2)) {
+    fprintf(stderr, "Invalid color LUT size\n");
+    return NULL;
+  }
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) goto err;
+
+  count = lut_size * lut_size * lut_size;
+  self->nodes = calloc(count, sizeof *self->nodes);
+  if (self->nodes == NULL) goto err_nodes;
+
+  self->ref = 1;
+  self->size = lut_size;
+
+  build_coords(self->red, shaper, shaper_size, 0, lut_size);
+  build_coords(self->green, shaper, shaper_size, 1, lut_size);
+  build_coords(self->blue, shaper, shaper_size, 2, lut_size);
+
+  for (int i = 0; i < count; i++) {
+    for (int c = 0; c < 3; c++) {
+      float value = lut[i * 3 + c];
+      if (value < 0) value = 0;
+      if (value > 1) value = 1;
+      // .cube is RGB, nodes are BGR
+      self->nodes[i][2 - c] =
+          (int16_t)lroundf(value * (255 << VALUE_BITS));
+    }
+  }
+
+  return self;
+
+err_nodes:
+  free(self);
+
+err:
+  fprintf(stderr, "Failed to allocate memory\n");
+  return NULL;
+}
+
+static bool
+parse_triplet(const char* line, float* out)
+{
+  return sscanf(line, "%f %f %f", &out[0], &out[1], &out[2]) == 3;
+}
+
+struct zippo_color_lut*
+zippo_color_lut_load(const char* path)
+{
+  struct zippo_color_lut* self = NULL;
+  FILE* file;
+  char* line = NULL;
+  size_t line_len = 0;
+  float domain_min[3] = {0, 0, 0}, domain_max[3] = {1, 1, 1};
+  float *shaper = NULL, *lut = NULL;
+  int shaper_size = 0, lut_size = 0, shaper_count = 0, lut_count = 0;
+
+  file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  while (getline(&line, &line_len, file) != -1) {
+    char* p = line + strspn(line, " \t");
+
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+    if (strncmp(p, "TITLE", 5) == 0) continue;
+
+    if (strncmp(p, "DOMAIN_MIN", 10) == 0) {
+      if (!parse_triplet(p + 10, domain_min)) goto err_parse;
+      continue;
+    }
+
+    if (strncmp(p, "DOMAIN_MAX", 10) == 0) {
+      if (!parse_triplet(p + 10, domain_max)) goto err_parse;
+      continue;
+    }
+
+    if (strncmp(p, "LUT_1D_SIZE", 11) == 0) {
+      if (shaper || lut) goto err_parse;
+      shaper_size = atoi(p + 11);
+      if (shaper_size < 2 || shaper_size > 65536) goto err_parse;
+      shaper = calloc(shaper_size * 3, sizeof *shaper);
+      if (shaper == NULL) goto err_parse;
+      continue;
+    }
+
+    if (strncmp(p, "LUT_3D_SIZE", 11) == 0) {
+      if (lut) goto err_parse;
+      lut_size = atoi(p + 11);
+      if (lut_size < 2 || lut_size > ZIPPO_COLOR_LUT_MAX_SIZE) goto err_parse;
+      lut = calloc(lut_size * lut_size * lut_size * 3, sizeof *lut);
+      if (lut == NULL) goto err_parse;
+      continue;
+    }
+
+    if (shaper && shaper_count < shaper_size) {
+      if (!parse_triplet(p, &shaper[shaper_count * 3])) goto err_parse;
+      shaper_count++;
+    } else if (lut && lut_count < lut_size * lut_size * lut_size) {
+      if (!parse_triplet(p, &lut[lut_count * 3])) goto err_parse;
+      lut_count++;
+    } else {
+      goto err_parse;
+    }
+  }
+
+  if (lut == NULL || lut_count != lut_size * lut_size * lut_size ||
+      shaper_count != shaper_size)
+    goto err_parse;
+
+  // fold the domain into the shaper so the 3D lookup stays in [0, 1]
+  if (domain_min[0] != 0 || domain_min[1] != 0 || domain_min[2] != 0 ||
+      domain_max[0] != 1 || domain_max[1] != 1 || domain_max[2] != 1) {
+    if (shaper == NULL) {
+      shaper_size = 2;
+      shaper = calloc(2 * 3, sizeof *shaper);
+      if (shaper == NULL) goto err_parse;
+      for (int c = 0; c < 3; c++) shaper[3 + c] = 1;
+    }
+    for (int i = 0; i < shaper_size * 3; i++) {
+      float range = domain_max[i % 3] - domain_min[i % 3];
+      if (range <= 0) goto err_parse;
+      shaper[i] = (shaper[i] - domain_min[i % 3]) / range;
+    }
+  }
+
+  self = zippo_color_lut_create(shaper, shaper_size, lut, lut_size);
+  goto out;
+
+err_parse:
+  fprintf(stderr, "Failed to parse color LUT %s\n", path);
+
+out:
+  free(line);
+  free(shaper);
+  free(lut);
+  fclose(file);
+
+  return self;
+}
+
+struct zippo_color_lut*
+zippo_color_lut_ref(struct zippo_color_lut* self)
+{
+  self->ref++;
+  return self;
+}
+
+void
+zippo_color_lut_unref(struct zippo_color_lut* self)
+{
+  if (--self->ref > 0) return;
+
+  free(self->nodes);
+  free(self);
+}
+
+// channels (0 r, 1 g, 2 b) sorted by descending fraction, indexed by
+// (fr >= fg) << 2 | (fg >= fb) << 1 | (fr >= fb). codes 1 and 6 cannot occur.
+static const uint8_t tetrahedron_order[8][3] = {
+    {2, 1, 0},  // b g r
+    {0, 1, 2},
+    {1, 2, 0},  // g b r
+    {1, 0, 2},  // g r b
+    {2, 0, 1},  // b r g
+    {0, 2, 1},  // r b g
+    {0, 1, 2},
+    {0, 1, 2},  // r g b
+};
+
+// pick the tetrahedron containing the point and return the offsets of its
+// two inner vertices from the base node along with the four weights. this is
+// done with a table rather than branches, which mispredict on noisy content.
+static inline void
+tetrahedron(int size, int fr, int fg, int fb, int* v1, int* v2, int16_t* w)
+{
+  const int frac[3] = {fr, fg, fb};
+  const int unit[3] = {1, size, size * size};
+  const uint8_t* order =
+      tetrahedron_order[(fr >= fg) << 2 | (fg >= fb) << 1 | (fr >= fb)];
+  int max = frac[order[0]], mid = frac[order[1]], min = frac[order[2]];
+
+  *v1 = unit[order[0]];
+  *v2 = unit[order[0]] + unit[order[1]];
+  w[0] = (1 << WEIGHT_BITS) - max;
+  w[1] = max - mid;
+  w[2] = mid - min;
+  w[3] = min;
+}
+
+static void
+apply_row(struct zippo_color_lut* self, uint32_t* row, int width)
+{
+  const int size = self->size, diagonal = 1 + size + size * size;
+  const int shift = WEIGHT_BITS + VALUE_BITS;
+  uint32_t last = UINT32_MAX, last_out = 0;  // no RGB matches the alpha bits
+
+#ifdef __SSE2__
+  const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+#endif
+
+  for (int x = 0; x < width; x++) {
+    uint32_t pixel = row[x], out;
+    const struct zippo_color_lut_coord *cr, *cg, *cb;
+    const int16_t* base;
+    int v1, v2;
+    int16_t w[4];
+
+    // flat areas of the desktop repeat one color along the row, noise is
+    // what costs the full lookup for every pixel
+    if ((pixel & 0x00ffffff) == last) {
+      row[x] = last_out | (pixel & 0xff000000);
+      continue;
+    }
+
+    cr = &self->red[(pixel >> 16) & 0xff];
+    cg = &self->green[(pixel >> 8) & 0xff];
+    cb = &self->blue[pixel & 0xff];
+    base = self->nodes[(cb->index * size + cg->index) * size + cr->index];
+    tetrahedron(size, cr->frac, cg->frac, cb->frac, &v1, &v2, w);
+
+#ifdef __SSE2__
+    {
+      // c0 c1 interleaved per channel with w0 w1, c2 c3 with w2 w3
+      __m128i c0 = _mm_loadl_epi64((const void*)base);
+      __m128i c1 = _mm_loadl_epi64((const void*)(base + v1 * 4));
+      __m128i c2 = _mm_loadl_epi64((const void*)(base + v2 * 4));
+      __m128i c3 = _mm_loadl_epi64((const void*)(base + diagonal * 4));
+      __m128i w01 = _mm_set1_epi32(
+          (int)((uint16_t)w[0] | ((uint32_t)(uint16_t)w[1] << 16)));
+      __m128i w23 = _mm_set1_epi32(
+          (int)((uint16_t)w[2] | ((uint32_t)(uint16_t)w[3] << 16)));
+      __m128i acc = _mm_add_epi32(
+          _mm_madd_epi16(_mm_unpacklo_epi16(c0, c1), w01),
+          _mm_madd_epi16(_mm_unpacklo_epi16(c2, c3), w23));
+
+      acc = _mm_srai_epi32(_mm_add_epi32(acc, round), shift);
+      acc = _mm_packs_epi32(acc, acc);
+      acc = _mm_packus_epi16(acc, acc);
+      out = (uint32_t)_mm_cvtsi128_si32(acc) & 0x00ffffff;
+    }
+#else
+    {
+      const int16_t* c1 = base + v1 * 4;
+      const int16_t* c2 = base + v2 * 4;
+      const int16_t* c3 = base + diagonal * 4;
+      out = 0;
+
+      for (int c = 0; c < 3; c++) {
+        int32_t acc = base[c] * w[0] + c1[c] * w[1] + c2[c] * w[2] +
+                      c3[c] * w[3];
+        acc = (acc + (1 << (shift - 1))) >> shift;
+        out |= (uint32_t)(acc > 255 ? 255 : acc) << (c * 8);
+      }
+    }
+#endif
+
+    last = pixel & 0x00ffffff;
+    last_out = out;
+    row[x] = out | (pixel & 0xff000000);
+  }
+}
+
+void
+zippo_color_lut_apply(struct zippo_color_lut* self, uint32_t* data,
+    int stride, int x, int y, int width, int height)
+{
+  for (int j = y; j < y + height; j++) {
+    uint32_t* row = (uint32_t*)((uint8_t*)data + j * stride);
+    apply_row(self, row + x, width);
+  }
+}
+
+struct zippo_color_lut*
+zippo_color_lut_cache_get(struct zippo_color_lut_cache* self, const char* path)
+{
+  struct zippo_color_lut_cache_entry* entries;
+  struct zippo_color_lut* lut;
+  char* key;
+
+  for (int i = 0; i < self->count; i++)
+    if (strcmp(self->entries[i].path, path) == 0)
+      return zippo_color_lut_ref(self->entries[i].lut);
+
+  lut = zippo_color_lut_load(path);
+  if (lut == NULL) return NULL;
+
+  key = strdup(path);
+  entries = realloc(self->entries, (self->count + 1) * sizeof *entries);
+  if (key == NULL || entries == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    free(key);
+    if (entries) self->entries = entries;
+    return lut;  // usable, just not cached
+  }
+
+  self->entries = entries;
+  self->entries[self->count].path = key;
+  self->entries[self->count].lut = lut;
+  self->count++;
+
+  return zippo_color_lut_ref(lut);
+}
+
+struct zippo_color_lut_cache*
+zippo_color_lut_cache_create()
+{
+  struct zippo_color_lut_cache* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  return self;
+}
+
+void
+zippo_color_lut_cache_destroy(struct zippo_color_lut_cache* self)
+{
+  for (int i = 0; i < self->count; i++) {
+    free(self->entries[i].path);
+    zippo_color_lut_unref(self->entries[i].lut);
+  }
+  free(self->entries);
+  free(self);
+}
@@ -0,0 +1,51 @@
+#ifndef ZIPPO_COLOR_LUT_H
+#define ZIPPO_COLOR_LUT_H
+
+#include <stdint.h>
+
+// 1D shaper + 3D LUT color transform for ARGB8888, used for per output
+// calibration in the software path by zippo_mirror_target_set_color_lut().
+// alpha is passed through.
+struct zippo_color_lut;
+
+/**
+ * Build a transform from float tables in [0, 1].
+ *
+ * @param shaper shaper_size RGB triplets applied per channel before the 3D
+ * LUT, or NULL for none
+ * @param lut lut_size^3 RGB triplets, red changing fastest (.cube order)
+ */
+struct zippo_color_lut* zippo_color_lut_create(const float* shaper,
+    int shaper_size, const float* lut, int lut_size);
+
+/**
+ * Load an Adobe/Resolve .cube file. An optional LUT_1D_SIZE section is used
+ * as the shaper and must precede the LUT_3D_SIZE data.
+ */
+struct zippo_color_lut* zippo_color_lut_load(const char* path);
+
+struct zippo_color_lut* zippo_color_lut_ref(struct zippo_color_lut* self);
+
+void zippo_color_lut_unref(struct zippo_color_lut* self);
+
+/**
+ * Transform the pixels inside the rectangle in place. Call it for each
+ * damaged rectangle of the composited output.
+ */
+void zippo_color_lut_apply(struct zippo_color_lut* self, uint32_t* data,
+    int stride, int x, int y, int width, int height);
+
+// loaded transforms by profile path, shared by outputs with the same profile
+struct zippo_color_lut_cache;
+
+/**
+ * @return a new reference, or NULL if the profile cannot be loaded
+ */
+struct zippo_color_lut* zippo_color_lut_cache_get(
+    struct zippo_color_lut_cache* self, const char* path);
+
+struct zippo_color_lut_cache* zippo_color_lut_cache_create();
+
+void zippo_color_lut_cache_destroy(struct zippo_color_lut_cache* self);
+
+#endif  //  ZIPPO_COLOR_LUT_H
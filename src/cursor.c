@@ -0,0 +1,256 @@
+#include "cursor.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct rect {
+  int x1;
+  int y1;
+  int x2;
+  int y2;
+};
+
+struct zippo_cursor_layer {
+  uint32_t* image;  // packed, width * height
+  int width;
+  int height;
+  int hotspot_x;
+  int hotspot_y;
+
+  bool visible;
+  int x;  // hotspot in target coordinates
+  int y;
+
+  // target pixels under the cursor, packed like image. only the part of the
+  // cursor inside the target at the last draw is valid.
+  uint32_t* saved;
+  struct rect drawn;  // clipped to the target, empty when hidden
+};
+
+static bool
+intersect(struct rect a, struct rect b, struct rect* out)
+{
+  out->x1 = a.x1 > b.x1 ? a.x1 : b.x1;
+  out->y1 = a.y1 > b.y1 ? a.y1 : b.y1;
+  out->x2 = a.x2 < b.x2 ? a.x2 : b.x2;
+  out->y2 = a.y2 < b.y2 ? a.y2 : b.y2;
+
+  return out->x1 < out->x2 && out->y1 < out->y2;
+}
+
+static bool
+is_empty(struct rect r)
+{
+  return r.x1 >= r.x2 || r.y1 >= r.y2;
+}
+
+static struct zippo_renderer_rect
+to_damage(struct rect r)
+{
+  return (struct zippo_renderer_rect){r.x1, r.y1, r.x2 - r.x1, r.y2 - r.y1};
+}
+
+// same operator as the scene's, premultiplied source over
+static inline uint32_t
+blend(uint32_t src, uint32_t dst)
+{
+  uint32_t a = 255 - (src >> 24);
+  uint32_t rb = (dst & 0x00ff00ff) * a + 0x00800080;
+  uint32_t ag = ((dst >> 8) & 0x00ff00ff) * a + 0x00800080;
+
+  rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+  ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+
+  return src + (rb | ag);
+}
+
+static inline uint32_t*
+target_row(struct zippo_scale_image* target, int y)
+{
+  return (uint32_t*)((uint8_t*)target->data + y * target->stride);
+}
+
+static void
+zippo_cursor_layer_restore(
+    struct zippo_cursor_layer* self, struct zippo_scale_image* target)
+{
+  int left = self->x - self->hotspot_x, top = self->y - self->hotspot_y;
+  struct rect r = self->drawn;
+
+  for (int y = r.y1; y < r.y2; y++) {
+    memcpy(target_row(target, y) + r.x1,
+        self->saved + (y - top) * self->width + (r.x1 - left),
+        (r.x2 - r.x1) * 4);
+  }
+}
+
+// save what is in region of target and draw the cursor over it
+static void
+zippo_cursor_layer_draw(struct zippo_cursor_layer* self,
+    struct zippo_scale_image* target, struct rect region)
+{
+  int left = self->x - self->hotspot_x, top = self->y - self->hotspot_y;
+
+  for (int y = region.y1; y < region.y2; y++) {
+    uint32_t* dst = target_row(target, y);
+    uint32_t* saved = self->saved + (y - top) * self->width - left;
+    const uint32_t* src = self->image + (y - top) * self->width - left;
+
+    for (int x = region.x1; x < region.x2; x++) {
+      uint32_t s = src[x];
+
+      saved[x] = dst[x];
+      if (s >> 24 == 0xff)
+        dst[x] = s;
+      else if (s != 0)
+        dst[x] = blend(s, dst[x]);
+    }
+  }
+}
+
+static void
+zippo_cursor_layer_show(
+    struct zippo_cursor_layer* self, struct zippo_scale_image* target)
+{
+  int left = self->x - self->hotspot_x, top = self->y - self->hotspot_y;
+  struct rect cursor = {left, top, left + self->width, top + self->height};
+  struct rect output = {0, 0, target->width, target->height};
+
+  if (!intersect(cursor, output, &self->drawn)) {
+    self->drawn = (struct rect){0};
+    return;
+  }
+
+  zippo_cursor_layer_draw(self, target, self->drawn);
+}
+
+int
+zippo_cursor_layer_move(struct zippo_cursor_layer* self,
+    struct zippo_scale_image* target, int x, int y,
+    struct zippo_renderer_rect damage[2])
+{
+  int count = 0;
+
+  if (self->visible && x == self->x && y == self->y) return 0;
+
+  if (self->visible && !is_empty(self->drawn)) {
+    zippo_cursor_layer_restore(self, target);
+    damage[count++] = to_damage(self->drawn);
+  }
+
+  self->visible = true;
+  self->x = x;
+  self->y = y;
+  zippo_cursor_layer_show(self, target);
+  if (!is_empty(self->drawn)) damage[count++] = to_damage(self->drawn);
+
+  return count;
+}
+
+int
+zippo_cursor_layer_set_image(struct zippo_cursor_layer* self,
+    struct zippo_scale_image* target, const struct zippo_scale_image* image,
+    int hotspot_x, int hotspot_y, struct zippo_renderer_rect damage[2])
+{
+  size_t size = (size_t)image->width * image->height * 4;
+  uint32_t *pixels, *saved;
+  int count = 0;
+
+  pixels = malloc(size);
+  saved = malloc(size);
+  if (pixels == NULL || saved == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    free(pixels);
+    free(saved);
+    return -1;
+  }
+
+  for (int y = 0; y < image->height; y++) {
+    memcpy(pixels + y * image->width,
+        (const uint8_t*)image->data + y * image->stride, image->width * 4);
+  }
+
+  // the old image goes with the pixels it covered
+  if (self->visible && !is_empty(self->drawn)) {
+    zippo_cursor_layer_restore(self, target);
+    damage[count++] = to_damage(self->drawn);
+  }
+
+  free(self->image);
+  free(self->saved);
+  self->image = pixels;
+  self->saved = saved;
+  self->width = image->width;
+  self->height = image->height;
+  self->hotspot_x = hotspot_x;
+  self->hotspot_y = hotspot_y;
+
+  if (self->visible) {
+    zippo_cursor_layer_show(self, target);
+    if (!is_empty(self->drawn)) damage[count++] = to_damage(self->drawn);
+  }
+
+  return count;
+}
+
+int
+zippo_cursor_layer_hide(struct zippo_cursor_layer* self,
+    struct zippo_scale_image* target, struct zippo_renderer_rect damage[1])
+{
+  int count = 0;
+
+  if (self->visible && !is_empty(self->drawn)) {
+    zippo_cursor_layer_restore(self, target);
+    damage[count++] = to_damage(self->drawn);
+  }
+
+  self->visible = false;
+  self->drawn = (struct rect){0};
+
+  return count;
+}
+
+void
+zippo_cursor_layer_repair(struct zippo_cursor_layer* self,
+    struct zippo_scale_image* target, const struct zippo_renderer_rect* rect)
+{
+  struct rect r = {rect->x, rect->y, rect->x + rect->width,
+      rect->y + rect->height};
+  struct rect clip;
+
+  if (!self->visible || !intersect(r, self->drawn, &clip)) return;
+
+  zippo_cursor_layer_draw(self, target, clip);
+}
+
+struct zippo_cursor_layer*
+zippo_cursor_layer_create(
+    const struct zippo_scale_image* image, int hotspot_x, int hotspot_y)
+{
+  struct zippo_cursor_layer* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  // hidden, there is nothing to restore or damage
+  if (zippo_cursor_layer_set_image(
+          self, NULL, image, hotspot_x, hotspot_y, NULL) < 0) {
+    free(self);
+    return NULL;
+  }
+
+  return self;
+}
+
+void
+zippo_cursor_layer_destroy(struct zippo_cursor_layer* self)
+{
+  free(self->image);
+  free(self->saved);
+  free(self);
+}
@@ -0,0 +1,62 @@
+#ifndef ZIPPO_CURSOR_H
+#define ZIPPO_CURSOR_H
+
+#include "renderer.h"
+#include "scale.h"
+
+// a cursor drawn straight into the framebuffer of a software composited
+// output, on top of the scene but not part of it. the pixels under it are
+// saved, so a move restores the old rectangle and draws the new one without
+// compositing anything. the output composites the scene again only where it
+// has changed, and hands those rectangles to zippo_cursor_layer_repair().
+//
+// passthrough frames have no framebuffer of the output's own to draw into,
+// the output has to composite while the cursor is visible.
+struct zippo_cursor_layer;
+
+/**
+ * Move the hotspot to x, y in target coordinates, showing the cursor if it
+ * was hidden.
+ *
+ * @param damage receives the rectangles of target that changed
+ * @return the number of rectangles in damage, 0 to 2
+ */
+int zippo_cursor_layer_move(struct zippo_cursor_layer* self,
+    struct zippo_scale_image* target, int x, int y,
+    struct zippo_renderer_rect damage[2]);
+
+/**
+ * Replace the image, e.g. when a client sets another cursor.
+ *
+ * @param image premultiplied ARGB8888, copied
+ * @return the number of rectangles in damage, -1 on failure
+ */
+int zippo_cursor_layer_set_image(struct zippo_cursor_layer* self,
+    struct zippo_scale_image* target, const struct zippo_scale_image* image,
+    int hotspot_x, int hotspot_y, struct zippo_renderer_rect damage[2]);
+
+/**
+ * Restore the pixels under the cursor and stop drawing it.
+ *
+ * @return the number of rectangles in damage, 0 or 1
+ */
+int zippo_cursor_layer_hide(struct zippo_cursor_layer* self,
+    struct zippo_scale_image* target, struct zippo_renderer_rect damage[1]);
+
+/**
+ * The scene has just been composited into rect of target, over the cursor.
+ * Save what is now under the cursor there and draw the cursor again. Call
+ * it for every rectangle after each zippo_renderer_render() into target.
+ */
+void zippo_cursor_layer_repair(struct zippo_cursor_layer* self,
+    struct zippo_scale_image* target, const struct zippo_renderer_rect* rect);
+
+/**
+ * @param image premultiplied ARGB8888, copied. the cursor starts hidden.
+ */
+struct zippo_cursor_layer* zippo_cursor_layer_create(
+    const struct zippo_scale_image* image, int hotspot_x, int hotspot_y);
+
+void zippo_cursor_layer_destroy(struct zippo_cursor_layer* self);
+
+#endif  //  ZIPPO_CURSOR_H
@@ -0,0 +1,221 @@
+#include "gpu_probe.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_SEAT "seat0"
+
+static ssize_t
+read_file(const char* path, char* buf, size_t size)
+{
+  ssize_t len;
+  int fd;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -1;
+
+  do {
+    len = read(fd, buf, size - 1);
+  } while (len < 0 && errno == EINTR);
+
+  close(fd);
+
+  if (len < 0) return -1;
+  buf[len] = '\0';
+
+  return len;
+}
+
+// "card0" but not connectors like "card0-HDMI-A-1"
+static int
+card_index(const char* name)
+{
+  const char* p = name + 4;
+
+  if (strncmp(name, "card", 4) != 0 || *p == '\0') return -1;
+  for (; *p; p++)
+    if (*p < '0' || *p > '9') return -1;
+
+  return atoi(name + 4);
+}
+
+// like udev_device_get_property_value() but with two reads instead of
+// libudev's full device setup.
+void
+zippo_gpu_probe_device_seat(const char* root, const char* device_path,
+    char* seat, size_t size)
+{
+  char path[PATH_MAX], dev[32], data[8192];
+  const char *line, *end;
+  ssize_t len;
+
+  snprintf(seat, size, "%s", DEFAULT_SEAT);
+
+  snprintf(path, sizeof path, "%s/dev", device_path);
+  len = read_file(path, dev, sizeof dev);
+  if (len <= 0) return;
+  dev[strcspn(dev, "\n")] = '\0';
+
+  snprintf(path, sizeof path, "%s/run/udev/data/c%s", root, dev);
+  if (read_file(path, data, sizeof data) <= 0) return;
+
+  for (line = data; *line; line = *end ? end + 1 : end) {
+    end = line + strcspn(line, "\n");
+    if (strncmp(line, "E:ID_SEAT=", 10) == 0) {
+      snprintf(seat, size, "%.*s", (int)(end - line - 10), line + 10);
+      return;
+    }
+  }
+}
+
+int
+zippo_gpu_probe_sysfs(
+    const char* root, const char* seat, char* syspath, size_t size)
+{
+  char dir_path[PATH_MAX], card_path[PATH_MAX], path[PATH_MAX];
+  char device_seat[64], boot_vga[8];
+  struct dirent* entry;
+  DIR* dir;
+  int found = -1, len;
+
+  snprintf(dir_path, sizeof dir_path, "%s/sys/class/drm", root);
+  dir = opendir(dir_path);
+  if (dir == NULL) return -1;
+
+  // same choice as zippo_gpu_probe_udev(): the boot_vga card, otherwise the
+  // first card of the seat. readdir() is unordered, so compare indices.
+  while ((entry = readdir(dir)) != NULL) {
+    bool is_boot_vga;
+    int index = card_index(entry->d_name);
+
+    if (index < 0) continue;
+
+    len = snprintf(
+        card_path, sizeof card_path, "%s/%s", dir_path, entry->d_name);
+    if (len < 0 || (size_t)len >= sizeof card_path) continue;
+
+    zippo_gpu_probe_device_seat(
+        root, card_path, device_seat, sizeof device_seat);
+    if (strcmp(device_seat, seat) != 0) continue;
+
+    len = snprintf(path, sizeof path, "%s/device/boot_vga", card_path);
+    if (len < 0 || (size_t)len >= sizeof path) continue;
+    is_boot_vga = read_file(path, boot_vga, sizeof boot_vga) > 0 &&
+                  boot_vga[0] == '1';
+
+    if (!is_boot_vga && found >= 0 && index > found) continue;
+
+    if (realpath(card_path, path) == NULL || strlen(path) >= size) continue;
+
+    strcpy(syspath, path);
+    found = index;
+
+    if (is_boot_vga) break;
+  }
+
+  closedir(dir);
+
+  return found >= 0 ? 0 : -1;
+}
+
+int
+zippo_gpu_probe_seats(const char* root, char (*seats)[ZIPPO_GPU_PROBE_SEAT_MAX],
+    int max)
+{
+  char dir_path[PATH_MAX], card_path[PATH_MAX], seat[ZIPPO_GPU_PROBE_SEAT_MAX];
+  struct dirent* entry;
+  int count = 0, len;
+  DIR* dir;
+
+  snprintf(dir_path, sizeof dir_path, "%s/sys/class/drm", root);
+  dir = opendir(dir_path);
+  if (dir == NULL) return -1;
+
+  while ((entry = readdir(dir)) != NULL) {
+    bool known = false;
+
+    if (card_index(entry->d_name) < 0) continue;
+
+    len = snprintf(
+        card_path, sizeof card_path, "%s/%s", dir_path, entry->d_name);
+    if (len < 0 || (size_t)len >= sizeof card_path) continue;
+    zippo_gpu_probe_device_seat(root, card_path, seat, sizeof seat);
+
+    for (int i = 0; i < count && !known; i++)
+      known = strcmp(seats[i], seat) == 0;
+    if (known || count == max) continue;
+
+    // the default seat first, it gets the session's vt
+    if (strcmp(seat, DEFAULT_SEAT) == 0 && count > 0) {
+      memcpy(seats[count], seats[0], sizeof seats[0]);
+      snprintf(seats[0], sizeof seats[0], "%s", seat);
+    } else {
+      snprintf(seats[count], sizeof seats[count], "%s", seat);
+    }
+    count++;
+  }
+
+  closedir(dir);
+
+  return count;
+}
+
+struct udev_device*
+zippo_gpu_probe_udev(struct udev* udev, const char* seat)
+{
+  struct udev_enumerate* e;
+  struct udev_list_entry* entry;
+  const char *path, *id, *device_seat;
+  struct udev_device *device, *drm_device, *pci;
+
+  e = udev_enumerate_new(udev);
+  udev_enumerate_add_match_subsystem(e, "drm");
+  udev_enumerate_add_match_sysname(e, "card[0-9]*");
+
+  udev_enumerate_scan_devices(e);
+  drm_device = NULL;
+
+  udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(e))
+  {
+    bool is_boot_vga = false;  // trueだとkmsがoffになるのとか関係あるか?
+
+    path = udev_list_entry_get_name(entry);
+    device = udev_device_new_from_syspath(udev, path);
+    if (!device) continue;
+
+    device_seat = udev_device_get_property_value(device, "ID_SEAT");
+    if (!device_seat) device_seat = DEFAULT_SEAT;
+    if (strcmp(device_seat, seat) != 0) {
+      udev_device_unref(device);
+      continue;
+    }
+
+    pci = udev_device_get_parent_with_subsystem_devtype(device, "pci", NULL);
+
+    if (pci) {
+      id = udev_device_get_sysattr_value(pci, "boot_vga");
+      if (id && strcmp(id, "1") == 0) is_boot_vga = true;
+    }
+
+    if (!is_boot_vga && drm_device) {
+      udev_device_unref(device);
+      continue;
+    }
+
+    if (drm_device) udev_device_unref(drm_device);
+    drm_device = device;
+
+    if (is_boot_vga) break;
+  }
+
+  udev_enumerate_unref(e);
+
+  return drm_device;
+}
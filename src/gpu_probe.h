@@ -0,0 +1,46 @@
+#ifndef ZIPPO_GPU_PROBE_H
+#define ZIPPO_GPU_PROBE_H
+
+#include <libudev.h>
+#include <stddef.h>
+
+#define ZIPPO_GPU_PROBE_SEAT_MAX 64  // name length, with the null byte
+
+/**
+ * Find the primary DRM card of the seat by reading sysfs and the udev
+ * database directly, without libudev enumeration.
+ *
+ * @param root prefix of /sys and /run/udev, "" on a real system
+ * @param syspath receives the canonical syspath of the card
+ * @return 0 on success, -1 if no card was found or sysfs could not be read
+ */
+int zippo_gpu_probe_sysfs(
+    const char* root, const char* seat, char* syspath, size_t size);
+
+/**
+ * Names of the seats that have a DRM card, by the ID_SEAT of the cards.
+ * seat0 comes first if it has one.
+ *
+ * @param root prefix of /sys and /run/udev, "" on a real system
+ * @return the number of names written, -1 if sysfs could not be read
+ */
+int zippo_gpu_probe_seats(
+    const char* root, char (*seats)[ZIPPO_GPU_PROBE_SEAT_MAX], int max);
+
+/**
+ * ID_SEAT property of a character device from the udev database, seat0 if
+ * it has none.
+ *
+ * @param device_path sysfs directory of the device, the one with its dev
+ * attribute
+ */
+void zippo_gpu_probe_device_seat(
+    const char* root, const char* device_path, char* seat, size_t size);
+
+/**
+ * Same as zippo_gpu_probe_sysfs() through libudev enumeration. Slower, but
+ * it does not depend on the layout of the udev database.
+ */
+struct udev_device* zippo_gpu_probe_udev(struct udev* udev, const char* seat);
+
+#endif  //  ZIPPO_GPU_PROBE_H
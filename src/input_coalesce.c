@@ -0,0 +1,300 @@
+#include "input_coalesce.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#define LONG_BITS (sizeof(unsigned long) * CHAR_BIT)
+
+enum zippo_input_pending {
+  ZIPPO_INPUT_PENDING_NONE = 0,
+  ZIPPO_INPUT_PENDING_RELATIVE,
+  ZIPPO_INPUT_PENDING_ABSOLUTE,
+};
+
+struct zippo_input_coalescer {
+  const struct zippo_input_coalescer_listener* listener;
+  void* data;
+
+  enum zippo_input_pending pending;
+  uint64_t time_usec;  // of the latest merged event
+  double dx;
+  double dy;
+  double dx_unaccel;
+  double dy_unaccel;
+  double x;
+  double y;
+
+  struct zippo_input_coalescer_stats stats;
+};
+
+void
+zippo_input_coalescer_flush(struct zippo_input_coalescer* self)
+{
+  const struct zippo_input_coalescer_listener* listener = self->listener;
+  enum zippo_input_pending pending = self->pending;
+
+  self->pending = ZIPPO_INPUT_PENDING_NONE;
+
+  switch (pending) {
+    case ZIPPO_INPUT_PENDING_RELATIVE:
+      self->stats.motion_out++;
+      if (listener->motion)
+        listener->motion(self->data, self->time_usec, self->dx, self->dy,
+            self->dx_unaccel, self->dy_unaccel);
+      break;
+
+    case ZIPPO_INPUT_PENDING_ABSOLUTE:
+      self->stats.motion_out++;
+      if (listener->motion_absolute)
+        listener->motion_absolute(
+            self->data, self->time_usec, self->x, self->y);
+      break;
+
+    case ZIPPO_INPUT_PENDING_NONE:
+      break;
+  }
+}
+
+void
+zippo_input_coalescer_motion(struct zippo_input_coalescer* self,
+    uint64_t time_usec, double dx, double dy, double dx_unaccel,
+    double dy_unaccel)
+{
+  self->stats.motion_in++;
+
+  // a relative motion after an absolute one is relative to that position
+  if (self->pending == ZIPPO_INPUT_PENDING_ABSOLUTE)
+    zippo_input_coalescer_flush(self);
+
+  if (self->pending == ZIPPO_INPUT_PENDING_NONE) {
+    self->pending = ZIPPO_INPUT_PENDING_RELATIVE;
+    self->dx = self->dy = 0;
+    self->dx_unaccel = self->dy_unaccel = 0;
+  }
+
+  self->time_usec = time_usec;
+  self->dx += dx;
+  self->dy += dy;
+  self->dx_unaccel += dx_unaccel;
+  self->dy_unaccel += dy_unaccel;
+}
+
+void
+zippo_input_coalescer_motion_absolute(
+    struct zippo_input_coalescer* self, uint64_t time_usec, double x, double y)
+{
+  self->stats.motion_in++;
+
+  if (self->pending == ZIPPO_INPUT_PENDING_RELATIVE)
+    zippo_input_coalescer_flush(self);
+
+  self->pending = ZIPPO_INPUT_PENDING_ABSOLUTE;
+  self->time_usec = time_usec;
+  self->x = x;
+  self->y = y;
+}
+
+void
+zippo_input_coalescer_button(struct zippo_input_coalescer* self,
+    uint64_t time_usec, uint32_t button, bool pressed)
+{
+  // the click must land where the pointer was when it happened
+  zippo_input_coalescer_flush(self);
+
+  if (self->listener->button)
+    self->listener->button(self->data, time_usec, button, pressed);
+}
+
+void
+zippo_input_coalescer_key(struct zippo_input_coalescer* self,
+    uint64_t time_usec, uint32_t key, bool pressed)
+{
+  zippo_input_coalescer_flush(self);
+
+  if (self->listener->key)
+    self->listener->key(self->data, time_usec, key, pressed);
+}
+
+static bool
+is_button(uint16_t code)
+{
+  return (code >= BTN_MISC && code < KEY_OK) ||
+         (code >= BTN_DPAD_UP && code <= BTN_DPAD_RIGHT) ||
+         code >= BTN_TRIGGER_HAPPY;
+}
+
+static bool
+test_bit(const unsigned long* bits, uint16_t code)
+{
+  return bits[code / LONG_BITS] & (1ul << (code % LONG_BITS));
+}
+
+// a press of a held key or a release of one that is not is not delivered
+static void
+zippo_input_coalescer_evdev_key(struct zippo_input_coalescer* self,
+    struct zippo_input_evdev_state* device, uint64_t time_usec,
+    uint16_t code, bool pressed)
+{
+  if (code >= KEY_CNT || test_bit(device->held, code) == pressed) return;
+
+  device->held[code / LONG_BITS] ^= 1ul << (code % LONG_BITS);
+
+  if (is_button(code))
+    zippo_input_coalescer_button(self, time_usec, code, pressed);
+  else
+    zippo_input_coalescer_key(self, time_usec, code, pressed);
+}
+
+// after a drop, deliver the presses and releases that were lost with it
+static void
+zippo_input_coalescer_evdev_resync(struct zippo_input_coalescer* self,
+    struct zippo_input_evdev_state* device, uint64_t time_usec)
+{
+  unsigned long keys[ZIPPO_INPUT_EVDEV_KEY_LONGS];
+
+  // better to release a key that is still down than to leave one stuck
+  if (device->fd < 0 || ioctl(device->fd, EVIOCGKEY(sizeof keys), keys) < 0)
+    memset(keys, 0, sizeof keys);
+
+  for (size_t i = 0; i < ZIPPO_INPUT_EVDEV_KEY_LONGS; i++) {
+    unsigned long changed = device->held[i] ^ keys[i];
+
+    for (; changed; changed &= changed - 1) {
+      uint16_t code = i * LONG_BITS + __builtin_ctzl(changed);
+
+      zippo_input_coalescer_evdev_key(
+          self, device, time_usec, code, test_bit(keys, code));
+    }
+  }
+}
+
+static void
+zippo_input_evdev_state_reset(struct zippo_input_evdev_state* device)
+{
+  device->dx = device->dy = 0;
+  device->has_relative = false;
+  device->has_absolute = false;
+  device->key_count = 0;
+}
+
+static void
+zippo_input_coalescer_handle_evdev_frame(struct zippo_input_coalescer* self,
+    struct zippo_input_evdev_state* device, uint64_t time_usec)
+{
+  // evdev does not order events within a frame, motion goes first like
+  // libinput does
+  if (device->has_relative)
+    zippo_input_coalescer_motion(
+        self, time_usec, device->dx, device->dy, device->dx, device->dy);
+
+  if (device->has_absolute)
+    zippo_input_coalescer_motion_absolute(
+        self, time_usec, device->x, device->y);
+
+  for (int i = 0; i < device->key_count; i++) {
+    zippo_input_coalescer_evdev_key(self, device, time_usec,
+        device->keys[i].code, device->keys[i].value != 0);
+  }
+
+  zippo_input_evdev_state_reset(device);
+}
+
+void
+zippo_input_coalescer_handle_evdev(struct zippo_input_coalescer* self,
+    struct zippo_input_evdev_state* device, const struct input_event* event)
+{
+  uint64_t time_usec =
+      (uint64_t)event->input_event_sec * 1000000 + event->input_event_usec;
+
+  if (event->type == EV_SYN) {
+    if (event->code == SYN_DROPPED) {
+      // the kernel buffer overflowed, the rest of this frame is garbage
+      zippo_input_evdev_state_reset(device);
+      device->dropped = true;
+    } else if (event->code == SYN_REPORT) {
+      if (device->dropped) {
+        device->dropped = false;
+        zippo_input_coalescer_evdev_resync(self, device, time_usec);
+      } else {
+        zippo_input_coalescer_handle_evdev_frame(self, device, time_usec);
+      }
+    }
+    return;
+  }
+
+  if (device->dropped) return;
+
+  switch (event->type) {
+    case EV_REL:
+      if (event->code == REL_X) {
+        device->dx += event->value;
+        device->has_relative = true;
+      } else if (event->code == REL_Y) {
+        device->dy += event->value;
+        device->has_relative = true;
+      }
+      break;
+
+    case EV_ABS:
+      if (event->code == ABS_X) {
+        device->x = event->value;
+        device->has_absolute = true;
+      } else if (event->code == ABS_Y) {
+        device->y = event->value;
+        device->has_absolute = true;
+      }
+      break;
+
+    case EV_KEY:
+      if (event->value == 2) break;  // we do key repeat ourselves
+
+      if (device->key_count == ZIPPO_INPUT_EVDEV_MAX_FRAME_KEYS) {
+        // unusually large frame, deliver what we have to keep the order
+        zippo_input_coalescer_handle_evdev_frame(self, device, time_usec);
+      }
+      device->keys[device->key_count].code = event->code;
+      device->keys[device->key_count].value = event->value;
+      device->key_count++;
+      break;
+  }
+}
+
+bool
+zippo_input_coalescer_has_pending(struct zippo_input_coalescer* self)
+{
+  return self->pending != ZIPPO_INPUT_PENDING_NONE;
+}
+
+void
+zippo_input_coalescer_get_stats(struct zippo_input_coalescer* self,
+    struct zippo_input_coalescer_stats* stats)
+{
+  *stats = self->stats;
+}
+
+struct zippo_input_coalescer*
+zippo_input_coalescer_create(
+    const struct zippo_input_coalescer_listener* listener, void* data)
+{
+  struct zippo_input_coalescer* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->listener = listener;
+  self->data = data;
+  self->pending = ZIPPO_INPUT_PENDING_NONE;
+
+  return self;
+}
+
+void
+zippo_input_coalescer_destroy(struct zippo_input_coalescer* self)
+{
+  free(self);
+}
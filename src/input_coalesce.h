@@ -0,0 +1,100 @@
+#ifndef ZIPPO_INPUT_COALESCE_H
+#define ZIPPO_INPUT_COALESCE_H
+
+#include <limits.h>
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ZIPPO_INPUT_EVDEV_MAX_FRAME_KEYS 16
+#define ZIPPO_INPUT_EVDEV_KEY_LONGS \
+  ((KEY_CNT + sizeof(unsigned long) * CHAR_BIT - 1) / \
+      (sizeof(unsigned long) * CHAR_BIT))
+
+struct zippo_input_coalescer_listener {
+  // accumulated since the last flush. the unaccelerated deltas are summed
+  // separately so that relative pointer clients lose nothing.
+  void (*motion)(void* data, uint64_t time_usec, double dx, double dy,
+      double dx_unaccel, double dy_unaccel);
+  // only the latest position since the last flush
+  void (*motion_absolute)(void* data, uint64_t time_usec, double x, double y);
+  void (*button)(void* data, uint64_t time_usec, uint32_t button, bool pressed);
+  void (*key)(void* data, uint64_t time_usec, uint32_t key, bool pressed);
+};
+
+struct zippo_input_coalescer_stats {
+  uint64_t motion_in;
+  uint64_t motion_out;
+};
+
+// per device state for zippo_input_coalescer_handle_evdev(), zero
+// initialized by the caller, who sets fd
+struct zippo_input_evdev_state {
+  int fd;  // the device, to read back its keys after a drop, -1 for none
+
+  int32_t dx;
+  int32_t dy;
+  int32_t x;
+  int32_t y;
+  bool has_relative;
+  bool has_absolute;
+  bool dropped;  // discard events up to the next SYN_REPORT
+
+  struct {
+    uint16_t code;
+    int32_t value;
+  } keys[ZIPPO_INPUT_EVDEV_MAX_FRAME_KEYS];
+  int key_count;
+
+  // keys and buttons delivered as pressed, a bit per code like EVIOCGKEY
+  unsigned long held[ZIPPO_INPUT_EVDEV_KEY_LONGS];
+};
+
+// sits between device reading and client delivery for one seat. motion is
+// held back and merged until the next flush, which the output calls once per
+// frame. buttons and keys are delivered at once, after flushing the motion
+// that preceded them, so clients see events in the order they happened.
+struct zippo_input_coalescer;
+
+void zippo_input_coalescer_motion(struct zippo_input_coalescer* self,
+    uint64_t time_usec, double dx, double dy, double dx_unaccel,
+    double dy_unaccel);
+
+void zippo_input_coalescer_motion_absolute(
+    struct zippo_input_coalescer* self, uint64_t time_usec, double x,
+    double y);
+
+void zippo_input_coalescer_button(struct zippo_input_coalescer* self,
+    uint64_t time_usec, uint32_t button, bool pressed);
+
+void zippo_input_coalescer_key(struct zippo_input_coalescer* self,
+    uint64_t time_usec, uint32_t key, bool pressed);
+
+/**
+ * Feed one event read from an evdev device. Motion and buttons of a frame
+ * are passed on at its SYN_REPORT. Relative deltas have no acceleration
+ * applied, absolute positions are in device units.
+ *
+ * After a SYN_DROPPED the events up to the next SYN_REPORT are discarded.
+ * The keys and buttons are then read back from the device and the changes
+ * missed are delivered, all held ones are released if that fails. A key
+ * event that does not change what is held is dropped, so every press gets
+ * exactly one release.
+ */
+void zippo_input_coalescer_handle_evdev(struct zippo_input_coalescer* self,
+    struct zippo_input_evdev_state* device, const struct input_event* event);
+
+// deliver pending motion, call it once per output frame
+void zippo_input_coalescer_flush(struct zippo_input_coalescer* self);
+
+bool zippo_input_coalescer_has_pending(struct zippo_input_coalescer* self);
+
+void zippo_input_coalescer_get_stats(struct zippo_input_coalescer* self,
+    struct zippo_input_coalescer_stats* stats);
+
+struct zippo_input_coalescer* zippo_input_coalescer_create(
+    const struct zippo_input_coalescer_listener* listener, void* data);
+
+void zippo_input_coalescer_destroy(struct zippo_input_coalescer* self);
+
+#endif  //  ZIPPO_INPUT_COALESCE_H
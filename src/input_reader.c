@@ -0,0 +1,566 @@
+#define _GNU_SOURCE
+
+#include "input_reader.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "loop_monitor.h"
+
+#define RING_ENTRIES 64
+// a completion per device, and as many again for reads out of buffers
+#define CQ_ENTRIES 1024
+#define BUFFER_COUNT 64  // power of two
+#define BUFFER_EVENTS 64  // a full frame of a multitouch device and more
+#define BUFFER_SIZE (BUFFER_EVENTS * sizeof(struct input_event))
+#define BUFFER_GROUP 0
+
+// IORING_OP_READ_MULTISHOT, linux 6.7, newer than some uapi headers. the
+// probe tells whether the running kernel has it.
+#define OP_READ_MULTISHOT 49
+
+struct zippo_input_source {
+  struct zippo_input_reader* reader;
+  struct wl_list link;
+
+  int fd;
+  zippo_input_reader_func_t func;
+  void* data;
+
+  struct wl_event_source* event_source;  // epoll only
+  bool armed;  // io_uring only, a read is queued or in the kernel
+  bool dispatching;
+  bool removed;  // freed once the kernel or the dispatch lets go of it
+};
+
+struct zippo_input_ring {
+  int fd;
+
+  void* ring;
+  size_t ring_size;
+  struct io_uring_sqe* sqes;
+  size_t sqes_size;
+
+  unsigned* sq_head;
+  unsigned* sq_flags;
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned sq_entries;
+  unsigned* sq_array;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_mask;
+  struct io_uring_cqe* cqes;
+  unsigned queued;  // sqes not submitted yet
+
+  struct io_uring_buf_ring* buffer_ring;
+  size_t buffer_ring_size;
+  uint8_t* buffers;
+
+  bool multishot;
+  struct wl_event_loop* loop;
+  struct wl_event_source* event_source;
+};
+
+struct zippo_input_reader {
+  struct wl_event_loop* loop;
+  struct wl_list sources;  // zippo_input_source::link
+  struct zippo_input_ring* ring;  // NULL with epoll
+  struct zippo_input_reader_stats stats;
+};
+
+static void
+zippo_input_source_free(struct zippo_input_source* source)
+{
+  if (source->event_source)
+    zippo_loop_source_remove(source->reader->loop, source->event_source);
+  wl_list_remove(&source->link);
+  free(source);
+}
+
+// false if the source was removed by the callback and is gone
+static bool
+zippo_input_source_deliver(
+    struct zippo_input_source* source, const void* buffer, int size)
+{
+  int count = size / (int)sizeof(struct input_event);
+
+  source->reader->stats.events += count;
+  source->dispatching = true;
+  source->func(source->data, buffer, count);
+  source->dispatching = false;
+
+  if (source->removed && !source->armed) {
+    zippo_input_source_free(source);
+    return false;
+  }
+
+  return !source->removed;
+}
+
+static int
+zippo_input_source_handle_readable(int fd, uint32_t mask, void* data)
+{
+  struct zippo_input_source* source = data;
+  struct input_event events[BUFFER_EVENTS];
+  ssize_t size;
+
+  source->reader->stats.wakeups++;
+
+  // a short read means the device is drained, no read() just for EAGAIN
+  do {
+    size = read(fd, events, sizeof events);
+    source->reader->stats.syscalls++;
+    if (size < 0 && (errno == EAGAIN || errno == EINTR)) break;
+    if (size <= 0) {
+      zippo_input_source_deliver(source, NULL, 0);
+      return 0;
+    }
+    if (!zippo_input_source_deliver(source, events, size)) return 0;
+  } while (size == sizeof events);
+
+  if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))
+    zippo_input_source_deliver(source, NULL, 0);
+
+  return 0;
+}
+
+static int
+zippo_input_ring_submit(struct zippo_input_reader* reader)
+{
+  struct zippo_input_ring* self = reader->ring;
+  int ret;
+
+  if (self->queued == 0) return 0;
+
+  ret = syscall(__NR_io_uring_enter, self->fd, self->queued, 0, 0, NULL, 0);
+  reader->stats.syscalls++;
+  if (ret < 0) {
+    fprintf(stderr, "Failed to submit input reads: %s\n", strerror(errno));
+    return -1;
+  }
+  self->queued -= ret;
+
+  return 0;
+}
+
+static bool
+zippo_input_ring_is_full(struct zippo_input_ring* self)
+{
+  return *self->sq_tail - __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE) ==
+         self->sq_entries;
+}
+
+// NULL if the ring is full and what is queued cannot be submitted
+static struct io_uring_sqe*
+zippo_input_ring_get_sqe(struct zippo_input_reader* reader)
+{
+  struct zippo_input_ring* self = reader->ring;
+  struct io_uring_sqe* sqe;
+  unsigned tail, index;
+
+  // one wakeup may rearm and cancel more sources than the ring holds, the
+  // queued ones go to the kernel to make room
+  if (zippo_input_ring_is_full(self) &&
+      (zippo_input_ring_submit(reader) != 0 || zippo_input_ring_is_full(self)))
+    return NULL;
+
+  tail = *self->sq_tail;
+  index = tail & *self->sq_mask;
+  sqe = &self->sqes[index];
+
+  memset(sqe, 0, sizeof *sqe);
+  self->sq_array[index] = index;
+  __atomic_store_n(self->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  self->queued++;
+
+  return sqe;
+}
+
+static int
+zippo_input_ring_arm(
+    struct zippo_input_reader* reader, struct zippo_input_source* source)
+{
+  struct zippo_input_ring* self = reader->ring;
+  struct io_uring_sqe* sqe = zippo_input_ring_get_sqe(reader);
+
+  if (sqe == NULL) return -1;
+
+  // the kernel picks a buffer from the group when data arrives
+  sqe->opcode = self->multishot ? OP_READ_MULTISHOT : IORING_OP_READ;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->fd = source->fd;
+  sqe->off = (uint64_t)-1;
+  sqe->len = self->multishot ? 0 : BUFFER_SIZE;
+  sqe->buf_group = BUFFER_GROUP;
+  sqe->user_data = (uintptr_t)source;
+  source->armed = true;
+
+  return 0;
+}
+
+static void
+zippo_input_ring_cancel(
+    struct zippo_input_reader* reader, struct zippo_input_source* source)
+{
+  struct io_uring_sqe* sqe = zippo_input_ring_get_sqe(reader);
+
+  // the source stays until its read ends on its own
+  if (sqe == NULL) {
+    fprintf(stderr, "Failed to cancel an input read\n");
+    return;
+  }
+
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = (uintptr_t)source;
+  sqe->user_data = 0;  // its completion is of no interest
+}
+
+static void
+zippo_input_ring_recycle(struct zippo_input_ring* self, uint16_t id)
+{
+  struct io_uring_buf_ring* ring = self->buffer_ring;
+  struct io_uring_buf* buffer = &ring->bufs[ring->tail & (BUFFER_COUNT - 1)];
+
+  buffer->addr = (uintptr_t)(self->buffers + id * BUFFER_SIZE);
+  buffer->len = BUFFER_SIZE;
+  buffer->bid = id;
+  __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+static void
+zippo_input_ring_complete(
+    struct zippo_input_reader* reader, const struct io_uring_cqe* cqe)
+{
+  struct zippo_input_ring* self = reader->ring;
+  struct zippo_input_source* source = (void*)(uintptr_t)cqe->user_data;
+  bool more = cqe->flags & IORING_CQE_F_MORE;
+
+  if (source == NULL) return;
+  source->armed = more;
+
+  if (cqe->flags & IORING_CQE_F_BUFFER) {
+    uint16_t id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    bool alive = cqe->res <= 0 || source->removed ||
+                 zippo_input_source_deliver(
+                     source, self->buffers + id * BUFFER_SIZE, cqe->res);
+
+    // copied out by the callback, the buffer is back in the ring right away
+    zippo_input_ring_recycle(self, id);
+    if (!alive) return;
+  }
+
+  if (more) return;
+
+  if (source->removed) {
+    zippo_input_source_free(source);
+    return;
+  }
+
+  // out of buffers or the end of a multishot read, nothing wrong with the
+  // device
+  if (cqe->res > 0 || cqe->res == -ENOBUFS || cqe->res == -EAGAIN ||
+      cqe->res == -EINTR) {
+    // with no read queued the device would go quiet for good
+    if (zippo_input_ring_arm(reader, source) == 0) return;
+    fprintf(stderr, "Failed to rearm an input read\n");
+  }
+
+  zippo_input_source_deliver(source, NULL, 0);
+}
+
+static int
+zippo_input_ring_handle_readable(int fd, uint32_t mask, void* data)
+{
+  struct zippo_input_reader* reader = data;
+  struct zippo_input_ring* self = reader->ring;
+  unsigned head;
+  (void)fd;
+  (void)mask;
+
+  reader->stats.wakeups++;
+
+  // completions are read from shared memory, read() is never called. they
+  // are taken one by one since a callback may remove sources.
+  for (;;) {
+    head = *self->cq_head;
+    while (head != __atomic_load_n(self->cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe cqe = self->cqes[head & *self->cq_mask];
+
+      __atomic_store_n(self->cq_head, ++head, __ATOMIC_RELEASE);
+      zippo_input_ring_complete(reader, &cqe);
+    }
+
+    // completions that did not fit wait in the kernel, and the ring fd does
+    // not become readable for them. entering the ring moves them in.
+    if (!(__atomic_load_n(self->sq_flags, __ATOMIC_ACQUIRE) &
+            IORING_SQ_CQ_OVERFLOW))
+      break;
+    syscall(__NR_io_uring_enter, self->fd, 0, 0, IORING_ENTER_GETEVENTS,
+        NULL, 0);
+    reader->stats.syscalls++;
+  }
+
+  // reads to rearm and cancels, all in one go
+  zippo_input_ring_submit(reader);
+
+  return 0;
+}
+
+static bool
+zippo_input_ring_has_multishot(int fd)
+{
+  size_t size = sizeof(struct io_uring_probe) +
+                256 * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe* probe = calloc(1, size);
+  bool supported = false;
+
+  if (probe == NULL) return false;
+
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+          256) == 0)
+    supported = probe->last_op >= OP_READ_MULTISHOT &&
+                (probe->ops[OP_READ_MULTISHOT].flags & IO_URING_OP_SUPPORTED);
+
+  free(probe);
+
+  return supported;
+}
+
+static void zippo_input_ring_destroy(struct zippo_input_ring* self);
+
+static struct zippo_input_ring*
+zippo_input_ring_create(struct zippo_input_reader* reader)
+{
+  struct zippo_input_ring* self;
+  struct io_uring_params params = {0};
+  struct io_uring_buf_reg reg = {0};
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+  self->ring = MAP_FAILED;
+  self->sqes = MAP_FAILED;
+  self->buffer_ring = MAP_FAILED;
+
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = CQ_ENTRIES;
+  self->fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+  if (self->fd < 0) {
+    // ENOSYS on old kernels, EPERM where a sysctl or seccomp forbids it
+    fprintf(stderr, "io_uring unavailable: %s\n", strerror(errno));
+    goto err;
+  }
+
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    fprintf(stderr, "io_uring too old\n");
+    goto err;
+  }
+
+  self->ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  if (params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) >
+      self->ring_size)
+    self->ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  self->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  self->ring = mmap(NULL, self->ring_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQ_RING);
+  self->sqes = mmap(NULL, self->sqes_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQES);
+  if (self->ring == MAP_FAILED || self->sqes == MAP_FAILED) {
+    fprintf(stderr, "Failed to map io_uring: %s\n", strerror(errno));
+    goto err;
+  }
+
+  self->sq_head = (unsigned*)((uint8_t*)self->ring + params.sq_off.head);
+  self->sq_flags = (unsigned*)((uint8_t*)self->ring + params.sq_off.flags);
+  self->sq_tail = (unsigned*)((uint8_t*)self->ring + params.sq_off.tail);
+  self->sq_entries = params.sq_entries;
+  self->sq_mask = (unsigned*)((uint8_t*)self->ring + params.sq_off.ring_mask);
+  self->sq_array = (unsigned*)((uint8_t*)self->ring + params.sq_off.array);
+  self->cq_head = (unsigned*)((uint8_t*)self->ring + params.cq_off.head);
+  self->cq_tail = (unsigned*)((uint8_t*)self->ring + params.cq_off.tail);
+  self->cq_mask = (unsigned*)((uint8_t*)self->ring + params.cq_off.ring_mask);
+  self->cqes =
+      (struct io_uring_cqe*)((uint8_t*)self->ring + params.cq_off.cqes);
+
+  // the buffers reads land in, registered once instead of passed per read
+  self->buffer_ring_size = BUFFER_COUNT * sizeof(struct io_uring_buf);
+  self->buffer_ring = mmap(NULL, self->buffer_ring_size,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  self->buffers = malloc(BUFFER_COUNT * BUFFER_SIZE);
+  if (self->buffer_ring == MAP_FAILED || self->buffers == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err;
+  }
+
+  reg.ring_addr = (uintptr_t)self->buffer_ring;
+  reg.ring_entries = BUFFER_COUNT;
+  reg.bgid = BUFFER_GROUP;
+  if (syscall(__NR_io_uring_register, self->fd, IORING_REGISTER_PBUF_RING,
+          &reg, 1) != 0) {
+    fprintf(stderr, "Failed to register input buffers: %s\n",
+        strerror(errno));
+    goto err;
+  }
+
+  for (uint16_t id = 0; id < BUFFER_COUNT; id++)
+    zippo_input_ring_recycle(self, id);
+
+  self->multishot = zippo_input_ring_has_multishot(self->fd);
+
+  // completions are posted by task work that interrupts the main thread in
+  // epoll_wait, the ring is readable on the wait after
+  self->loop = reader->loop;
+  self->event_source = zippo_loop_add_fd(reader->loop, self->fd,
+      WL_EVENT_READABLE, zippo_input_ring_handle_readable, reader,
+      "input ring");
+  if (self->event_source == NULL) {
+    fprintf(stderr, "Failed to add io_uring to the event loop\n");
+    goto err;
+  }
+
+  return self;
+
+err:
+  zippo_input_ring_destroy(self);
+
+  return NULL;
+}
+
+static void
+zippo_input_ring_destroy(struct zippo_input_ring* self)
+{
+  if (self->event_source)
+    zippo_loop_source_remove(self->loop, self->event_source);
+  // closing the ring cancels what is still in the kernel
+  if (self->fd >= 0) close(self->fd);
+  if (self->ring != MAP_FAILED) munmap(self->ring, self->ring_size);
+  if (self->sqes != MAP_FAILED) munmap(self->sqes, self->sqes_size);
+  if (self->buffer_ring != MAP_FAILED)
+    munmap(self->buffer_ring, self->buffer_ring_size);
+  free(self->buffers);
+  free(self);
+}
+
+struct zippo_input_source*
+zippo_input_reader_add(struct zippo_input_reader* self, int fd,
+    zippo_input_reader_func_t func, void* data, const char* name)
+{
+  struct zippo_input_source* source;
+
+  source = calloc(1, sizeof *source);
+  if (source == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  source->reader = self;
+  source->fd = fd;
+  source->func = func;
+  source->data = data;
+  wl_list_insert(&self->sources, &source->link);
+
+  if (self->ring) {
+    if (zippo_input_ring_arm(self, source) != 0 ||
+        zippo_input_ring_submit(self) != 0) {
+      // the sqe is gone with the failed submit
+      source->armed = false;
+      zippo_input_source_free(source);
+      return NULL;
+    }
+    return source;
+  }
+
+  source->event_source = zippo_loop_add_fd(self->loop, fd, WL_EVENT_READABLE,
+      zippo_input_source_handle_readable, source, name);
+  if (source->event_source == NULL) {
+    fprintf(stderr, "Failed to add %s to the event loop\n", name);
+    zippo_input_source_free(source);
+    return NULL;
+  }
+
+  return source;
+}
+
+void
+zippo_input_source_remove(struct zippo_input_source* source)
+{
+  struct zippo_input_reader* reader = source->reader;
+
+  if (source->removed) return;
+  source->removed = true;
+
+  // the kernel may still write into a buffer for it until the cancel
+  // completes
+  if (source->armed) {
+    zippo_input_ring_cancel(reader, source);
+    if (!source->dispatching) zippo_input_ring_submit(reader);
+    return;
+  }
+
+  if (!source->dispatching) zippo_input_source_free(source);
+}
+
+const char*
+zippo_input_reader_get_backend(struct zippo_input_reader* self)
+{
+  if (self->ring == NULL) return "epoll";
+
+  return self->ring->multishot ? "io_uring multishot" : "io_uring";
+}
+
+void
+zippo_input_reader_get_stats(struct zippo_input_reader* self,
+    struct zippo_input_reader_stats* stats)
+{
+  *stats = self->stats;
+}
+
+struct zippo_input_reader*
+zippo_input_reader_create(struct wl_event_loop* loop, bool use_io_uring)
+{
+  struct zippo_input_reader* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->loop = loop;
+  wl_list_init(&self->sources);
+
+  if (use_io_uring) {
+    self->ring = zippo_input_ring_create(self);
+    if (self->ring == NULL) fprintf(stderr, "Reading input with epoll\n");
+  }
+
+  return self;
+}
+
+void
+zippo_input_reader_destroy(struct zippo_input_reader* self)
+{
+  struct zippo_input_source *source, *tmp;
+
+  if (self->ring) zippo_input_ring_destroy(self->ring);
+
+  // removed ones waiting for their cancel to complete
+  wl_list_for_each_safe(source, tmp, &self->sources, link)
+  {
+    zippo_input_source_free(source);
+  }
+
+  free(self);
+}
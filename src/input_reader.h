@@ -0,0 +1,56 @@
+#ifndef ZIPPO_INPUT_READER_H
+#define ZIPPO_INPUT_READER_H
+
+#include <linux/input.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server-core.h>
+
+struct zippo_input_reader_stats {
+  uint64_t wakeups;  // callbacks from the event loop
+  uint64_t syscalls;  // read() or io_uring_enter() made to get events
+  uint64_t events;
+};
+
+/**
+ * @param count 0 once the device is gone or reading failed, remove the
+ * source then
+ */
+typedef void (*zippo_input_reader_func_t)(
+    void* data, const struct input_event* events, int count);
+
+// reads evdev devices for the event loop of the compositor. with io_uring,
+// one read per device stays armed in the kernel and the events land in
+// buffers registered with the ring, so a wakeup of the loop picks up what
+// every device had without a read() each. without it, or when the kernel
+// refuses, every ready device is read by its own fd source.
+struct zippo_input_reader;
+
+struct zippo_input_source;
+
+/**
+ * @param fd an evdev device opened O_NONBLOCK, left open on removal
+ * @param name shown in the log for slow callbacks
+ */
+struct zippo_input_source* zippo_input_reader_add(
+    struct zippo_input_reader* self, int fd, zippo_input_reader_func_t func,
+    void* data, const char* name);
+
+void zippo_input_source_remove(struct zippo_input_source* source);
+
+// "io_uring", "io_uring multishot" or "epoll"
+const char* zippo_input_reader_get_backend(struct zippo_input_reader* self);
+
+void zippo_input_reader_get_stats(struct zippo_input_reader* self,
+    struct zippo_input_reader_stats* stats);
+
+/**
+ * @param use_io_uring false to read with epoll only
+ */
+struct zippo_input_reader* zippo_input_reader_create(
+    struct wl_event_loop* loop, bool use_io_uring);
+
+// after every source was removed
+void zippo_input_reader_destroy(struct zippo_input_reader* self);
+
+#endif  //  ZIPPO_INPUT_READER_H
@@ -0,0 +1,541 @@
+#define _GNU_SOURCE
+
+#include "keymap_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ZIPPO_KEYMAP_FILE_MAGIC "ZPKEYMAP"
+#define ZIPPO_KEYMAP_FILE_VERSION 2
+
+// serialized keymap file: header, the names blob, then the keymap text with
+// its null terminator
+struct zippo_keymap_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t names_size;
+  uint64_t inputs;  // see keymap_inputs(), keymaps built from others are stale
+  uint64_t keymap_size;
+};
+
+struct zippo_keymap_cache_entry {
+  char* names;  // "rules\0model\0layout\0variant\0options\0"
+  size_t names_size;
+  struct zippo_keymap* keymap;
+};
+
+struct zippo_keymap_cache {
+  struct xkb_context* context;
+  char* dir;  // NULL if there is no usable cache directory
+
+  struct zippo_keymap_cache_entry* entries;
+  int count;
+};
+
+struct zippo_keymap*
+zippo_keymap_ref(struct zippo_keymap* self)
+{
+  self->ref_count++;
+  return self;
+}
+
+void
+zippo_keymap_unref(struct zippo_keymap* self)
+{
+  if (--self->ref_count > 0) return;
+
+  xkb_keymap_unref(self->keymap);
+  close(self->fd);
+  free(self);
+}
+
+static struct zippo_keymap*
+zippo_keymap_create(struct xkb_keymap* keymap, const char* text, size_t size)
+{
+  struct zippo_keymap* self;
+  const char* p = text;
+  size_t left = size;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->fd = memfd_create("zippo-keymap", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (self->fd < 0) {
+    fprintf(stderr, "Failed to create keymap memfd: %s\n", strerror(errno));
+    goto err_memfd;
+  }
+
+  while (left > 0) {
+    ssize_t len = write(self->fd, p, left);
+    if (len < 0 && errno == EINTR) continue;
+    if (len <= 0) {
+      fprintf(stderr, "Failed to write keymap: %s\n", strerror(errno));
+      goto err_write;
+    }
+    p += len;
+    left -= len;
+  }
+
+  // clients can only map it read only or private, so one copy is shared
+  if (fcntl(self->fd, F_ADD_SEALS,
+          F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+    fprintf(stderr, "Failed to seal keymap memfd: %s\n", strerror(errno));
+    goto err_write;
+  }
+
+  self->keymap = keymap;
+  self->size = size;
+  self->ref_count = 1;
+
+  return self;
+
+err_write:
+  close(self->fd);
+
+err_memfd:
+  free(self);
+  return NULL;
+}
+
+// same defaults as xkbcommon, so that every way of asking for a keymap maps
+// to one key
+static const char*
+names_default(const char* value, const char* env, const char* fallback)
+{
+  const char* env_value;
+
+  if (value && value[0] != '\0') return value;
+
+  env_value = secure_getenv(env);
+  if (env_value && env_value[0] != '\0') return env_value;
+
+  return fallback;
+}
+
+static void
+names_resolve(const struct xkb_rule_names* names, struct xkb_rule_names* out)
+{
+  static const struct xkb_rule_names empty = {0};
+
+  if (names == NULL) names = &empty;
+
+  out->rules = names_default(names->rules, "XKB_DEFAULT_RULES", "evdev");
+  out->model = names_default(names->model, "XKB_DEFAULT_MODEL", "pc105");
+
+  // the default variant only goes with the default layout
+  if (names->layout && names->layout[0] != '\0') {
+    out->layout = names->layout;
+    out->variant = names->variant ? names->variant : "";
+  } else {
+    out->layout = names_default(NULL, "XKB_DEFAULT_LAYOUT", "us");
+    out->variant = names_default(NULL, "XKB_DEFAULT_VARIANT", "");
+  }
+
+  if (names->options)
+    out->options = names->options;
+  else
+    out->options = names_default(NULL, "XKB_DEFAULT_OPTIONS", "");
+}
+
+static char*
+names_serialize(const struct xkb_rule_names* names, size_t* size)
+{
+  const char* fields[] = {
+      names->rules, names->model, names->layout, names->variant,
+      names->options};
+  size_t total = 0;
+  char *blob, *p;
+
+  for (int i = 0; i < 5; i++) total += strlen(fields[i]) + 1;
+
+  blob = malloc(total);
+  if (blob == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  p = blob;
+  for (int i = 0; i < 5; i++) {
+    size_t len = strlen(fields[i]) + 1;
+    memcpy(p, fields[i], len);
+    p += len;
+  }
+
+  *size = total;
+  return blob;
+}
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+
+static uint64_t
+fnv1a(uint64_t hash, const void* data, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    hash ^= ((const uint8_t*)data)[i];
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+static uint64_t
+stat_hash(uint64_t hash, const struct stat* st)
+{
+  hash = fnv1a(hash, &st->st_mtim, sizeof st->st_mtim);
+  hash = fnv1a(hash, &st->st_ino, sizeof st->st_ino);
+  return fnv1a(hash, &st->st_size, sizeof st->st_size);
+}
+
+// the directory and every file in it. the sum does not depend on the order
+// readdir() returns them in.
+static uint64_t
+dir_hash(const char* path)
+{
+  struct dirent* entry;
+  struct stat st;
+  uint64_t sum;
+  DIR* dir;
+
+  dir = opendir(path);
+  if (dir == NULL) return 0;
+
+  if (fstat(dirfd(dir), &st) != 0) {
+    closedir(dir);
+    return 0;
+  }
+  sum = stat_hash(FNV_OFFSET, &st);
+
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') continue;
+    if (fstatat(dirfd(dir), entry->d_name, &st, 0) != 0) continue;
+    sum += stat_hash(fnv1a(FNV_OFFSET, entry->d_name, strlen(entry->d_name)),
+        &st);
+  }
+
+  closedir(dir);
+
+  return sum;
+}
+
+// xkbcommon has no version call, the library file loaded stands in for it
+static int
+xkbcommon_hash(struct dl_phdr_info* info, size_t size, void* data)
+{
+  struct stat st;
+  (void)size;
+
+  if (strstr(info->dlpi_name, "libxkbcommon.so") == NULL) return 0;
+  if (stat(info->dlpi_name, &st) != 0) return 0;
+
+  *(uint64_t*)data = stat_hash(
+      fnv1a(*(uint64_t*)data, info->dlpi_name, strlen(info->dlpi_name)), &st);
+
+  return 1;
+}
+
+// what a compiled keymap depends on besides its names: the include paths
+// xkbcommon searches, in order, which cover $XDG_CONFIG_HOME/xkb, ~/.xkb,
+// /etc/xkb, XKB_CONFIG_EXTRA_PATH and XKB_CONFIG_ROOT, the files of their
+// components, and the xkbcommon library itself. a change to any of them
+// makes every cached keymap stale.
+static uint64_t
+keymap_inputs(struct xkb_context* context)
+{
+  static const char* components[] = {
+      "rules", "keycodes", "types", "compat", "symbols"};
+  uint64_t hash = FNV_OFFSET;
+  char path[PATH_MAX];
+  int len;
+
+  for (unsigned i = 0; i < xkb_context_num_include_paths(context); i++) {
+    const char* include = xkb_context_include_path_get(context, i);
+
+    hash = fnv1a(hash, include, strlen(include) + 1);
+    for (size_t k = 0; k < sizeof components / sizeof components[0]; k++) {
+      uint64_t dir;
+
+      len = snprintf(path, sizeof path, "%s/%s", include, components[k]);
+      if (len < 0 || (size_t)len >= sizeof path) continue;
+      dir = dir_hash(path);
+      hash = fnv1a(hash, &dir, sizeof dir);
+    }
+  }
+
+  dl_iterate_phdr(xkbcommon_hash, &hash);
+
+  return hash;
+}
+
+static void
+cache_path(struct zippo_keymap_cache* self, const char* names, size_t size,
+    char* path, size_t path_size)
+{
+  uint64_t hash = fnv1a(FNV_OFFSET, names, size);
+
+  snprintf(path, path_size, "%s/%016llx.keymap", self->dir,
+      (unsigned long long)hash);
+}
+
+static struct zippo_keymap*
+zippo_keymap_cache_load(struct zippo_keymap_cache* self, const char* path,
+    const char* names, size_t names_size, uint64_t inputs)
+{
+  const struct zippo_keymap_file_header* header;
+  struct zippo_keymap* keymap = NULL;
+  struct xkb_keymap* xkb_keymap;
+  const char* text;
+  struct stat st;
+  void* data;
+  int fd;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return NULL;  // not cached yet
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof *header) {
+    close(fd);
+    return NULL;
+  }
+
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return NULL;
+
+  header = data;
+  text = (const char*)(header + 1) + names_size;
+
+  // a hash collision, a stale or a truncated file is just a miss
+  if (memcmp(header->magic, ZIPPO_KEYMAP_FILE_MAGIC, 8) != 0 ||
+      header->version != ZIPPO_KEYMAP_FILE_VERSION ||
+      header->names_size != names_size || header->inputs != inputs ||
+      header->keymap_size == 0 ||
+      header->keymap_size > (uint64_t)st.st_size ||
+      (uint64_t)st.st_size !=
+          sizeof *header + names_size + header->keymap_size ||
+      memcmp(header + 1, names, names_size) != 0 ||
+      text[header->keymap_size - 1] != '\0')
+    goto out;
+
+  xkb_keymap = xkb_keymap_new_from_buffer(self->context, text,
+      header->keymap_size - 1, XKB_KEYMAP_FORMAT_TEXT_V1,
+      XKB_KEYMAP_COMPILE_NO_FLAGS);
+  if (xkb_keymap == NULL) goto out;
+
+  keymap = zippo_keymap_create(xkb_keymap, text, header->keymap_size);
+  if (keymap == NULL) xkb_keymap_unref(xkb_keymap);
+
+out:
+  munmap(data, st.st_size);
+  return keymap;
+}
+
+static void
+zippo_keymap_cache_store(struct zippo_keymap_cache* self, const char* path,
+    const char* names, size_t names_size, uint64_t inputs, const char* text,
+    size_t size)
+{
+  struct zippo_keymap_file_header header = {
+      .version = ZIPPO_KEYMAP_FILE_VERSION,
+      .names_size = names_size,
+      .inputs = inputs,
+      .keymap_size = size,
+  };
+  char tmp[PATH_MAX];
+  FILE* file;
+  int fd, ok;
+
+  memcpy(header.magic, ZIPPO_KEYMAP_FILE_MAGIC, sizeof header.magic);
+
+  snprintf(tmp, sizeof tmp, "%s/.keymap-XXXXXX", self->dir);
+  fd = mkostemp(tmp, O_CLOEXEC);
+  if (fd < 0) return;
+
+  file = fdopen(fd, "w");
+  if (file == NULL) {
+    close(fd);
+    unlink(tmp);
+    return;
+  }
+
+  ok = fwrite(&header, sizeof header, 1, file) == 1 &&
+       fwrite(names, names_size, 1, file) == 1 &&
+       fwrite(text, size, 1, file) == 1;
+  ok = fclose(file) == 0 && ok;
+
+  // readers only ever see a complete file
+  if (!ok || rename(tmp, path) != 0) {
+    fprintf(stderr, "Failed to store keymap to %s\n", path);
+    unlink(tmp);
+  }
+}
+
+static struct zippo_keymap*
+zippo_keymap_cache_compile(struct zippo_keymap_cache* self,
+    const struct xkb_rule_names* names, const char* blob, size_t blob_size)
+{
+  struct zippo_keymap* keymap;
+  struct xkb_keymap* xkb_keymap;
+  char path[PATH_MAX];
+  uint64_t inputs = 0;
+  char* text;
+
+  if (self->dir) {
+    cache_path(self, blob, blob_size, path, sizeof path);
+    inputs = keymap_inputs(self->context);
+    keymap = zippo_keymap_cache_load(self, path, blob, blob_size, inputs);
+    if (keymap) return keymap;
+  }
+
+  xkb_keymap = xkb_keymap_new_from_names(
+      self->context, names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  if (xkb_keymap == NULL) {
+    fprintf(stderr, "Failed to compile keymap %s/%s/%s/%s/%s\n", names->rules,
+        names->model, names->layout, names->variant, names->options);
+    return NULL;
+  }
+
+  text = xkb_keymap_get_as_string(xkb_keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+  if (text == NULL) {
+    fprintf(stderr, "Failed to serialize keymap\n");
+    xkb_keymap_unref(xkb_keymap);
+    return NULL;
+  }
+
+  keymap = zippo_keymap_create(xkb_keymap, text, strlen(text) + 1);
+  if (keymap == NULL) {
+    xkb_keymap_unref(xkb_keymap);
+  } else if (self->dir) {
+    zippo_keymap_cache_store(
+        self, path, blob, blob_size, inputs, text, keymap->size);
+  }
+
+  free(text);
+  return keymap;
+}
+
+struct zippo_keymap*
+zippo_keymap_cache_get(
+    struct zippo_keymap_cache* self, const struct xkb_rule_names* names)
+{
+  struct zippo_keymap_cache_entry* entries;
+  struct xkb_rule_names resolved;
+  struct zippo_keymap* keymap;
+  size_t blob_size;
+  char* blob;
+
+  names_resolve(names, &resolved);
+
+  blob = names_serialize(&resolved, &blob_size);
+  if (blob == NULL) return NULL;
+
+  for (int i = 0; i < self->count; i++) {
+    if (self->entries[i].names_size == blob_size &&
+        memcmp(self->entries[i].names, blob, blob_size) == 0) {
+      free(blob);
+      return zippo_keymap_ref(self->entries[i].keymap);
+    }
+  }
+
+  keymap = zippo_keymap_cache_compile(self, &resolved, blob, blob_size);
+  if (keymap == NULL) {
+    free(blob);
+    return NULL;
+  }
+
+  entries = realloc(self->entries, (self->count + 1) * sizeof *entries);
+  if (entries == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    free(blob);
+    return keymap;  // usable, just not cached
+  }
+
+  self->entries = entries;
+  self->entries[self->count].names = blob;
+  self->entries[self->count].names_size = blob_size;
+  self->entries[self->count].keymap = keymap;
+  self->count++;
+
+  return zippo_keymap_ref(keymap);
+}
+
+static int
+make_dirs(char* path)
+{
+  for (char* p = path + 1; *p; p++) {
+    if (*p != '/') continue;
+    *p = '\0';
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+      *p = '/';
+      return -1;
+    }
+    *p = '/';
+  }
+
+  return mkdir(path, 0700) != 0 && errno != EEXIST ? -1 : 0;
+}
+
+static char*
+default_dir()
+{
+  const char* base = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  char path[PATH_MAX];
+
+  if (base && base[0] == '/')
+    snprintf(path, sizeof path, "%s/zippo/keymaps", base);
+  else if (home && home[0] == '/')
+    snprintf(path, sizeof path, "%s/.cache/zippo/keymaps", home);
+  else
+    return NULL;
+
+  return strdup(path);
+}
+
+struct zippo_keymap_cache*
+zippo_keymap_cache_create(struct xkb_context* context, const char* dir)
+{
+  struct zippo_keymap_cache* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->context = xkb_context_ref(context);
+
+  self->dir = dir ? strdup(dir) : default_dir();
+  if (self->dir && make_dirs(self->dir) != 0) {
+    fprintf(stderr, "Failed to create keymap cache %s: %s\n", self->dir,
+        strerror(errno));
+    free(self->dir);
+    self->dir = NULL;
+  }
+
+  return self;
+}
+
+void
+zippo_keymap_cache_destroy(struct zippo_keymap_cache* self)
+{
+  for (int i = 0; i < self->count; i++) {
+    free(self->entries[i].names);
+    zippo_keymap_unref(self->entries[i].keymap);
+  }
+  free(self->entries);
+  free(self->dir);
+  xkb_context_unref(self->context);
+  free(self);
+}
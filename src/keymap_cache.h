@@ -0,0 +1,48 @@
+#ifndef ZIPPO_KEYMAP_CACHE_H
+#define ZIPPO_KEYMAP_CACHE_H
+
+#include <stddef.h>
+#include <xkbcommon/xkbcommon.h>
+
+struct zippo_keymap {
+  struct xkb_keymap* keymap;
+
+  // sealed read only memfd holding the serialized keymap, send the same fd
+  // to every client with wl_keyboard.keymap. size includes the terminating
+  // null byte as the protocol requires.
+  int fd;
+  size_t size;
+
+  int ref_count;
+};
+
+struct zippo_keymap* zippo_keymap_ref(struct zippo_keymap* self);
+
+void zippo_keymap_unref(struct zippo_keymap* self);
+
+// compiled keymaps keyed by their RMLVO names. a keymap is compiled from the
+// rules once, later lookups reuse it from memory and later runs load the
+// serialized form from the cache directory, which skips rules resolution. a
+// serialized keymap is only used while the xkb data files in the include
+// paths and the libxkbcommon library are the ones it was compiled from.
+struct zippo_keymap_cache;
+
+/**
+ * @param names NULL or empty fields take the same defaults xkbcommon would
+ * use
+ * @return a new reference, NULL on failure
+ */
+struct zippo_keymap* zippo_keymap_cache_get(
+    struct zippo_keymap_cache* self, const struct xkb_rule_names* names);
+
+/**
+ * @param dir where serialized keymaps are stored, NULL for
+ * $XDG_CACHE_HOME/zippo/keymaps. the cache still works in memory if it
+ * cannot be used.
+ */
+struct zippo_keymap_cache* zippo_keymap_cache_create(
+    struct xkb_context* context, const char* dir);
+
+void zippo_keymap_cache_destroy(struct zippo_keymap_cache* self);
+
+#endif  //  ZIPPO_KEYMAP_CACHE_H
@@ -0,0 +1,364 @@
+#include "launcher_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+// replies are small, but the launcher blocks sending them while we block
+// sending requests if both socket buffers fill up. bounding the requests in
+// flight keeps that from happening, the rest wait in the queue.
+#define ZIPPO_LAUNCHER_CLIENT_MAX_IN_FLIGHT 64
+
+struct zippo_launcher_client_request {
+  uint32_t id;
+  zippo_launcher_client_reply_func_t callback;
+  void* data;
+};
+
+// not sent yet, the fd is our own copy
+struct zippo_launcher_client_queued {
+  struct zippo_launcher_client_queued* next;
+  zippo_launcher_client_reply_func_t callback;
+  void* data;
+  uint16_t opcode;
+  int fd;
+  uint32_t size;
+  char payload[];
+};
+
+struct zippo_launcher_client {
+  int sock;
+  uint32_t next_id;
+
+  const struct zippo_launcher_client_listener* listener;
+  void* data;
+
+  // in flight requests in send order, a ring
+  struct zippo_launcher_client_request
+      pending[ZIPPO_LAUNCHER_CLIENT_MAX_IN_FLIGHT];
+  int head;
+  int count;
+
+  // waiting for a request in flight to be answered, in send order
+  struct zippo_launcher_client_queued* queue_head;
+  struct zippo_launcher_client_queued** queue_tail;
+  int queued;
+};
+
+static void
+zippo_launcher_client_queued_free(struct zippo_launcher_client_queued* self)
+{
+  if (self->fd >= 0) close(self->fd);
+  free(self);
+}
+
+static int
+zippo_launcher_client_send(struct zippo_launcher_client* self,
+    uint16_t opcode, const void* payload, uint32_t size, int fd,
+    zippo_launcher_client_reply_func_t callback, void* data)
+{
+  struct zippo_launcher_client_request* request;
+  uint32_t id;
+
+  id = self->next_id++;
+  if (self->next_id == 0) self->next_id = 1;  // 0 is for events
+
+  if (zippo_launch_message_send(self->sock, opcode, id, payload, size, fd) !=
+      0) {
+    fprintf(stderr, "Failed to send to the launcher: %s\n", strerror(errno));
+    return -1;
+  }
+
+  request = &self->pending[(self->head + self->count) %
+                           ZIPPO_LAUNCHER_CLIENT_MAX_IN_FLIGHT];
+  request->id = id;
+  request->callback = callback;
+  request->data = data;
+  self->count++;
+
+  return 0;
+}
+
+// as many queued requests as there is room for in flight
+static int
+zippo_launcher_client_send_queued(struct zippo_launcher_client* self)
+{
+  struct zippo_launcher_client_queued* queued;
+  int ret;
+
+  while (self->queue_head &&
+         self->count < ZIPPO_LAUNCHER_CLIENT_MAX_IN_FLIGHT) {
+    queued = self->queue_head;
+    self->queue_head = queued->next;
+    if (self->queue_head == NULL) self->queue_tail = &self->queue_head;
+    self->queued--;
+
+    ret = zippo_launcher_client_send(self, queued->opcode, queued->payload,
+        queued->size, queued->fd, queued->callback, queued->data);
+    zippo_launcher_client_queued_free(queued);
+    if (ret != 0) return -1;
+  }
+
+  return 0;
+}
+
+static void
+zippo_launcher_client_handle_reply(
+    struct zippo_launcher_client* self, uint32_t id, int ret, int fd)
+{
+  struct zippo_launcher_client_request request;
+  int i;
+
+  // the launcher answers in order, so this is almost always the head
+  for (i = 0; i < self->count; i++) {
+    int index = (self->head + i) % ZIPPO_LAUNCHER_CLIENT_MAX_IN_FLIGHT;
+    if (self->pending[index].id == id) break;
+  }
+
+  if (i == self->count) {
+    fprintf(stderr, "Unexpected launcher reply %u\n", id);
+    if (fd >= 0) close(fd);
+    return;
+  }
+
+  request =
+      self->pending[(self->head + i) % ZIPPO_LAUNCHER_CLIENT_MAX_IN_FLIGHT];
+
+  for (; i > 0; i--) {
+    int to = (self->head + i) % ZIPPO_LAUNCHER_CLIENT_MAX_IN_FLIGHT;
+    int from = (self->head + i - 1) % ZIPPO_LAUNCHER_CLIENT_MAX_IN_FLIGHT;
+    self->pending[to] = self->pending[from];
+  }
+  self->head = (self->head + 1) % ZIPPO_LAUNCHER_CLIENT_MAX_IN_FLIGHT;
+  self->count--;
+
+  if (request.callback)
+    request.callback(request.data, ret, fd);
+  else if (fd >= 0)
+    close(fd);
+}
+
+int
+zippo_launcher_client_dispatch(struct zippo_launcher_client* self)
+{
+  union {
+    struct zippo_launch_message message;
+    char buf[ZIPPO_LAUNCH_MAX_MESSAGE_SIZE];
+  } data;
+  ssize_t len;
+  int fd;
+
+  while ((len = zippo_launch_message_recv(
+              self->sock, data.buf, sizeof data.buf, &fd)) > 0) {
+    const struct zippo_launch_message* message = &data.message;
+
+    if (zippo_launch_message_validate(data.buf, len, fd) != 0) {
+      fprintf(stderr, "Invalid message from the launcher\n");
+      if (fd >= 0) close(fd);
+      continue;
+    }
+
+    switch (message->opcode) {
+      case ZIPPO_LAUNCH_REPLY: {
+        const struct zippo_launch_reply* reply = (const void*)(message + 1);
+        zippo_launcher_client_handle_reply(self, message->id, reply->ret, fd);
+        fd = -1;
+        break;
+      }
+
+      case ZIPPO_LAUNCH_ACTIVATE:
+        if (self->listener && self->listener->activate)
+          self->listener->activate(self->data);
+        break;
+
+      case ZIPPO_LAUNCH_DEACTIVATE:
+        if (self->listener && self->listener->deactivate)
+          self->listener->deactivate(self->data);
+        break;
+
+      default:
+        fprintf(stderr, "Unexpected launcher opcode %u\n", message->opcode);
+        break;
+    }
+
+    if (fd >= 0) close(fd);
+  }
+
+  if (len == 0) return -1;
+  if (len < 0 && errno != EAGAIN) {
+    fprintf(stderr, "Failed to receive from the launcher: %s\n",
+        strerror(errno));
+    return -1;
+  }
+
+  return zippo_launcher_client_send_queued(self);
+}
+
+static int
+zippo_launcher_client_request(struct zippo_launcher_client* self,
+    uint16_t opcode, const void* payload, uint32_t size, int fd,
+    zippo_launcher_client_reply_func_t callback, void* data)
+{
+  struct zippo_launcher_client_queued* queued;
+
+  // never wait for the launcher here, this runs on the main loop
+  if (self->count < ZIPPO_LAUNCHER_CLIENT_MAX_IN_FLIGHT &&
+      self->queue_head == NULL)
+    return zippo_launcher_client_send(
+        self, opcode, payload, size, fd, callback, data);
+
+  queued = malloc(sizeof *queued + size);
+  if (queued == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return -1;
+  }
+
+  queued->fd = -1;
+  if (fd >= 0) {
+    queued->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (queued->fd < 0) {
+      fprintf(stderr, "Failed to duplicate fd: %s\n", strerror(errno));
+      free(queued);
+      return -1;
+    }
+  }
+
+  queued->next = NULL;
+  queued->callback = callback;
+  queued->data = data;
+  queued->opcode = opcode;
+  queued->size = size;
+  if (size) memcpy(queued->payload, payload, size);
+
+  *self->queue_tail = queued;
+  self->queue_tail = &queued->next;
+  self->queued++;
+
+  return 0;
+}
+
+int
+zippo_launcher_client_open(struct zippo_launcher_client* self,
+    const char* path, int flags, zippo_launcher_client_reply_func_t callback,
+    void* data)
+{
+  union {
+    struct zippo_launch_open message;
+    char buf[ZIPPO_LAUNCH_MAX_MESSAGE_SIZE -
+             sizeof(struct zippo_launch_message)];
+  } payload;
+  size_t len = strlen(path) + 1;
+
+  if (sizeof payload.message + len > sizeof payload) {
+    fprintf(stderr, "Device path too long: %s\n", path);
+    return -1;
+  }
+
+  payload.message.flags = flags;
+  memcpy(payload.message.path, path, len);
+
+  return zippo_launcher_client_request(self, ZIPPO_LAUNCH_OPEN, &payload,
+      sizeof payload.message + len, -1, callback, data);
+}
+
+int
+zippo_launcher_client_revoke(struct zippo_launcher_client* self, int fd,
+    zippo_launcher_client_reply_func_t callback, void* data)
+{
+  return zippo_launcher_client_request(
+      self, ZIPPO_LAUNCH_REVOKE, NULL, 0, fd, callback, data);
+}
+
+int
+zippo_launcher_client_switch_vt(struct zippo_launcher_client* self, int vt,
+    zippo_launcher_client_reply_func_t callback, void* data)
+{
+  struct zippo_launch_switch_vt payload = {.vt = vt};
+
+  return zippo_launcher_client_request(self, ZIPPO_LAUNCH_SWITCH_VT, &payload,
+      sizeof payload, -1, callback, data);
+}
+
+int
+zippo_launcher_client_set_master(struct zippo_launcher_client* self, int fd,
+    zippo_launcher_client_reply_func_t callback, void* data)
+{
+  return zippo_launcher_client_request(
+      self, ZIPPO_LAUNCH_SET_MASTER, NULL, 0, fd, callback, data);
+}
+
+int
+zippo_launcher_client_drop_master(struct zippo_launcher_client* self, int fd,
+    zippo_launcher_client_reply_func_t callback, void* data)
+{
+  return zippo_launcher_client_request(
+      self, ZIPPO_LAUNCH_DROP_MASTER, NULL, 0, fd, callback, data);
+}
+
+int
+zippo_launcher_client_deactivate_done(struct zippo_launcher_client* self,
+    zippo_launcher_client_reply_func_t callback, void* data)
+{
+  return zippo_launcher_client_request(
+      self, ZIPPO_LAUNCH_DEACTIVATE_DONE, NULL, 0, -1, callback, data);
+}
+
+int
+zippo_launcher_client_heartbeat(struct zippo_launcher_client* self,
+    zippo_launcher_client_reply_func_t callback, void* data)
+{
+  return zippo_launcher_client_request(
+      self, ZIPPO_LAUNCH_HEARTBEAT, NULL, 0, -1, callback, data);
+}
+
+int
+zippo_launcher_client_get_fd(struct zippo_launcher_client* self)
+{
+  return self->sock;
+}
+
+int
+zippo_launcher_client_get_pending(struct zippo_launcher_client* self)
+{
+  return self->count + self->queued;
+}
+
+struct zippo_launcher_client*
+zippo_launcher_client_create(int sock,
+    const struct zippo_launcher_client_listener* listener, void* data)
+{
+  struct zippo_launcher_client* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->sock = sock;
+  self->next_id = 1;
+  self->queue_tail = &self->queue_head;
+  self->listener = listener;
+  self->data = data;
+
+  return self;
+}
+
+void
+zippo_launcher_client_destroy(struct zippo_launcher_client* self)
+{
+  struct zippo_launcher_client_queued *queued = self->queue_head, *next;
+
+  // pending callbacks are dropped, their replies can no longer arrive
+  for (; queued; queued = next) {
+    next = queued->next;
+    zippo_launcher_client_queued_free(queued);
+  }
+  close(self->sock);
+  free(self);
+}
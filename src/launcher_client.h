@@ -0,0 +1,65 @@
+#ifndef ZIPPO_LAUNCHER_CLIENT_H
+#define ZIPPO_LAUNCHER_CLIENT_H
+
+#include <stdint.h>
+
+// called with the result (0 or negative errno) of a request. fd is the
+// opened device for open requests and -1 otherwise, the callee owns it.
+typedef void (*zippo_launcher_client_reply_func_t)(
+    void* data, int ret, int fd);
+
+struct zippo_launcher_client_listener {
+  void (*activate)(void* data);
+  void (*deactivate)(void* data);
+};
+
+// compositor side of the zippo-launch socketpair. requests are pipelined:
+// they return as soon as the message is sent and their callbacks run from
+// zippo_launcher_client_dispatch() when the matching reply arrives. they
+// never block, past a bound of requests in flight they are queued and sent
+// from zippo_launcher_client_dispatch() as replies come in.
+struct zippo_launcher_client;
+
+int zippo_launcher_client_open(struct zippo_launcher_client* self,
+    const char* path, int flags, zippo_launcher_client_reply_func_t callback,
+    void* data);
+
+int zippo_launcher_client_revoke(struct zippo_launcher_client* self, int fd,
+    zippo_launcher_client_reply_func_t callback, void* data);
+
+int zippo_launcher_client_switch_vt(struct zippo_launcher_client* self,
+    int vt, zippo_launcher_client_reply_func_t callback, void* data);
+
+int zippo_launcher_client_set_master(struct zippo_launcher_client* self,
+    int fd, zippo_launcher_client_reply_func_t callback, void* data);
+
+int zippo_launcher_client_drop_master(struct zippo_launcher_client* self,
+    int fd, zippo_launcher_client_reply_func_t callback, void* data);
+
+int zippo_launcher_client_deactivate_done(struct zippo_launcher_client* self,
+    zippo_launcher_client_reply_func_t callback, void* data);
+
+int zippo_launcher_client_heartbeat(struct zippo_launcher_client* self,
+    zippo_launcher_client_reply_func_t callback, void* data);
+
+/**
+ * Handle every reply and event that can be read without blocking.
+ *
+ * @return 0 on success, -1 if the launcher has gone
+ */
+int zippo_launcher_client_dispatch(struct zippo_launcher_client* self);
+
+int zippo_launcher_client_get_fd(struct zippo_launcher_client* self);
+
+// number of requests waiting for their reply, queued ones included
+int zippo_launcher_client_get_pending(struct zippo_launcher_client* self);
+
+/**
+ * @param sock compositor end of the socketpair, owned by the client
+ */
+struct zippo_launcher_client* zippo_launcher_client_create(int sock,
+    const struct zippo_launcher_client_listener* listener, void* data);
+
+void zippo_launcher_client_destroy(struct zippo_launcher_client* self);
+
+#endif  //  ZIPPO_LAUNCHER_CLIENT_H
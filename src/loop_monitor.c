@@ -0,0 +1,591 @@
+#define _GNU_SOURCE
+
+#include "loop_monitor.h"
+
+#include <errno.h>
+#include <execinfo.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// sent by the watchdog to the main thread to have it print its backtrace
+#define WATCHDOG_SIGNAL SIGUSR2
+
+#define BACKTRACE_DEPTH 64
+
+enum zippo_loop_callback_type {
+  ZIPPO_LOOP_CALLBACK_FD,
+  ZIPPO_LOOP_CALLBACK_TIMER,
+  ZIPPO_LOOP_CALLBACK_SIGNAL,
+  ZIPPO_LOOP_CALLBACK_IDLE,
+};
+
+static const char* type_names[] = {
+    [ZIPPO_LOOP_CALLBACK_FD] = "fd",
+    [ZIPPO_LOOP_CALLBACK_TIMER] = "timer",
+    [ZIPPO_LOOP_CALLBACK_SIGNAL] = "signal",
+    [ZIPPO_LOOP_CALLBACK_IDLE] = "idle",
+};
+
+// stands in for the callback and data of a source, one per source. freed
+// with it by zippo_loop_source_remove(), or once it ran for idle sources,
+// which the loop removes by itself.
+struct zippo_loop_callback {
+  struct zippo_loop_monitor* monitor;
+  struct wl_list link;
+  struct wl_event_source* source;
+  bool removed;  // while it runs, freed once it returns
+
+  enum zippo_loop_callback_type type;
+  int fd;  // signal number for signals, -1 for timers and idles
+  const char* name;
+  union {
+    wl_event_loop_fd_func_t fd;
+    wl_event_loop_timer_func_t timer;
+    wl_event_loop_signal_func_t signal;
+    wl_event_loop_idle_func_t idle;
+  } func;
+  void* data;
+};
+
+struct zippo_loop_monitor {
+  struct wl_display* display;
+  struct wl_event_loop* loop;
+  struct wl_listener loop_destroy;
+  struct wl_list callbacks;
+
+  uint64_t threshold_ns;
+  bool running;
+  bool slow_callback;  // in the current iteration
+  struct zippo_loop_callback* current;  // the one running
+
+  // read by the watchdog thread. a copy of what describes the running
+  // callback, the callback itself may be freed under the watchdog's feet.
+  _Atomic uint64_t busy_since_ns;  // 0 while waiting for events
+  _Atomic int current_type;
+  _Atomic(const char*) current_name;  // NULL outside of timed callbacks
+  _Atomic uint64_t stalls;
+
+  uint64_t watchdog_ns;
+  bool has_watchdog;
+  pthread_t main_thread;
+  pthread_t watchdog;
+  int wake_fd;
+  struct sigaction old_action;
+
+  uint64_t iterations;
+  uint64_t slow_iterations;
+  uint64_t slow_callbacks;
+  uint64_t max_callback_ns;
+  const char* max_callback_name;
+};
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+handle_loop_destroy(struct wl_listener* listener, void* data)
+{
+  (void)data;
+
+  // only here so that the monitor can be found from the loop
+  wl_list_remove(&listener->link);
+  wl_list_init(&listener->link);
+}
+
+static struct zippo_loop_monitor*
+get_monitor(struct wl_event_loop* loop)
+{
+  struct zippo_loop_monitor* monitor;
+  struct wl_listener* listener;
+
+  listener = wl_event_loop_get_destroy_listener(loop, handle_loop_destroy);
+  if (listener == NULL) return NULL;
+
+  return wl_container_of(listener, monitor, loop_destroy);
+}
+
+static struct zippo_loop_callback*
+zippo_loop_monitor_add_callback(
+    struct zippo_loop_monitor* self, const struct zippo_loop_callback* key)
+{
+  struct zippo_loop_callback* callback;
+
+  callback = malloc(sizeof *callback);
+  if (callback == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  *callback = *key;
+  callback->monitor = self;
+  wl_list_insert(&self->callbacks, &callback->link);
+
+  return callback;
+}
+
+static void
+zippo_loop_callback_free(struct zippo_loop_callback* self)
+{
+  wl_list_remove(&self->link);
+  free(self);
+}
+
+// NULL if the loop failed to add the source, the callback is gone then
+static struct wl_event_source*
+zippo_loop_callback_set_source(
+    struct zippo_loop_callback* self, struct wl_event_source* source)
+{
+  if (source == NULL) {
+    zippo_loop_callback_free(self);
+    return NULL;
+  }
+  self->source = source;
+
+  return source;
+}
+
+static void
+zippo_loop_callback_log(struct zippo_loop_callback* self, uint64_t elapsed)
+{
+  struct zippo_loop_monitor* monitor = self->monitor;
+
+  monitor->slow_callbacks++;
+  monitor->slow_callback = true;
+
+  if (self->fd >= 0) {
+    fprintf(stderr, "Slow %s callback %s (%s %d): %.1f ms\n",
+        type_names[self->type], self->name,
+        self->type == ZIPPO_LOOP_CALLBACK_SIGNAL ? "signal" : "fd", self->fd,
+        elapsed / 1e6);
+  } else {
+    fprintf(stderr, "Slow %s callback %s: %.1f ms\n", type_names[self->type],
+        self->name, elapsed / 1e6);
+  }
+}
+
+static uint64_t
+zippo_loop_callback_begin(struct zippo_loop_callback* self)
+{
+  self->monitor->current = self;
+  atomic_store(&self->monitor->current_type, self->type);
+  atomic_store(&self->monitor->current_name, self->name);
+
+  return now_ns();
+}
+
+static void
+zippo_loop_callback_end(struct zippo_loop_callback* self, uint64_t start)
+{
+  struct zippo_loop_monitor* monitor = self->monitor;
+  uint64_t elapsed = now_ns() - start;
+
+  monitor->current = NULL;
+  atomic_store(&monitor->current_name, NULL);
+
+  if (elapsed > monitor->max_callback_ns) {
+    monitor->max_callback_ns = elapsed;
+    monitor->max_callback_name = self->name;
+  }
+
+  if (elapsed >= monitor->threshold_ns) zippo_loop_callback_log(self, elapsed);
+
+  if (self->removed) zippo_loop_callback_free(self);
+}
+
+static int
+dispatch_fd(int fd, uint32_t mask, void* data)
+{
+  struct zippo_loop_callback* self = data;
+  uint64_t start = zippo_loop_callback_begin(self);
+  int ret = self->func.fd(fd, mask, self->data);
+
+  zippo_loop_callback_end(self, start);
+
+  return ret;
+}
+
+static int
+dispatch_timer(void* data)
+{
+  struct zippo_loop_callback* self = data;
+  uint64_t start = zippo_loop_callback_begin(self);
+  int ret = self->func.timer(self->data);
+
+  zippo_loop_callback_end(self, start);
+
+  return ret;
+}
+
+static int
+dispatch_signal(int signal_number, void* data)
+{
+  struct zippo_loop_callback* self = data;
+  uint64_t start = zippo_loop_callback_begin(self);
+  int ret = self->func.signal(signal_number, self->data);
+
+  zippo_loop_callback_end(self, start);
+
+  return ret;
+}
+
+static void
+dispatch_idle(void* data)
+{
+  struct zippo_loop_callback* self = data;
+  uint64_t start = zippo_loop_callback_begin(self);
+
+  self->func.idle(self->data);
+
+  // the loop removes idle sources once they ran
+  self->removed = true;
+  zippo_loop_callback_end(self, start);
+}
+
+// without a monitor, or when out of memory, the source is added untimed
+struct wl_event_source*
+zippo_loop_add_fd(struct wl_event_loop* loop, int fd, uint32_t mask,
+    wl_event_loop_fd_func_t func, void* data, const char* name)
+{
+  struct zippo_loop_monitor* monitor = get_monitor(loop);
+  struct zippo_loop_callback key = {.type = ZIPPO_LOOP_CALLBACK_FD,
+      .fd = fd,
+      .name = name,
+      .func.fd = func,
+      .data = data};
+  struct zippo_loop_callback* callback;
+
+  if (monitor && (callback = zippo_loop_monitor_add_callback(monitor, &key)))
+    return zippo_loop_callback_set_source(
+        callback, wl_event_loop_add_fd(loop, fd, mask, dispatch_fd, callback));
+
+  return wl_event_loop_add_fd(loop, fd, mask, func, data);
+}
+
+struct wl_event_source*
+zippo_loop_add_timer(struct wl_event_loop* loop,
+    wl_event_loop_timer_func_t func, void* data, const char* name)
+{
+  struct zippo_loop_monitor* monitor = get_monitor(loop);
+  struct zippo_loop_callback key = {.type = ZIPPO_LOOP_CALLBACK_TIMER,
+      .fd = -1,
+      .name = name,
+      .func.timer = func,
+      .data = data};
+  struct zippo_loop_callback* callback;
+
+  if (monitor && (callback = zippo_loop_monitor_add_callback(monitor, &key)))
+    return zippo_loop_callback_set_source(
+        callback, wl_event_loop_add_timer(loop, dispatch_timer, callback));
+
+  return wl_event_loop_add_timer(loop, func, data);
+}
+
+struct wl_event_source*
+zippo_loop_add_signal(struct wl_event_loop* loop, int signal_number,
+    wl_event_loop_signal_func_t func, void* data, const char* name)
+{
+  struct zippo_loop_monitor* monitor = get_monitor(loop);
+  struct zippo_loop_callback key = {.type = ZIPPO_LOOP_CALLBACK_SIGNAL,
+      .fd = signal_number,
+      .name = name,
+      .func.signal = func,
+      .data = data};
+  struct zippo_loop_callback* callback;
+
+  if (monitor && (callback = zippo_loop_monitor_add_callback(monitor, &key)))
+    return zippo_loop_callback_set_source(callback,
+        wl_event_loop_add_signal(
+            loop, signal_number, dispatch_signal, callback));
+
+  return wl_event_loop_add_signal(loop, signal_number, func, data);
+}
+
+struct wl_event_source*
+zippo_loop_add_idle(struct wl_event_loop* loop,
+    wl_event_loop_idle_func_t func, void* data, const char* name)
+{
+  struct zippo_loop_monitor* monitor = get_monitor(loop);
+  struct zippo_loop_callback key = {.type = ZIPPO_LOOP_CALLBACK_IDLE,
+      .fd = -1,
+      .name = name,
+      .func.idle = func,
+      .data = data};
+  struct zippo_loop_callback* callback;
+
+  if (monitor && (callback = zippo_loop_monitor_add_callback(monitor, &key)))
+    return zippo_loop_callback_set_source(
+        callback, wl_event_loop_add_idle(loop, dispatch_idle, callback));
+
+  return wl_event_loop_add_idle(loop, func, data);
+}
+
+void
+zippo_loop_source_remove(
+    struct wl_event_loop* loop, struct wl_event_source* source)
+{
+  struct zippo_loop_monitor* monitor = get_monitor(loop);
+  struct zippo_loop_callback* callback;
+
+  wl_event_source_remove(source);
+  if (monitor == NULL) return;
+
+  wl_list_for_each(callback, &monitor->callbacks, link)
+  {
+    if (callback->source != source) continue;
+
+    // removed by its own callback, which still uses it
+    if (monitor->current == callback)
+      callback->removed = true;
+    else
+      zippo_loop_callback_free(callback);
+    return;
+  }
+}
+
+static void
+zippo_loop_monitor_end_iteration(
+    struct zippo_loop_monitor* self, uint64_t start)
+{
+  uint64_t elapsed = now_ns() - start;
+
+  atomic_store(&self->busy_since_ns, 0);
+  self->iterations++;
+
+  // already blamed on one of our callbacks
+  if (elapsed < self->threshold_ns || self->slow_callback) return;
+
+  self->slow_iterations++;
+  fprintf(stderr,
+      "Slow loop iteration: %.1f ms outside timed callbacks, e.g. in client "
+      "requests\n",
+      elapsed / 1e6);
+}
+
+void
+zippo_loop_monitor_run(struct zippo_loop_monitor* self)
+{
+  struct pollfd pfd = {
+      .fd = wl_event_loop_get_fd(self->loop),
+      .events = POLLIN,
+  };
+  uint64_t start;
+
+  // wl_display_run() with the wait taken out of the dispatch, so that the
+  // watchdog can tell an idle loop from a stuck one
+  self->running = true;
+  while (self->running) {
+    start = now_ns();
+    atomic_store(&self->busy_since_ns, start);
+    self->slow_callback = false;
+
+    wl_event_loop_dispatch(self->loop, 0);
+    wl_event_loop_dispatch_idle(self->loop);  // added by the callbacks
+    // events are only queued while dispatching, each client gets whatever
+    // this iteration produced for it in one sendmsg
+    wl_display_flush_clients(self->display);
+
+    zippo_loop_monitor_end_iteration(self, start);
+
+    if (!self->running) break;
+
+    if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+      fprintf(stderr, "Failed to poll the event loop: %s\n", strerror(errno));
+      break;
+    }
+  }
+}
+
+void
+zippo_loop_monitor_terminate(struct zippo_loop_monitor* self)
+{
+  self->running = false;
+}
+
+void
+zippo_loop_monitor_write_metrics(void* data, FILE* out)
+{
+  struct zippo_loop_monitor* self = data;
+
+  fprintf(out, "loop_iterations %" PRIu64 "\n", self->iterations);
+  fprintf(out, "loop_slow_iterations %" PRIu64 "\n", self->slow_iterations);
+  fprintf(out, "loop_slow_callbacks %" PRIu64 "\n", self->slow_callbacks);
+  if (self->max_callback_name) {
+    fprintf(out, "loop_max_callback_ms{name=\"%s\"} %.3f\n",
+        self->max_callback_name, self->max_callback_ns / 1e6);
+  }
+  fprintf(out, "loop_stalls %" PRIu64 "\n", atomic_load(&self->stalls));
+}
+
+static void
+handle_watchdog_signal(int signal_number)
+{
+  void* frames[BACKTRACE_DEPTH];
+  int count;
+  (void)signal_number;
+
+  // both are safe here once libgcc is loaded, names of static functions
+  // need -rdynamic or addr2line
+  count = backtrace(frames, BACKTRACE_DEPTH);
+  backtrace_symbols_fd(frames, count, STDERR_FILENO);
+}
+
+static void*
+watchdog_main(void* data)
+{
+  struct zippo_loop_monitor* self = data;
+  struct pollfd pfd = {.fd = self->wake_fd, .events = POLLIN};
+  int period = self->watchdog_ns / 4000000;
+  uint64_t busy_since, reported = 0;
+
+  if (period < 10) period = 10;
+
+  // woken up through wake_fd when the monitor goes away
+  while (poll(&pfd, 1, period) == 0) {
+    const char* name;
+    uint64_t elapsed;
+
+    busy_since = atomic_load(&self->busy_since_ns);
+    if (busy_since == 0 || busy_since == reported) continue;
+
+    elapsed = now_ns() - busy_since;
+    if (elapsed < self->watchdog_ns) continue;
+
+    // once per stall
+    reported = busy_since;
+    atomic_fetch_add(&self->stalls, 1);
+
+    // the type can only be off if the loop moved on in between, and then
+    // it is not stuck
+    name = atomic_load(&self->current_name);
+    if (name) {
+      fprintf(stderr, "Main loop stuck for %.1f s in %s callback %s:\n",
+          elapsed / 1e9, type_names[atomic_load(&self->current_type)], name);
+    } else {
+      fprintf(stderr, "Main loop stuck for %.1f s:\n", elapsed / 1e9);
+    }
+
+    pthread_kill(self->main_thread, WATCHDOG_SIGNAL);
+  }
+
+  return NULL;
+}
+
+static int
+zippo_loop_monitor_start_watchdog(struct zippo_loop_monitor* self)
+{
+  struct sigaction sa;
+  sigset_t all, old;
+  void* frame;
+  int ret;
+
+  // loads libgcc now instead of in the signal handler
+  backtrace(&frame, 1);
+
+  self->wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (self->wake_fd < 0) {
+    fprintf(stderr, "Failed to create eventfd: %s\n", strerror(errno));
+    return -1;
+  }
+
+  memset(&sa, 0, sizeof sa);
+  sa.sa_handler = handle_watchdog_signal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(WATCHDOG_SIGNAL, &sa, &self->old_action);
+
+  // signals for the whole process, such as SIGTERM, must keep going to the
+  // event loop's signalfd
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  ret = pthread_create(&self->watchdog, NULL, watchdog_main, self);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  if (ret != 0) {
+    fprintf(stderr, "Failed to start the watchdog: %s\n", strerror(ret));
+    sigaction(WATCHDOG_SIGNAL, &self->old_action, NULL);
+    close(self->wake_fd);
+    return -1;
+  }
+
+  self->has_watchdog = true;
+
+  return 0;
+}
+
+static void
+zippo_loop_monitor_stop_watchdog(struct zippo_loop_monitor* self)
+{
+  uint64_t one = 1;
+
+  if (!self->has_watchdog) return;
+
+  if (write(self->wake_fd, &one, sizeof one) != sizeof one)
+    fprintf(stderr, "Failed to wake the watchdog: %s\n", strerror(errno));
+  pthread_join(self->watchdog, NULL);
+
+  sigaction(WATCHDOG_SIGNAL, &self->old_action, NULL);
+  close(self->wake_fd);
+  self->has_watchdog = false;
+}
+
+struct zippo_loop_monitor*
+zippo_loop_monitor_create(
+    struct wl_display* display, int threshold_ms, int watchdog_ms)
+{
+  struct zippo_loop_monitor* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->display = display;
+  self->loop = wl_display_get_event_loop(display);
+  self->threshold_ns = threshold_ms * 1000000ull;
+  self->watchdog_ns = watchdog_ms * 1000000ull;
+  self->main_thread = pthread_self();
+  wl_list_init(&self->callbacks);
+
+  if (watchdog_ms > 0 && zippo_loop_monitor_start_watchdog(self) != 0) {
+    free(self);
+    return NULL;
+  }
+
+  self->loop_destroy.notify = handle_loop_destroy;
+  wl_event_loop_add_destroy_listener(self->loop, &self->loop_destroy);
+
+  return self;
+}
+
+void
+zippo_loop_monitor_destroy(struct zippo_loop_monitor* self)
+{
+  struct zippo_loop_callback *callback, *tmp;
+
+  zippo_loop_monitor_stop_watchdog(self);
+
+  // sources still on the loop are not dispatched anymore
+  wl_list_for_each_safe(callback, tmp, &self->callbacks, link)
+  {
+    wl_list_remove(&callback->link);
+    free(callback);
+  }
+
+  wl_list_remove(&self->loop_destroy.link);
+  free(self);
+}
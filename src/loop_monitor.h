@@ -0,0 +1,66 @@
+#ifndef ZIPPO_LOOP_MONITOR_H
+#define ZIPPO_LOOP_MONITOR_H
+
+#include <stdio.h>
+#include <wayland-server-core.h>
+
+#define ZIPPO_LOOP_MONITOR_DEFAULT_THRESHOLD 50  // ms
+#define ZIPPO_LOOP_MONITOR_DEFAULT_WATCHDOG 3000  // ms
+
+// times the callbacks of the event loop of a wl_display. sources added with
+// the zippo_loop_add_*() functions below are timed one by one, with their
+// name, type and fd in the log. everything else, mostly client requests
+// dispatched by libwayland, is only timed per loop iteration.
+//
+// a watchdog thread dumps the backtrace of the main thread once it has
+// been busy in one iteration for longer than the watchdog timeout.
+struct zippo_loop_monitor;
+
+/**
+ * Same as wl_event_loop_add_fd(), timed if the loop has a monitor.
+ *
+ * @param name shown in the log for slow callbacks, a string literal as it
+ * is kept after the source is gone
+ */
+struct wl_event_source* zippo_loop_add_fd(struct wl_event_loop* loop, int fd,
+    uint32_t mask, wl_event_loop_fd_func_t func, void* data,
+    const char* name);
+
+struct wl_event_source* zippo_loop_add_timer(struct wl_event_loop* loop,
+    wl_event_loop_timer_func_t func, void* data, const char* name);
+
+struct wl_event_source* zippo_loop_add_signal(struct wl_event_loop* loop,
+    int signal_number, wl_event_loop_signal_func_t func, void* data,
+    const char* name);
+
+struct wl_event_source* zippo_loop_add_idle(struct wl_event_loop* loop,
+    wl_event_loop_idle_func_t func, void* data, const char* name);
+
+/**
+ * Same as wl_event_source_remove(), for sources added with the functions
+ * above. Also frees what timed the source, may be called from its own
+ * callback.
+ */
+void zippo_loop_source_remove(
+    struct wl_event_loop* loop, struct wl_event_source* source);
+
+// replaces wl_display_run()
+void zippo_loop_monitor_run(struct zippo_loop_monitor* self);
+
+// replaces wl_display_terminate()
+void zippo_loop_monitor_terminate(struct zippo_loop_monitor* self);
+
+// zippo_metrics_func_t
+void zippo_loop_monitor_write_metrics(void* data, FILE* out);
+
+/**
+ * @param threshold_ms callbacks and iterations taking longer are logged
+ * @param watchdog_ms 0 to run without the watchdog thread
+ */
+struct zippo_loop_monitor* zippo_loop_monitor_create(
+    struct wl_display* display, int threshold_ms, int watchdog_ms);
+
+// after everything that added sources through it, right before the display
+void zippo_loop_monitor_destroy(struct zippo_loop_monitor* self);
+
+#endif  //  ZIPPO_LOOP_MONITOR_H
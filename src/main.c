@@ -1,23 +1,136 @@
+#include <getopt.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "config.h"
 #include "native.h"
+#include "server.h"
+#include "xwayland.h"
+
+static void
+help(char *name)
+{
+  fprintf(stderr,
+      "Usage: %s [args...]\n"
+      "  -x, --xwayland         Start Xwayland when the first X client\n"
+      "                         connects.\n"
+      "  -i, --xwayland-idle=S  Stop Xwayland S seconds after its last\n"
+      "                         client has gone, -1 to keep it, default %d.\n"
+      "  -m, --client-soft-limit=M\n"
+      "                         Ask a client to release buffers once it\n"
+      "                         holds M MiB, 0 for no limit, default %llu.\n"
+      "  -M, --client-hard-limit=M\n"
+      "                         Disconnect a client that holds more than\n"
+      "                         M MiB, 0 for no limit, default %llu.\n"
+      "  -s, --stall-threshold=MS\n"
+      "                         Log main loop callbacks taking longer than\n"
+      "                         MS, default %d.\n"
+      "  -w, --watchdog=MS      Dump a backtrace when the main loop has been\n"
+      "                         stuck for MS, 0 to disable, default %d.\n"
+      "  -h, --help             Display this help message\n",
+      name, ZIPPO_XWAYLAND_DEFAULT_IDLE_TIMEOUT,
+      ZIPPO_CLIENT_DEFAULT_SOFT_LIMIT >> 20,
+      ZIPPO_CLIENT_DEFAULT_HARD_LIMIT >> 20,
+      ZIPPO_LOOP_MONITOR_DEFAULT_THRESHOLD,
+      ZIPPO_LOOP_MONITOR_DEFAULT_WATCHDOG);
+}
 
 int
-main()
+main(int argc, char *argv[])
 {
   fprintf(stderr, "zippo %s\n", VERSION);
 
+  int i, c, ret = 1;
+  struct zippo_server *server;
   struct zippo_native *native;
+  struct zippo_xwayland *xwayland = NULL;
+  struct option opts[] = {
+      {"xwayland", no_argument, NULL, 'x'},
+      {"xwayland-idle", required_argument, NULL, 'i'},
+      {"client-soft-limit", required_argument, NULL, 'm'},
+      {"client-hard-limit", required_argument, NULL, 'M'},
+      {"stall-threshold", required_argument, NULL, 's'},
+      {"watchdog", required_argument, NULL, 'w'},
+      {"help", no_argument, NULL, 'h'},
+      {0, 0, NULL, 0},
+  };
+  bool use_xwayland = false;
+  int xwayland_idle = ZIPPO_XWAYLAND_DEFAULT_IDLE_TIMEOUT;
+  struct zippo_client_limits limits = {
+      .soft = ZIPPO_CLIENT_DEFAULT_SOFT_LIMIT,
+      .hard = ZIPPO_CLIENT_DEFAULT_HARD_LIMIT,
+  };
+
+  int stall_threshold = ZIPPO_LOOP_MONITOR_DEFAULT_THRESHOLD;
+  int watchdog = ZIPPO_LOOP_MONITOR_DEFAULT_WATCHDOG;
+
+  while ((c = getopt_long(argc, argv, "xi:m:M:s:w:h", opts, &i)) != -1) {
+    switch (c) {
+      case 'x':
+        use_xwayland = true;
+        break;
+
+      case 'i':
+        xwayland_idle = atoi(optarg);
+        break;
+
+      case 'm':
+        limits.soft = strtoull(optarg, NULL, 10) << 20;
+        break;
+
+      case 'M':
+        limits.hard = strtoull(optarg, NULL, 10) << 20;
+        break;
+
+      case 's':
+        stall_threshold = atoi(optarg);
+        break;
+
+      case 'w':
+        watchdog = atoi(optarg);
+        break;
+
+      case 'h':
+        help(argv[0]);
+        exit(EXIT_SUCCESS);
+        break;
+
+      default:
+        exit(EXIT_FAILURE);
+        break;
+    }
+  }
+
+  // listen first, clients can queue up while the backend initializes
+  server = zippo_server_create(&limits, stall_threshold, watchdog);
+
+  if (server == NULL) goto err;
+
+  // only the X11 sockets are reserved here, Xwayland itself is started by
+  // the first X client
+  if (use_xwayland) {
+    xwayland = zippo_xwayland_create(server->display, xwayland_idle);
+    if (xwayland == NULL) goto err_xwayland;
+    setenv("DISPLAY", zippo_xwayland_get_display_name(xwayland), 1);
+  }
 
   native = zippo_native_create();
 
-  if (native == NULL) goto err;
+  if (native == NULL) goto err_native;
+
+  zippo_server_run(server);
 
   zippo_native_destroy(native);
 
-  return 0;
+  ret = 0;
+
+err_native:
+  if (xwayland) zippo_xwayland_destroy(xwayland);
+
+err_xwayland:
+  zippo_server_destroy(server);
 
 err:
-  return 1;
+  return ret;
 }
@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+
+#include "metrics.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "loop_monitor.h"
+
+struct zippo_metrics_source {
+  zippo_metrics_func_t func;
+  void* data;
+};
+
+struct zippo_metrics {
+  int fd;
+  struct wl_event_loop* loop;
+  struct wl_event_source* source;
+  struct sockaddr_un addr;
+
+  struct zippo_metrics_source* sources;
+  int source_count;
+};
+
+static int
+handle_connect(int fd, uint32_t mask, void* data)
+{
+  struct zippo_metrics* self = data;
+  char* text = NULL;
+  size_t size = 0;
+  FILE* out;
+  int client;
+  (void)mask;
+
+  client = accept4(fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+  if (client < 0) return 0;
+
+  out = open_memstream(&text, &size);
+  if (out == NULL) {
+    close(client);
+    return 0;
+  }
+
+  for (int i = 0; i < self->source_count; i++)
+    self->sources[i].func(self->sources[i].data, out);
+  fclose(out);
+
+  // a snapshot fits in the socket buffer, a reader that does not keep up
+  // gets it truncated rather than stalling the compositor
+  if (send(client, text, size, MSG_NOSIGNAL) < 0)
+    fprintf(stderr, "Failed to send metrics: %s\n", strerror(errno));
+
+  free(text);
+  close(client);
+
+  return 0;
+}
+
+int
+zippo_metrics_add_source(
+    struct zippo_metrics* self, zippo_metrics_func_t func, void* data)
+{
+  struct zippo_metrics_source* sources;
+
+  sources =
+      realloc(self->sources, (self->source_count + 1) * sizeof *sources);
+  if (sources == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return -1;
+  }
+
+  self->sources = sources;
+  self->sources[self->source_count].func = func;
+  self->sources[self->source_count].data = data;
+  self->source_count++;
+
+  return 0;
+}
+
+void
+zippo_metrics_remove_source(
+    struct zippo_metrics* self, zippo_metrics_func_t func, void* data)
+{
+  for (int i = 0; i < self->source_count; i++) {
+    if (self->sources[i].func == func && self->sources[i].data == data) {
+      memmove(&self->sources[i], &self->sources[i + 1],
+          (self->source_count - i - 1) * sizeof *self->sources);
+      self->source_count--;
+      return;
+    }
+  }
+}
+
+static int
+socket_path(const char* socket_name, char* path, size_t size)
+{
+  const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+  int len;
+
+  if (socket_name[0] == '/') {
+    len = snprintf(path, size, "%s.metrics", socket_name);
+  } else {
+    if (runtime_dir == NULL) {
+      fprintf(stderr, "XDG_RUNTIME_DIR is not set\n");
+      return -1;
+    }
+    len = snprintf(path, size, "%s/%s.metrics", runtime_dir, socket_name);
+  }
+
+  if (len < 0 || (size_t)len >= size) {
+    fprintf(stderr, "Metrics socket path is too long\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+struct zippo_metrics*
+zippo_metrics_create(struct wl_event_loop* loop, const char* socket_name)
+{
+  struct zippo_metrics* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err;
+  }
+
+  self->addr.sun_family = AF_LOCAL;
+  if (socket_path(socket_name, self->addr.sun_path,
+          sizeof self->addr.sun_path) != 0)
+    goto err_free;
+
+  self->fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (self->fd < 0) {
+    fprintf(stderr, "Failed to create metrics socket: %s\n", strerror(errno));
+    goto err_free;
+  }
+
+  // the wayland socket's lock is held, so this one is ours to replace
+  unlink(self->addr.sun_path);
+  if (bind(self->fd, (struct sockaddr*)&self->addr, sizeof self->addr) < 0 ||
+      listen(self->fd, 4) < 0) {
+    fprintf(stderr, "Failed to listen on %s: %s\n", self->addr.sun_path,
+        strerror(errno));
+    goto err_socket;
+  }
+
+  self->loop = loop;
+  self->source = zippo_loop_add_fd(
+      loop, self->fd, WL_EVENT_READABLE, handle_connect, self, "metrics");
+  if (self->source == NULL) {
+    fprintf(stderr, "Failed to watch the metrics socket\n");
+    goto err_bind;
+  }
+
+  return self;
+
+err_bind:
+  unlink(self->addr.sun_path);
+
+err_socket:
+  close(self->fd);
+
+err_free:
+  free(self);
+
+err:
+  return NULL;
+}
+
+void
+zippo_metrics_destroy(struct zippo_metrics* self)
+{
+  zippo_loop_source_remove(self->loop, self->source);
+  unlink(self->addr.sun_path);
+  close(self->fd);
+  free(self->sources);
+  free(self);
+}
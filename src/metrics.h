@@ -0,0 +1,35 @@
+#ifndef ZIPPO_METRICS_H
+#define ZIPPO_METRICS_H
+
+#include <stdio.h>
+#include <wayland-server-core.h>
+
+/**
+ * Append this source's metrics to out, one "name value" pair per line.
+ */
+typedef void (*zippo_metrics_func_t)(void* data, FILE* out);
+
+// a unix socket next to the wayland socket. every connection gets a text
+// snapshot of all metrics and is closed, e.g.
+//   socat - UNIX-CONNECT:$XDG_RUNTIME_DIR/wayland-0.metrics
+struct zippo_metrics;
+
+/**
+ * @return 0 on success, -1 on failure
+ */
+int zippo_metrics_add_source(
+    struct zippo_metrics* self, zippo_metrics_func_t func, void* data);
+
+void zippo_metrics_remove_source(
+    struct zippo_metrics* self, zippo_metrics_func_t func, void* data);
+
+/**
+ * @param socket_name name of the wayland socket, the metrics socket is
+ * created next to it with ".metrics" appended
+ */
+struct zippo_metrics* zippo_metrics_create(
+    struct wl_event_loop* loop, const char* socket_name);
+
+void zippo_metrics_destroy(struct zippo_metrics* self);
+
+#endif  //  ZIPPO_METRICS_H
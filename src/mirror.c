@@ -0,0 +1,322 @@
+#include "mirror.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wayland-server-core.h>
+
+struct zippo_mirror_target {
+  struct zippo_mirror* mirror;
+  struct wl_list link;
+
+  struct zippo_scale_image* image;
+  enum zippo_scale_filter filter;
+  struct zippo_color_lut* lut;  // NULL if not calibrated
+  bool needs_full;  // new, nothing of the source is in it yet
+  struct zippo_mirror_stats stats;
+};
+
+struct zippo_mirror {
+  struct zippo_renderer* renderer;
+  struct zippo_scene* scene;
+  int x;
+  int y;
+
+  struct zippo_scale_image source;
+  struct zippo_scaler* scaler;  // coefficients of every target size
+  struct wl_list targets;  // zippo_mirror_target::link
+
+  struct zippo_renderer_rect damage[ZIPPO_MIRROR_MAX_DAMAGE];
+  int damage_count;
+};
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool
+overlaps(const struct zippo_renderer_rect* a,
+    const struct zippo_renderer_rect* b)
+{
+  return a->x < b->x + b->width && b->x < a->x + a->width &&
+         a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+static void
+unite(struct zippo_renderer_rect* a, const struct zippo_renderer_rect* b)
+{
+  int x2 = a->x + a->width > b->x + b->width ? a->x + a->width
+                                               : b->x + b->width;
+  int y2 = a->y + a->height > b->y + b->height ? a->y + a->height
+                                                 : b->y + b->height;
+
+  a->x = a->x < b->x ? a->x : b->x;
+  a->y = a->y < b->y ? a->y : b->y;
+  a->width = x2 - a->x;
+  a->height = y2 - a->y;
+}
+
+// clipped to the source
+static bool
+clip(const struct zippo_scale_image* source, struct zippo_renderer_rect* r)
+{
+  int x2 = r->x + r->width, y2 = r->y + r->height;
+
+  if (r->x < 0) r->x = 0;
+  if (r->y < 0) r->y = 0;
+  if (x2 > source->width) x2 = source->width;
+  if (y2 > source->height) y2 = source->height;
+  r->width = x2 - r->x;
+  r->height = y2 - r->y;
+
+  return r->width > 0 && r->height > 0;
+}
+
+void
+zippo_mirror_damage(
+    struct zippo_mirror* self, const struct zippo_renderer_rect* rect)
+{
+  struct zippo_renderer_rect r = *rect;
+
+  if (!clip(&self->source, &r)) return;
+
+  // a union may reach rectangles it did not overlap before, start over
+  // until nothing overlaps
+  for (int i = 0; i < self->damage_count; i++) {
+    if (!overlaps(&self->damage[i], &r)) continue;
+    unite(&r, &self->damage[i]);
+    self->damage[i] = self->damage[--self->damage_count];
+    i = -1;
+  }
+
+  if (self->damage_count == ZIPPO_MIRROR_MAX_DAMAGE) {
+    for (int i = 1; i < self->damage_count; i++)
+      unite(&self->damage[0], &self->damage[i]);
+    unite(&self->damage[0], &r);
+    self->damage_count = 1;
+    return;
+  }
+
+  self->damage[self->damage_count++] = r;
+}
+
+// the target pixels a damaged source rectangle reaches, widened by what the
+// filter of either direction reads around a pixel
+static struct zippo_renderer_rect
+zippo_mirror_target_map(
+    struct zippo_mirror_target* self, const struct zippo_renderer_rect* r)
+{
+  const struct zippo_scale_image* source = &self->mirror->source;
+  int width = self->image->width, height = self->image->height;
+  int margin_x = (width + source->width - 1) / source->width + 1;
+  int margin_y = (height + source->height - 1) / source->height + 1;
+  int64_t x1 = (int64_t)r->x * width / source->width - margin_x;
+  int64_t y1 = (int64_t)r->y * height / source->height - margin_y;
+  int64_t x2 = ((int64_t)(r->x + r->width) * width + source->width - 1) /
+                   source->width +
+               margin_x;
+  int64_t y2 = ((int64_t)(r->y + r->height) * height + source->height - 1) /
+                   source->height +
+               margin_y;
+
+  if (x1 < 0) x1 = 0;
+  if (y1 < 0) y1 = 0;
+  if (x2 > width) x2 = width;
+  if (y2 > height) y2 = height;
+
+  return (struct zippo_renderer_rect){x1, y1, x2 - x1, y2 - y1};
+}
+
+static int
+zippo_mirror_target_update(struct zippo_mirror_target* self,
+    const struct zippo_renderer_rect* damage, int damage_count)
+{
+  const struct zippo_scale_image* source = &self->mirror->source;
+  struct zippo_renderer_rect full = {0, 0, source->width, source->height};
+  bool copy = self->image->width == source->width &&
+              self->image->height == source->height;
+  uint64_t start = now_ns();
+
+  if (self->needs_full) {
+    damage = &full;
+    damage_count = 1;
+  }
+
+  for (int i = 0; i < damage_count; i++) {
+    struct zippo_renderer_rect r;
+
+    if (copy) {
+      r = damage[i];
+      for (int y = r.y; y < r.y + r.height; y++) {
+        memcpy((uint8_t*)self->image->data + y * self->image->stride +
+                   r.x * 4,
+            (const uint8_t*)source->data + y * source->stride + r.x * 4,
+            r.width * 4);
+      }
+    } else {
+      // scaled from the whole source so the filter sees the pixels around
+      // the damage, the same result as scaling everything
+      r = zippo_mirror_target_map(self, &damage[i]);
+      if (zippo_scaler_scale_region(self->mirror->scaler, self->filter,
+              source, self->image, r.x, r.y, r.width, r.height) != 0)
+        return -1;
+    }
+
+    // every rectangle is written from the source before it is transformed,
+    // so pixels where they overlap are transformed only once
+    if (self->lut) {
+      uint64_t color_start = now_ns();
+      zippo_color_lut_apply(self->lut, self->image->data, self->image->stride,
+          r.x, r.y, r.width, r.height);
+      self->stats.color_ns += now_ns() - color_start;
+    }
+
+    self->stats.pixels += (uint64_t)r.width * r.height;
+  }
+
+  self->needs_full = false;
+  self->stats.frames++;
+  if (copy) self->stats.copied_frames++;
+  self->stats.blit_ns += now_ns() - start;
+
+  return 0;
+}
+
+int
+zippo_mirror_render(struct zippo_mirror* self)
+{
+  struct zippo_mirror_target* target;
+  int ret = 0;
+
+  if (self->damage_count > 0 &&
+      zippo_renderer_render(self->renderer, self->scene, self->x, self->y,
+          &self->source, self->damage, self->damage_count) != 0)
+    return -1;
+
+  wl_list_for_each(target, &self->targets, link)
+  {
+    if (self->damage_count == 0 && !target->needs_full) continue;
+    if (zippo_mirror_target_update(
+            target, self->damage, self->damage_count) != 0)
+      ret = -1;
+  }
+
+  self->damage_count = 0;
+
+  return ret;
+}
+
+struct zippo_mirror_target*
+zippo_mirror_add_target(struct zippo_mirror* self,
+    struct zippo_scale_image* image, enum zippo_scale_filter filter)
+{
+  struct zippo_mirror_target* target;
+
+  target = calloc(1, sizeof *target);
+  if (target == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  target->mirror = self;
+  target->image = image;
+  target->filter = filter;
+  target->needs_full = true;
+  wl_list_insert(self->targets.prev, &target->link);
+
+  return target;
+}
+
+void
+zippo_mirror_target_remove(struct zippo_mirror_target* target)
+{
+  if (target->lut) zippo_color_lut_unref(target->lut);
+  wl_list_remove(&target->link);
+  free(target);
+}
+
+void
+zippo_mirror_target_set_color_lut(
+    struct zippo_mirror_target* target, struct zippo_color_lut* lut)
+{
+  if (lut) zippo_color_lut_ref(lut);
+  if (target->lut) zippo_color_lut_unref(target->lut);
+
+  target->lut = lut;
+  target->needs_full = true;
+}
+
+void
+zippo_mirror_target_get_stats(struct zippo_mirror_target* target,
+    struct zippo_mirror_stats* stats)
+{
+  *stats = target->stats;
+}
+
+const struct zippo_scale_image*
+zippo_mirror_get_source(struct zippo_mirror* self)
+{
+  return &self->source;
+}
+
+struct zippo_mirror*
+zippo_mirror_create(struct zippo_renderer* renderer,
+    struct zippo_scene* scene, int x, int y, int width, int height)
+{
+  struct zippo_mirror* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err;
+  }
+
+  self->renderer = renderer;
+  self->scene = scene;
+  self->x = x;
+  self->y = y;
+  wl_list_init(&self->targets);
+
+  self->source = (struct zippo_scale_image){
+      .width = width,
+      .height = height,
+      .stride = width * 4,
+  };
+  self->source.data = malloc((size_t)width * height * 4);
+  if (self->source.data == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err_free;
+  }
+
+  self->scaler = zippo_scaler_create();
+  if (self->scaler == NULL) goto err_source;
+
+  // nothing has been composited yet
+  self->damage[0] = (struct zippo_renderer_rect){0, 0, width, height};
+  self->damage_count = 1;
+
+  return self;
+
+err_source:
+  free(self->source.data);
+
+err_free:
+  free(self);
+
+err:
+  return NULL;
+}
+
+void
+zippo_mirror_destroy(struct zippo_mirror* self)
+{
+  zippo_scaler_destroy(self->scaler);
+  free(self->source.data);
+  free(self);
+}
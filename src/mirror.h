@@ -0,0 +1,78 @@
+#ifndef ZIPPO_MIRROR_H
+#define ZIPPO_MIRROR_H
+
+#include <stdint.h>
+
+#include "color_lut.h"
+#include "renderer.h"
+#include "scale.h"
+
+#define ZIPPO_MIRROR_MAX_DAMAGE 16
+
+struct zippo_mirror_stats {
+  uint64_t frames;  // with damage for this target
+  uint64_t copied_frames;  // same size as the source, no scaling
+  uint64_t pixels;  // target pixels written
+  uint64_t blit_ns;
+  uint64_t color_ns;  // part of blit_ns spent in the color LUT
+};
+
+// one desktop shown on several outputs of any size. the scene is composited
+// once per frame into a source buffer, only where it is damaged, and every
+// target gets the damaged area copied, or scaled when its size differs.
+struct zippo_mirror;
+
+struct zippo_mirror_target;
+
+/**
+ * @param image the framebuffer of the output, kept until the target is
+ * removed. its whole content is drawn on the next render.
+ */
+struct zippo_mirror_target* zippo_mirror_add_target(struct zippo_mirror* self,
+    struct zippo_scale_image* image, enum zippo_scale_filter filter);
+
+void zippo_mirror_target_remove(struct zippo_mirror_target* target);
+
+/**
+ * Calibrate the output. The LUT is applied to each damaged rectangle after
+ * it is copied or scaled into the target, the source stays as it is. The
+ * whole target is drawn again on the next render.
+ *
+ * @param lut NULL for none, the target keeps a reference
+ */
+void zippo_mirror_target_set_color_lut(
+    struct zippo_mirror_target* target, struct zippo_color_lut* lut);
+
+void zippo_mirror_target_get_stats(struct zippo_mirror_target* target,
+    struct zippo_mirror_stats* stats);
+
+/**
+ * Add a damaged rectangle in source coordinates. Overlapping rectangles are
+ * merged, and all of them into their bounding box once there are more than
+ * ZIPPO_MIRROR_MAX_DAMAGE.
+ */
+void zippo_mirror_damage(
+    struct zippo_mirror* self, const struct zippo_renderer_rect* rect);
+
+/**
+ * Composite the damage into the source, then update every target.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int zippo_mirror_render(struct zippo_mirror* self);
+
+// the composited desktop, valid until the mirror is destroyed
+const struct zippo_scale_image* zippo_mirror_get_source(
+    struct zippo_mirror* self);
+
+/**
+ * @param x, y top left corner of the mirrored desktop in the scene
+ * @param width, height its size, the size of the source buffer
+ */
+struct zippo_mirror* zippo_mirror_create(struct zippo_renderer* renderer,
+    struct zippo_scene* scene, int x, int y, int width, int height);
+
+// after every target was removed
+void zippo_mirror_destroy(struct zippo_mirror* self);
+
+#endif  //  ZIPPO_MIRROR_H
@@ -1,61 +1,75 @@
 #include "native.h"
 
-#include <stdbool.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
+
+#include "gpu_probe.h"
+#include "seat.h"
+
+#define MAX_SEATS 16
 
 static struct udev_device*
 find_primary_gpu(struct udev* udev, const char* seat)
 {
-  struct udev_enumerate* e;
-  struct udev_list_entry* entry;
-  const char *path, *id;
-  struct udev_device *device, *drm_device, *pci;
-
-  (void)seat;
-
-  e = udev_enumerate_new(udev);
-  udev_enumerate_add_match_subsystem(e, "drm");
-  udev_enumerate_add_match_sysname(e, "card[0-9]*");
+  char syspath[PATH_MAX];
+  struct udev_device* device;
+
+  // reading sysfs directly saves most of the libudev enumeration cost at
+  // boot, keep libudev for layouts the fast path does not understand.
+  if (zippo_gpu_probe_sysfs("", seat, syspath, sizeof syspath) == 0) {
+    device = udev_device_new_from_syspath(udev, syspath);
+    if (device) return device;
+  }
 
-  udev_enumerate_scan_devices(e);
-  drm_device = NULL;
+  return zippo_gpu_probe_udev(udev, seat);
+}
 
-  udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(e))
-  {
-    bool is_boot_vga = false;  // trueだとkmsがoffになるのとか関係あるか?
+// ZIPPO_RENDERER picks the renderer, the software one is always there to
+// fall back to
+static struct zippo_renderer*
+create_renderer()
+{
+  const char* name = getenv("ZIPPO_RENDERER");
+  struct zippo_renderer* renderer;
 
-    path = udev_list_entry_get_name(entry);
-    device = udev_device_new_from_syspath(udev, path);
-    if (!device) continue;
+  if (name && *name) {
+    renderer = zippo_renderer_create(name);
+    if (renderer) return renderer;
+    fprintf(stderr, "Falling back to the software renderer\n");
+  }
 
-    // weston checks devices' "ID_SEAT" property
+  return zippo_software_renderer_create();
+}
 
-    pci = udev_device_get_parent_with_subsystem_devtype(device, "pci", NULL);
+static int
+zippo_native_add_seat(struct zippo_native* self, const char* name)
+{
+  struct udev_device* drm_device;
+  struct zippo_seat* seat;
 
-    if (pci) {
-      id = udev_device_get_sysattr_value(pci, "boot_vga");
-      if (id && strcmp(id, "1") == 0) is_boot_vga = true;
-    }
+  drm_device = find_primary_gpu(self->udev, name);
+  if (drm_device == NULL) return -1;
 
-    if (!is_boot_vga && drm_device) {
-      udev_device_unref(device);
-      continue;
-    }
-  }
+  seat = zippo_seat_create(
+      "", name, udev_device_get_syspath(drm_device), self->keymaps);
+  udev_device_unref(drm_device);
+  if (seat == NULL) return -1;
 
-  udev_enumerate_unref(e);
+  fprintf(stderr, "Seat %s: %s, %d input devices\n", seat->name,
+      seat->drm_syspath, seat->input_count);
+  wl_list_insert(self->seats.prev, &seat->link);
 
-  return drm_device;
+  return 0;
 }
 
 struct zippo_native*
 zippo_native_create()
 {
+  char seats[MAX_SEATS][ZIPPO_GPU_PROBE_SEAT_MAX];
   struct zippo_native* self;
-  struct udev* udev = NULL;
-  struct udev_device* drm_device;
+  struct zippo_seat *seat, *tmp;
+  int count;
 
   self = calloc(1, sizeof *self);
 
@@ -64,37 +78,83 @@ zippo_native_create()
     goto err;
   }
 
-  udev = udev_new();
-  if (udev == NULL) {
+  wl_list_init(&self->seats);
+
+  self->udev = udev_new();
+  if (self->udev == NULL) {
     fprintf(stderr, "Failed to initialize udev context\n");
-    goto err;
+    goto err_udev;
+  }
+
+  self->renderer = create_renderer();
+  if (self->renderer == NULL) {
+    fprintf(stderr, "Failed to create a renderer\n");
+    goto err_renderer;
   }
 
+  self->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+  if (self->xkb_context == NULL) {
+    fprintf(stderr, "Failed to create xkb context\n");
+    goto err_xkb;
+  }
+
+  self->keymaps = zippo_keymap_cache_create(self->xkb_context, NULL);
+  if (self->keymaps == NULL) goto err_keymaps;
+
   // TODO: do some stuff regarding logind D-BUS API
 
-  drm_device = find_primary_gpu(udev, "seat0");
-  if (drm_device == NULL) {
-    fprintf(stderr, "No drm device found\n");
-    goto err;
+  // every seat with a card of its own, in this one process
+  count = zippo_gpu_probe_seats("", seats, MAX_SEATS);
+  for (int i = 0; i < count; i++) {
+    if (zippo_native_add_seat(self, seats[i]) != 0)
+      fprintf(stderr, "Failed to set up seat %s\n", seats[i]);
   }
 
-  self->udev = udev;
-  self->drm_device = drm_device;
+  // sysfs could not be read, libudev may still find a card
+  if (count < 0) zippo_native_add_seat(self, "seat0");
+
+  if (wl_list_empty(&self->seats)) {
+    fprintf(stderr, "No drm device found\n");
+    goto err_seats;
+  }
 
   return self;
 
-err:
-  if (udev) udev_unref(udev);
+err_seats:
+  wl_list_for_each_safe(seat, tmp, &self->seats, link)
+  {
+    zippo_seat_destroy(seat);
+  }
+  zippo_keymap_cache_destroy(self->keymaps);
+
+err_keymaps:
+  xkb_context_unref(self->xkb_context);
+
+err_xkb:
+  zippo_renderer_destroy(self->renderer);
+
+err_renderer:
+  udev_unref(self->udev);
 
+err_udev:
   free(self);
 
+err:
   return NULL;
 }
 
 void
 zippo_native_destroy(struct zippo_native* self)
 {
-  udev_device_unref(self->drm_device);
+  struct zippo_seat *seat, *tmp;
+
+  wl_list_for_each_safe(seat, tmp, &self->seats, link)
+  {
+    zippo_seat_destroy(seat);
+  }
+  zippo_keymap_cache_destroy(self->keymaps);
+  xkb_context_unref(self->xkb_context);
+  zippo_renderer_destroy(self->renderer);
   udev_unref(self->udev);
   free(self);
 }
@@ -2,10 +2,20 @@
 #define ZIPPO_NATIVE_H
 
 #include <libudev.h>
+#include <wayland-server-core.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "keymap_cache.h"
+#include "renderer.h"
 
 struct zippo_native {
   struct udev* udev;
-  struct udev_device* drm_device;
+  struct wl_list seats;  // zippo_seat::link, seat0 first
+
+  // shared by every seat
+  struct zippo_renderer* renderer;
+  struct xkb_context* xkb_context;
+  struct zippo_keymap_cache* keymaps;
 };
 
 struct zippo_native* zippo_native_create();
@@ -0,0 +1,187 @@
+#include "presentation.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct zippo_presentation_feedback {
+  struct wl_list link;  // zippo_presentation::pending or ::latched
+  const void* key;
+  zippo_presentation_func_t func;
+  void* data;
+};
+
+struct zippo_presentation {
+  uint64_t refresh_ns;
+  struct zippo_presentation_info last;  // of the latest presented frame
+
+  struct wl_list pending;  // committed since the last latch
+  struct wl_list latched;  // in the frame being drawn
+};
+
+static void
+zippo_presentation_feedback_discard(struct zippo_presentation_feedback* self)
+{
+  wl_list_remove(&self->link);
+  self->func(self->data, NULL);
+  free(self);
+}
+
+// one at a time, a callback may create feedbacks or destroy others, which
+// may be the next ones of the list
+static void
+zippo_presentation_discard_all(struct wl_list* list)
+{
+  while (!wl_list_empty(list)) {
+    struct zippo_presentation_feedback* feedback =
+        wl_container_of(list->next, feedback, link);
+
+    zippo_presentation_feedback_discard(feedback);
+  }
+}
+
+struct zippo_presentation_feedback*
+zippo_presentation_feedback_create(struct zippo_presentation* presentation,
+    const void* key, zippo_presentation_func_t func, void* data)
+{
+  struct zippo_presentation_feedback *self, *feedback, *tmp;
+  struct wl_list replaced;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  // the latched content of the same surface is still drawn, only what never
+  // made it into a frame is replaced
+  wl_list_init(&replaced);
+  if (key) {
+    wl_list_for_each_safe(feedback, tmp, &presentation->pending, link)
+    {
+      if (feedback->key != key) continue;
+      wl_list_remove(&feedback->link);
+      wl_list_insert(replaced.prev, &feedback->link);
+    }
+  }
+  zippo_presentation_discard_all(&replaced);
+
+  self->key = key;
+  self->func = func;
+  self->data = data;
+  wl_list_insert(presentation->pending.prev, &self->link);
+
+  return self;
+}
+
+void
+zippo_presentation_feedback_destroy(struct zippo_presentation_feedback* self)
+{
+  wl_list_remove(&self->link);
+  free(self);
+}
+
+void
+zippo_presentation_latch(struct zippo_presentation* self)
+{
+  wl_list_insert_list(self->latched.prev, &self->pending);
+  wl_list_init(&self->pending);
+}
+
+void
+zippo_presentation_presented(
+    struct zippo_presentation* self, uint64_t present_ns, uint32_t flags)
+{
+  uint64_t refresh = self->refresh_ns, steps = 1;
+
+  // count the vblanks that passed without a frame, like a hardware counter
+  if (refresh && self->last.present_ns && present_ns > self->last.present_ns)
+    steps = (present_ns - self->last.present_ns + refresh / 2) / refresh;
+  if (steps == 0) steps = 1;
+
+  self->last.present_ns = present_ns;
+  self->last.refresh_ns = refresh;
+  self->last.seq += steps;
+  self->last.flags = flags;
+
+  // a callback may create feedbacks for the next frame or destroy others of
+  // this one
+  while (!wl_list_empty(&self->latched)) {
+    struct zippo_presentation_feedback* feedback =
+        wl_container_of(self->latched.next, feedback, link);
+
+    wl_list_remove(&feedback->link);
+    feedback->func(feedback->data, &self->last);
+    free(feedback);
+  }
+}
+
+static bool
+zippo_presentation_has_pending(
+    struct zippo_presentation* self, const void* key)
+{
+  struct zippo_presentation_feedback* feedback;
+
+  wl_list_for_each(feedback, &self->pending, link)
+  {
+    if (feedback->key == key) return true;
+  }
+
+  return false;
+}
+
+void
+zippo_presentation_failed(struct zippo_presentation* self)
+{
+  struct zippo_presentation_feedback *feedback, *tmp;
+  struct wl_list replaced;
+
+  // content committed again while drawing is never going to be shown
+  wl_list_init(&replaced);
+  wl_list_for_each_safe(feedback, tmp, &self->latched, link)
+  {
+    if (!feedback->key || !zippo_presentation_has_pending(self, feedback->key))
+      continue;
+    wl_list_remove(&feedback->link);
+    wl_list_insert(replaced.prev, &feedback->link);
+  }
+  zippo_presentation_discard_all(&replaced);
+
+  wl_list_insert_list(&self->pending, &self->latched);
+  wl_list_init(&self->latched);
+}
+
+void
+zippo_presentation_get_clock(
+    struct zippo_presentation* self, struct zippo_presentation_info* info)
+{
+  *info = self->last;
+  info->refresh_ns = self->refresh_ns;
+}
+
+struct zippo_presentation*
+zippo_presentation_create(uint64_t refresh_ns)
+{
+  struct zippo_presentation* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->refresh_ns = refresh_ns;
+  wl_list_init(&self->pending);
+  wl_list_init(&self->latched);
+
+  return self;
+}
+
+void
+zippo_presentation_destroy(struct zippo_presentation* self)
+{
+  zippo_presentation_discard_all(&self->latched);
+  zippo_presentation_discard_all(&self->pending);
+
+  free(self);
+}
@@ -0,0 +1,80 @@
+#ifndef ZIPPO_PRESENTATION_H
+#define ZIPPO_PRESENTATION_H
+
+#include <stdint.h>
+#include <wayland-server-core.h>
+
+// same meaning as the kind flags of wp_presentation_feedback.presented
+enum zippo_presentation_flags {
+  ZIPPO_PRESENTATION_VSYNC = 1 << 0,  // no tearing, shown at a vblank
+  ZIPPO_PRESENTATION_HW_CLOCK = 1 << 1,  // timestamp from the display hw
+  ZIPPO_PRESENTATION_HW_COMPLETION = 1 << 2,  // completion signaled by hw
+  ZIPPO_PRESENTATION_ZERO_COPY = 1 << 3,  // client buffer scanned out as is
+};
+
+struct zippo_presentation_info {
+  uint64_t present_ns;  // CLOCK_MONOTONIC, when the frame turned visible
+  uint64_t refresh_ns;  // until the next possible present, 0 if unknown
+  uint64_t seq;  // vblank counter of the output, skipped vblanks count too
+  uint32_t flags;  // zippo_presentation_flags
+};
+
+/**
+ * @param info NULL when the content was replaced before it got on screen
+ */
+typedef void (*zippo_presentation_func_t)(
+    void* data, const struct zippo_presentation_info* info);
+
+// the clock of one output. contents committed with a feedback are reported
+// with the present time of the first frame that shows them, so that a client
+// can pace itself from the present time, refresh and sequence without a
+// frame callback round trip per frame.
+struct zippo_presentation;
+
+struct zippo_presentation_feedback;
+
+/**
+ * Ask to be told when the content committed now is presented. A pending
+ * feedback with the same key, the previous commit of the same surface that
+ * has not been drawn yet, is discarded.
+ *
+ * @param key the surface, NULL to never discard
+ * @return freed once func has run
+ */
+struct zippo_presentation_feedback* zippo_presentation_feedback_create(
+    struct zippo_presentation* presentation, const void* key,
+    zippo_presentation_func_t func, void* data);
+
+// drop a feedback without calling it, e.g. its client is gone
+void zippo_presentation_feedback_destroy(
+    struct zippo_presentation_feedback* self);
+
+// a frame starts drawing, what has been committed so far goes into it
+void zippo_presentation_latch(struct zippo_presentation* self);
+
+/**
+ * The frame started by the last zippo_presentation_latch() is on screen.
+ *
+ * @param present_ns the vblank it was shown at, the target vblank on an
+ * output that simulates them
+ * @param flags zippo_presentation_flags
+ */
+void zippo_presentation_presented(
+    struct zippo_presentation* self, uint64_t present_ns, uint32_t flags);
+
+// the latched frame never made it to the screen, its contents go into the
+// next one
+void zippo_presentation_failed(struct zippo_presentation* self);
+
+void zippo_presentation_get_clock(
+    struct zippo_presentation* self, struct zippo_presentation_info* info);
+
+/**
+ * @param refresh_ns vblank interval of the output, 0 for variable refresh
+ */
+struct zippo_presentation* zippo_presentation_create(uint64_t refresh_ns);
+
+// discards every feedback still waiting
+void zippo_presentation_destroy(struct zippo_presentation* self);
+
+#endif  //  ZIPPO_PRESENTATION_H
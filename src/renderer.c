@@ -0,0 +1,37 @@
+#include "renderer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int
+zippo_renderer_render(struct zippo_renderer* self, struct zippo_scene* scene,
+    int x, int y, struct zippo_scale_image* target,
+    const struct zippo_renderer_rect* damage, int damage_count)
+{
+  return self->impl->render(
+      self, scene, x, y, target, damage, damage_count);
+}
+
+void
+zippo_renderer_forget(
+    struct zippo_renderer* self, const struct zippo_scene_view* view)
+{
+  if (self->impl->forget) self->impl->forget(self, view);
+}
+
+void
+zippo_renderer_destroy(struct zippo_renderer* self)
+{
+  self->impl->destroy(self);
+}
+
+struct zippo_renderer*
+zippo_renderer_create(const char* name)
+{
+  if (strcmp(name, "software") == 0) return zippo_software_renderer_create();
+  if (strcmp(name, "gles2") == 0) return zippo_gles2_renderer_create();
+
+  fprintf(stderr, "Unknown renderer: %s\n", name);
+
+  return NULL;
+}
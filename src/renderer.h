@@ -0,0 +1,59 @@
+#ifndef ZIPPO_RENDERER_H
+#define ZIPPO_RENDERER_H
+
+#include "scale.h"
+#include "scene.h"
+
+struct zippo_renderer_rect {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+struct zippo_renderer;
+
+struct zippo_renderer_interface {
+  int (*render)(struct zippo_renderer* self, struct zippo_scene* scene,
+      int x, int y, struct zippo_scale_image* target,
+      const struct zippo_renderer_rect* damage, int damage_count);
+  void (*forget)(
+      struct zippo_renderer* self, const struct zippo_scene_view* view);
+  void (*destroy)(struct zippo_renderer* self);
+};
+
+// draws a zippo_scene into memory, either on the CPU or through a GPU API.
+// implementations embed this as their first member.
+struct zippo_renderer {
+  const struct zippo_renderer_interface* impl;
+  const char* name;
+};
+
+/**
+ * Draw the output whose top left corner is at x, y in the scene into
+ * target. Only the damaged rectangles, in target coordinates, are
+ * guaranteed to be updated.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int zippo_renderer_render(struct zippo_renderer* self,
+    struct zippo_scene* scene, int x, int y, struct zippo_scale_image* target,
+    const struct zippo_renderer_rect* damage, int damage_count);
+
+// drop whatever the renderer keeps for a view that is going away
+void zippo_renderer_forget(
+    struct zippo_renderer* self, const struct zippo_scene_view* view);
+
+void zippo_renderer_destroy(struct zippo_renderer* self);
+
+struct zippo_renderer* zippo_software_renderer_create();
+
+// GLES2 on EGL_MESA_platform_surfaceless, needs no display or GPU
+struct zippo_renderer* zippo_gles2_renderer_create();
+
+/**
+ * @param name "software" or "gles2"
+ */
+struct zippo_renderer* zippo_renderer_create(const char* name);
+
+#endif  //  ZIPPO_RENDERER_H
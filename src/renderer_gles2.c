@@ -0,0 +1,606 @@
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "renderer.h"
+
+// textures of views that have not been drawn for this many frames are
+// dropped, in case nobody called zippo_renderer_forget() for them
+#define TEXTURE_MAX_IDLE_FRAMES 120
+
+// x, y, u, v for the two triangles of a quad
+#define QUAD_FLOATS (6 * 4)
+
+struct zippo_gles2_texture {
+  uint64_t view_id;
+  GLuint texture;
+  uint32_t generation;
+  int width;
+  int height;
+  uint64_t last_used;
+};
+
+struct zippo_gles2_quad {
+  struct zippo_scene_view* view;
+  GLuint texture;
+};
+
+struct zippo_gles2_renderer {
+  struct zippo_renderer base;
+
+  EGLDisplay display;
+  EGLContext context;
+
+  GLuint program;
+  GLint position_location;
+  GLint texcoord_location;
+  GLint opaque_location;
+
+  // every quad of a frame goes into this one buffer
+  GLuint vbo;
+  GLfloat* vertices;
+  struct zippo_gles2_quad* quads;
+  int quad_capacity;
+
+  GLuint fbo;
+  GLuint fbo_texture;
+  int fbo_width;
+  int fbo_height;
+
+  uint32_t* readback;
+  size_t readback_size;
+
+  struct zippo_gles2_texture* textures;
+  int texture_count;
+  uint64_t frame;
+};
+
+static const char vertex_shader_source[] =
+    "attribute vec2 position;\n"
+    "attribute vec2 texcoord;\n"
+    "varying vec2 v_texcoord;\n"
+    "void main() {\n"
+    "  gl_Position = vec4(position, 0.0, 1.0);\n"
+    "  v_texcoord = texcoord;\n"
+    "}\n";
+
+// ARGB8888 is uploaded as RGBA bytes and read back the same way, so the
+// red and blue swap cancels out and only alpha needs care
+static const char fragment_shader_source[] =
+    "precision mediump float;\n"
+    "varying vec2 v_texcoord;\n"
+    "uniform sampler2D tex;\n"
+    "uniform float opaque;\n"
+    "void main() {\n"
+    "  vec4 color = texture2D(tex, v_texcoord);\n"
+    "  gl_FragColor = vec4(color.rgb, max(color.a, opaque));\n"
+    "}\n";
+
+static bool
+has_extension(const char* extensions, const char* name)
+{
+  size_t len = strlen(name);
+  const char* p = extensions;
+
+  while (p && (p = strstr(p, name))) {
+    if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || !p[len]))
+      return true;
+    p += len;
+  }
+
+  return false;
+}
+
+static GLuint
+compile_shader(GLenum type, const char* source)
+{
+  GLuint shader = glCreateShader(type);
+  GLint status;
+
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (!status) {
+    char log[512];
+    glGetShaderInfoLog(shader, sizeof log, NULL, log);
+    fprintf(stderr, "Failed to compile shader: %s\n", log);
+    glDeleteShader(shader);
+    return 0;
+  }
+
+  return shader;
+}
+
+static int
+zippo_gles2_renderer_init_egl(struct zippo_gles2_renderer* self)
+{
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+  const EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+  const EGLint config_attribs[] = {
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT, EGL_NONE};
+  EGLConfig config = NULL;
+  EGLint count;
+  const char* extensions;
+
+  extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (!has_extension(extensions, "EGL_MESA_platform_surfaceless") ||
+      !has_extension(extensions, "EGL_EXT_platform_base")) {
+    fprintf(stderr, "EGL_MESA_platform_surfaceless is not supported\n");
+    return -1;
+  }
+
+  get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+      "eglGetPlatformDisplayEXT");
+  self->display = get_platform_display(
+      EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if (self->display == EGL_NO_DISPLAY ||
+      !eglInitialize(self->display, NULL, NULL)) {
+    fprintf(stderr, "Failed to initialize EGL display\n");
+    return -1;
+  }
+
+  extensions = eglQueryString(self->display, EGL_EXTENSIONS);
+  if (!has_extension(extensions, "EGL_KHR_surfaceless_context")) {
+    fprintf(stderr, "EGL_KHR_surfaceless_context is not supported\n");
+    goto err;
+  }
+
+  if (!has_extension(extensions, "EGL_KHR_no_config_context") &&
+      (!eglChooseConfig(self->display, config_attribs, &config, 1, &count) ||
+          count == 0)) {
+    fprintf(stderr, "No EGL config for GLES2\n");
+    goto err;
+  }
+
+  eglBindAPI(EGL_OPENGL_ES_API);
+  self->context =
+      eglCreateContext(self->display, config, EGL_NO_CONTEXT, context_attribs);
+  if (self->context == EGL_NO_CONTEXT) {
+    fprintf(stderr, "Failed to create GLES2 context\n");
+    goto err;
+  }
+
+  if (!eglMakeCurrent(
+          self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, self->context)) {
+    fprintf(stderr, "Failed to make GLES2 context current\n");
+    eglDestroyContext(self->display, self->context);
+    goto err;
+  }
+
+  return 0;
+
+err:
+  eglTerminate(self->display);
+  return -1;
+}
+
+static int
+zippo_gles2_renderer_init_gl(struct zippo_gles2_renderer* self)
+{
+  GLuint vertex_shader, fragment_shader;
+  GLint status;
+
+  vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_shader_source);
+  fragment_shader =
+      compile_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
+  if (vertex_shader == 0 || fragment_shader == 0) return -1;
+
+  self->program = glCreateProgram();
+  glAttachShader(self->program, vertex_shader);
+  glAttachShader(self->program, fragment_shader);
+  glLinkProgram(self->program);
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+
+  glGetProgramiv(self->program, GL_LINK_STATUS, &status);
+  if (!status) {
+    fprintf(stderr, "Failed to link GLES2 program\n");
+    return -1;
+  }
+
+  self->position_location = glGetAttribLocation(self->program, "position");
+  self->texcoord_location = glGetAttribLocation(self->program, "texcoord");
+  self->opaque_location = glGetUniformLocation(self->program, "opaque");
+
+  glUseProgram(self->program);
+  glUniform1i(glGetUniformLocation(self->program, "tex"), 0);
+
+  glGenBuffers(1, &self->vbo);
+  glGenFramebuffers(1, &self->fbo);
+  glGenTextures(1, &self->fbo_texture);
+
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);  // premultiplied
+  glClearColor(0, 0, 0, 1);
+
+  return 0;
+}
+
+static int
+zippo_gles2_renderer_ensure_fbo(
+    struct zippo_gles2_renderer* self, int width, int height)
+{
+  if (self->fbo_width == width && self->fbo_height == height) return 0;
+
+  glBindTexture(GL_TEXTURE_2D, self->fbo_texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+      GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, self->fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+      self->fbo_texture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    fprintf(stderr, "Incomplete GLES2 framebuffer\n");
+    self->fbo_width = self->fbo_height = 0;
+    return -1;
+  }
+
+  self->fbo_width = width;
+  self->fbo_height = height;
+  glViewport(0, 0, width, height);
+
+  return 0;
+}
+
+// rows y to y + height of the buffer, whole rows since GLES2 has no
+// GL_UNPACK_ROW_LENGTH
+static void
+upload(const struct zippo_scale_image* buffer, int y, int height)
+{
+  const uint8_t* data =
+      (const uint8_t*)buffer->data + (size_t)y * buffer->stride;
+
+  if (buffer->stride == buffer->width * 4) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, buffer->width, height, GL_RGBA,
+        GL_UNSIGNED_BYTE, data);
+    return;
+  }
+
+  for (int j = 0; j < height; j++) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y + j, buffer->width, 1, GL_RGBA,
+        GL_UNSIGNED_BYTE, data + (size_t)j * buffer->stride);
+  }
+}
+
+static struct zippo_gles2_texture*
+zippo_gles2_renderer_get_texture(
+    struct zippo_gles2_renderer* self, struct zippo_scene_view* view)
+{
+  struct zippo_gles2_texture *texture = NULL, *textures;
+  bool resize;
+
+  for (int i = 0; i < self->texture_count; i++) {
+    if (self->textures[i].view_id == view->id) {
+      texture = &self->textures[i];
+      break;
+    }
+  }
+
+  if (texture == NULL) {
+    textures = realloc(
+        self->textures, (self->texture_count + 1) * sizeof *textures);
+    if (textures == NULL) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      return NULL;
+    }
+    self->textures = textures;
+    texture = &self->textures[self->texture_count++];
+
+    memset(texture, 0, sizeof *texture);
+    texture->view_id = view->id;
+    texture->generation = view->generation - 1;  // force an upload
+    glGenTextures(1, &texture->texture);
+    glBindTexture(GL_TEXTURE_2D, texture->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+
+  texture->last_used = self->frame;
+
+  // the client committed since we last uploaded
+  if (texture->generation != view->generation) {
+    resize = texture->width != view->buffer.width ||
+             texture->height != view->buffer.height;
+    glBindTexture(GL_TEXTURE_2D, texture->texture);
+    if (resize) {
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, view->buffer.width,
+          view->buffer.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    // the damage is against the generation before, older copies need all
+    if (!resize && texture->generation + 1 == view->generation)
+      upload(&view->buffer, view->damage.y, view->damage.height);
+    else
+      upload(&view->buffer, 0, view->buffer.height);
+    texture->generation = view->generation;
+    texture->width = view->buffer.width;
+    texture->height = view->buffer.height;
+  }
+
+  return texture;
+}
+
+static void
+zippo_gles2_renderer_remove_texture(
+    struct zippo_gles2_renderer* self, int index)
+{
+  glDeleteTextures(1, &self->textures[index].texture);
+  self->textures[index] = self->textures[--self->texture_count];
+}
+
+static void
+zippo_gles2_renderer_expire_textures(struct zippo_gles2_renderer* self)
+{
+  for (int i = self->texture_count - 1; i >= 0; i--) {
+    if (self->frame - self->textures[i].last_used > TEXTURE_MAX_IDLE_FRAMES)
+      zippo_gles2_renderer_remove_texture(self, i);
+  }
+}
+
+static bool
+view_visible(struct zippo_scene_view* view, int x, int y, int width,
+    int height)
+{
+  return view->buffer.data && view->x < x + width &&
+         view->x + view->buffer.width > x && view->y < y + height &&
+         view->y + view->buffer.height > y;
+}
+
+static bool
+view_covers(struct zippo_scene_view* view, int x, int y, int width,
+    int height)
+{
+  return view->opaque && view->buffer.data && view->x <= x &&
+         view->y <= y && view->x + view->buffer.width >= x + width &&
+         view->y + view->buffer.height >= y + height;
+}
+
+// one quad per view that is not hidden by an opaque view above it, bottom
+// to top
+static int
+zippo_gles2_renderer_build_quads(struct zippo_gles2_renderer* self,
+    struct zippo_scene* scene, int x, int y, int width, int height)
+{
+  struct zippo_scene_view *view, *start = NULL;
+  int count = 0;
+
+  wl_list_for_each_reverse(view, &scene->views, link)
+  {
+    if (view_covers(view, x, y, width, height)) {
+      start = view;
+      break;
+    }
+  }
+
+  wl_list_for_each(view, &scene->views, link)
+  {
+    struct zippo_gles2_texture* texture;
+    GLfloat* v;
+    GLfloat x1, y1, x2, y2;
+
+    if (start && view != start) continue;
+    start = NULL;
+
+    if (!view_visible(view, x, y, width, height)) continue;
+
+    if (count == self->quad_capacity) {
+      int capacity = self->quad_capacity ? self->quad_capacity * 2 : 16;
+      GLfloat* vertices =
+          realloc(self->vertices, capacity * QUAD_FLOATS * sizeof *vertices);
+      struct zippo_gles2_quad* quads;
+
+      if (vertices) self->vertices = vertices;
+      quads = realloc(self->quads, capacity * sizeof *quads);
+      if (quads) self->quads = quads;
+      if (vertices == NULL || quads == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        return -1;
+      }
+      self->quad_capacity = capacity;
+    }
+
+    texture = zippo_gles2_renderer_get_texture(self, view);
+    if (texture == NULL) return -1;
+
+    // the framebuffer's row 0 is the output's top row, so no flip
+    x1 = 2.0f * (view->x - x) / width - 1.0f;
+    y1 = 2.0f * (view->y - y) / height - 1.0f;
+    x2 = 2.0f * (view->x + view->buffer.width - x) / width - 1.0f;
+    y2 = 2.0f * (view->y + view->buffer.height - y) / height - 1.0f;
+
+    v = &self->vertices[count * QUAD_FLOATS];
+    GLfloat quad[QUAD_FLOATS] = {
+        x1, y1, 0, 0, x2, y1, 1, 0, x1, y2, 0, 1,  //
+        x2, y1, 1, 0, x2, y2, 1, 1, x1, y2, 0, 1,  //
+    };
+    memcpy(v, quad, sizeof quad);
+
+    self->quads[count].view = view;
+    self->quads[count].texture = texture->texture;
+    count++;
+  }
+
+  return count;
+}
+
+static int
+zippo_gles2_renderer_read_pixels(struct zippo_gles2_renderer* self,
+    struct zippo_scale_image* target, const struct zippo_renderer_rect* rect)
+{
+  size_t size = (size_t)rect->width * rect->height * 4;
+
+  if (size > self->readback_size) {
+    uint32_t* readback = realloc(self->readback, size);
+    if (readback == NULL) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      return -1;
+    }
+    self->readback = readback;
+    self->readback_size = size;
+  }
+
+  glReadPixels(rect->x, rect->y, rect->width, rect->height, GL_RGBA,
+      GL_UNSIGNED_BYTE, self->readback);
+
+  for (int j = 0; j < rect->height; j++) {
+    memcpy((uint8_t*)target->data + (rect->y + j) * target->stride +
+               rect->x * 4,
+        self->readback + j * rect->width, rect->width * 4);
+  }
+
+  return 0;
+}
+
+static int
+zippo_gles2_renderer_render(struct zippo_renderer* base,
+    struct zippo_scene* scene, int x, int y, struct zippo_scale_image* target,
+    const struct zippo_renderer_rect* damage, int damage_count)
+{
+  struct zippo_gles2_renderer* self = (struct zippo_gles2_renderer*)base;
+  int width = target->width, height = target->height, count;
+
+  if (eglGetCurrentContext() != self->context)
+    eglMakeCurrent(
+        self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, self->context);
+
+  if (zippo_gles2_renderer_ensure_fbo(self, width, height) != 0) return -1;
+
+  self->frame++;
+
+  count = zippo_gles2_renderer_build_quads(self, scene, x, y, width, height);
+  if (count < 0) return -1;
+
+  glBindBuffer(GL_ARRAY_BUFFER, self->vbo);
+  glBufferData(GL_ARRAY_BUFFER, count * QUAD_FLOATS * sizeof(GLfloat),
+      self->vertices, GL_STREAM_DRAW);
+  glVertexAttribPointer(self->position_location, 2, GL_FLOAT, GL_FALSE,
+      4 * sizeof(GLfloat), (void*)0);
+  glVertexAttribPointer(self->texcoord_location, 2, GL_FLOAT, GL_FALSE,
+      4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
+  glEnableVertexAttribArray(self->position_location);
+  glEnableVertexAttribArray(self->texcoord_location);
+
+  glEnable(GL_SCISSOR_TEST);
+
+  // each rect is cleared and redrawn whole, so overlapping rects do not
+  // blend twice
+  for (int i = 0; i < damage_count; i++) {
+    const struct zippo_renderer_rect* rect = &damage[i];
+
+    glScissor(rect->x, rect->y, rect->width, rect->height);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    for (int q = 0; q < count; q++) {
+      struct zippo_scene_view* view = self->quads[q].view;
+
+      if (!view_visible(view, x + rect->x, y + rect->y, rect->width,
+              rect->height))
+        continue;
+
+      if (view->opaque)
+        glDisable(GL_BLEND);
+      else
+        glEnable(GL_BLEND);
+      glUniform1f(self->opaque_location, view->opaque ? 1.0f : 0.0f);
+      glBindTexture(GL_TEXTURE_2D, self->quads[q].texture);
+      glDrawArrays(GL_TRIANGLES, q * 6, 6);
+    }
+  }
+
+  glDisable(GL_SCISSOR_TEST);
+
+  for (int i = 0; i < damage_count; i++) {
+    if (zippo_gles2_renderer_read_pixels(self, target, &damage[i]) != 0)
+      return -1;
+  }
+
+  zippo_gles2_renderer_expire_textures(self);
+
+  return 0;
+}
+
+static void
+zippo_gles2_renderer_forget(
+    struct zippo_renderer* base, const struct zippo_scene_view* view)
+{
+  struct zippo_gles2_renderer* self = (struct zippo_gles2_renderer*)base;
+
+  for (int i = 0; i < self->texture_count; i++) {
+    if (self->textures[i].view_id == view->id) {
+      eglMakeCurrent(
+          self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, self->context);
+      zippo_gles2_renderer_remove_texture(self, i);
+      return;
+    }
+  }
+}
+
+static void
+zippo_gles2_renderer_destroy(struct zippo_renderer* base)
+{
+  struct zippo_gles2_renderer* self = (struct zippo_gles2_renderer*)base;
+
+  eglMakeCurrent(self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, self->context);
+  while (self->texture_count > 0)
+    zippo_gles2_renderer_remove_texture(self, self->texture_count - 1);
+  glDeleteTextures(1, &self->fbo_texture);
+  glDeleteFramebuffers(1, &self->fbo);
+  glDeleteBuffers(1, &self->vbo);
+  glDeleteProgram(self->program);
+
+  eglMakeCurrent(self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(self->display, self->context);
+  eglTerminate(self->display);
+
+  free(self->textures);
+  free(self->readback);
+  free(self->quads);
+  free(self->vertices);
+  free(self);
+}
+
+static const struct zippo_renderer_interface gles2_renderer_interface = {
+    .render = zippo_gles2_renderer_render,
+    .forget = zippo_gles2_renderer_forget,
+    .destroy = zippo_gles2_renderer_destroy,
+};
+
+struct zippo_renderer*
+zippo_gles2_renderer_create()
+{
+  struct zippo_gles2_renderer* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err;
+  }
+
+  self->base.impl = &gles2_renderer_interface;
+  self->base.name = "gles2";
+
+  if (zippo_gles2_renderer_init_egl(self) != 0) goto err_egl;
+
+  if (zippo_gles2_renderer_init_gl(self) != 0) goto err_gl;
+
+  return &self->base;
+
+err_gl:
+  if (self->program) glDeleteProgram(self->program);
+  eglMakeCurrent(self->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(self->display, self->context);
+  eglTerminate(self->display);
+
+err_egl:
+  free(self);
+
+err:
+  return NULL;
+}
@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "renderer.h"
+
+static int
+zippo_software_renderer_render(struct zippo_renderer* self,
+    struct zippo_scene* scene, int x, int y, struct zippo_scale_image* target,
+    const struct zippo_renderer_rect* damage, int damage_count)
+{
+  (void)self;
+
+  for (int i = 0; i < damage_count; i++) {
+    zippo_scene_composite_region(scene, x, y, target, damage[i].x,
+        damage[i].y, damage[i].width, damage[i].height);
+  }
+
+  return 0;
+}
+
+static void
+zippo_software_renderer_destroy(struct zippo_renderer* self)
+{
+  free(self);
+}
+
+static const struct zippo_renderer_interface software_renderer_interface = {
+    .render = zippo_software_renderer_render,
+    .forget = NULL,  // draws straight from the client buffers
+    .destroy = zippo_software_renderer_destroy,
+};
+
+struct zippo_renderer*
+zippo_software_renderer_create()
+{
+  struct zippo_renderer* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->impl = &software_renderer_interface;
+  self->name = "software";
+
+  return self;
+}
@@ -0,0 +1,241 @@
+#include "repaint.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "loop_monitor.h"
+
+// frames are started this long before their vblank, at most
+#define REPAINT_WINDOW_NS 7000000ull
+
+// consecutive commits within 25% of the average interval before the cadence
+// counts as steady
+#define STEADY_COMMITS 4
+
+struct zippo_repaint_scheduler {
+  struct wl_event_loop* loop;
+  struct wl_event_source* timer;
+  uint64_t refresh_ns;
+  uint64_t window_ns;
+
+  zippo_repaint_func_t repaint;
+  void* data;
+
+  uint32_t pending;
+  bool armed;
+  bool armed_deferred;
+  uint64_t target_ns;  // vblank the armed timer is for
+  bool in_flight;
+  uint64_t last_vblank_ns;
+
+  // cadence of damaging commits
+  uint64_t last_damage_ns;
+  uint64_t damage_interval_ns;
+  int steady;
+
+  struct zippo_repaint_stats stats;
+};
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+zippo_repaint_scheduler_update_cadence(
+    struct zippo_repaint_scheduler* self, uint64_t now)
+{
+  uint64_t interval, average = self->damage_interval_ns;
+
+  if (self->last_damage_ns == 0) {
+    self->last_damage_ns = now;
+    return;
+  }
+
+  interval = now - self->last_damage_ns;
+  self->last_damage_ns = now;
+
+  if (interval > 1000000000ull) {  // was idle, start over
+    self->damage_interval_ns = 0;
+    self->steady = 0;
+    return;
+  }
+
+  if (average && interval > average - average / 4 &&
+      interval < average + average / 4)
+    self->steady++;
+  else
+    self->steady = 0;
+
+  self->damage_interval_ns =
+      average ? (average * 3 + interval) / 4 : interval;
+}
+
+uint64_t
+zippo_repaint_scheduler_get_effective_interval(
+    struct zippo_repaint_scheduler* self)
+{
+  uint64_t refresh = self->refresh_ns, interval = self->damage_interval_ns;
+
+  if (self->steady < STEADY_COMMITS || interval < refresh + refresh / 2)
+    return refresh;
+
+  // a client that has stopped committing has no cadence to follow
+  if (now_ns() - self->last_damage_ns > interval * 4) return refresh;
+
+  return (interval + refresh / 2) / refresh * refresh;
+}
+
+// first vblank at or after not_before
+static uint64_t
+zippo_repaint_scheduler_next_vblank(
+    struct zippo_repaint_scheduler* self, uint64_t not_before)
+{
+  uint64_t k;
+
+  if (self->last_vblank_ns == 0 || not_before <= self->last_vblank_ns)
+    return self->last_vblank_ns ? self->last_vblank_ns + self->refresh_ns
+                                : not_before;
+
+  k = (not_before - self->last_vblank_ns + self->refresh_ns - 1) /
+      self->refresh_ns;
+
+  return self->last_vblank_ns + k * self->refresh_ns;
+}
+
+static void
+zippo_repaint_scheduler_arm(struct zippo_repaint_scheduler* self)
+{
+  uint64_t now = now_ns(), earliest = now + self->window_ns, target, fire;
+  bool deferred = false;
+  int ms;
+
+  if (self->pending == 0 || self->in_flight) return;
+
+  // only frame callbacks are waiting, pace them like the client's commits
+  if (self->pending == ZIPPO_REPAINT_FRAME_CALLBACK && self->last_vblank_ns) {
+    uint64_t paced = self->last_vblank_ns +
+                     zippo_repaint_scheduler_get_effective_interval(self);
+    if (paced > earliest + self->refresh_ns / 2) {
+      earliest = paced;
+      deferred = true;
+    }
+  }
+
+  target = zippo_repaint_scheduler_next_vblank(self, earliest);
+  // a commit landing inside the window of the armed vblank must not push
+  // it back, or a steady stream of commits starves the output
+  if (self->armed && target >= self->target_ns) return;
+
+  fire = target - self->window_ns;
+  ms = fire > now ? (int)((fire - now + 999999) / 1000000) : 1;
+
+  self->armed = true;
+  self->armed_deferred = deferred;
+  self->target_ns = target;
+  wl_event_source_timer_update(self->timer, ms);
+}
+
+static int
+handle_timer(void* data)
+{
+  struct zippo_repaint_scheduler* self = data;
+  uint32_t reasons = self->pending;
+
+  self->stats.wakeups++;
+  self->armed = false;
+
+  if (reasons == 0) {
+    self->stats.idle_wakeups++;
+    return 0;
+  }
+
+  self->pending = 0;
+  self->in_flight = true;
+  self->stats.frames++;
+  if (self->armed_deferred) self->stats.deferred++;
+
+  self->repaint(self->data, reasons, self->target_ns);
+
+  return 0;
+}
+
+void
+zippo_repaint_scheduler_schedule(
+    struct zippo_repaint_scheduler* self, uint32_t reasons)
+{
+  // several surfaces committing for the same frame are one step of the
+  // cadence
+  if ((reasons & ZIPPO_REPAINT_DAMAGE) &&
+      !(self->pending & ZIPPO_REPAINT_DAMAGE))
+    zippo_repaint_scheduler_update_cadence(self, now_ns());
+
+  self->pending |= reasons;
+
+  // may also pull a deferred frame forward
+  zippo_repaint_scheduler_arm(self);
+}
+
+void
+zippo_repaint_scheduler_present_done(
+    struct zippo_repaint_scheduler* self, uint64_t vblank_ns)
+{
+  self->in_flight = false;
+  self->last_vblank_ns = vblank_ns;
+
+  // whatever came in while drawing, and animations that asked for more
+  zippo_repaint_scheduler_arm(self);
+}
+
+void
+zippo_repaint_scheduler_get_stats(struct zippo_repaint_scheduler* self,
+    struct zippo_repaint_stats* stats)
+{
+  *stats = self->stats;
+}
+
+struct zippo_repaint_scheduler*
+zippo_repaint_scheduler_create(struct wl_event_loop* loop,
+    uint64_t refresh_ns, zippo_repaint_func_t repaint, void* data)
+{
+  struct zippo_repaint_scheduler* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err;
+  }
+
+  self->loop = loop;
+  self->timer = zippo_loop_add_timer(loop, handle_timer, self, "repaint");
+  if (self->timer == NULL) {
+    fprintf(stderr, "Failed to create repaint timer\n");
+    goto err_timer;
+  }
+
+  self->refresh_ns = refresh_ns;
+  self->window_ns =
+      refresh_ns / 2 < REPAINT_WINDOW_NS ? refresh_ns / 2 : REPAINT_WINDOW_NS;
+  self->repaint = repaint;
+  self->data = data;
+
+  return self;
+
+err_timer:
+  free(self);
+
+err:
+  return NULL;
+}
+
+void
+zippo_repaint_scheduler_destroy(struct zippo_repaint_scheduler* self)
+{
+  zippo_loop_source_remove(self->loop, self->timer);
+  free(self);
+}
@@ -0,0 +1,59 @@
+#ifndef ZIPPO_REPAINT_H
+#define ZIPPO_REPAINT_H
+
+#include <stdint.h>
+#include <wayland-server-core.h>
+
+// why an output needs a new frame
+enum zippo_repaint_reason {
+  ZIPPO_REPAINT_DAMAGE = 1 << 0,
+  ZIPPO_REPAINT_FRAME_CALLBACK = 1 << 1,
+  ZIPPO_REPAINT_ANIMATION = 1 << 2,
+};
+
+/**
+ * Draw and present a frame for the vblank at target_ns. Call
+ * zippo_repaint_scheduler_present_done() once it is on screen, right away
+ * for outputs without a real vblank.
+ *
+ * @param reasons all reasons scheduled since the previous frame
+ */
+typedef void (*zippo_repaint_func_t)(
+    void* data, uint32_t reasons, uint64_t target_ns);
+
+struct zippo_repaint_stats {
+  uint64_t wakeups;       // timer expirations
+  uint64_t idle_wakeups;  // wakeups that found nothing to draw
+  uint64_t frames;
+  uint64_t deferred;  // frame callback only frames moved to a later vblank
+};
+
+// demand driven repaint loop of one output. nothing runs unless a frame has
+// been scheduled. when a client commits at a steady rate below the refresh
+// rate, frames needed only for frame callbacks follow its cadence instead
+// of every vblank.
+struct zippo_repaint_scheduler;
+
+void zippo_repaint_scheduler_schedule(
+    struct zippo_repaint_scheduler* self, uint32_t reasons);
+
+void zippo_repaint_scheduler_present_done(
+    struct zippo_repaint_scheduler* self, uint64_t vblank_ns);
+
+// current interval between frames when clients keep up the steady pace
+uint64_t zippo_repaint_scheduler_get_effective_interval(
+    struct zippo_repaint_scheduler* self);
+
+void zippo_repaint_scheduler_get_stats(struct zippo_repaint_scheduler* self,
+    struct zippo_repaint_stats* stats);
+
+/**
+ * @param refresh_ns vblank interval of the output
+ */
+struct zippo_repaint_scheduler* zippo_repaint_scheduler_create(
+    struct wl_event_loop* loop, uint64_t refresh_ns,
+    zippo_repaint_func_t repaint, void* data);
+
+void zippo_repaint_scheduler_destroy(struct zippo_repaint_scheduler* self);
+
+#endif  //  ZIPPO_REPAINT_H
@@ -0,0 +1,386 @@
+#include "scale.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define ZIPPO_SCALE_COEFF_CACHE_SIZE 8
+
+// a tile is at most TILE_WIDTH dst columns and needs at most about
+// TILE_SRC_ROWS intermediate rows, so it stays in L2 even for thumbnails.
+#define ZIPPO_SCALE_TILE_WIDTH 256
+#define ZIPPO_SCALE_TILE_HEIGHT 32
+#define ZIPPO_SCALE_TILE_SRC_ROWS 64
+
+// weights are Q14 and sum up to exactly 1 << WEIGHT_BITS. the intermediate
+// (horizontally filtered) image keeps INTER_BITS fractional bits, so every
+// value fits in int16 and both passes can use 16bit multiply-add.
+#define WEIGHT_BITS 14
+#define INTER_BITS 7
+
+struct zippo_scale_coeffs {
+  enum zippo_scale_filter filter;
+  int src_len;
+  int dst_len;
+  int taps;
+  int* offsets;      // first src index for each dst index
+  int16_t* weights;  // dst_len * taps
+};
+
+struct zippo_scaler {
+  // most recently used first
+  struct zippo_scale_coeffs* cache[ZIPPO_SCALE_COEFF_CACHE_SIZE];
+  int16_t* tile;
+  size_t tile_len;
+};
+
+static void
+zippo_scale_coeffs_destroy(struct zippo_scale_coeffs* self)
+{
+  free(self->offsets);
+  free(self->weights);
+  free(self);
+}
+
+static struct zippo_scale_coeffs*
+zippo_scale_coeffs_create(
+    enum zippo_scale_filter filter, int src_len, int dst_len)
+{
+  struct zippo_scale_coeffs* self;
+  double scale = (double)src_len / dst_len;
+  double* acc = NULL;
+  int taps;
+
+  if (filter == ZIPPO_SCALE_FILTER_BILINEAR)
+    taps = 2;
+  else
+    taps = (int)ceil(scale) + 1;
+  if (taps > src_len) taps = src_len;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) goto err;
+
+  self->filter = filter;
+  self->src_len = src_len;
+  self->dst_len = dst_len;
+  self->taps = taps;
+  self->offsets = calloc(dst_len, sizeof *self->offsets);
+  self->weights = calloc((size_t)dst_len * taps, sizeof *self->weights);
+  acc = calloc(taps, sizeof *acc);
+  if (!self->offsets || !self->weights || !acc) goto err_alloc;
+
+  for (int i = 0; i < dst_len; i++) {
+    int index[2], first, last, offset, sum, largest;
+    double weight[2];
+    int16_t* w = self->weights + (size_t)i * taps;
+
+    memset(acc, 0, taps * sizeof *acc);
+
+    if (filter == ZIPPO_SCALE_FILTER_BILINEAR) {
+      double center = (i + 0.5) * scale - 0.5;
+      int x = (int)floor(center);
+
+      index[0] = x;
+      index[1] = x + 1;
+      weight[1] = center - x;
+      weight[0] = 1.0 - weight[1];
+      for (int k = 0; k < 2; k++) {
+        if (index[k] < 0) index[k] = 0;
+        if (index[k] > src_len - 1) index[k] = src_len - 1;
+      }
+      first = index[0];
+      offset = first < src_len - taps ? first : src_len - taps;
+      for (int k = 0; k < 2; k++) acc[index[k] - offset] += weight[k];
+    } else {
+      double start = i * scale, end = (i + 1) * scale;
+
+      first = (int)floor(start);
+      last = (int)ceil(end) - 1;
+      if (last > src_len - 1) last = src_len - 1;
+      offset = first < src_len - taps ? first : src_len - taps;
+      for (int x = first; x <= last; x++) {
+        double overlap = fmin(end, x + 1) - fmax(start, x);
+        if (overlap > 0) acc[x - offset] += overlap / scale;
+      }
+    }
+
+    self->offsets[i] = offset;
+
+    // round to Q14 and put the rounding error on the largest weight so that
+    // flat areas keep their exact color.
+    sum = 0;
+    largest = 0;
+    for (int k = 0; k < taps; k++) {
+      w[k] = (int16_t)lround(acc[k] * (1 << WEIGHT_BITS));
+      sum += w[k];
+      if (w[k] > w[largest]) largest = k;
+    }
+    w[largest] += (1 << WEIGHT_BITS) - sum;
+  }
+
+  free(acc);
+
+  return self;
+
+err_alloc:
+  free(acc);
+  zippo_scale_coeffs_destroy(self);
+
+err:
+  fprintf(stderr, "Failed to allocate memory\n");
+  return NULL;
+}
+
+static struct zippo_scale_coeffs*
+zippo_scaler_get_coeffs(struct zippo_scaler* self,
+    enum zippo_scale_filter filter, int src_len, int dst_len)
+{
+  struct zippo_scale_coeffs* coeffs;
+  int i;
+
+  for (i = 0; i < ZIPPO_SCALE_COEFF_CACHE_SIZE; i++) {
+    coeffs = self->cache[i];
+    if (coeffs == NULL) break;
+    if (coeffs->filter == filter && coeffs->src_len == src_len &&
+        coeffs->dst_len == dst_len)
+      goto found;
+  }
+
+  coeffs = zippo_scale_coeffs_create(filter, src_len, dst_len);
+  if (coeffs == NULL) return NULL;
+
+  i = ZIPPO_SCALE_COEFF_CACHE_SIZE - 1;
+  if (self->cache[i]) zippo_scale_coeffs_destroy(self->cache[i]);
+
+found:
+  memmove(&self->cache[1], &self->cache[0], i * sizeof self->cache[0]);
+  self->cache[0] = coeffs;
+
+  return coeffs;
+}
+
+#ifdef __SSE2__
+// w[0] w[1] w[0] w[1] ... for _mm_madd_epi16 on interleaved taps. built with
+// a single movd instead of _mm_set_epi16, which goes through the stack.
+static inline __m128i
+weight_pair(const int16_t* w)
+{
+  return _mm_set1_epi32((int)((uint16_t)w[0] | ((uint32_t)w[1] << 16)));
+}
+#endif
+
+// filter src pixels into dst columns [x0, x1), 4 int16 per pixel
+static void
+scale_row_horizontal(const uint32_t* src,
+    const struct zippo_scale_coeffs* coeffs, int x0, int x1, int16_t* out)
+{
+  const int taps = coeffs->taps;
+  const int shift = WEIGHT_BITS - INTER_BITS;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+
+  for (int x = x0; x < x1; x++) {
+    const uint32_t* p = src + coeffs->offsets[x];
+    const int16_t* w = coeffs->weights + (size_t)x * taps;
+    __m128i acc = _mm_setzero_si128();
+    int k;
+
+    for (k = 0; k + 1 < taps; k += 2) {
+      // a0 a1 a2 a3 b0 b1 b2 b3 -> a0 b0 a1 b1 a2 b2 a3 b3
+      __m128i px = _mm_loadl_epi64((const void*)(p + k));
+      __m128i wv = weight_pair(w + k);
+      px = _mm_unpacklo_epi8(px, zero);
+      px = _mm_unpacklo_epi16(px, _mm_srli_si128(px, 8));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(px, wv));
+    }
+    if (k < taps) {
+      __m128i px = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)p[k]), zero);
+      px = _mm_unpacklo_epi16(px, zero);
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(px, _mm_set1_epi32(w[k])));
+    }
+
+    acc = _mm_srai_epi32(_mm_add_epi32(acc, round), shift);
+    _mm_storel_epi64((void*)(out + (x - x0) * 4), _mm_packs_epi32(acc, acc));
+  }
+#else
+  for (int x = x0; x < x1; x++) {
+    const uint8_t* p = (const uint8_t*)(src + coeffs->offsets[x]);
+    const int16_t* w = coeffs->weights + (size_t)x * taps;
+    int32_t acc[4] = {0};
+
+    for (int k = 0; k < taps; k++)
+      for (int c = 0; c < 4; c++) acc[c] += p[k * 4 + c] * w[k];
+
+    for (int c = 0; c < 4; c++)
+      out[(x - x0) * 4 + c] = (int16_t)((acc[c] + (1 << (shift - 1))) >> shift);
+  }
+#endif
+}
+
+// filter `taps` intermediate rows, `stride` int16 apart, into len bytes
+static void
+scale_row_vertical(const int16_t* rows, int stride, const int16_t* w, int taps,
+    uint8_t* out, int len)
+{
+  const int shift = WEIGHT_BITS + INTER_BITS;
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+
+  for (; i + 8 <= len; i += 8) {
+    __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    int k;
+
+    for (k = 0; k + 1 < taps; k += 2) {
+      __m128i a = _mm_loadu_si128((const void*)(rows + k * stride + i));
+      __m128i b = _mm_loadu_si128((const void*)(rows + (k + 1) * stride + i));
+      __m128i wv = weight_pair(w + k);
+      lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), wv));
+      hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), wv));
+    }
+    if (k < taps) {
+      __m128i a = _mm_loadu_si128((const void*)(rows + k * stride + i));
+      __m128i wv = _mm_set1_epi32(w[k]);
+      lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), wv));
+      hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), wv));
+    }
+
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, round), shift);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, round), shift);
+    lo = _mm_packs_epi32(lo, hi);
+    _mm_storel_epi64((void*)(out + i), _mm_packus_epi16(lo, lo));
+  }
+#endif
+
+  for (; i < len; i++) {
+    int32_t acc = 0;
+    for (int k = 0; k < taps; k++) acc += rows[k * stride + i] * w[k];
+    acc = (acc + (1 << (shift - 1))) >> shift;
+    out[i] = acc > 255 ? 255 : (uint8_t)acc;
+  }
+}
+
+static int
+zippo_scaler_reserve_tile(struct zippo_scaler* self, size_t len)
+{
+  int16_t* tile;
+
+  if (len <= self->tile_len) return 0;
+
+  tile = realloc(self->tile, len * sizeof *tile);
+  if (tile == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return -1;
+  }
+
+  self->tile = tile;
+  self->tile_len = len;
+
+  return 0;
+}
+
+int
+zippo_scaler_scale_region(struct zippo_scaler* self,
+    enum zippo_scale_filter filter, const struct zippo_scale_image* src,
+    struct zippo_scale_image* dst, int x, int y, int width, int height)
+{
+  struct zippo_scale_coeffs *hcoeffs, *vcoeffs;
+  int x1 = x + width, y1 = y + height, tile_height;
+
+  if (src->width <= 0 || src->height <= 0 || dst->width <= 0 ||
+      dst->height <= 0)
+    return -1;
+
+  if (x < 0) x = 0;
+  if (y < 0) y = 0;
+  if (x1 > dst->width) x1 = dst->width;
+  if (y1 > dst->height) y1 = dst->height;
+  if (x >= x1 || y >= y1) return 0;
+
+  hcoeffs = zippo_scaler_get_coeffs(self, filter, src->width, dst->width);
+  if (hcoeffs == NULL) return -1;
+  vcoeffs = zippo_scaler_get_coeffs(self, filter, src->height, dst->height);
+  if (vcoeffs == NULL) return -1;
+
+  tile_height = ZIPPO_SCALE_TILE_SRC_ROWS * dst->height / src->height;
+  if (tile_height > ZIPPO_SCALE_TILE_HEIGHT)
+    tile_height = ZIPPO_SCALE_TILE_HEIGHT;
+  if (tile_height < 1) tile_height = 1;
+
+  for (int ty = y; ty < y1; ty += tile_height) {
+    int ty1 = ty + tile_height < y1 ? ty + tile_height : y1;
+    int sy0 = vcoeffs->offsets[ty];
+    int sy1 = vcoeffs->offsets[ty1 - 1] + vcoeffs->taps;
+
+    for (int tx = x; tx < x1; tx += ZIPPO_SCALE_TILE_WIDTH) {
+      int tx1 = tx + ZIPPO_SCALE_TILE_WIDTH < x1 ? tx + ZIPPO_SCALE_TILE_WIDTH
+                                                 : x1;
+      int stride = (tx1 - tx) * 4, done = sy0;
+
+      if (zippo_scaler_reserve_tile(self, (size_t)(sy1 - sy0) * stride) != 0)
+        return -1;
+
+      for (int dy = ty; dy < ty1; dy++) {
+        uint8_t* out = (uint8_t*)dst->data + dy * dst->stride + tx * 4;
+
+        // offsets are monotonic, so only filter the src rows this dst row
+        // needs and that no previous row of the tile has filtered. bilinear
+        // downscaling skips most of the src rows.
+        int sy = vcoeffs->offsets[dy] > done ? vcoeffs->offsets[dy] : done;
+        for (; sy < vcoeffs->offsets[dy] + vcoeffs->taps; sy++) {
+          const uint32_t* row =
+              (const uint32_t*)((const uint8_t*)src->data + sy * src->stride);
+          scale_row_horizontal(
+              row, hcoeffs, tx, tx1, self->tile + (sy - sy0) * stride);
+        }
+        if (sy > done) done = sy;
+
+        scale_row_vertical(self->tile + (vcoeffs->offsets[dy] - sy0) * stride,
+            stride, vcoeffs->weights + (size_t)dy * vcoeffs->taps,
+            vcoeffs->taps, out, stride);
+      }
+    }
+  }
+
+  return 0;
+}
+
+int
+zippo_scaler_scale(struct zippo_scaler* self, enum zippo_scale_filter filter,
+    const struct zippo_scale_image* src, struct zippo_scale_image* dst)
+{
+  return zippo_scaler_scale_region(
+      self, filter, src, dst, 0, 0, dst->width, dst->height);
+}
+
+struct zippo_scaler*
+zippo_scaler_create()
+{
+  struct zippo_scaler* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  return self;
+}
+
+void
+zippo_scaler_destroy(struct zippo_scaler* self)
+{
+  for (int i = 0; i < ZIPPO_SCALE_COEFF_CACHE_SIZE; i++)
+    if (self->cache[i]) zippo_scale_coeffs_destroy(self->cache[i]);
+  free(self->tile);
+  free(self);
+}
@@ -0,0 +1,45 @@
+#ifndef ZIPPO_SCALE_H
+#define ZIPPO_SCALE_H
+
+#include <stdint.h>
+
+enum zippo_scale_filter {
+  ZIPPO_SCALE_FILTER_BILINEAR,
+  ZIPPO_SCALE_FILTER_BOX,  // area average, for thumbnails
+};
+
+// ARGB8888 image, stride in bytes
+struct zippo_scale_image {
+  uint32_t* data;
+  int width;
+  int height;
+  int stride;
+};
+
+// keeps filter coefficient tables per (filter, src size, dst size) and the
+// intermediate tile buffer, so repeated scaling at the same factor (scaled
+// outputs, thumbnails) does not recompute them.
+struct zippo_scaler;
+
+/**
+ * Scale the whole src into dst.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int zippo_scaler_scale(struct zippo_scaler* self,
+    enum zippo_scale_filter filter, const struct zippo_scale_image* src,
+    struct zippo_scale_image* dst);
+
+/**
+ * Same as zippo_scaler_scale() but only writes the dst pixels inside the
+ * given rectangle, e.g. the damaged region of a scaled output.
+ */
+int zippo_scaler_scale_region(struct zippo_scaler* self,
+    enum zippo_scale_filter filter, const struct zippo_scale_image* src,
+    struct zippo_scale_image* dst, int x, int y, int width, int height);
+
+struct zippo_scaler* zippo_scaler_create();
+
+void zippo_scaler_destroy(struct zippo_scaler* self);
+
+#endif  //  ZIPPO_SCALE_H
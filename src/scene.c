@@ -0,0 +1,301 @@
+#include "scene.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct rect {
+  int x1;
+  int y1;
+  int x2;
+  int y2;
+};
+
+// shared by every scene, so an id is unique among all views of the process
+static uint64_t next_view_id;
+
+static bool
+intersect(struct rect a, struct rect b, struct rect* out)
+{
+  out->x1 = a.x1 > b.x1 ? a.x1 : b.x1;
+  out->y1 = a.y1 > b.y1 ? a.y1 : b.y1;
+  out->x2 = a.x2 < b.x2 ? a.x2 : b.x2;
+  out->y2 = a.y2 < b.y2 ? a.y2 : b.y2;
+
+  return out->x1 < out->x2 && out->y1 < out->y2;
+}
+
+static bool
+view_rect(struct zippo_scene_view* view, struct rect* out)
+{
+  if (view->buffer.data == NULL) return false;
+
+  out->x1 = view->x;
+  out->y1 = view->y;
+  out->x2 = view->x + view->buffer.width;
+  out->y2 = view->y + view->buffer.height;
+
+  return true;
+}
+
+static bool
+covers(struct zippo_scene_view* view, struct rect output)
+{
+  struct rect r;
+
+  return view->opaque && view_rect(view, &r) && r.x1 <= output.x1 &&
+         r.y1 <= output.y1 && r.x2 >= output.x2 && r.y2 >= output.y2;
+}
+
+// the topmost view that hides everything below it on this output
+static struct zippo_scene_view*
+find_occluder(struct zippo_scene* self, struct rect output)
+{
+  struct zippo_scene_view* view;
+
+  wl_list_for_each_reverse(view, &self->views, link)
+  {
+    if (covers(view, output)) return view;
+  }
+
+  return NULL;
+}
+
+static bool
+visible_above(
+    struct zippo_scene* self, struct zippo_scene_view* view, struct rect output)
+{
+  struct zippo_scene_view* above;
+  struct rect r, clip;
+
+  for (struct wl_list* l = view->link.next; l != &self->views; l = l->next) {
+    above = wl_container_of(l, above, link);
+    if (view_rect(above, &r) && intersect(r, output, &clip)) return true;
+  }
+
+  return false;
+}
+
+static void
+clear(struct zippo_scale_image* target, struct rect output, struct rect clip)
+{
+  for (int y = clip.y1; y < clip.y2; y++) {
+    uint32_t* row = (uint32_t*)((uint8_t*)target->data +
+                                (y - output.y1) * target->stride);
+    for (int x = clip.x1 - output.x1; x < clip.x2 - output.x1; x++)
+      row[x] = 0xff000000;
+  }
+}
+
+static inline uint32_t
+blend(uint32_t src, uint32_t dst)
+{
+  uint32_t a = 255 - (src >> 24);
+  uint32_t rb = (dst & 0x00ff00ff) * a + 0x00800080;
+  uint32_t ag = ((dst >> 8) & 0x00ff00ff) * a + 0x00800080;
+
+  // x / 255 as (x + (x >> 8)) >> 8 on both channel pairs at once
+  rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+  ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+
+  return src + (rb | ag);
+}
+
+static void
+draw_view(struct zippo_scene_view* view, struct rect output,
+    struct zippo_scale_image* target, struct rect region)
+{
+  struct rect r, clip;
+  int width;
+
+  if (!view_rect(view, &r) || !intersect(r, region, &clip)) return;
+
+  width = clip.x2 - clip.x1;
+
+  for (int y = clip.y1; y < clip.y2; y++) {
+    const uint32_t* src =
+        (const uint32_t*)((const uint8_t*)view->buffer.data +
+                          (y - view->y) * view->buffer.stride) +
+        (clip.x1 - view->x);
+    uint32_t* dst = (uint32_t*)((uint8_t*)target->data +
+                                (y - output.y1) * target->stride) +
+                    (clip.x1 - output.x1);
+
+    if (view->opaque) {
+      memcpy(dst, src, width * 4);
+      continue;
+    }
+
+    for (int x = 0; x < width; x++) {
+      uint32_t s = src[x];
+      if (s >> 24 == 0xff)
+        dst[x] = s;
+      else if (s != 0)
+        dst[x] = blend(s, dst[x]);
+    }
+  }
+}
+
+const struct zippo_scale_image*
+zippo_scene_render_output(
+    struct zippo_scene* self, int x, int y, struct zippo_scale_image* target)
+{
+  struct rect output = {x, y, x + target->width, y + target->height};
+  struct zippo_scene_view* occluder;
+
+  self->stats.frames++;
+
+  occluder = find_occluder(self, output);
+
+  // composition would be a plain copy of this buffer
+  if (occluder && occluder->x == x && occluder->y == y &&
+      occluder->buffer.width == target->width &&
+      occluder->buffer.height == target->height &&
+      !visible_above(self, occluder, output)) {
+    self->stats.passthrough_frames++;
+    self->stats.bytes_saved += (uint64_t)target->width * target->height * 8;
+    return &occluder->buffer;
+  }
+
+  zippo_scene_composite_region(
+      self, x, y, target, 0, 0, target->width, target->height);
+
+  return target;
+}
+
+void
+zippo_scene_composite_region(struct zippo_scene* self, int x, int y,
+    struct zippo_scale_image* target, int rx, int ry, int rwidth, int rheight)
+{
+  struct rect output = {x, y, x + target->width, y + target->height};
+  struct rect region = {x + rx, y + ry, x + rx + rwidth, y + ry + rheight};
+  struct zippo_scene_view *occluder, *view;
+  struct wl_list* start;
+
+  if (!intersect(region, output, &region)) return;
+
+  occluder = find_occluder(self, region);
+  if (occluder) {
+    start = &occluder->link;
+  } else {
+    clear(target, output, region);
+    start = self->views.next;
+  }
+
+  for (struct wl_list* l = start; l != &self->views; l = l->next) {
+    view = wl_container_of(l, view, link);
+    draw_view(view, output, target, region);
+  }
+}
+
+struct zippo_scene_view*
+zippo_scene_view_create(struct zippo_scene* scene)
+{
+  struct zippo_scene_view* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->scene = scene;
+  self->id = ++next_view_id;
+  wl_list_insert(scene->views.prev, &self->link);
+
+  return self;
+}
+
+void
+zippo_scene_view_set_buffer(struct zippo_scene_view* self,
+    const struct zippo_scale_image* buffer, bool opaque)
+{
+  zippo_scene_view_set_buffer_damage(
+      self, buffer, opaque, 0, 0, INT32_MAX, INT32_MAX);
+}
+
+void
+zippo_scene_view_set_buffer_damage(struct zippo_scene_view* self,
+    const struct zippo_scale_image* buffer, bool opaque, int x, int y,
+    int width, int height)
+{
+  struct rect bounds = {0, 0, 0, 0}, damage = {0, 0, 0, 0};
+
+  if (buffer) {
+    if (buffer->width != self->buffer.width ||
+        buffer->height != self->buffer.height)
+      x = y = 0, width = height = INT32_MAX;
+
+    bounds.x2 = buffer->width;
+    bounds.y2 = buffer->height;
+    damage.x1 = x;
+    damage.y1 = y;
+    damage.x2 = width > bounds.x2 - x ? bounds.x2 : x + width;
+    damage.y2 = height > bounds.y2 - y ? bounds.y2 : y + height;
+    if (!intersect(damage, bounds, &damage)) memset(&damage, 0, sizeof damage);
+
+    self->buffer = *buffer;
+  } else {
+    memset(&self->buffer, 0, sizeof self->buffer);
+  }
+
+  self->damage.x = damage.x1;
+  self->damage.y = damage.y1;
+  self->damage.width = damage.x2 - damage.x1;
+  self->damage.height = damage.y2 - damage.y1;
+  self->opaque = opaque;
+  self->generation++;
+}
+
+void
+zippo_scene_view_set_position(struct zippo_scene_view* self, int x, int y)
+{
+  self->x = x;
+  self->y = y;
+}
+
+void
+zippo_scene_view_raise(struct zippo_scene_view* self)
+{
+  wl_list_remove(&self->link);
+  wl_list_insert(self->scene->views.prev, &self->link);
+}
+
+void
+zippo_scene_view_destroy(struct zippo_scene_view* self)
+{
+  wl_list_remove(&self->link);
+  free(self);
+}
+
+struct zippo_scene*
+zippo_scene_create()
+{
+  struct zippo_scene* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  wl_list_init(&self->views);
+
+  return self;
+}
+
+void
+zippo_scene_destroy(struct zippo_scene* self)
+{
+  struct zippo_scene_view *view, *tmp;
+
+  // views still around can only be destroyed from now on
+  wl_list_for_each_safe(view, tmp, &self->views, link)
+  {
+    wl_list_remove(&view->link);
+    wl_list_init(&view->link);
+    view->scene = NULL;
+  }
+
+  free(self);
+}
@@ -0,0 +1,97 @@
+#ifndef ZIPPO_SCENE_H
+#define ZIPPO_SCENE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-server-core.h>
+
+#include "scale.h"
+
+struct zippo_scene_stats {
+  uint64_t frames;
+  uint64_t passthrough_frames;  // client buffer handed out as is
+  uint64_t bytes_saved;  // composite reads and writes that were skipped
+};
+
+struct zippo_scene {
+  struct wl_list views;  // zippo_scene_view::link, bottom to top
+  struct zippo_scene_stats stats;
+};
+
+struct zippo_scene_view {
+  struct zippo_scene* scene;
+  struct wl_list link;
+
+  struct zippo_scale_image buffer;  // premultiplied, data NULL if unmapped
+  bool opaque;  // XRGB or an opaque region covering the whole buffer
+  int x;
+  int y;
+
+  // bumped by every zippo_scene_view_set_buffer(), tells renderers that
+  // keep a copy of the buffer to refresh it
+  uint32_t generation;
+
+  // in buffer coordinates, what changed with the latest generation. a
+  // renderer whose copy is one generation behind only refreshes this.
+  struct {
+    int x;
+    int y;
+    int width;
+    int height;
+  } damage;
+
+  // never reused, unlike the address of a destroyed view, so renderers key
+  // what they keep for the view on it
+  uint64_t id;
+};
+
+struct zippo_scene_view* zippo_scene_view_create(struct zippo_scene* scene);
+
+/**
+ * @param buffer NULL to unmap, the pixels must stay valid until replaced
+ */
+void zippo_scene_view_set_buffer(struct zippo_scene_view* self,
+    const struct zippo_scale_image* buffer, bool opaque);
+
+/**
+ * Like zippo_scene_view_set_buffer(), for a buffer that only differs from
+ * the previous one inside the given rectangle, in buffer coordinates. Pass
+ * the bounds of what the client declared with wl_surface.damage_buffer.
+ * Damage to a buffer of another size covers all of it.
+ */
+void zippo_scene_view_set_buffer_damage(struct zippo_scene_view* self,
+    const struct zippo_scale_image* buffer, bool opaque, int x, int y,
+    int width, int height);
+
+void zippo_scene_view_set_position(
+    struct zippo_scene_view* self, int x, int y);
+
+// put on top of every other view, e.g. the cursor
+void zippo_scene_view_raise(struct zippo_scene_view* self);
+
+void zippo_scene_view_destroy(struct zippo_scene_view* self);
+
+/**
+ * Produce the content of the output whose top left corner is at x, y in the
+ * scene and whose size is the target's. When one opaque view exactly covers
+ * the output and nothing is drawn above it, its buffer is returned as is and
+ * target is left untouched. Otherwise the views are composited into target.
+ *
+ * @return the image to scan out or capture, target or a client buffer
+ */
+const struct zippo_scale_image* zippo_scene_render_output(
+    struct zippo_scene* self, int x, int y, struct zippo_scale_image* target);
+
+/**
+ * Composite the views into the given rectangle of target, regardless of
+ * passthrough. target covers the output whose top left corner is at x, y.
+ */
+void zippo_scene_composite_region(struct zippo_scene* self, int x, int y,
+    struct zippo_scale_image* target, int rx, int ry, int rwidth,
+    int rheight);
+
+struct zippo_scene* zippo_scene_create();
+
+void zippo_scene_destroy(struct zippo_scene* self);
+
+#endif  //  ZIPPO_SCENE_H
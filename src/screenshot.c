@@ -0,0 +1,699 @@
+#include "screenshot.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "loop_monitor.h"
+
+#define POOL_SIZE 2  // snapshots kept for the next capture
+
+// 4k rows of 11 KiB, big enough that compressing each band without the
+// window of the one before costs little, small enough for every worker to
+// get a few
+#define PNG_BAND_ROWS 64
+#define PNG_LEVEL 1  // screenshots are mostly flat, more buys little
+
+#define QOI_CHUNK_SIZE (64 * 1024)
+
+struct zippo_screenshot_buffer {
+  uint32_t* data;
+  size_t size;
+};
+
+struct zippo_screenshot_band {
+  uint8_t* out;
+  size_t out_len;
+  size_t in_len;
+  uLong adler;
+  bool done;
+};
+
+struct zippo_screenshot {
+  struct zippo_screenshooter* shooter;
+  struct wl_list link;  // zippo_screenshooter::queue or ::done
+
+  enum zippo_screenshot_format format;
+  int fd;
+  zippo_screenshot_done_func_t done;
+  void* data;
+
+  struct zippo_screenshot_buffer snapshot;
+  int width;
+  int height;
+
+  int task_count;  // bands for png, 1 for qoi
+  int next_task;  // under the lock of the shooter
+
+  // in order, under write_lock
+  pthread_mutex_t write_lock;
+  struct zippo_screenshot_band* bands;
+  int bands_written;
+  uLong adler;
+
+  int ret;
+  uint64_t start_ns;
+  uint64_t encode_ns;
+  uint64_t bytes_out;
+};
+
+struct zippo_screenshooter {
+  struct wl_event_loop* loop;
+  struct wl_event_source* done_source;
+  int done_fd;
+
+  pthread_t* threads;
+  int thread_count;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct wl_list queue;  // with tasks left to hand out
+  struct wl_list done;  // to finish on the main loop
+  bool stopping;
+
+  // main loop only
+  struct zippo_screenshot_buffer pool[POOL_SIZE];
+  int pool_count;
+  struct zippo_screenshot_stats stats;
+};
+
+static uint64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+put_be32(uint8_t* out, uint32_t value)
+{
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+// the requester may have handed over a non-blocking fd
+static int
+zippo_screenshot_write(
+    struct zippo_screenshot* self, const void* data, size_t len)
+{
+  const uint8_t* p = data;
+
+  if (self->ret != 0) return -1;
+
+  while (len > 0) {
+    ssize_t n = write(self->fd, p, len);
+
+    if (n < 0 && errno == EAGAIN) {
+      struct pollfd pfd = {.fd = self->fd, .events = POLLOUT};
+      poll(&pfd, 1, -1);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      fprintf(stderr, "Failed to write screenshot: %s\n", strerror(errno));
+      self->ret = -1;
+      return -1;
+    }
+
+    p += n;
+    len -= n;
+    self->bytes_out += n;
+  }
+
+  return 0;
+}
+
+static int
+zippo_screenshot_write_chunk(struct zippo_screenshot* self, const char* type,
+    const void* data, size_t len)
+{
+  uint8_t head[8], tail[4];
+  uLong crc = crc32(0, (const Bytef*)type, 4);
+
+  // a NULL buffer would reset it
+  if (len > 0) crc = crc32(crc, data, len);
+  put_be32(head, len);
+  memcpy(head + 4, type, 4);
+  put_be32(tail, crc);
+
+  if (zippo_screenshot_write(self, head, sizeof head) != 0 ||
+      zippo_screenshot_write(self, data, len) != 0 ||
+      zippo_screenshot_write(self, tail, sizeof tail) != 0)
+    return -1;
+
+  return 0;
+}
+
+static void
+zippo_screenshot_png_write_head(struct zippo_screenshot* self)
+{
+  static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a,
+      '\n'};
+  static const uint8_t zlib_head[2] = {0x78, 0x01};
+  uint8_t ihdr[13] = {0};
+
+  put_be32(ihdr, self->width);
+  put_be32(ihdr + 4, self->height);
+  ihdr[8] = 8;  // bit depth
+  ihdr[9] = 2;  // rgb
+
+  zippo_screenshot_write(self, signature, sizeof signature);
+  zippo_screenshot_write_chunk(self, "IHDR", ihdr, sizeof ihdr);
+  // the bands are raw deflate, one zlib stream around all of them
+  zippo_screenshot_write_chunk(self, "IDAT", zlib_head, sizeof zlib_head);
+}
+
+static void
+zippo_screenshot_png_write_tail(struct zippo_screenshot* self)
+{
+  uint8_t adler[4];
+
+  put_be32(adler, self->adler);
+  zippo_screenshot_write_chunk(self, "IDAT", adler, sizeof adler);
+  zippo_screenshot_write_chunk(self, "IEND", NULL, 0);
+}
+
+// every row with the up filter, which needs nothing but the row above, so
+// bands can be filtered on their own
+static void
+zippo_screenshot_png_encode_band(struct zippo_screenshot* self, int index)
+{
+  struct zippo_screenshot_band* band = &self->bands[index];
+  int y0 = index * PNG_BAND_ROWS;
+  int rows = self->height - y0 < PNG_BAND_ROWS ? self->height - y0
+                                                : PNG_BAND_ROWS;
+  size_t row_len = 1 + (size_t)self->width * 3;
+  bool last = index == self->task_count - 1;
+  uint8_t* filtered;
+  z_stream z = {0};
+
+  band->in_len = rows * row_len;
+  filtered = malloc(band->in_len);
+  if (filtered == NULL) return;
+
+  for (int y = y0; y < y0 + rows; y++) {
+    const uint32_t* row = self->snapshot.data + (size_t)y * self->width;
+    const uint32_t* above = y > 0 ? row - self->width : NULL;
+    uint8_t* out = filtered + (y - y0) * row_len;
+
+    *out++ = 2;
+    for (int x = 0; x < self->width; x++) {
+      uint32_t p = row[x], a = above ? above[x] : 0;
+
+      *out++ = ((p >> 16) & 0xff) - ((a >> 16) & 0xff);
+      *out++ = ((p >> 8) & 0xff) - ((a >> 8) & 0xff);
+      *out++ = (p & 0xff) - (a & 0xff);
+    }
+  }
+
+  band->adler = adler32(adler32(0, NULL, 0), filtered, band->in_len);
+
+  if (deflateInit2(&z, PNG_LEVEL, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK)
+    goto out;
+
+  // a sync flush ends the band on a byte boundary without a final block,
+  // so the next band's deflate output follows it in the same stream
+  band->out_len = deflateBound(&z, band->in_len) + 16;
+  band->out = malloc(band->out_len);
+  if (band->out == NULL) {
+    deflateEnd(&z);
+    goto out;
+  }
+
+  z.next_in = filtered;
+  z.avail_in = band->in_len;
+  z.next_out = band->out;
+  z.avail_out = band->out_len;
+  if (deflate(&z, last ? Z_FINISH : Z_SYNC_FLUSH) ==
+      (last ? Z_STREAM_END : Z_OK)) {
+    band->out_len -= z.avail_out;
+  } else {
+    free(band->out);
+    band->out = NULL;
+  }
+  deflateEnd(&z);
+
+out:
+  free(filtered);
+}
+
+static void zippo_screenshot_finish(struct zippo_screenshot* self);
+
+// whoever completes the band the file is waiting for writes it and what is
+// ready behind it
+static void
+zippo_screenshot_png_band_done(struct zippo_screenshot* self, int index)
+{
+  bool finished = false;
+
+  pthread_mutex_lock(&self->write_lock);
+
+  self->bands[index].done = true;
+  while (self->bands_written < self->task_count &&
+         self->bands[self->bands_written].done) {
+    struct zippo_screenshot_band* band = &self->bands[self->bands_written];
+
+    if (self->bands_written == 0) zippo_screenshot_png_write_head(self);
+    if (band->out == NULL) {
+      fprintf(stderr, "Failed to compress screenshot\n");
+      self->ret = -1;
+    }
+    zippo_screenshot_write_chunk(self, "IDAT", band->out, band->out_len);
+    self->adler = adler32_combine(self->adler, band->adler, band->in_len);
+    free(band->out);
+    band->out = NULL;
+
+    if (++self->bands_written == self->task_count) {
+      zippo_screenshot_png_write_tail(self);
+      finished = true;
+    }
+  }
+
+  pthread_mutex_unlock(&self->write_lock);
+
+  if (finished) zippo_screenshot_finish(self);
+}
+
+struct qoi_writer {
+  struct zippo_screenshot* shot;
+  uint8_t buffer[QOI_CHUNK_SIZE];
+  size_t len;
+};
+
+static inline void
+qoi_put(struct qoi_writer* w, const uint8_t* bytes, size_t len)
+{
+  if (w->len + len > sizeof w->buffer) {
+    zippo_screenshot_write(w->shot, w->buffer, w->len);
+    w->len = 0;
+  }
+  memcpy(w->buffer + w->len, bytes, len);
+  w->len += len;
+}
+
+static void
+zippo_screenshot_qoi_encode(struct zippo_screenshot* self)
+{
+  struct qoi_writer* w = malloc(sizeof *w);
+  uint32_t index[64] = {0}, prev = 0xff000000;
+  size_t count = (size_t)self->width * self->height;
+  static const uint8_t end[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+  uint8_t head[14] = {'q', 'o', 'i', 'f'};
+  int run = 0;
+
+  if (w == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    self->ret = -1;
+    goto out;
+  }
+  w->shot = self;
+  w->len = 0;
+
+  put_be32(head + 4, self->width);
+  put_be32(head + 8, self->height);
+  head[12] = 3;  // rgb
+  head[13] = 0;  // srgb
+  qoi_put(w, head, sizeof head);
+
+  for (size_t i = 0; i < count; i++) {
+    uint32_t px = self->snapshot.data[i] | 0xff000000;
+    int r = (px >> 16) & 0xff, g = (px >> 8) & 0xff, b = px & 0xff;
+    int hash;
+
+    if (px == prev) {
+      if (++run == 62) {
+        qoi_put(w, &(uint8_t){0xc0 | (run - 1)}, 1);
+        run = 0;
+      }
+      continue;
+    }
+
+    if (run > 0) {
+      qoi_put(w, &(uint8_t){0xc0 | (run - 1)}, 1);
+      run = 0;
+    }
+
+    hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+    if (index[hash] == px) {
+      qoi_put(w, &(uint8_t){hash}, 1);
+    } else {
+      int8_t dr = r - ((prev >> 16) & 0xff), dg = g - ((prev >> 8) & 0xff);
+      int8_t db = b - (prev & 0xff);
+      int8_t dr_dg = dr - dg, db_dg = db - dg;
+
+      index[hash] = px;
+      if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+        qoi_put(w, &(uint8_t){0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)},
+            1);
+      } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+                 db_dg >= -8 && db_dg <= 7) {
+        uint8_t luma[2] = {0x80 | (dg + 32), (dr_dg + 8) << 4 | (db_dg + 8)};
+        qoi_put(w, luma, sizeof luma);
+      } else {
+        uint8_t rgb[4] = {0xfe, r, g, b};
+        qoi_put(w, rgb, sizeof rgb);
+      }
+    }
+    prev = px;
+  }
+  if (run > 0) qoi_put(w, &(uint8_t){0xc0 | (run - 1)}, 1);
+
+  qoi_put(w, end, sizeof end);
+  zippo_screenshot_write(self, w->buffer, w->len);
+
+out:
+  free(w);
+  zippo_screenshot_finish(self);
+}
+
+static void
+zippo_screenshot_run_task(struct zippo_screenshot* self, int task)
+{
+  if (self->format == ZIPPO_SCREENSHOT_FORMAT_QOI) {
+    zippo_screenshot_qoi_encode(self);
+    return;
+  }
+
+  zippo_screenshot_png_encode_band(self, task);
+  zippo_screenshot_png_band_done(self, task);
+}
+
+// the last byte is out, hand it back to the main loop
+static void
+zippo_screenshot_finish(struct zippo_screenshot* self)
+{
+  struct zippo_screenshooter* shooter = self->shooter;
+  uint64_t one = 1;
+
+  close(self->fd);
+  self->fd = -1;
+  self->encode_ns = now_ns() - self->start_ns;
+
+  pthread_mutex_lock(&shooter->lock);
+  wl_list_insert(shooter->done.prev, &self->link);
+  pthread_mutex_unlock(&shooter->lock);
+
+  if (write(shooter->done_fd, &one, sizeof one) < 0)
+    fprintf(stderr, "Failed to signal a screenshot: %s\n", strerror(errno));
+}
+
+static void
+zippo_screenshot_destroy(struct zippo_screenshot* self)
+{
+  struct zippo_screenshooter* shooter = self->shooter;
+
+  // the snapshot goes back to the pool, or the smallest one in it makes way
+  if (shooter->pool_count < POOL_SIZE) {
+    shooter->pool[shooter->pool_count++] = self->snapshot;
+  } else {
+    int smallest = 0;
+
+    for (int i = 1; i < POOL_SIZE; i++) {
+      if (shooter->pool[i].size < shooter->pool[smallest].size) smallest = i;
+    }
+    if (shooter->pool[smallest].size < self->snapshot.size) {
+      free(shooter->pool[smallest].data);
+      shooter->pool[smallest] = self->snapshot;
+    } else {
+      free(self->snapshot.data);
+    }
+  }
+
+  if (self->bands) {
+    for (int i = 0; i < self->task_count; i++) free(self->bands[i].out);
+    free(self->bands);
+  }
+  pthread_mutex_destroy(&self->write_lock);
+  if (self->fd >= 0) close(self->fd);
+  free(self);
+}
+
+static void*
+zippo_screenshooter_run_worker(void* data)
+{
+  struct zippo_screenshooter* self = data;
+
+  pthread_mutex_lock(&self->lock);
+  for (;;) {
+    struct zippo_screenshot* shot;
+    int task;
+
+    while (wl_list_empty(&self->queue) && !self->stopping)
+      pthread_cond_wait(&self->cond, &self->lock);
+    if (wl_list_empty(&self->queue)) break;
+
+    shot = wl_container_of(self->queue.next, shot, link);
+    task = shot->next_task++;
+    if (shot->next_task == shot->task_count) wl_list_remove(&shot->link);
+
+    pthread_mutex_unlock(&self->lock);
+    zippo_screenshot_run_task(shot, task);
+    pthread_mutex_lock(&self->lock);
+  }
+  pthread_mutex_unlock(&self->lock);
+
+  return NULL;
+}
+
+static int
+zippo_screenshooter_handle_done(int fd, uint32_t mask, void* data)
+{
+  struct zippo_screenshooter* self = data;
+  struct zippo_screenshot *shot, *tmp;
+  struct wl_list done;
+  uint64_t count;
+  (void)mask;
+
+  if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN)
+    fprintf(stderr, "Failed to read screenshot events: %s\n", strerror(errno));
+
+  wl_list_init(&done);
+  pthread_mutex_lock(&self->lock);
+  wl_list_insert_list(&done, &self->done);
+  wl_list_init(&self->done);
+  pthread_mutex_unlock(&self->lock);
+
+  wl_list_for_each_safe(shot, tmp, &done, link)
+  {
+    wl_list_remove(&shot->link);
+    self->stats.encode_ns += shot->encode_ns;
+    self->stats.bytes_out += shot->bytes_out;
+    if (shot->done) shot->done(shot->data, shot->ret);
+    zippo_screenshot_destroy(shot);
+  }
+
+  return 0;
+}
+
+// a pooled snapshot as large as needed, the main loop copies into it
+static int
+zippo_screenshooter_take_buffer(struct zippo_screenshooter* self,
+    size_t size, struct zippo_screenshot_buffer* buffer)
+{
+  for (int i = 0; i < self->pool_count; i++) {
+    if (self->pool[i].size < size) continue;
+    *buffer = self->pool[i];
+    self->pool[i] = self->pool[--self->pool_count];
+    return 0;
+  }
+
+  buffer->data = malloc(size);
+  buffer->size = size;
+  if (buffer->data == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int
+zippo_screenshooter_capture(struct zippo_screenshooter* self,
+    const struct zippo_scale_image* output,
+    enum zippo_screenshot_format format, int fd,
+    zippo_screenshot_done_func_t done, void* data)
+{
+  size_t size = (size_t)output->width * output->height * 4;
+  uint64_t start = now_ns();
+  struct zippo_screenshot* shot;
+
+  shot = calloc(1, sizeof *shot);
+  if (shot == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err;
+  }
+
+  shot->shooter = self;
+  shot->format = format;
+  shot->fd = fd;
+  shot->done = done;
+  shot->data = data;
+  shot->width = output->width;
+  shot->height = output->height;
+  shot->adler = adler32(0, NULL, 0);
+  shot->task_count = format == ZIPPO_SCREENSHOT_FORMAT_PNG
+                         ? (output->height + PNG_BAND_ROWS - 1) / PNG_BAND_ROWS
+                         : 1;
+  pthread_mutex_init(&shot->write_lock, NULL);
+  wl_list_init(&shot->link);
+
+  if (format == ZIPPO_SCREENSHOT_FORMAT_PNG) {
+    shot->bands = calloc(shot->task_count, sizeof *shot->bands);
+    if (shot->bands == NULL) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      goto err_shot;
+    }
+  }
+
+  if (zippo_screenshooter_take_buffer(self, size, &shot->snapshot) != 0)
+    goto err_shot;
+
+  // all the main loop pays for
+  for (int y = 0; y < output->height; y++) {
+    memcpy(shot->snapshot.data + (size_t)y * output->width,
+        (const uint8_t*)output->data + (size_t)y * output->stride,
+        (size_t)output->width * 4);
+  }
+
+  shot->start_ns = now_ns();
+  self->stats.captures++;
+  self->stats.copy_ns += shot->start_ns - start;
+  self->stats.bytes_in += size;
+
+  if (self->thread_count == 0) {
+    for (int i = 0; i < shot->task_count; i++)
+      zippo_screenshot_run_task(shot, i);
+    return 0;
+  }
+
+  pthread_mutex_lock(&self->lock);
+  wl_list_insert(self->queue.prev, &shot->link);
+  pthread_cond_broadcast(&self->cond);
+  pthread_mutex_unlock(&self->lock);
+
+  return 0;
+
+err_shot:
+  shot->fd = -1;
+  free(shot->bands);
+  pthread_mutex_destroy(&shot->write_lock);
+  free(shot);
+
+err:
+  close(fd);
+  return -1;
+}
+
+void
+zippo_screenshooter_get_stats(struct zippo_screenshooter* self,
+    struct zippo_screenshot_stats* stats)
+{
+  *stats = self->stats;
+}
+
+struct zippo_screenshooter*
+zippo_screenshooter_create(struct wl_event_loop* loop, int threads)
+{
+  struct zippo_screenshooter* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err;
+  }
+
+  self->loop = loop;
+  wl_list_init(&self->queue);
+  wl_list_init(&self->done);
+  pthread_mutex_init(&self->lock, NULL);
+  pthread_cond_init(&self->cond, NULL);
+
+  self->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (self->done_fd < 0) {
+    fprintf(stderr, "Failed to create eventfd: %s\n", strerror(errno));
+    goto err_free;
+  }
+
+  self->done_source = zippo_loop_add_fd(loop, self->done_fd,
+      WL_EVENT_READABLE, zippo_screenshooter_handle_done, self,
+      "screenshots");
+  if (self->done_source == NULL) {
+    fprintf(stderr, "Failed to add screenshots to the event loop\n");
+    goto err_fd;
+  }
+
+  self->threads = calloc(threads > 0 ? threads : 1, sizeof *self->threads);
+  if (self->threads == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err_source;
+  }
+
+  for (; self->thread_count < threads; self->thread_count++) {
+    if (pthread_create(&self->threads[self->thread_count], NULL,
+            zippo_screenshooter_run_worker, self) != 0) {
+      fprintf(stderr, "Failed to start a screenshot worker\n");
+      break;
+    }
+  }
+  // even one worker keeps the encoding off the main loop
+  if (threads > 0 && self->thread_count == 0) goto err_threads;
+
+  return self;
+
+err_threads:
+  free(self->threads);
+
+err_source:
+  zippo_loop_source_remove(self->loop, self->done_source);
+
+err_fd:
+  close(self->done_fd);
+
+err_free:
+  pthread_cond_destroy(&self->cond);
+  pthread_mutex_destroy(&self->lock);
+  free(self);
+
+err:
+  return NULL;
+}
+
+void
+zippo_screenshooter_destroy(struct zippo_screenshooter* self)
+{
+  struct zippo_screenshot *shot, *tmp;
+
+  pthread_mutex_lock(&self->lock);
+  self->stopping = true;
+  pthread_cond_broadcast(&self->cond);
+  pthread_mutex_unlock(&self->lock);
+
+  // the queue is drained before the workers leave
+  for (int i = 0; i < self->thread_count; i++)
+    pthread_join(self->threads[i], NULL);
+
+  wl_list_for_each_safe(shot, tmp, &self->done, link)
+  {
+    wl_list_remove(&shot->link);
+    zippo_screenshot_destroy(shot);
+  }
+
+  for (int i = 0; i < self->pool_count; i++) free(self->pool[i].data);
+  zippo_loop_source_remove(self->loop, self->done_source);
+  close(self->done_fd);
+  free(self->threads);
+  pthread_cond_destroy(&self->cond);
+  pthread_mutex_destroy(&self->lock);
+  free(self);
+}
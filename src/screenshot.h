@@ -0,0 +1,58 @@
+#ifndef ZIPPO_SCREENSHOT_H
+#define ZIPPO_SCREENSHOT_H
+
+#include <stdint.h>
+#include <wayland-server-core.h>
+
+#include "scale.h"
+
+enum zippo_screenshot_format {
+  ZIPPO_SCREENSHOT_FORMAT_PNG,
+  ZIPPO_SCREENSHOT_FORMAT_QOI,
+};
+
+struct zippo_screenshot_stats {
+  uint64_t captures;
+  uint64_t copy_ns;  // on the main loop
+  uint64_t encode_ns;  // capture to the last byte written, on the workers
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+};
+
+/**
+ * @param ret 0 when the whole file was written, -1 on failure
+ */
+typedef void (*zippo_screenshot_done_func_t)(void* data, int ret);
+
+// takes screenshots of outputs without stalling the main loop. the output
+// is copied into a pooled snapshot, and worker threads encode it and write
+// it out while the compositor goes on drawing. png is cut into bands of rows
+// compressed in parallel, qoi is encoded in one go on one worker, it is
+// fast enough.
+struct zippo_screenshooter;
+
+/**
+ * @param output ARGB8888, alpha is dropped
+ * @param fd where the file is written, closed once it is done
+ * @param done called on the main loop at the end, may be NULL
+ * @return 0 if the screenshot is under way, -1 on failure, fd closed
+ */
+int zippo_screenshooter_capture(struct zippo_screenshooter* self,
+    const struct zippo_scale_image* output,
+    enum zippo_screenshot_format format, int fd,
+    zippo_screenshot_done_func_t done, void* data);
+
+void zippo_screenshooter_get_stats(struct zippo_screenshooter* self,
+    struct zippo_screenshot_stats* stats);
+
+/**
+ * @param threads workers, 0 to encode on the calling thread in
+ * zippo_screenshooter_capture()
+ */
+struct zippo_screenshooter* zippo_screenshooter_create(
+    struct wl_event_loop* loop, int threads);
+
+// waits for the screenshots under way, without calling their done
+void zippo_screenshooter_destroy(struct zippo_screenshooter* self);
+
+#endif  //  ZIPPO_SCREENSHOT_H
@@ -0,0 +1,126 @@
+#include "seat.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int
+zippo_seat_add_input(struct zippo_seat* self, const char* sysname)
+{
+  char** devnodes;
+  char devnode[PATH_MAX];
+  int len;
+
+  // sysfs names are short, one that is not is no evdev node of ours
+  len = snprintf(devnode, sizeof devnode, "/dev/input/%s", sysname);
+  if (len < 0 || (size_t)len >= sizeof devnode) return 0;
+
+  devnodes = realloc(
+      self->input_devnodes, (self->input_count + 1) * sizeof *devnodes);
+  if (devnodes == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return -1;
+  }
+  self->input_devnodes = devnodes;
+
+  devnodes[self->input_count] = strdup(devnode);
+  if (devnodes[self->input_count] == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return -1;
+  }
+  self->input_count++;
+
+  return 0;
+}
+
+// evdev nodes only, the mouseN and jsN compatibility nodes and the parent
+// inputN devices would double up
+static int
+zippo_seat_scan_inputs(struct zippo_seat* self, const char* root)
+{
+  char dir_path[PATH_MAX], path[PATH_MAX], seat[ZIPPO_GPU_PROBE_SEAT_MAX];
+  struct dirent* entry;
+  DIR* dir;
+
+  snprintf(dir_path, sizeof dir_path, "%s/sys/class/input", root);
+  dir = opendir(dir_path);
+  if (dir == NULL) return 0;  // a seat without input is still a seat
+
+  while ((entry = readdir(dir)) != NULL) {
+    int len;
+
+    if (strncmp(entry->d_name, "event", 5) != 0) continue;
+
+    len = snprintf(path, sizeof path, "%s/%s", dir_path, entry->d_name);
+    if (len < 0 || (size_t)len >= sizeof path) continue;
+    zippo_gpu_probe_device_seat(root, path, seat, sizeof seat);
+    if (strcmp(seat, self->name) != 0) continue;
+
+    if (zippo_seat_add_input(self, entry->d_name) != 0) {
+      closedir(dir);
+      return -1;
+    }
+  }
+
+  closedir(dir);
+
+  return 0;
+}
+
+struct zippo_seat*
+zippo_seat_create(const char* root, const char* name,
+    const char* drm_syspath, struct zippo_keymap_cache* keymaps)
+{
+  struct zippo_seat* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err;
+  }
+
+  snprintf(self->name, sizeof self->name, "%s", name);
+  wl_list_init(&self->link);
+
+  self->drm_syspath = strdup(drm_syspath);
+  if (self->drm_syspath == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err_free;
+  }
+
+  if (zippo_seat_scan_inputs(self, root) != 0) goto err_inputs;
+
+  if (keymaps) {
+    self->keymap = zippo_keymap_cache_get(keymaps, NULL);
+    if (self->keymap == NULL) {
+      fprintf(stderr, "Failed to get a keymap for %s\n", name);
+      goto err_inputs;
+    }
+  }
+
+  return self;
+
+err_inputs:
+  for (int i = 0; i < self->input_count; i++) free(self->input_devnodes[i]);
+  free(self->input_devnodes);
+  free(self->drm_syspath);
+
+err_free:
+  free(self);
+
+err:
+  return NULL;
+}
+
+void
+zippo_seat_destroy(struct zippo_seat* self)
+{
+  if (self->keymap) zippo_keymap_unref(self->keymap);
+  for (int i = 0; i < self->input_count; i++) free(self->input_devnodes[i]);
+  free(self->input_devnodes);
+  free(self->drm_syspath);
+  wl_list_remove(&self->link);
+  free(self);
+}
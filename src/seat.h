@@ -0,0 +1,34 @@
+#ifndef ZIPPO_SEAT_H
+#define ZIPPO_SEAT_H
+
+#include <wayland-server-core.h>
+
+#include "gpu_probe.h"
+#include "keymap_cache.h"
+
+// the devices of one seat, assigned by their ID_SEAT udev property. one
+// process drives every seat, what does not change between them, like the
+// renderer and compiled keymaps, is created once and shared.
+struct zippo_seat {
+  struct wl_list link;
+  char name[ZIPPO_GPU_PROBE_SEAT_MAX];
+
+  char* drm_syspath;  // primary card
+  char** input_devnodes;  // evdev devices, "/dev/input/event<N>"
+  int input_count;
+
+  // a reference to the keymap shared by every seat with the same names
+  struct zippo_keymap* keymap;
+};
+
+/**
+ * @param root prefix of /sys and /run/udev, "" on a real system
+ * @param drm_syspath primary card of the seat
+ * @param keymaps NULL to leave keymap unset
+ */
+struct zippo_seat* zippo_seat_create(const char* root, const char* name,
+    const char* drm_syspath, struct zippo_keymap_cache* keymaps);
+
+void zippo_seat_destroy(struct zippo_seat* self);
+
+#endif  //  ZIPPO_SEAT_H
@@ -0,0 +1,302 @@
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+// events queued for a client that does not read its socket, beyond what the
+// socket itself holds, before it is disconnected
+#define CLIENT_BUFFER_SIZE (1 << 20)
+
+// take over an fd inherited from zippo-launch, -1 if there is none
+static int
+take_env_fd(const char* name)
+{
+  const char* value = getenv(name);
+  char* end;
+  long fd;
+  int flags;
+
+  if (value == NULL) return -1;
+
+  errno = 0;
+  fd = strtol(value, &end, 10);
+  unsetenv(name);  // not for our children
+
+  if (errno != 0 || end == value || *end != '\0' || fd < 0 || fd > INT_MAX)
+    goto err;
+
+  flags = fcntl(fd, F_GETFD);
+  if (flags < 0 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) < 0) goto err;
+
+  return fd;
+
+err:
+  fprintf(stderr, "Invalid fd in %s\n", name);
+  return -1;
+}
+
+static void
+handle_launcher_activate(void* data)
+{
+  (void)data;
+  fprintf(stderr, "Session activated\n");
+}
+
+static void
+handle_launcher_deactivate(void* data)
+{
+  struct zippo_server* self = data;
+
+  // nothing to release yet, let the vt switch go ahead
+  zippo_launcher_client_deactivate_done(self->launcher, NULL, NULL);
+}
+
+static const struct zippo_launcher_client_listener launcher_listener = {
+    .activate = handle_launcher_activate,
+    .deactivate = handle_launcher_deactivate,
+};
+
+static void
+handle_client_pressure(void* data, struct wl_client* client)
+{
+  pid_t pid;
+  (void)data;
+
+  // nothing holds client buffers yet, the limits are all there is
+  wl_client_get_credentials(client, &pid, NULL, NULL);
+  fprintf(stderr, "Client %d is near its memory limit\n", (int)pid);
+}
+
+static int
+handle_launcher_event(int fd, uint32_t mask, void* data)
+{
+  struct zippo_server* self = data;
+  (void)fd;
+
+  if (zippo_launcher_client_dispatch(self->launcher) != 0 ||
+      (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))) {
+    fprintf(stderr, "Lost connection to the launcher\n");
+    zippo_loop_monitor_terminate(self->monitor);
+  }
+
+  return 0;
+}
+
+static int
+handle_terminate_signal(int signal_number, void* data)
+{
+  struct zippo_server* self = data;
+  (void)signal_number;
+
+  zippo_loop_monitor_terminate(self->monitor);
+
+  return 0;
+}
+
+// sent from the main loop, so that the launcher notices when it hangs
+static int
+handle_heartbeat(void* data)
+{
+  struct zippo_server* self = data;
+
+  zippo_launcher_client_heartbeat(self->launcher, NULL, NULL);
+  wl_event_source_timer_update(
+      self->heartbeat_source, ZIPPO_LAUNCH_HEARTBEAT_INTERVAL);
+
+  return 0;
+}
+
+static int
+zippo_server_add_socket(struct zippo_server* self)
+{
+  const char* name;
+  int fd;
+
+  fd = take_env_fd(ZIPPO_LAUNCH_WAYLAND_SOCKET_ENV);
+  if (fd >= 0) {
+    if (wl_display_add_socket_fd(self->display, fd) != 0) {
+      fprintf(stderr, "Failed to listen on the launcher's socket\n");
+      close(fd);
+      return -1;
+    }
+    // zippo-launch has set WAYLAND_DISPLAY for us
+    return 0;
+  }
+
+  name = wl_display_add_socket_auto(self->display);
+  if (name == NULL) {
+    fprintf(stderr, "Failed to create wayland socket\n");
+    return -1;
+  }
+  setenv("WAYLAND_DISPLAY", name, 1);
+
+  return 0;
+}
+
+static int
+zippo_server_connect_launcher(struct zippo_server* self)
+{
+  struct wl_event_loop* loop = wl_display_get_event_loop(self->display);
+  int fd;
+
+  fd = take_env_fd(ZIPPO_LAUNCH_SOCKET_ENV);
+  if (fd < 0) return 0;
+
+  self->launcher = zippo_launcher_client_create(fd, &launcher_listener, self);
+  if (self->launcher == NULL) {
+    close(fd);
+    return -1;
+  }
+
+  self->launcher_source = zippo_loop_add_fd(
+      loop, fd, WL_EVENT_READABLE, handle_launcher_event, self, "launcher");
+  if (self->launcher_source == NULL) {
+    fprintf(stderr, "Failed to watch the launcher socket\n");
+    return -1;
+  }
+
+  self->heartbeat_source =
+      zippo_loop_add_timer(loop, handle_heartbeat, self, "heartbeat");
+  if (self->heartbeat_source == NULL) {
+    fprintf(stderr, "Failed to create the heartbeat timer\n");
+    return -1;
+  }
+  // the first one once the loop is running
+  wl_event_source_timer_update(self->heartbeat_source, 1);
+
+  return 0;
+}
+
+static void
+zippo_server_create_metrics(struct zippo_server* self)
+{
+  struct wl_event_loop* loop = wl_display_get_event_loop(self->display);
+  const char* name = getenv("WAYLAND_DISPLAY");
+
+  // not worth failing the session for
+  if (name) self->metrics = zippo_metrics_create(loop, name);
+  if (self->metrics == NULL) return;
+
+  if (zippo_metrics_add_source(
+          self->metrics, zippo_client_quota_write_metrics, self->quota) != 0 ||
+      zippo_metrics_add_source(self->metrics,
+          zippo_loop_monitor_write_metrics, self->monitor) != 0) {
+    zippo_metrics_destroy(self->metrics);
+    self->metrics = NULL;
+  }
+}
+
+struct zippo_server*
+zippo_server_create(const struct zippo_client_limits* limits,
+    int stall_threshold_ms, int watchdog_ms)
+{
+  struct zippo_server* self;
+  struct wl_event_loop* loop;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err;
+  }
+
+  self->display = wl_display_create();
+  if (self->display == NULL) {
+    fprintf(stderr, "Failed to create wayland display\n");
+    goto err_display;
+  }
+
+  loop = wl_display_get_event_loop(self->display);
+
+#if WAYLAND_VERSION_MAJOR > 1 || WAYLAND_VERSION_MINOR >= 23
+  // older versions drop a client once 4 KiB pile up behind its full socket,
+  // a client busy for a few frames of pointer motion is not worth that
+  wl_display_set_default_max_buffer_size(self->display, CLIENT_BUFFER_SIZE);
+#endif
+
+  // first, sources added from now on are timed
+  self->monitor =
+      zippo_loop_monitor_create(self->display, stall_threshold_ms, watchdog_ms);
+  if (self->monitor == NULL) goto err_monitor;
+
+  self->quota = zippo_client_quota_create(
+      self->display, limits, handle_client_pressure, self);
+  if (self->quota == NULL) goto err_quota;
+
+  if (zippo_server_add_socket(self) != 0) goto err_socket;
+
+  zippo_server_create_metrics(self);
+
+  if (zippo_server_connect_launcher(self) != 0) goto err_launcher;
+
+  self->sigterm_source = zippo_loop_add_signal(
+      loop, SIGTERM, handle_terminate_signal, self, "terminate");
+  self->sigint_source = zippo_loop_add_signal(
+      loop, SIGINT, handle_terminate_signal, self, "terminate");
+  if (self->sigterm_source == NULL || self->sigint_source == NULL) {
+    fprintf(stderr, "Failed to watch signals\n");
+    goto err_signal;
+  }
+
+  return self;
+
+err_signal:
+  if (self->sigterm_source)
+    zippo_loop_source_remove(loop, self->sigterm_source);
+  if (self->sigint_source) zippo_loop_source_remove(loop, self->sigint_source);
+
+err_launcher:
+  if (self->heartbeat_source)
+    zippo_loop_source_remove(loop, self->heartbeat_source);
+  if (self->launcher_source)
+    zippo_loop_source_remove(loop, self->launcher_source);
+  if (self->launcher) zippo_launcher_client_destroy(self->launcher);
+
+err_socket:
+  if (self->metrics) zippo_metrics_destroy(self->metrics);
+  zippo_client_quota_destroy(self->quota);
+
+err_quota:
+  zippo_loop_monitor_destroy(self->monitor);
+
+err_monitor:
+  wl_display_destroy(self->display);
+
+err_display:
+  free(self);
+
+err:
+  return NULL;
+}
+
+void
+zippo_server_run(struct zippo_server* self)
+{
+  zippo_loop_monitor_run(self->monitor);
+}
+
+void
+zippo_server_destroy(struct zippo_server* self)
+{
+  struct wl_event_loop* loop = wl_display_get_event_loop(self->display);
+
+  zippo_loop_source_remove(loop, self->sigint_source);
+  zippo_loop_source_remove(loop, self->sigterm_source);
+  if (self->heartbeat_source)
+    zippo_loop_source_remove(loop, self->heartbeat_source);
+  if (self->launcher_source)
+    zippo_loop_source_remove(loop, self->launcher_source);
+  if (self->launcher) zippo_launcher_client_destroy(self->launcher);
+  if (self->metrics) zippo_metrics_destroy(self->metrics);
+  wl_display_destroy_clients(self->display);
+  zippo_client_quota_destroy(self->quota);
+  zippo_loop_monitor_destroy(self->monitor);
+  wl_display_destroy(self->display);
+  free(self);
+}
@@ -0,0 +1,45 @@
+#ifndef ZIPPO_SERVER_H
+#define ZIPPO_SERVER_H
+
+#include <wayland-server-core.h>
+
+#include "client_quota.h"
+#include "launcher_client.h"
+#include "loop_monitor.h"
+#include "metrics.h"
+
+struct zippo_server {
+  struct wl_display* display;
+  struct zippo_loop_monitor* monitor;
+
+  // NULL when not started by zippo-launch
+  struct zippo_launcher_client* launcher;
+  struct wl_event_source* launcher_source;
+  struct wl_event_source* heartbeat_source;
+
+  struct wl_event_source* sigterm_source;
+  struct wl_event_source* sigint_source;
+
+  struct zippo_client_quota* quota;
+  // NULL when the metrics socket could not be created
+  struct zippo_metrics* metrics;
+};
+
+/**
+ * Start listening for clients. Under zippo-launch the already bound socket
+ * it passes is used, so clients may be waiting on it before this is called.
+ *
+ * @param limits memory limits of each client
+ * @param stall_threshold_ms main loop callbacks taking longer are logged
+ * @param watchdog_ms a main loop stuck for longer dumps a backtrace, 0 for
+ * no watchdog
+ */
+struct zippo_server* zippo_server_create(
+    const struct zippo_client_limits* limits, int stall_threshold_ms,
+    int watchdog_ms);
+
+void zippo_server_run(struct zippo_server* self);
+
+void zippo_server_destroy(struct zippo_server* self);
+
+#endif  //  ZIPPO_SERVER_H
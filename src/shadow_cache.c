@@ -0,0 +1,307 @@
+#include "shadow_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ZIPPO_SHADOW_CACHE_MIN_BUCKETS 64
+
+struct zippo_shadow_entry {
+  const void* key;
+  uint32_t* data;
+  int width;
+  int height;
+  size_t size;
+
+  // most recently used at the head
+  struct zippo_shadow_entry* prev;
+  struct zippo_shadow_entry* next;
+
+  struct zippo_shadow_entry* bucket_next;
+};
+
+struct zippo_shadow_cache {
+  size_t budget;
+  struct zippo_shadow_cache_stats stats;
+
+  struct zippo_shadow_entry* head;
+  struct zippo_shadow_entry* tail;
+
+  struct zippo_shadow_entry** buckets;
+  size_t bucket_count;  // power of 2
+  size_t entry_count;
+};
+
+static size_t
+hash_key(const void* key, size_t bucket_count)
+{
+  uintptr_t h = (uintptr_t)key;
+
+  // pointers are aligned, mix the high bits down
+  h ^= h >> 17;
+  h *= (uintptr_t)0x9e3779b97f4a7c15ull;
+  h ^= h >> 29;
+
+  return h & (bucket_count - 1);
+}
+
+static struct zippo_shadow_entry**
+zippo_shadow_cache_find(struct zippo_shadow_cache* self, const void* key)
+{
+  struct zippo_shadow_entry** p;
+
+  p = &self->buckets[hash_key(key, self->bucket_count)];
+  while (*p && (*p)->key != key) p = &(*p)->bucket_next;
+
+  return p;
+}
+
+static void
+zippo_shadow_cache_rehash(struct zippo_shadow_cache* self)
+{
+  struct zippo_shadow_entry** buckets;
+  size_t count = self->bucket_count * 2;
+
+  buckets = calloc(count, sizeof *buckets);
+  if (buckets == NULL) return;  // keep the longer chains
+
+  for (size_t i = 0; i < self->bucket_count; i++) {
+    struct zippo_shadow_entry *entry = self->buckets[i], *next;
+    for (; entry; entry = next) {
+      size_t h = hash_key(entry->key, count);
+      next = entry->bucket_next;
+      entry->bucket_next = buckets[h];
+      buckets[h] = entry;
+    }
+  }
+
+  free(self->buckets);
+  self->buckets = buckets;
+  self->bucket_count = count;
+}
+
+static void
+lru_unlink(struct zippo_shadow_cache* self, struct zippo_shadow_entry* entry)
+{
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    self->head = entry->next;
+
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    self->tail = entry->prev;
+
+  entry->prev = entry->next = NULL;
+}
+
+static void
+lru_push_head(
+    struct zippo_shadow_cache* self, struct zippo_shadow_entry* entry)
+{
+  entry->prev = NULL;
+  entry->next = self->head;
+  if (self->head)
+    self->head->prev = entry;
+  else
+    self->tail = entry;
+  self->head = entry;
+}
+
+static void
+zippo_shadow_cache_drop(
+    struct zippo_shadow_cache* self, struct zippo_shadow_entry** link)
+{
+  struct zippo_shadow_entry* entry = *link;
+
+  *link = entry->bucket_next;
+  lru_unlink(self, entry);
+  self->stats.bytes_cached -= entry->size;
+  self->entry_count--;
+
+  free(entry->data);
+  free(entry);
+}
+
+// evict from the tail until `extra` more bytes fit
+static void
+zippo_shadow_cache_make_room(struct zippo_shadow_cache* self, size_t extra)
+{
+  while (self->tail && self->stats.bytes_cached + extra > self->budget) {
+    zippo_shadow_cache_drop(
+        self, zippo_shadow_cache_find(self, self->tail->key));
+    self->stats.evictions++;
+  }
+}
+
+static void
+copy_rect(struct zippo_shadow_cache* self, struct zippo_shadow_entry* entry,
+    const uint32_t* data, int stride, int x, int y, int width, int height)
+{
+  size_t len;
+
+  if (x < 0) width += x, x = 0;
+  if (y < 0) height += y, y = 0;
+  if (x + width > entry->width) width = entry->width - x;
+  if (y + height > entry->height) height = entry->height - y;
+  if (width <= 0 || height <= 0) return;
+
+  len = (size_t)width * 4;
+
+  if (x == 0 && width == entry->width && stride == entry->width * 4) {
+    memcpy(entry->data + (size_t)y * entry->width,
+        (const uint8_t*)data + (size_t)y * stride, len * height);
+  } else {
+    for (int j = y; j < y + height; j++)
+      memcpy(entry->data + (size_t)j * entry->width + x,
+          (const uint8_t*)data + (size_t)j * stride + x * 4, len);
+  }
+
+  self->stats.bytes_copied += len * height;
+}
+
+int
+zippo_shadow_cache_upload(struct zippo_shadow_cache* self, const void* key,
+    const uint32_t* data, int width, int height, int stride,
+    const struct zippo_shadow_rect* damage, int damage_count)
+{
+  struct zippo_shadow_entry** link;
+  struct zippo_shadow_entry* entry;
+  size_t size = (size_t)width * height * 4;
+
+  link = zippo_shadow_cache_find(self, key);
+  entry = *link;
+
+  if (entry && entry->width == width && entry->height == height) {
+    lru_unlink(self, entry);
+    lru_push_head(self, entry);
+    self->stats.hits++;
+
+    for (int i = 0; i < damage_count; i++)
+      copy_rect(self, entry, data, stride, damage[i].x, damage[i].y,
+          damage[i].width, damage[i].height);
+
+    return 0;
+  }
+
+  self->stats.misses++;
+
+  if (entry) {  // resized
+    zippo_shadow_cache_drop(self, link);
+    entry = NULL;
+  }
+
+  // would evict everything else and still not fit, the caller reads the
+  // client buffer instead
+  if (size > self->budget) return 0;
+
+  zippo_shadow_cache_make_room(self, size);
+
+  entry = calloc(1, sizeof *entry);
+  if (entry == NULL) goto err;
+
+  entry->data = malloc(size);
+  if (entry->data == NULL) goto err_data;
+
+  entry->key = key;
+  entry->width = width;
+  entry->height = height;
+  entry->size = size;
+
+  if (self->entry_count >= self->bucket_count)
+    zippo_shadow_cache_rehash(self);
+
+  link = &self->buckets[hash_key(key, self->bucket_count)];
+  entry->bucket_next = *link;
+  *link = entry;
+  lru_push_head(self, entry);
+  self->stats.bytes_cached += size;
+  self->entry_count++;
+
+  copy_rect(self, entry, data, stride, 0, 0, width, height);
+
+  return 0;
+
+err_data:
+  free(entry);
+
+err:
+  fprintf(stderr, "Failed to allocate memory\n");
+  return -1;
+}
+
+const uint32_t*
+zippo_shadow_cache_get(struct zippo_shadow_cache* self, const void* key,
+    int* width, int* height)
+{
+  struct zippo_shadow_entry* entry = *zippo_shadow_cache_find(self, key);
+
+  if (entry == NULL) return NULL;
+
+  *width = entry->width;
+  *height = entry->height;
+
+  return entry->data;
+}
+
+void
+zippo_shadow_cache_remove(struct zippo_shadow_cache* self, const void* key)
+{
+  struct zippo_shadow_entry** link = zippo_shadow_cache_find(self, key);
+
+  if (*link) zippo_shadow_cache_drop(self, link);
+}
+
+void
+zippo_shadow_cache_set_budget(struct zippo_shadow_cache* self, size_t budget)
+{
+  self->budget = budget;
+  zippo_shadow_cache_make_room(self, 0);
+}
+
+void
+zippo_shadow_cache_get_stats(
+    struct zippo_shadow_cache* self, struct zippo_shadow_cache_stats* stats)
+{
+  *stats = self->stats;
+}
+
+struct zippo_shadow_cache*
+zippo_shadow_cache_create(size_t budget)
+{
+  struct zippo_shadow_cache* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) goto err;
+
+  self->bucket_count = ZIPPO_SHADOW_CACHE_MIN_BUCKETS;
+  self->buckets = calloc(self->bucket_count, sizeof *self->buckets);
+  if (self->buckets == NULL) goto err_buckets;
+
+  self->budget = budget;
+
+  return self;
+
+err_buckets:
+  free(self);
+
+err:
+  fprintf(stderr, "Failed to allocate memory\n");
+  return NULL;
+}
+
+void
+zippo_shadow_cache_destroy(struct zippo_shadow_cache* self)
+{
+  struct zippo_shadow_entry *entry = self->head, *next;
+
+  for (; entry; entry = next) {
+    next = entry->next;
+    free(entry->data);
+    free(entry);
+  }
+
+  free(self->buckets);
+  free(self);
+}
@@ -0,0 +1,68 @@
+#ifndef ZIPPO_SHADOW_CACHE_H
+#define ZIPPO_SHADOW_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ZIPPO_SHADOW_CACHE_DEFAULT_BUDGET (256 * 1024 * 1024)
+
+struct zippo_shadow_rect {
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+struct zippo_shadow_cache_stats {
+  uint64_t hits;    // only the damage was copied
+  uint64_t misses;  // the whole buffer was copied
+  uint64_t evictions;
+  uint64_t bytes_copied;
+  size_t bytes_cached;
+};
+
+// compositor side copies of shm client buffers, keyed by surface. a surface
+// that is still cached only gets the client-declared damage copied on
+// commit. least recently used copies are dropped to stay within the budget.
+//
+// for a renderer that draws from its own copy of each surface. the ones in
+// the tree do not: the software renderer reads the client buffers directly
+// and GLES2 keeps its copies in textures.
+struct zippo_shadow_cache;
+
+/**
+ * Bring the copy of the surface up to date with its committed ARGB8888
+ * buffer. Call it on commit while the client buffer is still accessible.
+ * A buffer larger than the whole budget is not copied.
+ *
+ * @param key identifies the surface, e.g. its struct pointer
+ * @param damage damaged rectangles in buffer coordinates, ignored when the
+ * surface has no valid copy yet
+ * @return 0 on success, -1 on failure
+ */
+int zippo_shadow_cache_upload(struct zippo_shadow_cache* self,
+    const void* key, const uint32_t* data, int width, int height, int stride,
+    const struct zippo_shadow_rect* damage, int damage_count);
+
+/**
+ * @return the copy with a stride of width * 4, or NULL if it has been
+ * evicted or was too large to cache. valid until the next upload or remove.
+ */
+const uint32_t* zippo_shadow_cache_get(struct zippo_shadow_cache* self,
+    const void* key, int* width, int* height);
+
+// drop the copy of a destroyed surface
+void zippo_shadow_cache_remove(
+    struct zippo_shadow_cache* self, const void* key);
+
+void zippo_shadow_cache_set_budget(
+    struct zippo_shadow_cache* self, size_t budget);
+
+void zippo_shadow_cache_get_stats(struct zippo_shadow_cache* self,
+    struct zippo_shadow_cache_stats* stats);
+
+struct zippo_shadow_cache* zippo_shadow_cache_create(size_t budget);
+
+void zippo_shadow_cache_destroy(struct zippo_shadow_cache* self);
+
+#endif  //  ZIPPO_SHADOW_CACHE_H
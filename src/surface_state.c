@@ -0,0 +1,457 @@
+#include "surface_state.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NONE ZIPPO_SURFACE_NONE
+
+// only in functions returning int
+#define GROW(array, capacity)                                      \
+  do {                                                             \
+    void* grown = realloc((array), sizeof *(array) * (capacity)); \
+    if (grown == NULL) return -1;                                  \
+    (array) = grown;                                               \
+  } while (0)
+
+struct node {
+  uint32_t parent;
+  uint32_t first_child;  // the top one
+  uint32_t next_sibling;  // below it
+  bool sync;
+};
+
+// damage rectangles of every state of every surface, in lists linked by
+// index
+struct zippo_damage_pool {
+  struct zippo_surface_geometry* rects;
+  uint32_t* next;
+
+  uint32_t free;  // list of free rectangles
+  uint32_t count;  // in use or free
+  uint32_t capacity;
+};
+
+struct zippo_surface_store {
+  zippo_surface_release_func_t release;
+  void* data;
+
+  struct zippo_surface_arrays pending;
+  struct zippo_surface_arrays cached;  // committed while synchronized
+  struct zippo_surface_arrays current;
+
+  struct node* nodes;
+
+  uint32_t count;  // ids in use or free
+  uint32_t capacity;
+  uint32_t* free_ids;
+  uint32_t free_count;
+
+  struct zippo_damage_pool damage;
+
+  uint32_t* batch;  // ids applied in one pass
+  struct zippo_surface_store_stats stats;
+};
+
+static int
+grow_arrays(struct zippo_surface_arrays* arrays, uint32_t capacity)
+{
+  GROW(arrays->geometry, capacity);
+  GROW(arrays->buffer, capacity);
+  GROW(arrays->damage, capacity);
+  GROW(arrays->flags, capacity);
+
+  return 0;
+}
+
+static void
+free_arrays(struct zippo_surface_arrays* arrays)
+{
+  free(arrays->geometry);
+  free(arrays->buffer);
+  free(arrays->damage);
+  free(arrays->flags);
+}
+
+// arrays that already grew stay that way when a later one fails, they are
+// only bigger than needed
+static int
+grow_surfaces(struct zippo_surface_store* self)
+{
+  uint32_t capacity = self->capacity ? self->capacity * 2 : 64;
+
+  if (grow_arrays(&self->pending, capacity) != 0 ||
+      grow_arrays(&self->cached, capacity) != 0 ||
+      grow_arrays(&self->current, capacity) != 0)
+    return -1;
+
+  GROW(self->nodes, capacity);
+  GROW(self->free_ids, capacity);
+  GROW(self->batch, capacity);
+
+  self->capacity = capacity;
+
+  return 0;
+}
+
+static int
+grow_damage(struct zippo_damage_pool* pool)
+{
+  uint32_t capacity = pool->capacity ? pool->capacity * 2 : 256;
+
+  GROW(pool->rects, capacity);
+  GROW(pool->next, capacity);
+
+  pool->capacity = capacity;
+
+  return 0;
+}
+
+static void
+reset_state(struct zippo_surface_arrays* state, uint32_t id)
+{
+  state->geometry[id] = (struct zippo_surface_geometry){0};
+  state->buffer[id] = NULL;
+  state->damage[id] = (struct zippo_surface_damage){NONE, NONE, 0};
+  state->flags[id] = 0;
+}
+
+// moves the damage of src to the end of dst
+static void
+splice_damage(struct zippo_damage_pool* pool, struct zippo_surface_damage* src,
+    struct zippo_surface_damage* dst)
+{
+  if (src->head == NONE) return;
+
+  if (dst->head == NONE)
+    dst->head = src->head;
+  else
+    pool->next[dst->tail] = src->head;
+  dst->tail = src->tail;
+  dst->count += src->count;
+
+  *src = (struct zippo_surface_damage){NONE, NONE, 0};
+}
+
+static void
+free_damage(struct zippo_damage_pool* pool, struct zippo_surface_damage* list)
+{
+  if (list->head == NONE) return;
+
+  pool->next[list->tail] = pool->free;
+  pool->free = list->head;
+
+  *list = (struct zippo_surface_damage){NONE, NONE, 0};
+}
+
+static void
+release(struct zippo_surface_store* self, void* buffer)
+{
+  if (buffer != NULL && self->release) self->release(self->data, buffer);
+}
+
+// its own or one of its ancestors
+static bool
+is_synchronized(struct zippo_surface_store* self, uint32_t id)
+{
+  for (; self->nodes[id].parent != NONE; id = self->nodes[id].parent) {
+    if (self->nodes[id].sync) return true;
+  }
+
+  return false;
+}
+
+// pending into cached, of one surface
+static void
+cache(struct zippo_surface_store* self, uint32_t id)
+{
+  struct zippo_surface_arrays* pending = &self->pending;
+  struct zippo_surface_arrays* cached = &self->cached;
+  uint32_t flags = pending->flags[id];
+
+  if (flags & ZIPPO_SURFACE_STATE_BUFFER) {
+    if (cached->flags[id] & ZIPPO_SURFACE_STATE_BUFFER &&
+        cached->buffer[id] != pending->buffer[id])
+      release(self, cached->buffer[id]);
+    cached->buffer[id] = pending->buffer[id];
+    cached->geometry[id].width = pending->geometry[id].width;
+    cached->geometry[id].height = pending->geometry[id].height;
+    pending->buffer[id] = NULL;
+  }
+
+  if (flags & ZIPPO_SURFACE_STATE_POSITION) {
+    cached->geometry[id].x = pending->geometry[id].x;
+    cached->geometry[id].y = pending->geometry[id].y;
+  }
+
+  splice_damage(&self->damage, &pending->damage[id], &cached->damage[id]);
+
+  cached->flags[id] |= flags;
+  pending->flags[id] = 0;
+}
+
+// cached into current, of every surface in ids, a column at a time
+static void
+apply(struct zippo_surface_store* self, const uint32_t* ids, uint32_t count)
+{
+  struct zippo_surface_arrays* cached = &self->cached;
+  struct zippo_surface_arrays* current = &self->current;
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t id = ids[i];
+
+    if (!(cached->flags[id] & ZIPPO_SURFACE_STATE_BUFFER)) continue;
+    if (current->buffer[id] != cached->buffer[id])
+      release(self, current->buffer[id]);
+    current->buffer[id] = cached->buffer[id];
+    cached->buffer[id] = NULL;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t id = ids[i], flags = cached->flags[id];
+    struct zippo_surface_geometry* geometry = &current->geometry[id];
+
+    if (flags & ZIPPO_SURFACE_STATE_BUFFER) {
+      geometry->width = cached->geometry[id].width;
+      geometry->height = cached->geometry[id].height;
+    }
+    if (flags & ZIPPO_SURFACE_STATE_POSITION) {
+      geometry->x = cached->geometry[id].x;
+      geometry->y = cached->geometry[id].y;
+    }
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    splice_damage(
+        &self->damage, &cached->damage[ids[i]], &current->damage[ids[i]]);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    current->flags[ids[i]] |= cached->flags[ids[i]];
+    cached->flags[ids[i]] = 0;
+  }
+}
+
+uint32_t
+zippo_surface_store_add(struct zippo_surface_store* self)
+{
+  uint32_t id;
+
+  if (self->free_count > 0) {
+    id = self->free_ids[--self->free_count];
+  } else {
+    if (self->count == self->capacity && grow_surfaces(self) != 0) {
+      fprintf(stderr, "Failed to grow the surface store\n");
+      return NONE;
+    }
+    id = self->count++;
+  }
+
+  reset_state(&self->pending, id);
+  reset_state(&self->cached, id);
+  reset_state(&self->current, id);
+  self->nodes[id] = (struct node){NONE, NONE, NONE, false};
+
+  return id;
+}
+
+void
+zippo_surface_store_remove(struct zippo_surface_store* self, uint32_t id)
+{
+  zippo_surface_store_set_parent(self, id, NONE);
+
+  for (uint32_t child = self->nodes[id].first_child, next; child != NONE;
+       child = next) {
+    next = self->nodes[child].next_sibling;
+    self->nodes[child].parent = NONE;
+    self->nodes[child].next_sibling = NONE;
+    self->nodes[child].sync = false;
+  }
+
+  // a pending buffer was never committed, nothing to release
+  if (self->cached.buffer[id] != self->current.buffer[id])
+    release(self, self->cached.buffer[id]);
+  release(self, self->current.buffer[id]);
+
+  free_damage(&self->damage, &self->pending.damage[id]);
+  free_damage(&self->damage, &self->cached.damage[id]);
+  free_damage(&self->damage, &self->current.damage[id]);
+
+  self->free_ids[self->free_count++] = id;
+}
+
+void
+zippo_surface_store_set_parent(
+    struct zippo_surface_store* self, uint32_t id, uint32_t parent)
+{
+  struct node* node = &self->nodes[id];
+
+  if (node->parent != NONE) {
+    uint32_t* link = &self->nodes[node->parent].first_child;
+
+    while (*link != id) link = &self->nodes[*link].next_sibling;
+    *link = node->next_sibling;
+  }
+
+  node->parent = parent;
+  node->next_sibling = NONE;
+  // subsurfaces start out synchronized
+  node->sync = parent != NONE;
+
+  if (parent == NONE) return;
+  node->next_sibling = self->nodes[parent].first_child;
+  self->nodes[parent].first_child = id;
+}
+
+void
+zippo_surface_store_set_sync(
+    struct zippo_surface_store* self, uint32_t id, bool sync)
+{
+  // what was cached is applied with the next commit of its own
+  self->nodes[id].sync = sync;
+}
+
+void
+zippo_surface_store_attach(struct zippo_surface_store* self, uint32_t id,
+    void* buffer, int32_t width, int32_t height)
+{
+  self->pending.buffer[id] = buffer;
+  self->pending.geometry[id].width = width;
+  self->pending.geometry[id].height = height;
+  self->pending.flags[id] |= ZIPPO_SURFACE_STATE_BUFFER;
+}
+
+void
+zippo_surface_store_set_position(
+    struct zippo_surface_store* self, uint32_t id, int32_t x, int32_t y)
+{
+  self->pending.geometry[id].x = x;
+  self->pending.geometry[id].y = y;
+  self->pending.flags[id] |= ZIPPO_SURFACE_STATE_POSITION;
+}
+
+int
+zippo_surface_store_damage(struct zippo_surface_store* self, uint32_t id,
+    int32_t x, int32_t y, int32_t width, int32_t height)
+{
+  struct zippo_damage_pool* pool = &self->damage;
+  struct zippo_surface_damage* list = &self->pending.damage[id];
+  uint32_t rect;
+
+  if (pool->free != NONE) {
+    rect = pool->free;
+    pool->free = pool->next[rect];
+  } else {
+    if (pool->count == pool->capacity && grow_damage(pool) != 0) {
+      fprintf(stderr, "Failed to grow the damage pool\n");
+      return -1;
+    }
+    rect = pool->count++;
+  }
+
+  pool->rects[rect] = (struct zippo_surface_geometry){x, y, width, height};
+  pool->next[rect] = NONE;
+
+  if (list->head == NONE)
+    list->head = rect;
+  else
+    pool->next[list->tail] = rect;
+  list->tail = rect;
+  list->count++;
+  self->pending.flags[id] |= ZIPPO_SURFACE_STATE_DAMAGE;
+
+  return 0;
+}
+
+void
+zippo_surface_store_commit(struct zippo_surface_store* self, uint32_t id)
+{
+  uint32_t count = 1;
+
+  self->stats.commits++;
+
+  // everything goes through the cached state, a desynchronized surface
+  // that was synchronized before applies what it cached with this commit
+  cache(self, id);
+  if (is_synchronized(self, id)) return;
+
+  // the surface and the subsurfaces below it that are synchronized, breadth
+  // first. below a synchronized one that is all of them, desynchronized
+  // ones included. a desynchronized child of this surface has nothing
+  // cached, and its own subsurfaces go with its commits.
+  self->batch[0] = id;
+  for (uint32_t i = 0; i < count; i++) {
+    for (uint32_t child = self->nodes[self->batch[i]].first_child;
+         child != NONE; child = self->nodes[child].next_sibling) {
+      if (i > 0 || self->nodes[child].sync) self->batch[count++] = child;
+    }
+  }
+
+  apply(self, self->batch, count);
+
+  self->stats.applied += count;
+  self->stats.batches++;
+}
+
+const struct zippo_surface_arrays*
+zippo_surface_store_get_current(struct zippo_surface_store* self)
+{
+  return &self->current;
+}
+
+void
+zippo_surface_store_take_damage(struct zippo_surface_store* self, uint32_t id,
+    void (*func)(void* data, int32_t x, int32_t y, int32_t width,
+        int32_t height),
+    void* data)
+{
+  struct zippo_damage_pool* pool = &self->damage;
+
+  for (uint32_t rect = self->current.damage[id].head; rect != NONE;
+       rect = pool->next[rect]) {
+    struct zippo_surface_geometry* r = &pool->rects[rect];
+
+    func(data, r->x, r->y, r->width, r->height);
+  }
+
+  free_damage(pool, &self->current.damage[id]);
+  self->current.flags[id] = 0;
+}
+
+void
+zippo_surface_store_get_stats(struct zippo_surface_store* self,
+    struct zippo_surface_store_stats* stats)
+{
+  *stats = self->stats;
+}
+
+struct zippo_surface_store*
+zippo_surface_store_create(zippo_surface_release_func_t release, void* data)
+{
+  struct zippo_surface_store* self;
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return NULL;
+  }
+
+  self->release = release;
+  self->data = data;
+  self->damage.free = NONE;
+
+  return self;
+}
+
+void
+zippo_surface_store_destroy(struct zippo_surface_store* self)
+{
+  free_arrays(&self->pending);
+  free_arrays(&self->cached);
+  free_arrays(&self->current);
+  free(self->nodes);
+  free(self->free_ids);
+  free(self->batch);
+  free(self->damage.rects);
+  free(self->damage.next);
+  free(self);
+}
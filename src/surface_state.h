@@ -0,0 +1,117 @@
+#ifndef ZIPPO_SURFACE_STATE_H
+#define ZIPPO_SURFACE_STATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ZIPPO_SURFACE_NONE UINT32_MAX
+
+// what a state carries, set in its flags by the requests since it was last
+// applied. in the current state, what changed since its damage was taken.
+enum zippo_surface_state_field {
+  ZIPPO_SURFACE_STATE_BUFFER = 1 << 0,  // and its size
+  ZIPPO_SURFACE_STATE_POSITION = 1 << 1,
+  ZIPPO_SURFACE_STATE_DAMAGE = 1 << 2,
+};
+
+/**
+ * @param buffer committed before and no longer used, replaced by another
+ * one or its surface removed
+ */
+typedef void (*zippo_surface_release_func_t)(void* data, void* buffer);
+
+struct zippo_surface_geometry {
+  int32_t x;  // relative to the parent
+  int32_t y;
+  int32_t width;  // of the buffer
+  int32_t height;
+};
+
+// a list in the damage pool
+struct zippo_surface_damage {
+  uint32_t head;  // ZIPPO_SURFACE_NONE when there is none
+  uint32_t tail;
+  uint32_t count;
+};
+
+// one state of every surface, indexed by surface id. a column per kind of
+// state, so applying many surfaces walks a few arrays in order instead of
+// every field of every surface.
+struct zippo_surface_arrays {
+  struct zippo_surface_geometry* geometry;
+  void** buffer;
+  struct zippo_surface_damage* damage;
+  uint32_t* flags;  // zippo_surface_state_field
+};
+
+struct zippo_surface_store_stats {
+  uint64_t commits;
+  uint64_t applied;  // surface states that became current
+  uint64_t batches;  // passes applying a surface and its synced subsurfaces
+};
+
+// pending, cached and current state of every surface. a synchronized
+// subsurface keeps its commits in the cached state, and when the surface
+// it is synchronized to commits, the cached state of the whole tree becomes
+// current in one pass over the arrays.
+struct zippo_surface_store;
+
+/**
+ * @return the id of a new surface, ZIPPO_SURFACE_NONE on failure
+ */
+uint32_t zippo_surface_store_add(struct zippo_surface_store* self);
+
+// releases its buffers, its subsurfaces lose their parent
+void zippo_surface_store_remove(struct zippo_surface_store* self, uint32_t id);
+
+/**
+ * Make id a subsurface of parent, at the top of its siblings, or a
+ * toplevel surface again with ZIPPO_SURFACE_NONE.
+ */
+void zippo_surface_store_set_parent(
+    struct zippo_surface_store* self, uint32_t id, uint32_t parent);
+
+void zippo_surface_store_set_sync(
+    struct zippo_surface_store* self, uint32_t id, bool sync);
+
+// requests, all of them go into the pending state
+
+void zippo_surface_store_attach(struct zippo_surface_store* self,
+    uint32_t id, void* buffer, int32_t width, int32_t height);
+
+void zippo_surface_store_set_position(
+    struct zippo_surface_store* self, uint32_t id, int32_t x, int32_t y);
+
+/**
+ * @return 0 on success, -1 on failure
+ */
+int zippo_surface_store_damage(struct zippo_surface_store* self, uint32_t id,
+    int32_t x, int32_t y, int32_t width, int32_t height);
+
+void zippo_surface_store_commit(struct zippo_surface_store* self, uint32_t id);
+
+// every surface, its current state. valid until the next add.
+const struct zippo_surface_arrays* zippo_surface_store_get_current(
+    struct zippo_surface_store* self);
+
+/**
+ * Take the damage accumulated in the current state of a surface, e.g. when
+ * the output draws it.
+ *
+ * @param func called for each rectangle
+ */
+void zippo_surface_store_take_damage(struct zippo_surface_store* self,
+    uint32_t id,
+    void (*func)(void* data, int32_t x, int32_t y, int32_t width,
+        int32_t height),
+    void* data);
+
+void zippo_surface_store_get_stats(struct zippo_surface_store* self,
+    struct zippo_surface_store_stats* stats);
+
+struct zippo_surface_store* zippo_surface_store_create(
+    zippo_surface_release_func_t release, void* data);
+
+void zippo_surface_store_destroy(struct zippo_surface_store* self);
+
+#endif  //  ZIPPO_SURFACE_STATE_H
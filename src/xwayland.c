@@ -0,0 +1,425 @@
+#define _GNU_SOURCE
+
+#include "xwayland.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "loop_monitor.h"
+
+#define X11_SOCKET_DIR "/tmp/.X11-unix"
+#define X11_DISPLAY_MAX 32
+
+// an Xwayland that exits this soon after being started is considered broken,
+// restarting it for the connection still in the backlog would loop forever
+#define XWAYLAND_MIN_LIFETIME 1
+
+struct zippo_xwayland {
+  struct wl_display* display;
+  int idle_timeout;
+
+  int display_number;
+  char display_name[16];
+  char lock_path[64];
+  char socket_path[64];
+
+  // X clients connect to either of these and wait there until Xwayland
+  // accepts them
+  int unix_fd;
+  int abstract_fd;
+  struct wl_event_source* unix_source;
+  struct wl_event_source* abstract_source;
+
+  pid_t pid;
+  time_t started;
+  struct wl_client* client;
+  struct wl_listener client_destroy;
+  struct wl_event_source* sigchld_source;
+};
+
+static int
+lock_display(int display_number, char* path, size_t size)
+{
+  char pid[16];
+  int fd;
+
+  snprintf(path, size, "/tmp/.X%d-lock", display_number);
+
+  fd = open(path, O_WRONLY | O_CLOEXEC | O_CREAT | O_EXCL, 0444);
+  if (fd < 0 && errno == EEXIST) {
+    // reclaim the lock of an X server that is gone
+    long other = 0;
+    FILE* file = fopen(path, "r");
+
+    if (file == NULL) return -1;
+    if (fscanf(file, "%ld", &other) != 1) other = 0;
+    fclose(file);
+
+    if (other <= 0 || (kill(other, 0) == 0 || errno != ESRCH)) return -1;
+    if (unlink(path) != 0) return -1;
+
+    fd = open(path, O_WRONLY | O_CLOEXEC | O_CREAT | O_EXCL, 0444);
+  }
+  if (fd < 0) return -1;
+
+  // the format X servers expect
+  snprintf(pid, sizeof pid, "%10d\n", getpid());
+  if (write(fd, pid, 11) != 11) {
+    close(fd);
+    unlink(path);
+    return -1;
+  }
+  close(fd);
+
+  return 0;
+}
+
+static int
+bind_socket(const struct sockaddr_un* addr, socklen_t size)
+{
+  int fd;
+
+  fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+
+  if (bind(fd, (const struct sockaddr*)addr, size) < 0 ||
+      listen(fd, 16) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static int
+zippo_xwayland_bind_sockets(struct zippo_xwayland* self)
+{
+  struct sockaddr_un addr = {.sun_family = AF_LOCAL};
+  socklen_t size;
+  int len;
+
+  // abstract socket, the name starts with a null byte
+  len = snprintf(addr.sun_path + 1, sizeof addr.sun_path - 1, "%s/X%d",
+      X11_SOCKET_DIR, self->display_number);
+  size = offsetof(struct sockaddr_un, sun_path) + 1 + len;
+  self->abstract_fd = bind_socket(&addr, size);
+  if (self->abstract_fd < 0) return -1;
+
+  snprintf(self->socket_path, sizeof self->socket_path, "%s/X%d",
+      X11_SOCKET_DIR, self->display_number);
+  unlink(self->socket_path);  // we own the lock, it is stale
+  memset(addr.sun_path, 0, sizeof addr.sun_path);
+  strcpy(addr.sun_path, self->socket_path);
+  size = offsetof(struct sockaddr_un, sun_path) + strlen(addr.sun_path) + 1;
+  self->unix_fd = bind_socket(&addr, size);
+  if (self->unix_fd < 0) {
+    close(self->abstract_fd);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int
+zippo_xwayland_reserve_display(struct zippo_xwayland* self)
+{
+  if (mkdir(X11_SOCKET_DIR, 01777) == 0) {
+    chmod(X11_SOCKET_DIR, 01777);  // not masked by umask
+  } else if (errno != EEXIST) {
+    fprintf(stderr, "Failed to create %s: %s\n", X11_SOCKET_DIR,
+        strerror(errno));
+    return -1;
+  }
+
+  for (int i = 0; i < X11_DISPLAY_MAX; i++) {
+    if (lock_display(i, self->lock_path, sizeof self->lock_path) != 0)
+      continue;
+
+    self->display_number = i;
+    if (zippo_xwayland_bind_sockets(self) == 0) {
+      snprintf(self->display_name, sizeof self->display_name, ":%d", i);
+      return 0;
+    }
+
+    unlink(self->lock_path);
+  }
+
+  fprintf(stderr, "Failed to find a free X11 display\n");
+
+  return -1;
+}
+
+// after this the display number is free for another X server
+static void
+zippo_xwayland_release_display(struct zippo_xwayland* self)
+{
+  if (self->unix_fd >= 0) close(self->unix_fd);
+  if (self->abstract_fd >= 0) close(self->abstract_fd);
+  self->unix_fd = -1;
+  self->abstract_fd = -1;
+
+  // empty once released, these may be another server's files by then
+  if (self->socket_path[0]) unlink(self->socket_path);
+  if (self->lock_path[0]) unlink(self->lock_path);
+  self->socket_path[0] = '\0';
+  self->lock_path[0] = '\0';
+}
+
+static int handle_x11_connect(int fd, uint32_t mask, void* data);
+
+static int
+zippo_xwayland_listen(struct zippo_xwayland* self)
+{
+  struct wl_event_loop* loop = wl_display_get_event_loop(self->display);
+
+  self->unix_source = zippo_loop_add_fd(loop, self->unix_fd,
+      WL_EVENT_READABLE, handle_x11_connect, self, "xwayland connect");
+  self->abstract_source = zippo_loop_add_fd(loop, self->abstract_fd,
+      WL_EVENT_READABLE, handle_x11_connect, self, "xwayland connect");
+
+  if (self->unix_source == NULL || self->abstract_source == NULL) {
+    fprintf(stderr, "Failed to watch the X11 sockets\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+static void
+zippo_xwayland_unlisten(struct zippo_xwayland* self)
+{
+  struct wl_event_loop* loop = wl_display_get_event_loop(self->display);
+
+  if (self->unix_source) zippo_loop_source_remove(loop, self->unix_source);
+  if (self->abstract_source)
+    zippo_loop_source_remove(loop, self->abstract_source);
+  self->unix_source = NULL;
+  self->abstract_source = NULL;
+}
+
+// X clients in the backlog and any that come later fail right away instead
+// of waiting for an Xwayland that will not come
+static void
+zippo_xwayland_disable(struct zippo_xwayland* self)
+{
+  const char* display = getenv("DISPLAY");
+
+  fprintf(stderr, "X11 support disabled\n");
+
+  zippo_xwayland_unlisten(self);
+  zippo_xwayland_release_display(self);
+
+  // clients started from now on do not look for it
+  if (display && strcmp(display, self->display_name) == 0) unsetenv("DISPLAY");
+}
+
+static void
+handle_client_destroy(struct wl_listener* listener, void* data)
+{
+  struct zippo_xwayland* self =
+      wl_container_of(listener, self, client_destroy);
+  (void)data;
+
+  self->client = NULL;
+}
+
+static void
+zippo_xwayland_exec(struct zippo_xwayland* self, int wayland_fd)
+{
+  char wayland_socket[16], unix_fd[16], abstract_fd[16], idle_timeout[16];
+  char* argv[16];
+  int argc = 0, fd;
+  sigset_t mask;
+
+  // the event loop blocks the signals it watches, do not pass that on
+  sigemptyset(&mask);
+  sigprocmask(SIG_SETMASK, &mask, NULL);
+
+  // dup() clears FD_CLOEXEC
+  fd = dup(wayland_fd);
+  snprintf(wayland_socket, sizeof wayland_socket, "%d", fd);
+  fd = dup(self->unix_fd);
+  snprintf(unix_fd, sizeof unix_fd, "%d", fd);
+  fd = dup(self->abstract_fd);
+  snprintf(abstract_fd, sizeof abstract_fd, "%d", fd);
+  snprintf(idle_timeout, sizeof idle_timeout, "%d", self->idle_timeout);
+
+  setenv("WAYLAND_SOCKET", wayland_socket, 1);
+
+  argv[argc++] = "Xwayland";
+  argv[argc++] = self->display_name;
+  argv[argc++] = "-rootless";
+  argv[argc++] = "-listenfd";
+  argv[argc++] = unix_fd;
+  argv[argc++] = "-listenfd";
+  argv[argc++] = abstract_fd;
+  if (self->idle_timeout >= 0) {
+    argv[argc++] = "-terminate";
+    if (self->idle_timeout > 0) argv[argc++] = idle_timeout;
+  }
+  argv[argc] = NULL;
+
+  execvp(argv[0], argv);
+  fprintf(stderr, "Failed to exec Xwayland: %s\n", strerror(errno));
+  _exit(EXIT_FAILURE);
+}
+
+static int
+zippo_xwayland_spawn(struct zippo_xwayland* self)
+{
+  int fds[2];
+
+  if (socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+    fprintf(stderr, "Failed to create socketpair: %s\n", strerror(errno));
+    return -1;
+  }
+
+  self->pid = fork();
+  if (self->pid < 0) {
+    fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+
+  if (self->pid == 0) zippo_xwayland_exec(self, fds[1]);  // -> exit
+
+  close(fds[1]);
+  self->started = time(NULL);
+
+  self->client = wl_client_create(self->display, fds[0]);
+  if (self->client == NULL) {
+    fprintf(stderr, "Failed to create the Xwayland client\n");
+    close(fds[0]);
+    kill(self->pid, SIGTERM);
+    return 0;  // reaped as usual
+  }
+  wl_client_add_destroy_listener(self->client, &self->client_destroy);
+
+  return 0;
+}
+
+static int
+handle_x11_connect(int fd, uint32_t mask, void* data)
+{
+  struct zippo_xwayland* self = data;
+  (void)fd;
+  (void)mask;
+
+  // Xwayland accepts from the same sockets, stop watching them until it
+  // has exited
+  zippo_xwayland_unlisten(self);
+
+  fprintf(stderr, "Starting Xwayland on %s\n", self->display_name);
+
+  // listening again would wake up for the same client right away and fork
+  // in a loop
+  if (zippo_xwayland_spawn(self) != 0) zippo_xwayland_disable(self);
+
+  return 0;
+}
+
+static int
+handle_sigchld(int signal_number, void* data)
+{
+  struct zippo_xwayland* self = data;
+  int status;
+  (void)signal_number;
+
+  if (self->pid <= 0 || waitpid(self->pid, &status, WNOHANG) != self->pid)
+    return 0;
+
+  self->pid = -1;
+  if (self->client) wl_client_destroy(self->client);
+
+  if (time(NULL) - self->started < XWAYLAND_MIN_LIFETIME &&
+      !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+    fprintf(stderr, "Xwayland failed to start\n");
+    zippo_xwayland_disable(self);
+    return 0;
+  }
+
+  fprintf(stderr, "Xwayland exited, waiting for X clients\n");
+  if (zippo_xwayland_listen(self) != 0) zippo_xwayland_disable(self);
+
+  return 0;
+}
+
+const char*
+zippo_xwayland_get_display_name(struct zippo_xwayland* self)
+{
+  return self->display_name;
+}
+
+struct zippo_xwayland*
+zippo_xwayland_create(struct wl_display* display, int idle_timeout)
+{
+  struct zippo_xwayland* self;
+  struct wl_event_loop* loop = wl_display_get_event_loop(display);
+
+  self = calloc(1, sizeof *self);
+  if (self == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    goto err;
+  }
+
+  self->display = display;
+  self->idle_timeout = idle_timeout;
+  self->pid = -1;
+  self->client_destroy.notify = handle_client_destroy;
+
+  if (zippo_xwayland_reserve_display(self) != 0) goto err_free;
+
+  self->sigchld_source = zippo_loop_add_signal(
+      loop, SIGCHLD, handle_sigchld, self, "xwayland sigchld");
+  if (self->sigchld_source == NULL) {
+    fprintf(stderr, "Failed to watch SIGCHLD\n");
+    goto err_display;
+  }
+
+  if (zippo_xwayland_listen(self) != 0) goto err_listen;
+
+  return self;
+
+err_listen:
+  zippo_xwayland_unlisten(self);
+  zippo_loop_source_remove(loop, self->sigchld_source);
+
+err_display:
+  zippo_xwayland_release_display(self);
+
+err_free:
+  free(self);
+
+err:
+  return NULL;
+}
+
+void
+zippo_xwayland_destroy(struct zippo_xwayland* self)
+{
+  struct wl_event_loop* loop = wl_display_get_event_loop(self->display);
+
+  if (self->client) wl_client_destroy(self->client);
+  if (self->pid > 0) {
+    kill(self->pid, SIGTERM);
+    waitpid(self->pid, NULL, 0);
+  }
+
+  zippo_xwayland_unlisten(self);
+  zippo_loop_source_remove(loop, self->sigchld_source);
+
+  zippo_xwayland_release_display(self);
+  free(self);
+}
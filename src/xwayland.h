@@ -0,0 +1,25 @@
+#ifndef ZIPPO_XWAYLAND_H
+#define ZIPPO_XWAYLAND_H
+
+#include <wayland-server-core.h>
+
+#define ZIPPO_XWAYLAND_DEFAULT_IDLE_TIMEOUT 10
+
+// reserves an X11 display and only starts Xwayland when the first X client
+// connects to it. Xwayland exits by itself after the idle timeout once its
+// last client is gone, the next X client starts it again.
+struct zippo_xwayland;
+
+// the display name for DISPLAY, e.g. ":1"
+const char* zippo_xwayland_get_display_name(struct zippo_xwayland* self);
+
+/**
+ * @param idle_timeout seconds Xwayland stays up without X clients, negative
+ * to keep it running once started
+ */
+struct zippo_xwayland* zippo_xwayland_create(
+    struct wl_display* display, int idle_timeout);
+
+void zippo_xwayland_destroy(struct zippo_xwayland* self);
+
+#endif  //  ZIPPO_XWAYLAND_H